@@ -0,0 +1,270 @@
+/*
+    Approximation engine (see ApproximateEngine.h).
+
+    The strokes are the ones approximate() draws: from a random pixel, walk
+    the two directions towards its most similar neighbours for as long as
+    the pixels stay close to its colour, then paint the triangle between the
+    three points (or the line, if the directions are opposite) with its
+    colour, wherever the original is close to it. The walks and the
+    triangle's rows go through a colour run index (ColorRunIndex.h) built
+    for the image, so runs of pixels that are close to the colour (or far
+    from it) are found without comparing each of them, and are painted a
+    span at a time.
+*/
+
+#include "ApproximateEngine.h"
+#include "ColorRunIndex.h"
+#include "ParallelExecutor.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+static const int PASSES = 100;
+static const int DEFAULT_ITERATIONS = 10000;  // Pace of time budget runs
+
+
+static inline uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+/* Stroke strength (colour distance still close) as the painting progresses
+   (0-1), the same steps approximate() takes over its 10000 strokes */
+static int strokeStrength(double progress) {
+    if (progress < 0.25)
+        return 90;
+    if (progress < 0.5)
+        return 60;
+    if (progress < 0.6)
+        return 45;
+    if (progress < 0.8)
+        return 30;
+    return 20;
+}
+
+
+/* Paints columns [from, to] of a canvas row with colour */
+static inline void paintSpan(uint8_t *row, int from, int to,
+                             const uint8_t *colour) {
+    uint8_t *span = row + 3 * from;
+    int pixels = to - from + 1;
+    int first = std::min(pixels, 16);
+    for (int i = 0; i < first; ++i) {
+        span[3 * i] = colour[0];
+        span[3 * i + 1] = colour[1];
+        span[3 * i + 2] = colour[2];
+    }
+    // Long spans double what's painted
+    size_t bytes = (size_t)pixels * 3;
+    for (size_t done = 3 * first; done < bytes; done *= 2)
+        std::memcpy(span + done, span, std::min(done, bytes - done));
+}
+
+
+/* Draws the stroke starting at (row, col), within tile */
+static void drawStroke(const cv::Mat &original, const ColorRunIndex &index,
+                       cv::Mat &modified, const cv::Rect &tile, int row,
+                       int col, int strength) {
+    static const int rowStep[4] = {-1, 0, 1, 0};  // Up, right, down, left
+    static const int colStep[4] = {0, 1, 0, -1};
+    uint8_t colour[3];
+    std::copy_n(original.ptr<uint8_t>(row) + 3 * col, 3, colour);
+
+    auto inside = [&](int r, int c) {
+        return r >= tile.y && r < tile.y + tile.height && c >= tile.x
+            && c < tile.x + tile.width;
+    };
+    // Pixels from (r, c) to the edge of the tile in direction d
+    auto toEdge = [&](int r, int c, int d) {
+        switch (d) {
+            case 0: return r - tile.y;
+            case 1: return tile.x + tile.width - 1 - c;
+            case 2: return tile.y + tile.height - 1 - r;
+            default: return c - tile.x;
+        }
+    };
+
+    // The two directions with the most similar neighbours (neighbours
+    // outside the tile are never picked unless they have to be)
+    int distance[4];
+    for (int d = 0; d < 4; ++d) {
+        int r = row + rowStep[d], c = col + colStep[d];
+        distance[d] = inside(r, c)
+            ? colorDistance(original.ptr<uint8_t>(r) + 3 * c, colour)
+            : INT_MAX;
+    }
+    int first = 0;
+    for (int d = 1; d < 4; ++d) {
+        if (distance[d] < distance[first])
+            first = d;
+    }
+    int second = first == 0 ? 1 : 0;
+    for (int d = 0; d < 4; ++d) {
+        if (d != first && distance[d] < distance[second])
+            second = d;
+    }
+
+    // Walk each way while the next pixel is still close
+    int ends[4][2];
+    for (int d : {first, second}) {
+        int reach = 0;
+        ColorRunLine line = index.line(original, row, col, rowStep[d],
+                                       colStep[d]);
+        forEachColorRun(line, 1, toEdge(row, col, d), colour, strength,
+                        [&](int, int last, bool close) {
+            if (close)
+                reach = last;
+            return close;
+        });
+        ends[d][0] = row + reach * rowStep[d];
+        ends[d][1] = col + reach * colStep[d];
+    }
+
+    auto paint = [&](int r, int c) {
+        uint8_t *pixel = modified.ptr<uint8_t>(r) + 3 * c;
+        pixel[0] = colour[0];
+        pixel[1] = colour[1];
+        pixel[2] = colour[2];
+    };
+
+    if ((first ^ second) == 2) {
+        // Opposite directions, a straight line between the two ends
+        int fromRow = std::min(ends[first][0], ends[second][0]);
+        int toRow = std::max(ends[first][0], ends[second][0]);
+        int fromCol = std::min(ends[first][1], ends[second][1]);
+        int toCol = std::max(ends[first][1], ends[second][1]);
+        for (int r = fromRow; r <= toRow; ++r) {
+            for (int c = fromCol; c <= toCol; ++c)
+                paint(r, c);
+        }
+        return;
+    }
+
+    // A right triangle in the quadrant of the two directions, its rows
+    // shrinking by the height over the width
+    int vertical = first % 2 == 0 ? first : second;
+    int horizontal = first % 2 == 1 ? first : second;
+    int height = std::abs(ends[vertical][0] - row);
+    int width = std::max(std::abs(ends[horizontal][1] - col), 1);
+    int shrink = height / width;
+    int length = width;
+    for (int i = 0; i <= height && length >= 0; ++i, length -= shrink) {
+        int r = row + i * rowStep[vertical];
+        ColorRunLine line = index.line(original, r, col, 0,
+                                       colStep[horizontal]);
+        uint8_t *canvas = modified.ptr<uint8_t>(r);
+        forEachColorRun(line, 0, std::min(length, toEdge(r, col, horizontal)),
+                        colour, strength, [&](int from, int to, bool close) {
+            if (close) {
+                int c0 = col + from * colStep[horizontal];
+                int c1 = col + to * colStep[horizontal];
+                paintSpan(canvas, std::min(c0, c1), std::max(c0, c1), colour);
+            }
+            return true;
+        });
+    }
+}
+
+
+int approximateTiled(const cv::Mat &original, cv::Mat &modified,
+                     const ApproximateSettings &settings,
+                     const ApproximateRefresh &refresh) {
+    typedef std::chrono::steady_clock Clock;
+    modified.create(original.size(), original.type());
+    modified.setTo(cv::Scalar(255, 255, 255));  // Blank white canvas
+    if (original.empty())
+        return 0;
+
+    // The index is built if the strongest strokes are worth it, and used
+    // for the strengths that are
+    ColorRunIndex index, unindexed;
+    double roughness = ColorRunIndex::averageNeighbourDistance(original);
+    if (ColorRunIndex::worthIndexing(roughness, strokeStrength(0)))
+        index.build(original);
+
+    int64_t iterations = settings.iterations;
+    if (iterations <= 0 && settings.timeBudget <= 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    // Tiles with a generator each, and the pixels before each tile (for
+    // their share of the strokes)
+    int tileSize = std::max(settings.tileSize, 16);
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < original.rows; y += tileSize) {
+        for (int x = 0; x < original.cols; x += tileSize) {
+            tiles.push_back(cv::Rect(x, y,
+                                     std::min(tileSize, original.cols - x),
+                                     std::min(tileSize, original.rows - y)));
+        }
+    }
+    std::vector<uint32_t> states(tiles.size());
+    std::vector<int64_t> areaBefore(tiles.size() + 1, 0);
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        states[t] = (settings.seed * 2654435761u) ^ ((t + 1) * 0x9e3779b9u);
+        if (states[t] == 0)
+            states[t] = 1;
+        areaBefore[t + 1] = areaBefore[t] + tiles[t].area();
+    }
+    int64_t area = areaBefore.back();
+
+    // Strokes of the first stroke total given to tile t
+    auto tileShare = [&](int64_t total, size_t t) {
+        return total * areaBefore[t + 1] / area - total * areaBefore[t] / area;
+    };
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point refreshed = start;
+    int64_t drawn = 0;
+    for (int pass = 0; ; ++pass) {
+        double elapsed = std::chrono::duration<double>(Clock::now()
+                                                       - start).count();
+        double progress = iterations > 0 ? (double)pass / PASSES : 0;
+        if (settings.timeBudget > 0)
+            progress = std::max(progress, elapsed / settings.timeBudget);
+        if (progress >= 1)
+            break;
+
+        int64_t total = iterations > 0
+            ? iterations * (pass + 1) / PASSES
+            : drawn + DEFAULT_ITERATIONS / PASSES;
+        int strength = strokeStrength(progress);
+        const ColorRunIndex &lines
+            = ColorRunIndex::worthIndexing(roughness, strength) ? index
+                                                                : unindexed;
+        // Tiles are bands here, so a stream or daemon worker runs them on
+        // its WorkStealingPool. Each tile has its own random state, so
+        // how they're grouped doesn't change the painting
+        parallelForRows(tiles.size(), [&](int begin, int end) {
+            for (int t = begin; t < end; ++t) {
+                const cv::Rect &tile = tiles[t];
+                int64_t strokes = tileShare(total, t) - tileShare(drawn, t);
+                for (int64_t s = 0; s < strokes; ++s) {
+                    int row = tile.y + nextRandom(states[t]) % tile.height;
+                    int col = tile.x + nextRandom(states[t]) % tile.width;
+                    drawStroke(original, lines, modified, tile, row, col,
+                               strength);
+                }
+            }
+        });
+        drawn = total;
+
+        if (refresh && settings.refreshInterval > 0) {
+            Clock::time_point now = Clock::now();
+            if (std::chrono::duration<double>(now - refreshed).count()
+                    >= settings.refreshInterval) {
+                refreshed = now;
+                if (!refresh(modified))
+                    break;
+            }
+        }
+    }
+
+    if (refresh && settings.refreshInterval > 0)
+        refresh(modified);
+    return drawn;
+}
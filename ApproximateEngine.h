@@ -0,0 +1,45 @@
+/*
+    Approximation engine: paints the image as strokes like approximate(),
+    but without showing every stroke, so it runs as fast as the strokes can
+    be drawn (batch mode renders whole catalogs with it).
+
+    The image is split into tiles and every stroke stays inside the tile it
+    starts in, so the tiles are painted in parallel on the thread pool
+    (ParallelExecutor.h). Each tile draws its own random numbers from a
+    generator seeded with the seed and the tile's index, and gets a share of
+    the strokes proportional to its area, so a given seed, stroke count and
+    tile size always give the same image, whatever the thread count.
+
+    Strokes are drawn in passes of 1% of the strokes. Between passes the
+    time budget (if any) is checked and, every refresh interval, the canvas
+    is handed to a refresh callback (to show it). Stroke sizes shrink as the
+    painting progresses, by strokes drawn or by time spent, whichever is
+    further along.
+*/
+
+#ifndef APPROXIMATE_ENGINE_H
+#define APPROXIMATE_ENGINE_H
+
+#include "opencv2/opencv.hpp"
+#include <cstdint>
+#include <functional>
+
+struct ApproximateSettings {
+    int iterations = 10000;      // Strokes in all, 0 to paint until the
+                                 // time budget runs out
+    double timeBudget = 0;       // Seconds, 0 for no limit
+    uint32_t seed = 1;
+    int tileSize = 256;          // Pixels, strokes stay within their tile
+    double refreshInterval = 0;  // Seconds between refreshes, 0 for none
+};
+
+/* Called with the canvas every refresh interval, returns false to stop */
+typedef std::function<bool(const cv::Mat &)> ApproximateRefresh;
+
+/* Paints original's approximation into modified (allocated like original),
+   returns the number of strokes drawn */
+int approximateTiled(const cv::Mat &original, cv::Mat &modified,
+                     const ApproximateSettings &settings,
+                     const ApproximateRefresh &refresh = nullptr);
+
+#endif
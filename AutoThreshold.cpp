@@ -0,0 +1,155 @@
+/*
+    Automatic thresholds (see AutoThreshold.h).
+*/
+
+#include "AutoThreshold.h"
+#include "ParallelExecutor.h"
+#include "PointKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/* How far a frame moves a live feed's threshold towards its own */
+static const double smoothing = 0.25;
+
+
+int otsuThreshold(const uint32_t *histogram, int bins) {
+    double total = 0, totalSum = 0;
+    for (int value = 0; value < bins; ++value) {
+        total += histogram[value];
+        totalSum += (double)value * histogram[value];
+    }
+
+    // Maximizes the variance between the classes, below * above *
+    // (meanBelow - meanAbove)^2
+    double below = 0, belowSum = 0, bestVariance = 0;
+    int best = -1;
+    for (int threshold = 0; threshold < bins - 1; ++threshold) {
+        below += histogram[threshold];
+        belowSum += (double)threshold * histogram[threshold];
+        double above = total - below;
+        if (below == 0 || above == 0)
+            continue;
+        double difference = belowSum / below - (totalSum - belowSum) / above;
+        double variance = below * above * difference * difference;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = threshold;
+        }
+    }
+    return best;
+}
+
+
+void countValues(const uint16_t *values, int count, uint32_t *histogram) {
+    for (int i = 0; i < count; ++i)
+        ++histogram[values[i]];
+}
+
+
+int AutoThreshold::current(int fallback) const {
+    return ready() ? (int)std::lround(smoothed) : fallback;
+}
+
+
+void AutoThreshold::merge(const uint32_t *histogram) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int value = 0; value < autoThresholdBins; ++value)
+        this->histogram[value] += histogram[value];
+}
+
+
+void AutoThreshold::endFrame(int minimum) {
+    int threshold = otsuThreshold(histogram, autoThresholdBins);
+    std::memset(histogram, 0, sizeof histogram);
+    if (threshold < 0)  // A flat frame says nothing about the split
+        return;
+    threshold = std::max(threshold, minimum);
+    if (ready())
+        smoothed += (threshold - smoothed) * smoothing;
+    else
+        smoothed = threshold;
+}
+
+
+void AutoThreshold::reset() {
+    std::memset(histogram, 0, sizeof histogram);
+    smoothed = -1;
+}
+
+
+/* Counts the channel sums of every pixel into threshold's histogram, a
+   band of rows at a time */
+static void countFrame(const cv::Mat &original, AutoThreshold &threshold) {
+    parallelForRows(original.rows, [&](int rowBegin, int rowEnd) {
+        uint32_t histogram[autoThresholdBins] = {};
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            channelSumHistogramRow(original.ptr<uint8_t>(r), original.cols,
+                                   histogram);
+        }
+        threshold.merge(histogram);
+    });
+    threshold.endFrame();
+}
+
+
+static void countFrame(const PlanarFrame &original, AutoThreshold &threshold) {
+    parallelForRows(original.rows(), [&](int rowBegin, int rowEnd) {
+        uint32_t histogram[autoThresholdBins] = {};
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            const uint8_t *src[3] = {original.ptr(0, r), original.ptr(1, r),
+                                     original.ptr(2, r)};
+            channelSumHistogramPlanarRow(src, original.cols(), histogram);
+        }
+        threshold.merge(histogram);
+    });
+    threshold.endFrame();
+}
+
+
+void autoBlackWhite(const cv::Mat &original, cv::Mat &modified,
+                    AutoThreshold *follow) {
+    AutoThreshold own;
+    AutoThreshold &threshold = follow ? *follow : own;
+    if (!threshold.ready())
+        countFrame(original, threshold);
+    int limit = threshold.current(0);
+
+    parallelForRows(original.rows, [&](int rowBegin, int rowEnd) {
+        uint32_t histogram[autoThresholdBins] = {};
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            blackWhiteHistogramRow(original.ptr<uint8_t>(r),
+                                   modified.ptr<uint8_t>(r), original.cols,
+                                   limit, follow ? histogram : nullptr);
+        }
+        if (follow)
+            follow->merge(histogram);
+    });
+    if (follow)
+        follow->endFrame();
+}
+
+
+void autoBlackWhite(const PlanarFrame &original, PlanarFrame &modified,
+                    AutoThreshold *follow) {
+    AutoThreshold own;
+    AutoThreshold &threshold = follow ? *follow : own;
+    if (!threshold.ready())
+        countFrame(original, threshold);
+    int limit = threshold.current(0);
+
+    parallelForRows(original.rows(), [&](int rowBegin, int rowEnd) {
+        uint32_t histogram[autoThresholdBins] = {};
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            const uint8_t *src[3] = {original.ptr(0, r), original.ptr(1, r),
+                                     original.ptr(2, r)};
+            blackWhiteHistogramPlanarRow(src, modified.ptr(0, r),
+                                         original.cols(), limit,
+                                         follow ? histogram : nullptr);
+        }
+        if (follow)
+            follow->merge(histogram);
+    });
+    if (follow)
+        follow->endFrame();
+}
@@ -0,0 +1,71 @@
+/*
+    Automatic thresholds for black and white (a bwThreshold of -1) and
+    motion detection (a motion threshold of -1), picked by Otsu's method:
+    the threshold splitting the histogram of the values into the two
+    classes that are furthest apart. The values are sums of the three
+    channels (0-765), those of the pixels for black and white and those of
+    the differences from the background for motion detection.
+
+    The histogram is built in the same pass that thresholds the frame, each
+    band of rows counting into its own histogram on the stack, merged into
+    the frame's once the band is done. A live feed's frame is thresholded
+    at the value the previous frames settled on, then moves it a quarter of
+    the way to the frame's own threshold, so a single pass is enough and a
+    flicker doesn't make the output flash. A single image (or the first
+    frame) is counted first and split at its own threshold.
+*/
+
+#ifndef AUTO_THRESHOLD_H
+#define AUTO_THRESHOLD_H
+
+#include "opencv2/opencv.hpp"
+#include "PlanarFrame.h"
+#include <cstdint>
+#include <mutex>
+
+/* Histogram bins, one per sum of three channels */
+const int autoThresholdBins = 766;
+
+/* Otsu's threshold of histogram: values up to it are one class, those
+   above it the other. -1 if every value is the same */
+int otsuThreshold(const uint32_t *histogram, int bins);
+
+/* Adds count values (below autoThresholdBins) to histogram */
+void countValues(const uint16_t *values, int count, uint32_t *histogram);
+
+/* A threshold following a stream of frames */
+class AutoThreshold {
+public:
+    /* Whether a frame has set the threshold yet */
+    bool ready() const { return smoothed >= 0; }
+
+    /* The threshold (a sum of three channels), fallback until a frame has
+       set it */
+    int current(int fallback) const;
+
+    /* Adds a band's histogram to the frame's, from any thread */
+    void merge(const uint32_t *histogram);
+
+    /* Moves the threshold towards the Otsu threshold of the frame's
+       histogram (all the way on the first frame), keeping it at minimum or
+       above, and clears the histogram for the next frame */
+    void endFrame(int minimum = 0);
+
+    /* Forgets the threshold */
+    void reset();
+
+private:
+    std::mutex mutex;
+    uint32_t histogram[autoThresholdBins] = {};
+    double smoothed = -1;
+};
+
+/* Black and white at Otsu's threshold. With follow (a live feed) the frame
+   is thresholded in one pass at follow's threshold, which it then moves.
+   Without it the image is counted first and split at its own threshold */
+void autoBlackWhite(const cv::Mat &original, cv::Mat &modified,
+                    AutoThreshold *follow);
+void autoBlackWhite(const PlanarFrame &original, PlanarFrame &modified,
+                    AutoThreshold *follow);
+
+#endif
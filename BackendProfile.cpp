@@ -0,0 +1,222 @@
+/*
+    Backend choices and their profile file (see BackendProfile.h).
+*/
+
+#include "BackendProfile.h"
+#include "ParallelExecutor.h"
+#include "SimdDispatch.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+/* A profile line's filter, width, height, threads and SIMD level */
+typedef std::tuple<int, int, int, int, std::string> ProfileKey;
+
+struct ProfileEntry {
+    std::string backend;
+    double milliseconds;
+    const ManipulationBackend *resolved;  // Null if unknown or built-in
+    bool tuning;  // Being measured, the built-in backend runs meanwhile
+};
+
+/* The profile, read on first use */
+struct BackendProfile {
+    std::mutex mutex;  // Guards the rest, not held while measuring
+    bool loaded = false;
+    std::map<ProfileKey, ProfileEntry> entries;
+};
+
+static std::atomic<int> currentPolicy{-1};  // -1 until first asked for
+
+/* Set on a thread while it measures, which can run other frames' row
+   bands while it waits for its own (WorkStealingPool) */
+static thread_local bool measuring = false;
+
+
+static BackendProfile &backendProfile() {
+    static BackendProfile profile;
+    return profile;
+}
+
+
+static BackendPolicy startupPolicy() {
+    const char *policy = std::getenv("IMAGE_MANIPULATION_BACKENDS");
+    if (policy != nullptr && std::strcmp(policy, "profile") == 0)
+        return BackendPolicy::Profile;
+    if (policy != nullptr && std::strcmp(policy, "tune") == 0)
+        return BackendPolicy::Tune;
+    return BackendPolicy::Default;
+}
+
+
+BackendPolicy backendPolicy() {
+    int policy = currentPolicy;
+    if (policy < 0) {
+        policy = (int)startupPolicy();
+        currentPolicy = policy;
+    }
+    return (BackendPolicy)policy;
+}
+
+
+void setBackendPolicy(BackendPolicy policy) {
+    currentPolicy = (int)policy;
+}
+
+
+std::string backendProfilePath() {
+    const char *path = std::getenv("IMAGE_MANIPULATION_PROFILE");
+    return path != nullptr && *path ? path : "image_manipulation_profile.txt";
+}
+
+
+/* The thread count manipulations called from this thread run with */
+static int activeThreads() {
+    WorkStealingPool *pool = WorkStealingPool::current();
+    return pool ? pool->threadCount() : executorThreads();
+}
+
+
+static ProfileKey profileKey(int choice, cv::Size size) {
+    return ProfileKey(choice, size.width, size.height, activeThreads(),
+                      simdLevelName(activeSimdLevel()));
+}
+
+
+static ProfileEntry profileEntry(int choice, const std::string &backend,
+                                 double milliseconds) {
+    const ManipulationBackend *resolved = findManipulationBackend(choice,
+                                                                  backend);
+    if (resolved && !resolved->run)
+        resolved = nullptr;
+    return {backend, milliseconds, resolved, false};
+}
+
+
+/* Reads the profile, skipping lines it doesn't understand */
+static void loadProfile(BackendProfile &profile) {
+    profile.loaded = true;
+    std::ifstream file(backendProfilePath());
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        int choice, width, height, threads;
+        char x;
+        std::string simd, backend;
+        double milliseconds;
+        if (fields >> choice >> width >> x >> height >> threads >> simd
+                   >> backend >> milliseconds && x == 'x') {
+            profile.entries[ProfileKey(choice, width, height, threads, simd)]
+                = profileEntry(choice, backend, milliseconds);
+        }
+    }
+}
+
+
+/* Writes the profile to a temporary file moved over it, so a reader never
+   sees half of one */
+static bool saveProfile(const BackendProfile &profile, std::string &error) {
+    std::string path = backendProfilePath();
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary);
+        file << "# filter size threads simd backend ms (BackendProfile.h)"
+             << std::endl;
+        for (const auto &item : profile.entries) {
+            if (item.second.tuning)
+                continue;
+            const ProfileKey &key = item.first;
+            file << std::get<0>(key) << " " << std::get<1>(key) << "x"
+                 << std::get<2>(key) << " " << std::get<3>(key) << " "
+                 << std::get<4>(key) << " " << item.second.backend << " "
+                 << item.second.milliseconds << std::endl;
+        }
+        if (!file) {
+            error = "can't write " + temporary;
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "can't replace " + path;
+        return false;
+    }
+    return true;
+}
+
+
+const ManipulationBackend *selectBackend(int choice, cv::Size size,
+                                         const ManipulationSpecs *specs) {
+    BackendPolicy policy = backendPolicy();
+    if (policy == BackendPolicy::Default || choice < 0 || choice > 6
+            || measuring)
+        return nullptr;
+
+    BackendProfile &profile = backendProfile();
+    ProfileKey key = profileKey(choice, size);
+    {
+        std::lock_guard<std::mutex> lock(profile.mutex);
+        if (!profile.loaded)
+            loadProfile(profile);
+        auto found = profile.entries.find(key);
+        if (found != profile.entries.end())
+            return found->second.resolved;  // Null while being tuned
+        if (policy != BackendPolicy::Tune || specs == nullptr)
+            return nullptr;
+        // Claimed, so other threads run the built-in backend meanwhile
+        // rather than measure it too
+        profile.entries[key] = ProfileEntry{"", 0, nullptr, true};
+    }
+
+    // Measured without the lock, which the other threads' frames need
+    measuring = true;
+    std::vector<BackendResult> results;
+    try {
+        results = measureBackends(choice, size, *specs);
+    } catch (...) {
+        measuring = false;
+        std::lock_guard<std::mutex> lock(profile.mutex);
+        profile.entries.erase(key);
+        throw;
+    }
+    measuring = false;
+    const BackendResult &fastest = fastestBackend(results);
+
+    std::lock_guard<std::mutex> lock(profile.mutex);
+    ProfileEntry &entry = profile.entries[key];
+    entry = profileEntry(choice, fastest.backend->name,
+                         fastest.medianSeconds * 1000);
+    std::cout << "Tuned filter " << choice << " at " << size.width << "x"
+              << size.height << " on " << std::get<3>(key) << " threads: "
+              << entry.backend << " (" << std::fixed << std::setprecision(3)
+              << entry.milliseconds << " ms)" << std::defaultfloat
+              << std::endl;
+    std::string error;
+    if (!saveProfile(profile, error))
+        std::cout << "Error saving the backend profile: " << error
+                  << std::endl;
+    return entry.resolved;
+}
+
+
+bool storeBackendChoice(int choice, cv::Size size,
+                        const BackendResult &result, std::string &error) {
+    BackendProfile &profile = backendProfile();
+    ProfileKey key = profileKey(choice, size);
+    std::lock_guard<std::mutex> lock(profile.mutex);
+    if (!profile.loaded)
+        loadProfile(profile);
+    profile.entries[key] = profileEntry(choice, result.backend->name,
+                                        result.medianSeconds * 1000);
+    return saveProfile(profile, error);
+}
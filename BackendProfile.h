@@ -0,0 +1,53 @@
+/*
+    Which backend (BackendRegistry.h) each manipulation runs on, and the
+    profile file the choices are kept in.
+
+    The environment variable IMAGE_MANIPULATION_BACKENDS sets the policy:
+    - default (or unset): the built-in backends.
+    - profile: the profile's choice for the filter, the frame size and the
+      active thread count, the built-in backend where it has none.
+    - tune: the same, but a filter the profile has no choice for is tuned
+      (measureBackends()) the first time it runs at a frame size and thread
+      count, and the choice saved. Tuning takes a fraction of a second per
+      filter, once per host, on the thread that first ran it; the other
+      threads keep running that filter on the built-in backend meanwhile,
+      so long runs and daemons can leave it on.
+
+    The profile is a text file (IMAGE_MANIPULATION_PROFILE, or
+    image_manipulation_profile.txt in the working directory), a line per
+    choice: the filter, WxH, threads, SIMD level (SimdDispatch.h), backend
+    and its median ms per frame. The choices of other SIMD levels are kept
+    but not used, so capping the kernels with IMAGE_MANIPULATION_SIMD tunes
+    again. The benchmark's --tune writes a whole profile on demand.
+*/
+
+#ifndef BACKEND_PROFILE_H
+#define BACKEND_PROFILE_H
+
+#include "opencv2/opencv.hpp"
+#include "BackendRegistry.h"
+#include <string>
+
+enum class BackendPolicy { Default, Profile, Tune };
+
+/* The policy (from the environment unless set) */
+BackendPolicy backendPolicy();
+void setBackendPolicy(BackendPolicy policy);
+
+/* The profile file's path */
+std::string backendProfilePath();
+
+/* The backend a menu choice runs on for a frame of size with the calling
+   thread's executor, nullptr for the built-in one. Tunes a choice the
+   profile lacks with specs if the policy says so and specs is given,
+   which it mustn't be from inside a band of rows */
+const ManipulationBackend *selectBackend(int choice, cv::Size size,
+                                         const ManipulationSpecs *specs);
+
+/* Sets the backend of a menu choice for a frame of size with the calling
+   thread's executor, and saves the profile. Returns false and sets error
+   if it can't be written */
+bool storeBackendChoice(int choice, cv::Size size,
+                        const BackendResult &result, std::string &error);
+
+#endif
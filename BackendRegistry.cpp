@@ -0,0 +1,287 @@
+/*
+    Backends of the manipulations (see BackendRegistry.h).
+*/
+
+#include "BackendRegistry.h"
+#include "FrameSource.h"
+#include "Manipulations.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+
+/* Loops, on whatever rows they're given */
+static void originalLoops(const cv::Mat &original, cv::Mat &modified,
+                          const ManipulationSpecs &) {
+    originalMedia(original, modified);
+}
+
+
+static void grayscaleLoops(const cv::Mat &original, cv::Mat &modified,
+                           const ManipulationSpecs &) {
+    grayscale(original, modified);
+}
+
+
+static void purifyLoops(const cv::Mat &original, cv::Mat &modified,
+                        const ManipulationSpecs &) {
+    purify(original, modified);
+}
+
+
+static void outlineLoops(const cv::Mat &original, cv::Mat &modified,
+                         const ManipulationSpecs &) {
+    strobelOutline(original, modified);
+}
+
+
+static void blackWhiteLut(const cv::Mat &original, cv::Mat &modified,
+                          const ManipulationSpecs &specs) {
+    manipulationLut(1, original, modified, specs);
+}
+
+
+/* OpenCV built-ins */
+static void originalOpenCv(const cv::Mat &original, cv::Mat &modified,
+                           const ManipulationSpecs &) {
+    original.copyTo(modified);
+}
+
+
+/* A mean above the threshold is a sum above 3 times it */
+static void blackWhiteOpenCv(const cv::Mat &original, cv::Mat &modified,
+                             const ManipulationSpecs &specs) {
+    cv::Mat wide, sums, white;
+    original.convertTo(wide, CV_16U);
+    cv::transform(wide, sums, cv::Matx13f(1, 1, 1));
+    cv::compare(sums, 3 * specs.bwThreshold, white, cv::CMP_GT);
+    cv::cvtColor(white, modified, cv::COLOR_GRAY2BGR);
+}
+
+
+static void grayscaleOpenCv(const cv::Mat &original, cv::Mat &modified,
+                            const ManipulationSpecs &) {
+    cv::Mat gray;
+    cv::cvtColor(original, gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(gray, modified, cv::COLOR_GRAY2BGR);
+}
+
+
+/* Per channel tables of the at<> loops' formula, wrapping past 255 */
+static void scaleOpenCv(const cv::Mat &original, cv::Mat &modified,
+                        double blue, double green, double red) {
+    cv::Mat table(1, 256, CV_8UC3);
+    for (int value = 0; value < 256; ++value) {
+        cv::Vec3b &entry = table.at<cv::Vec3b>(0, value);
+        entry[0] = (int)(value * blue);
+        entry[1] = (int)(value * green);
+        entry[2] = (int)(value * red);
+    }
+    cv::LUT(original, table, modified);
+}
+
+
+static void darkenOpenCv(const cv::Mat &original, cv::Mat &modified,
+                         const ManipulationSpecs &specs) {
+    double k = specs.brightnessConstant;
+    scaleOpenCv(original, modified, k, k, k);
+}
+
+
+static void rgbPercentagesOpenCv(const cv::Mat &original, cv::Mat &modified,
+                                 const ManipulationSpecs &specs) {
+    scaleOpenCv(original, modified, specs.blueMult / 100.0,
+                specs.greenMult / 100.0, specs.redMult / 100.0);
+}
+
+
+/* The outline's luminance weights and thresholds (above 100 white, above
+   30 the magnitude, black otherwise) on OpenCV's Sobel, with the edges
+   repeated like the kernels */
+static void outlineOpenCv(const cv::Mat &original, cv::Mat &modified,
+                          const ManipulationSpecs &) {
+    cv::Mat wide, luminance, dx, dy, magnitude, outline, mask;
+    original.convertTo(wide, CV_32F);
+    cv::transform(wide, luminance, cv::Matx13f(0.0722f, 0.7152f, 0.2126f));
+    cv::Sobel(luminance, dx, CV_32F, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE);
+    cv::Sobel(luminance, dy, CV_32F, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE);
+    cv::magnitude(dx, dy, magnitude);
+    magnitude.convertTo(outline, CV_8U, 1, -0.5);  // Truncated, not rounded
+    cv::compare(magnitude, 30, mask, cv::CMP_LE);
+    outline.setTo(0, mask);
+    cv::compare(magnitude, 100, mask, cv::CMP_GT);
+    outline.setTo(255, mask);
+    cv::cvtColor(outline, modified, cv::COLOR_GRAY2BGR);
+}
+
+
+static const ManipulationBackend BACKENDS[] = {
+    {0, "kernels", true, nullptr},
+    {0, "loops", true, originalLoops},
+    {0, "opencv", true, originalOpenCv},
+    {1, "kernels", true, nullptr},
+    {1, "lut", true, blackWhiteLut},
+    {1, "loops", true, blackWhite},
+    {1, "opencv", true, blackWhiteOpenCv},
+    {2, "kernels", true, nullptr},
+    {2, "loops", true, grayscaleLoops},
+    {2, "opencv", true, grayscaleOpenCv},
+    {3, "lut", true, nullptr},
+    {3, "kernels", true, darkenSimd},
+    {3, "loops", true, darken},
+    {3, "opencv", true, darkenOpenCv},
+    {4, "lut", true, nullptr},
+    {4, "kernels", true, rgbPercentagesSimd},
+    {4, "loops", true, rgbPercentages},
+    {4, "opencv", true, rgbPercentagesOpenCv},
+    {5, "kernels", true, nullptr},
+    {5, "loops", true, purifyLoops},
+    {6, "kernels", true, nullptr},
+    {6, "loops", false, outlineLoops},
+    {6, "opencv", false, outlineOpenCv},
+};
+
+
+std::vector<const ManipulationBackend *> manipulationBackends(int choice) {
+    std::vector<const ManipulationBackend *> backends;
+    for (const ManipulationBackend &backend : BACKENDS) {
+        if (backend.choice == choice)
+            backends.push_back(&backend);
+    }
+    return backends;
+}
+
+
+const ManipulationBackend *findManipulationBackend(int choice,
+                                                   const std::string &name) {
+    for (const ManipulationBackend &backend : BACKENDS) {
+        if (backend.choice == choice && name == backend.name)
+            return &backend;
+    }
+    return nullptr;
+}
+
+
+/* How far a backend may be from the built-in one: values within tolerance,
+   and a share of them past it */
+static void equivalence(int choice, int &tolerance, double &share) {
+    tolerance = choice == 2 || choice == 6 ? 1 : 0;
+    share = choice == 6 ? 0.001 : 0;
+}
+
+
+/* Compares output against reference, returns whether it's close enough */
+static bool compareOutputs(int choice, const cv::Mat &reference,
+                           const cv::Mat &output, BackendResult &result) {
+    int tolerance;
+    double share;
+    equivalence(choice, tolerance, share);
+    size_t rowBytes = reference.cols * reference.elemSize();
+    uint64_t differing = 0;
+    for (int r = 0; r < reference.rows; ++r) {
+        const uint8_t *expected = reference.ptr<uint8_t>(r);
+        const uint8_t *actual = output.ptr<uint8_t>(r);
+        for (size_t i = 0; i < rowBytes; ++i) {
+            int difference = std::abs(expected[i] - actual[i]);
+            result.maxDifference = std::max(result.maxDifference, difference);
+            differing += difference > tolerance;
+        }
+    }
+    double differingShare = (double)differing / (rowBytes * reference.rows);
+    result.differingShare = std::max(result.differingShare, differingShare);
+    return differingShare <= share;
+}
+
+
+/* Every value, in no order */
+static void fillNoise(cv::Mat &frame) {
+    uint32_t state = 12345;
+    for (int r = 0; r < frame.rows; ++r) {
+        uint8_t *row = frame.ptr<uint8_t>(r);
+        for (size_t i = 0; i < frame.cols * frame.elemSize(); ++i) {
+            state = state * 1664525 + 1013904223;
+            row[i] = state >> 24;
+        }
+    }
+}
+
+
+std::vector<double> timeRuns(const std::function<void()> &body,
+                             double minSeconds) {
+    typedef std::chrono::steady_clock Clock;
+    body();
+    std::vector<double> times;
+    Clock::time_point begin = Clock::now();
+    while (times.size() < 3
+               || (std::chrono::duration<double>(Clock::now() - begin).count()
+                       < minSeconds && times.size() < 1000)) {
+        Clock::time_point start = Clock::now();
+        body();
+        times.push_back(std::chrono::duration<double>(Clock::now()
+                                                      - start).count());
+    }
+    return times;
+}
+
+
+/* Median seconds per run of body (timeRuns()) */
+static double medianRun(const std::function<void()> &body,
+                        double minSeconds) {
+    std::vector<double> times = timeRuns(body, minSeconds);
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    return times[times.size() / 2];
+}
+
+
+std::vector<BackendResult> measureBackends(int choice, cv::Size size,
+                                           const ManipulationSpecs &specs,
+                                           double minSeconds) {
+    SyntheticOptions synthetic;
+    synthetic.width = size.width;
+    synthetic.height = size.height;
+    synthetic.fps = 0;
+    SyntheticSource source(synthetic);
+    cv::Mat frames[2];
+    source.read(frames[0]);
+    frames[1].create(size, CV_8UC3);
+    fillNoise(frames[1]);
+
+    cv::Mat references[2];
+    for (int f = 0; f < 2; ++f) {
+        runManipulationBackend(choice, nullptr, frames[f], references[f],
+                               specs);
+    }
+
+    std::vector<BackendResult> results;
+    cv::Mat output(size, CV_8UC3);
+    for (const ManipulationBackend *backend : manipulationBackends(choice)) {
+        BackendResult result = {backend, true, 0, 0, 0};
+        for (int f = 0; f < 2; ++f) {
+            output.setTo(cv::Scalar(77, 77, 77));  // Shows pixels left out
+            runManipulationBackend(choice, backend, frames[f], output, specs);
+            if (!compareOutputs(choice, references[f], output, result))
+                result.equivalent = false;
+        }
+        if (result.equivalent) {
+            result.medianSeconds = medianRun([&] {
+                runManipulationBackend(choice, backend, frames[0], output,
+                                       specs);
+            }, minSeconds);
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+
+const BackendResult &fastestBackend(const std::vector<BackendResult> &results) {
+    const BackendResult *fastest = &results[0];
+    for (const BackendResult &result : results) {
+        if (result.equivalent && result.medianSeconds < fastest->medianSeconds)
+            fastest = &result;
+    }
+    if (fastest->medianSeconds > results[0].medianSeconds * 0.95)
+        return results[0];
+    return *fastest;
+}
@@ -0,0 +1,85 @@
+/*
+    Backends of the manipulations: every implementation of the point
+    manipulations and the outline (menu choices 0-6), so the one that is
+    fastest on this host can be picked per filter, frame size and thread
+    count (BackendProfile.h).
+
+    - kernels: the vectorized row kernels (PointKernels.h, SobelEngine.h).
+      The built-in backend of every filter but darken and RGB values.
+    - lut: the lookup tables (LutEngine.h), built-in for darken and RGB
+      values.
+    - loops: the at<> loops of Manipulations.cpp.
+    - opencv: OpenCV's built-ins (cv::cvtColor, cv::LUT, cv::compare,
+      cv::Sobel...).
+
+    The point backends run on row bands on the executor, so they use the
+    active thread count and also serve tiles, strips and chains. The
+    outline's loops and OpenCV backend need the whole frame: the loops run
+    on the calling thread, OpenCV's Sobel on its own threads
+    (cv::parallel_for_).
+
+    A backend only counts as an implementation of its filter once its
+    output has been checked against the built-in backend's. Darken, RGB
+    values, black and white and purify have to match exactly. Grayscale may
+    differ by 1 (PointKernels.h), and the outline by 1 with up to 0.1% of
+    the values on the other side of a threshold (SobelEngine.h's fixed
+    point luminance). The outline's loops leave the edge pixels and read
+    one neighbour's red channel from another pixel, so they only take part
+    as a reference and never pass. Motion detection, approximate and the
+    automatic thresholds keep their single engines.
+*/
+
+#ifndef BACKEND_REGISTRY_H
+#define BACKEND_REGISTRY_H
+
+#include "opencv2/opencv.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ManipulationSpecs;
+
+struct ManipulationBackend {
+    int choice;  // Menu choice
+    const char *name;
+    bool rowBands;  // Runs on any band of rows, otherwise the whole frame
+    /* Manipulates original into modified (allocated like it), nullptr for
+       the built-in backend (executeManipulation()'s own row bands) */
+    void (*run)(const cv::Mat &original, cv::Mat &modified,
+                const ManipulationSpecs &specs);
+};
+
+/* The backends of a menu choice, the built-in one first. Empty past 6 */
+std::vector<const ManipulationBackend *> manipulationBackends(int choice);
+
+/* A menu choice's backend called name, nullptr if there's none */
+const ManipulationBackend *findManipulationBackend(int choice,
+                                                   const std::string &name);
+
+struct BackendResult {
+    const ManipulationBackend *backend;
+    bool equivalent;
+    int maxDifference;      // From the built-in backend's values
+    double differingShare;  // Of the values, by more than the tolerance
+    double medianSeconds;   // Per frame, 0 if not equivalent (not timed)
+};
+
+/* Runs body until minSeconds have passed (at least 3 times, at most 1000)
+   after a warm up run, returns the run times in seconds. The benchmark
+   times its cases with it too */
+std::vector<double> timeRuns(const std::function<void()> &body,
+                             double minSeconds);
+
+/* Checks every backend of choice against the built-in one on a synthetic
+   frame and a noise frame of size, then times the equivalent ones (median
+   per frame, over at least minSeconds after a warm up run). Returns a
+   result per backend, the built-in one first */
+std::vector<BackendResult> measureBackends(int choice, cv::Size size,
+                                           const ManipulationSpecs &specs,
+                                           double minSeconds = 0.1);
+
+/* The equivalent backend with the lowest median, keeping the built-in one
+   unless another is at least 5% faster so noise doesn't flip the choice */
+const BackendResult &fastestBackend(const std::vector<BackendResult> &results);
+
+#endif
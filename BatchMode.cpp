@@ -0,0 +1,358 @@
+/*
+    Headless batch mode (see BatchMode.h). Every thread of the pool
+    (ParallelExecutor.h) claims the next image of the catalog, decodes it,
+    runs the manipulation and writes the result, so throughput grows with the
+    number of cores. Each image's manipulation then runs on its own thread
+    instead of being split into bands.
+
+    With --strips, the images are streamed through one at a time instead
+    (StripProcessor.h), each strip's rows split into bands on the pool.
+*/
+
+#include "BatchMode.h"
+#include "CommandLine.h"
+#include "FilterChain.h"
+#include "ImageLoader.h"
+#include "Manipulations.h"
+#include "ParallelExecutor.h"
+#include "PointKernels.h"
+#include "StripProcessor.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/* Options given on the command line for a batch run */
+struct BatchOptions {
+    std::string input;
+    std::string outputDir;
+    int choice = -1;
+    ManipulationSpecs specs;
+    std::vector<ChainStage> chain;  // Used instead of choice if not empty
+    int width = 0;   // 0 keeps the native resolution
+    int height = 0;
+    int threads = 0; // 0 uses every core
+    int stripRows = 0;  // Rows per strip, 0 loads the images whole
+};
+
+static bool parseBatchOptions(int argc, char **argv, BatchOptions &options);
+static std::vector<fs::path> collectImages(const std::string &input,
+                                           std::vector<fs::path> &names);
+static bool isImageFile(const fs::path &path);
+static bool prepareOutputs(const BatchOptions &options,
+                           const std::vector<fs::path> &images,
+                           const std::vector<fs::path> &names,
+                           std::vector<fs::path> &outputs);
+static int runStrips(const BatchOptions &options,
+                     const std::vector<fs::path> &images,
+                     const std::vector<fs::path> &outputs);
+static void printBatchUsage();
+
+
+int runBatchMode(int argc, char **argv) {
+    BatchOptions options;
+    if (!parseBatchOptions(argc, argv, options)) {
+        printBatchUsage();
+        return -1;
+    }
+
+    std::vector<fs::path> names;
+    std::vector<fs::path> images = collectImages(options.input, names);
+    if (images.empty()) {
+        std::cout << "No images found in " << options.input << std::endl;
+        return -1;
+    }
+
+    std::vector<fs::path> outputs;
+    if (!prepareOutputs(options, images, names, outputs))
+        return -1;
+
+    configureExecutor(options.threads, 0);
+    if (options.stripRows > 0)
+        return runStrips(options, images, outputs);
+    std::shared_ptr<ThreadPool> pool = executorPool();
+
+    FilterChain chain(options.chain);
+    if (!options.chain.empty()) {
+        std::cout << "Chain runs as " << chain.passes() << " pass(es): "
+                  << chain.describe() << std::endl;
+    }
+
+    // Images are spread over our own threads, so keep opencv from starting
+    // threads of its own inside imread/resize/imwrite
+    cv::setNumThreads(0);
+
+    std::atomic<int> failures(0);
+
+    auto processImage = [&](size_t i) {
+        // Large JPEGs going to a smaller --size decode at a reduced size
+        cv::Mat original = loadImage(images[i].string(),
+                                     cv::Size(options.width, options.height));
+        if (original.empty()) {
+            std::cout << "Error loading image " << images[i] << std::endl;
+            ++failures;
+            return;
+        }
+        cv::Mat modified = original.clone();
+
+        if (options.chain.empty())
+            executeManipulation(options.choice, 1, original, modified,
+                                options.specs);
+        else
+            chain.run(original, modified);
+
+        if (!cv::imwrite(outputs[i].string(), modified)) {
+            std::cout << "Error writing image " << outputs[i] << std::endl;
+            ++failures;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    pool->parallelFor(images.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            processImage(i);
+    });
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    int processed = images.size() - failures;
+    std::cout << "Processed " << processed << " of " << images.size()
+              << " images on " << pool->threadCount() << " threads ("
+              << simdLevelName(activeSimdLevel()) << " kernels) in " << seconds
+              << " s (" << processed / seconds << " images/sec)" << std::endl;
+
+    return failures == 0 ? 0 : -1;
+}
+
+
+/* Streams each image through in strips at its native resolution (see
+   StripProcessor.h), returns the exit code */
+static int runStrips(const BatchOptions &options,
+                     const std::vector<fs::path> &images,
+                     const std::vector<fs::path> &outputs) {
+    std::vector<ChainStage> stages = options.chain;
+    if (stages.empty())
+        stages.push_back(ChainStage{options.choice, options.specs});
+    FilterChain chain(stages);
+    if (!options.chain.empty()) {
+        std::cout << "Chain runs as " << chain.passes() << " pass(es): "
+                  << chain.describe() << std::endl;
+    }
+
+    int failures = 0;
+    size_t peakBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < images.size(); ++i) {
+        const fs::path &image = images[i];
+        StripStats stats;
+        std::string error;
+        if (!processStrips(image.string(), outputs[i].string(), chain,
+                           options.stripRows, stats, error)) {
+            std::cout << "Error processing image: " << error << std::endl;
+            ++failures;
+            continue;
+        }
+        peakBytes = std::max(peakBytes, stats.bufferBytes);
+        std::cout << image.filename().string() << ": " << stats.size.width
+                  << "x" << stats.size.height << " in " << stats.strips
+                  << " strips" << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    int processed = images.size() - failures;
+    std::cout << "Processed " << processed << " of " << images.size()
+              << " images in strips of " << options.stripRows << " rows on "
+              << executorThreads() << " threads ("
+              << simdLevelName(activeSimdLevel()) << " kernels) in " << seconds
+              << " s, strip buffers peaked at " << peakBytes / 1e6 << " MB"
+              << std::endl;
+
+    return failures == 0 ? 0 : -1;
+}
+
+
+/* Fills options from argv (argv[1] is "--batch"), returns false and prints
+   the reason if an option is missing or out of range */
+static bool parseBatchOptions(int argc, char **argv, BatchOptions &options) {
+    double value;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            return false;
+        }
+        std::string text = argv[++i];
+
+        bool valid;
+        if (flag == "--batch") {
+            options.input = text;
+        } else if (flag == "--out") {
+            options.outputDir = text;
+        } else if (flag == "--filter") {
+            if (!parseNumberOption(flag, text, 0, 7, value))
+                return false;
+            options.choice = value;
+        } else if (flag == "--chain") {
+            std::string error;
+            if (!parseChain(text, options.chain, error)) {
+                std::cout << "Invalid chain: " << error << std::endl;
+                return false;
+            }
+        } else if (flag == "--threads") {
+            if (!parseNumberOption(flag, text, 1, 1024, value))
+                return false;
+            options.threads = value;
+        } else if (flag == "--size") {
+            if (!parseSizeOption(flag, text, 100000, options.width,
+                                 options.height))
+                return false;
+        } else if (flag == "--strips") {
+            if (!parseNumberOption(flag, text, 1, 100000, value))
+                return false;
+            options.stripRows = value;
+        } else if (!parseSpecsOption(flag, text, options.specs, valid)) {
+            std::cout << "Unknown option " << flag << std::endl;
+            return false;
+        } else if (!valid) {
+            return false;
+        }
+    }
+
+    if (options.input.empty() || options.outputDir.empty()
+            || (options.choice < 0 && options.chain.empty())) {
+        std::cout << "--batch, --filter (or --chain) and --out are required"
+                  << std::endl;
+        return false;
+    }
+    if (options.stripRows > 0 && (options.width > 0 || options.choice == 7)) {
+        std::cout << "--strips keeps the native resolution and can't run"
+                  << " approximate (7), so it takes no --size or filter 7"
+                  << std::endl;
+        return false;
+    }
+    if (options.stripRows > 0 && options.choice == 1
+            && options.specs.bwThreshold < 0) {
+        std::cout << "--strips never sees the whole image, so it needs a"
+                  << " --threshold other than auto" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/* Lists the images to process, and in names the path each one's output
+   gets under --out: its file name, or for a list file its path as listed
+   if that's relative and stays inside the list's directory */
+static std::vector<fs::path> collectImages(const std::string &input,
+                                           std::vector<fs::path> &names) {
+    std::vector<fs::path> images;
+    std::error_code error;
+
+    if (fs::is_regular_file(input, error) && isImageFile(input)) {
+        images.push_back(input);
+        names.push_back(images.back().filename());
+        return images;
+    }
+
+    if (fs::is_directory(input, error)) {
+        for (const fs::directory_entry &entry : fs::directory_iterator(input, error)) {
+            if (entry.is_regular_file(error) && isImageFile(entry.path()))
+                images.push_back(entry.path());
+        }
+        std::sort(images.begin(), images.end());
+        for (const fs::path &image : images)
+            names.push_back(image.filename());
+        return images;
+    }
+
+    std::ifstream listFile(input);
+    if (!listFile.is_open()) {
+        std::cout << "Error opening image list " << input << std::endl;
+        return images;
+    }
+
+    fs::path listDir = fs::path(input).parent_path();
+    std::string line;
+    while (std::getline(listFile, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        fs::path path(line);
+        images.push_back(path.is_absolute() ? path : listDir / path);
+        fs::path name = path.lexically_normal();
+        bool inside = name.is_relative() && !name.empty()
+                      && *name.begin() != "..";
+        names.push_back(inside ? name : path.filename());
+    }
+    return images;
+}
+
+
+/* Fills outputs with each image's output path and creates their
+   directories. Returns false and prints the reason if it can't, or if two
+   images would be written to the same path */
+static bool prepareOutputs(const BatchOptions &options,
+                           const std::vector<fs::path> &images,
+                           const std::vector<fs::path> &names,
+                           std::vector<fs::path> &outputs) {
+    std::map<fs::path, size_t> written;
+    for (size_t i = 0; i < images.size(); ++i) {
+        fs::path output = fs::path(options.outputDir) / names[i];
+        // Strips are written as JPEG if it was one, as PPM otherwise
+        if (options.stripRows > 0 && !isStripOutput(output.string()))
+            output.replace_extension(".ppm");
+        auto inserted = written.emplace(output, i);
+        if (!inserted.second) {
+            std::cout << "Error: " << images[inserted.first->second]
+                      << " and " << images[i] << " would both be written to "
+                      << output << std::endl;
+            return false;
+        }
+        outputs.push_back(output);
+    }
+
+    for (const auto &item : written) {
+        std::error_code error;
+        fs::create_directories(item.first.parent_path(), error);
+        if (error) {
+            std::cout << "Error creating output directory "
+                      << item.first.parent_path() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool isImageFile(const fs::path &path) {
+    std::string ext = path.extension().string();
+    for (char &c : ext)
+        c = std::tolower((unsigned char)c);
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp"
+        || ext == ".tif" || ext == ".tiff" || ext == ".ppm"
+        || ext == ".pgm";
+}
+
+
+static void printBatchUsage() {
+    std::cout << std::endl << "Usage: image_manipulation --batch "
+              << "<directory | list file> --filter <0-7> --out <directory>"
+              << std::endl
+              << "    [--chain <choice[:spec],...> instead of --filter]"
+              << std::endl
+              << "    [--threshold 0-255|auto] [--brightness 0-1] [--red 0-150]"
+              << " [--green 0-150] [--blue 0-150]" << std::endl
+              << "    [--iterations N] [--time-budget seconds] [--seed N]"
+              << " [--approximate-tile N]" << std::endl
+              << "    [--size WxH] [--strips rows] [--threads N]" << std::endl;
+}
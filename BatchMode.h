@@ -0,0 +1,39 @@
+/*
+    Headless batch mode: applies one manipulation to a whole catalog of
+    images and writes the results to disk, spreading the images over all
+    cores. Usage:
+
+    image_manipulation --batch <directory | list file> --filter <0-7>
+                       --out <directory> [--threshold 0-255|auto]
+                       [--brightness 0-1] [--red 0-150] [--green 0-150]
+                       [--blue 0-150] [--iterations N]
+                       [--time-budget seconds] [--seed N]
+                       [--approximate-tile N] [--size WxH] [--strips rows]
+                       [--threads N]
+
+    --chain <stages> can be given instead of --filter to apply several
+    manipulations in a row (see FilterChain.h), e.g. --chain 3:0.5,2,1:128
+
+    Filter 7 is approximate, painted without a display (ApproximateEngine.h)
+    in --iterations strokes (10000 by default) or until --time-budget runs
+    out, the same --seed giving the same painting.
+
+    --strips streams each image through a few rows at a time at its native
+    resolution (StripProcessor.h), for JPEG, PPM and PGM images too large
+    to load whole.
+
+    A single image can be given instead of a directory. A list file holds
+    one image path per line, relative paths being relative to the list
+    file and keeping their subdirectories under --out. Nothing is written
+    if two images would have the same output path. The filter numbers and
+    parameters are the same as the main menu and
+    getManipulationSpecifications().
+*/
+
+#ifndef BATCH_MODE_H
+#define BATCH_MODE_H
+
+/* Runs batch mode with the program's command line, returns the exit code */
+int runBatchMode(int argc, char **argv);
+
+#endif
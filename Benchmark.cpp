@@ -0,0 +1,462 @@
+/*
+    Manipulation benchmark (the image_manipulation_benchmark target).
+
+    Times every manipulation at several resolutions and thread counts on
+    synthetic frames (FrameSource.h), both through executeManipulation() (the
+    thread pool and vectorized kernels the program runs) and the original
+    at<> loops, and reports the median time per frame as ns/pixel, MPix/s
+    and GB/s. Bandwidth is estimated from the bytes each manipulation has to
+    read and write per pixel. Approximate is bounded to a fixed number of
+    triangles without the display (the executor runs being the tiled
+    approximation engine, ApproximateEngine.h).
+
+    The other manipulations are also timed on planar frames (PlanarFrame.h),
+    both on their own ("planar") and end to end with the conversion of each
+    frame to planes and back ("planar+cvt"), what the planar live loop does
+    per frame across its threads.
+
+    --tune instead checks and times every backend of filters 0-6
+    (BackendRegistry.h) at each size and thread count, and saves the
+    fastest to the backend profile (BackendProfile.h) for
+    IMAGE_MANIPULATION_BACKENDS=profile runs on this host.
+
+    Usage:
+    image_manipulation_benchmark [--sizes WxH,...] [--threads N,...]
+                                 [--filters 0-8,...] [--time seconds]
+                                 [--iterations N] [--label text]
+                                 [--json file] [--tune]
+
+    Filters are the menu choices, 7 being motion detection and 8 approximate.
+    The results can be saved as JSON (--json) and compared between builds,
+    --label naming the build in the file.
+*/
+
+#include "opencv2/opencv.hpp"
+#include "BackendProfile.h"
+#include "CommandLine.h"
+#include "FrameSource.h"
+#include "Manipulations.h"
+#include "ParallelExecutor.h"
+#include "PlanarFrame.h"
+#include "SimdDispatch.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchmarkOptions {
+    std::vector<cv::Size> sizes = {cv::Size(640, 360), cv::Size(1280, 720),
+                                   cv::Size(1920, 1080),
+                                   cv::Size(3840, 2160)};
+    std::vector<int> threads;
+    std::vector<int> filters = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+    double minSeconds = 0.2;  // Per case, after a warm up run
+    int approximateIterations = 2000;
+    std::string label;
+    std::string jsonPath;
+    bool tune = false;  // Times the backends instead
+};
+
+/* One manipulation's name and the bytes it reads and writes per pixel */
+struct BenchmarkFilter {
+    int choice;
+    const char *name;
+    int bytesPerPixel;
+};
+
+static const BenchmarkFilter FILTERS[] = {
+    {0, "originalMedia", 6},
+    {1, "blackWhite", 6},
+    {2, "grayscale", 6},
+    {3, "darken", 6},
+    {4, "rgbPercentages", 6},
+    {5, "purify", 6},
+    {6, "strobelOutline", 6},
+    {7, "motionDetection", 12},  // Also reads and updates the previous frame
+    {8, "approximate", 0},       // Not bandwidth bound
+};
+
+struct BenchmarkResult {
+    const BenchmarkFilter *filter;
+    std::string implementation;
+    cv::Size size;
+    int threads;
+    int runs;
+    double medianSeconds;
+    double minSeconds;
+};
+
+
+static BenchmarkResult makeResult(const BenchmarkFilter &filter,
+                                  const std::string &implementation,
+                                  cv::Size size, int threads,
+                                  std::vector<double> times) {
+    std::sort(times.begin(), times.end());
+    BenchmarkResult result;
+    result.filter = &filter;
+    result.implementation = implementation;
+    result.size = size;
+    result.threads = threads;
+    result.runs = times.size();
+    result.medianSeconds = times[times.size() / 2];
+    result.minSeconds = times[0];
+    return result;
+}
+
+
+/* Runs the original at<> loop of a manipulation */
+static void runReference(int choice, const cv::Mat &original,
+                         cv::Mat &modified, const ManipulationSpecs &specs,
+                         cv::Mat &prevFrame) {
+    switch (choice) {
+        case 0: originalMedia(original, modified); break;
+        case 1: blackWhite(original, modified, specs); break;
+        case 2: grayscale(original, modified); break;
+        case 3: darken(original, modified, specs); break;
+        case 4: rgbPercentages(original, modified, specs); break;
+        case 5: purify(original, modified); break;
+        case 6: strobelOutline(original, modified); break;
+        case 7: motionDetection(original, modified, prevFrame); break;
+    }
+}
+
+
+static void printResult(const BenchmarkResult &result) {
+    double pixels = (double)result.size.width * result.size.height;
+    std::cout << std::left << std::setw(16) << result.filter->name
+              << std::setw(10) << result.implementation << std::right
+              << std::setw(6) << result.size.width << "x" << std::left
+              << std::setw(6) << result.size.height << std::right
+              << std::setw(4) << result.threads
+              << std::fixed << std::setprecision(3)
+              << std::setw(11) << result.medianSeconds * 1e3
+              << std::setw(9) << result.medianSeconds * 1e9 / pixels
+              << std::setprecision(1)
+              << std::setw(9) << pixels / result.medianSeconds / 1e6
+              << std::setprecision(2)
+              << std::setw(9) << pixels * result.filter->bytesPerPixel
+                                     / result.medianSeconds / 1e9
+              << std::defaultfloat << std::endl;
+}
+
+
+static void writeJson(const std::string &path, const BenchmarkOptions &options,
+                      const std::vector<BenchmarkResult> &results) {
+    std::ofstream file(path);
+    file << "{\n"
+         << "  \"label\": \"" << options.label << "\",\n"
+         << "  \"simd\": \"" << simdLevelName(activeSimdLevel()) << "\",\n"
+         << "  \"hardwareThreads\": " << std::thread::hardware_concurrency()
+         << ",\n"
+         << "  \"approximateIterations\": " << options.approximateIterations
+         << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult &result = results[i];
+        double pixels = (double)result.size.width * result.size.height;
+        file << "    {\"filter\": \"" << result.filter->name
+             << "\", \"implementation\": \"" << result.implementation
+             << "\", \"width\": " << result.size.width
+             << ", \"height\": " << result.size.height
+             << ", \"threads\": " << result.threads
+             << ", \"runs\": " << result.runs
+             << ", \"medianMs\": " << result.medianSeconds * 1e3
+             << ", \"minMs\": " << result.minSeconds * 1e3
+             << ", \"nsPerPixel\": " << result.medianSeconds * 1e9 / pixels
+             << ", \"mpixPerSec\": " << pixels / result.medianSeconds / 1e6
+             << ", \"gbPerSec\": ";
+        if (result.filter->bytesPerPixel > 0)
+            file << pixels * result.filter->bytesPerPixel
+                        / result.medianSeconds / 1e9;
+        else
+            file << "null";
+        file << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+}
+
+
+/* Checks and times every backend of filters 0-6 at each size and thread
+   count, prints them and saves the fastest to the profile */
+static int tuneBackends(const BenchmarkOptions &options,
+                        const ManipulationSpecs &specs) {
+    std::cout << "SIMD kernels: " << simdLevelName(activeSimdLevel())
+              << std::endl << std::endl
+              << "Filter          Backend         Size      Thr  Median ms"
+              << "   MPix/s" << std::endl;
+    for (cv::Size size : options.sizes) {
+        double pixels = (double)size.width * size.height;
+        for (int choice : options.filters) {
+            if (choice > 6)
+                continue;
+            for (int threads : options.threads) {
+                configureExecutor(threads, 0);
+                std::vector<BackendResult> results = measureBackends(
+                    choice, size, specs, options.minSeconds);
+                const BackendResult &fastest = fastestBackend(results);
+                for (const BackendResult &result : results) {
+                    std::cout << std::left << std::setw(16)
+                              << FILTERS[choice].name << std::setw(10)
+                              << result.backend->name << std::right
+                              << std::setw(6) << size.width << "x"
+                              << std::left << std::setw(6) << size.height
+                              << std::right << std::setw(4) << threads;
+                    if (result.equivalent) {
+                        std::cout << std::fixed << std::setprecision(3)
+                                  << std::setw(11)
+                                  << result.medianSeconds * 1e3
+                                  << std::setprecision(1) << std::setw(9)
+                                  << pixels / result.medianSeconds / 1e6
+                                  << std::defaultfloat
+                                  << (&result == &fastest ? "  fastest"
+                                                          : "");
+                    } else {
+                        std::cout << "  differs by up to "
+                                  << result.maxDifference << " ("
+                                  << std::fixed << std::setprecision(2)
+                                  << result.differingShare * 100
+                                  << "% of values)" << std::defaultfloat;
+                    }
+                    std::cout << std::endl;
+                }
+
+                std::string error;
+                if (!storeBackendChoice(choice, size, fastest, error)) {
+                    std::cout << "Error: " << error << std::endl;
+                    return -1;
+                }
+            }
+        }
+    }
+    std::cout << std::endl << "Backend profile written to "
+              << backendProfilePath() << std::endl;
+    return 0;
+}
+
+
+/* Splits a comma separated list */
+static std::vector<std::string> splitList(const std::string &text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+
+static bool parseBenchmarkOptions(int argc, char **argv,
+                                  BenchmarkOptions &options) {
+    double value;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--tune") {
+            options.tune = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            return false;
+        }
+        std::string text = argv[++i];
+
+        if (flag == "--sizes") {
+            options.sizes.clear();
+            for (const std::string &size : splitList(text)) {
+                size_t x = size.find('x');
+                double w, h;
+                if (x == std::string::npos
+                        || !parseNumberOption(flag, size.substr(0, x), 8,
+                                              16384, w)
+                        || !parseNumberOption(flag, size.substr(x + 1), 8,
+                                              16384, h))
+                    return false;
+                options.sizes.push_back(cv::Size(w, h));
+            }
+        } else if (flag == "--threads") {
+            options.threads.clear();
+            for (const std::string &threads : splitList(text)) {
+                if (!parseNumberOption(flag, threads, 1, 1024, value))
+                    return false;
+                options.threads.push_back(value);
+            }
+        } else if (flag == "--filters") {
+            options.filters.clear();
+            for (const std::string &filter : splitList(text)) {
+                if (!parseNumberOption(flag, filter, 0, 8, value))
+                    return false;
+                options.filters.push_back(value);
+            }
+        } else if (flag == "--time") {
+            if (!parseNumberOption(flag, text, 0, 3600, value))
+                return false;
+            options.minSeconds = value;
+        } else if (flag == "--iterations") {
+            if (!parseNumberOption(flag, text, 1, 1e7, value))
+                return false;
+            options.approximateIterations = value;
+        } else if (flag == "--label") {
+            // Written into the JSON as is
+            text.erase(std::remove_if(text.begin(), text.end(), [](char c) {
+                return c == '"' || c == '\\' || (unsigned char)c < 32;
+            }), text.end());
+            options.label = text;
+        } else if (flag == "--json") {
+            options.jsonPath = text;
+        } else {
+            std::cout << "Unknown option " << flag << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+    BenchmarkOptions options;
+    if (!parseBenchmarkOptions(argc, argv, options)) {
+        std::cout << std::endl << "Usage: image_manipulation_benchmark "
+                  << "[--sizes WxH,...] [--threads N,...]" << std::endl
+                  << "    [--filters 0-8,...] (7 motion detection, "
+                  << "8 approximate) [--time seconds]" << std::endl
+                  << "    [--iterations N] [--label text] [--json file] "
+                  << "[--tune]" << std::endl;
+        return -1;
+    }
+
+    // Thread counts default to powers of two up to every core
+    if (options.threads.empty()) {
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (int threads = 1; threads < cores; threads *= 2)
+            options.threads.push_back(threads);
+        options.threads.push_back(cores);
+    }
+
+    ManipulationSpecs specs;
+    specs.bwThreshold = 128;
+    specs.brightnessConstant = 0.5;
+    specs.redMult = 120;
+    specs.greenMult = 80;
+    specs.blueMult = 50;
+
+    if (options.tune)
+        return tuneBackends(options, specs);
+
+    std::cout << "SIMD kernels: " << simdLevelName(activeSimdLevel())
+              << std::endl << std::endl
+              << "Filter          Impl            Size      Thr  Median ms"
+              << "   ns/pix   MPix/s     GB/s" << std::endl;
+
+    std::vector<BenchmarkResult> results;
+    for (cv::Size size : options.sizes) {
+        // Two frames with the squares moved, so motion detection has motion
+        SyntheticOptions synthetic;
+        synthetic.width = size.width;
+        synthetic.height = size.height;
+        synthetic.fps = 0;
+        SyntheticSource source(synthetic);
+        cv::Mat frames[2];
+        source.read(frames[0]);
+        source.read(frames[1]);
+        cv::Mat modified = frames[0].clone();
+        PlanarFrame planes[2], planarModified;
+        toPlanar(frames[0], planes[0]);
+        toPlanar(frames[1], planes[1]);
+
+        for (int choice : options.filters) {
+            const BenchmarkFilter &filter = FILTERS[choice];
+
+            if (choice == 8) {
+                ManipulationSpecs approximation;
+                approximation.approximation.iterations
+                    = options.approximateIterations;
+                for (int threads : options.threads) {
+                    configureExecutor(threads, 0);
+                    std::vector<double> times = timeRuns([&] {
+                        executeManipulation(7, 1, frames[0], modified,
+                                            approximation);
+                    }, options.minSeconds);
+                    results.push_back(makeResult(filter, "executor", size,
+                                                 threads, times));
+                    printResult(results.back());
+                }
+
+                srand(1);
+                std::vector<double> times = timeRuns([&] {
+                    approximate(frames[0], modified,
+                                options.approximateIterations, false);
+                }, options.minSeconds);
+                results.push_back(makeResult(filter, "reference", size, 1,
+                                             times));
+                printResult(results.back());
+                continue;
+            }
+
+            // Alternating frames, which only matters for motion detection
+            int frame = 0;
+            for (int threads : options.threads) {
+                configureExecutor(threads, 0);
+                std::vector<double> times = timeRuns([&] {
+                    executeManipulation(choice, 2, frames[frame ^= 1],
+                                        modified, specs);
+                }, options.minSeconds);
+                results.push_back(makeResult(filter, "executor", size,
+                                             threads, times));
+                printResult(results.back());
+
+                if (choice == 1 || choice == 7) {
+                    // Picking the threshold per frame (AutoThreshold.h)
+                    ManipulationSpecs automatic = specs;
+                    automatic.bwThreshold = -1;
+                    automatic.motion.threshold = -1;
+                    ManipulationState state;
+                    times = timeRuns([&] {
+                        executeManipulation(choice, 2, frames[frame ^= 1],
+                                            modified, automatic, state);
+                    }, options.minSeconds);
+                    results.push_back(makeResult(filter, "auto", size,
+                                                 threads, times));
+                    printResult(results.back());
+                }
+
+                times = timeRuns([&] {
+                    executePlanarManipulation(choice, 2, planes[frame ^= 1],
+                                              planarModified, specs);
+                }, options.minSeconds);
+                results.push_back(makeResult(filter, "planar", size, threads,
+                                             times));
+                printResult(results.back());
+
+                times = timeRuns([&] {
+                    frame ^= 1;
+                    toPlanar(frames[frame], planes[frame]);
+                    executePlanarManipulation(choice, 2, planes[frame],
+                                              planarModified, specs);
+                    fromPlanar(planarModified, modified);
+                }, options.minSeconds);
+                results.push_back(makeResult(filter, "planar+cvt", size,
+                                             threads, times));
+                printResult(results.back());
+            }
+
+            cv::Mat prevFrame;
+            std::vector<double> times = timeRuns([&] {
+                runReference(choice, frames[frame ^= 1], modified, specs,
+                             prevFrame);
+            }, options.minSeconds);
+            results.push_back(makeResult(filter, "reference", size, 1, times));
+            printResult(results.back());
+        }
+    }
+
+    if (!options.jsonPath.empty()) {
+        writeJson(options.jsonPath, options, results);
+        std::cout << std::endl << "Results written to " << options.jsonPath
+                  << std::endl;
+    }
+    return 0;
+}
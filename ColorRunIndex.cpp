@@ -0,0 +1,92 @@
+/*
+    Colour run index (see ColorRunIndex.h).
+*/
+
+#include "ColorRunIndex.h"
+#include "ParallelExecutor.h"
+
+
+/* Colour distance between two pixels in COLOR_RUN_SCALE units, rounded
+   up */
+static inline uint32_t neighbourDistance(const uint8_t *a, const uint8_t *b) {
+    return std::ceil(std::sqrt((float)colorDistance(a, b)) * COLOR_RUN_SCALE);
+}
+
+
+void ColorRunIndex::build(const cv::Mat &image) {
+    cols = image.cols;
+    rowSums.resize((size_t)image.rows * cols);
+    columnSums.resize((size_t)image.rows * cols);
+
+    // Sums along the rows, and each pixel's distance to the one above
+    parallelForRows(image.rows, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            const uint8_t *row = image.ptr<uint8_t>(r);
+            const uint8_t *above = image.ptr<uint8_t>(r > 0 ? r - 1 : 0);
+            uint32_t *sums = &rowSums[(size_t)r * cols];
+            uint32_t *steps = &columnSums[(size_t)r * cols];
+            uint32_t sum = 0;
+            for (int c = 0; c < cols; ++c) {
+                if (c > 0)
+                    sum += neighbourDistance(row + 3 * c, row + 3 * c - 3);
+                sums[c] = sum;
+                steps[c] = neighbourDistance(row + 3 * c, above + 3 * c);
+            }
+        }
+    });
+
+    // Then the sums down the columns
+    for (int r = 1; r < image.rows; ++r) {
+        const uint32_t *previous = &columnSums[(size_t)(r - 1) * cols];
+        uint32_t *sums = &columnSums[(size_t)r * cols];
+        for (int c = 0; c < cols; ++c)
+            sums[c] += previous[c];
+    }
+}
+
+
+/* Runs are about strength over the average neighbour distance long, and
+   the index only pays for itself on runs of several pixels */
+static const int MIN_RUN_PIXELS = 8;
+static const int SAMPLE_ROWS = 8;  // Every 8th row is sampled
+
+
+double ColorRunIndex::averageNeighbourDistance(const cv::Mat &image) {
+    double total = 0;
+    int64_t samples = 0;
+    for (int r = 0; r < image.rows; r += SAMPLE_ROWS) {
+        const uint8_t *row = image.ptr<uint8_t>(r);
+        for (int c = 1; c < image.cols; ++c)
+            total += std::sqrt((float)colorDistance(row + 3 * c,
+                                                    row + 3 * c - 3));
+        samples += image.cols - 1;
+    }
+    return samples > 0 ? total / samples : 0;
+}
+
+
+bool ColorRunIndex::worthIndexing(double averageDistance, int strength) {
+    return averageDistance * MIN_RUN_PIXELS < strength;
+}
+
+
+ColorRunLine ColorRunIndex::line(const cv::Mat &image, int row, int col,
+                                 int rowStep, int colStep) const {
+    ColorRunLine line;
+    line.pixel = image.ptr<uint8_t>(row) + 3 * col;
+    size_t start = (size_t)row * cols + col;
+    if (cols == 0) {
+        line.pixelStep = (ptrdiff_t)image.step * rowStep + 3 * colStep;
+        line.steps = nullptr;
+        line.stepsStride = 0;
+    } else if (rowStep == 0) {
+        line.pixelStep = 3 * colStep;
+        line.steps = &rowSums[start];
+        line.stepsStride = colStep;
+    } else {
+        line.pixelStep = (ptrdiff_t)image.step * rowStep;
+        line.steps = &columnSums[start];
+        line.stepsStride = (ptrdiff_t)cols * rowStep;
+    }
+    return line;
+}
@@ -0,0 +1,159 @@
+/*
+    Colour run index for the approximation engine (ApproximateEngine.h).
+
+    For every row and every column of an image it keeps the running sum of
+    the colour distances between neighbouring pixels (in 1/64ths, each
+    rounded up). By the triangle inequality, the distance between two
+    pixels of a row or column is at most the sum of the neighbour distances
+    between them, so from a pixel whose distance d to a stroke's colour is
+    known, every pixel within strength - d of steps is close to the colour
+    too, and every pixel within d - strength of steps is not. Runs of pixels
+    are classified with a search over the sums instead of comparing every
+    pixel, whatever the stroke strength, and only the pixels at the ends of
+    the runs are compared.
+
+    On noisy images the runs are a pixel or two long and comparing every
+    pixel is cheaper, so lines without sums (from an unbuilt index) compare
+    each pixel, and the index is only built when the image's neighbour
+    distances are well under the strengths used (worthIndexing()). It takes
+    8 bytes per pixel and is built once per image, in parallel over rows.
+*/
+
+#ifndef COLOR_RUN_INDEX_H
+#define COLOR_RUN_INDEX_H
+
+#include "opencv2/opencv.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Units of the neighbour distance sums per unit of colour distance */
+const int COLOR_RUN_SCALE = 64;
+
+/* Pixels from a start pixel along a row or column (either way) */
+struct ColorRunLine {
+    const uint8_t *pixel;   // Start pixel
+    ptrdiff_t pixelStep;    // Bytes to the next pixel
+    const uint32_t *steps;  // Neighbour distance sum at the start pixel,
+                            // null to compare every pixel
+    ptrdiff_t stepsStride;  // Elements to the next pixel's sum
+
+    /* Neighbour distances summed from pixel a to pixel b (a <= b) */
+    uint32_t between(int a, int b) const {
+        int64_t difference = (int64_t)steps[b * stepsStride]
+                             - steps[a * stepsStride];
+        return difference < 0 ? -difference : difference;
+    }
+};
+
+class ColorRunIndex {
+public:
+    /* Indexes a BGR image */
+    void build(const cv::Mat &image);
+
+    /* Average colour distance between neighbouring pixels of image,
+       sampling every few rows */
+    static double averageNeighbourDistance(const cv::Mat &image);
+
+    /* Whether runs of pixels within strength are usually long enough for
+       the index to pay off, given the average neighbour distance */
+    static bool worthIndexing(double averageDistance, int strength);
+
+    /* The line from (row, col) towards (rowStep, colStep), one of which is
+       0 and the other 1 or -1 (without sums if the index isn't built) */
+    ColorRunLine line(const cv::Mat &image, int row, int col, int rowStep,
+                      int colStep) const;
+
+private:
+    int cols = 0;
+    std::vector<uint32_t> rowSums;     // Along each row, row major
+    std::vector<uint32_t> columnSums;  // Along each column, row major
+};
+
+/* Pixels compared one by one after a run the index can't lengthen */
+const int SHORT_RUN_PIXELS = 16;
+
+/* Squared colour distance between two pixels */
+inline int colorDistance(const uint8_t *a, const uint8_t *b) {
+    int blue = a[0] - b[0], green = a[1] - b[1], red = a[2] - b[2];
+    return blue * blue + green * green + red * red;
+}
+
+/* Square root of a squared distance, rounded up or down exactly */
+inline int64_t scaledDistance(int64_t squared, bool roundUp) {
+    int64_t root = std::sqrt((double)squared);
+    while (root * root > squared)
+        --root;
+    while ((root + 1) * (root + 1) <= squared)
+        ++root;
+    return roundUp && root * root < squared ? root + 1 : root;
+}
+
+/* Last pixel in [good, end] at most budget neighbour distances from
+   anchor, good being known to be. Searches out from good since most runs
+   are short */
+inline int furthestWithin(const ColorRunLine &line, int good, int end,
+                          int64_t budget, int anchor) {
+    int step = 1;
+    while (good + step <= end && line.between(anchor, good + step) <= budget) {
+        good += step;
+        step *= 2;
+    }
+    for (step /= 2; step > 0; step /= 2) {
+        if (good + step <= end && line.between(anchor, good + step) <= budget)
+            good += step;
+    }
+    return good;
+}
+
+/* Calls run(first, last, close) for the runs of pixels [begin, end] of line
+   that are all close (within strength) to colour or all not, in order,
+   stopping when run returns false */
+template <typename Run>
+void forEachColorRun(const ColorRunLine &line, int begin, int end,
+                     const uint8_t *colour, int strength, Run run) {
+    int limit = strength * strength;
+    for (int first = begin; first <= end;) {
+        int64_t squared = colorDistance(line.pixel + first * line.pixelStep,
+                                        colour);
+        bool close = squared < limit;
+
+        // Close pixels stay under strength away, the others at least
+        // strength. Most runs are a pixel long on noisy images, so whether
+        // the next pixel is in the run is checked squared first
+        int last = first;
+        int64_t strengthUnits = (int64_t)strength * COLOR_RUN_SCALE;
+        int64_t scaledSquared = squared * COLOR_RUN_SCALE * COLOR_RUN_SCALE;
+        if (first < end && line.steps) {
+            int64_t step = line.between(first, first + 1);
+            int64_t reach = close ? strengthUnits - 1 - step
+                                  : strengthUnits + step;
+            bool longer = close ? reach >= 0 && reach * reach >= scaledSquared
+                                : reach * reach <= scaledSquared;
+            if (longer) {
+                int64_t budget = close
+                    ? strengthUnits - 1 - scaledDistance(scaledSquared, true)
+                    : scaledDistance(scaledSquared, false) - strengthUnits;
+                last = furthestWithin(line, first + 1, end, budget, first);
+            }
+        }
+        if (last == first) {
+            // Compare the next pixels one by one instead (a few of them,
+            // then try the index again)
+            int stop = line.steps ? std::min(end, first + SHORT_RUN_PIXELS)
+                                  : end;
+            while (last < stop
+                       && (colorDistance(line.pixel + (last + 1)
+                                         * line.pixelStep, colour)
+                           < limit) == close)
+                ++last;
+        }
+        if (!run(first, last, close))
+            return;
+        first = last + 1;
+    }
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+    Option parsing shared by the headless modes (see CommandLine.h).
+*/
+
+#include "CommandLine.h"
+#include <iostream>
+
+
+bool parseNumberOption(const std::string &flag, const std::string &text,
+                       double lower, double upper, double &value) {
+    try {
+        size_t used;
+        value = std::stod(text, &used);
+        if (used == text.size() && value >= lower && value <= upper)
+            return true;
+    } catch (const std::exception &) {
+    }
+    std::cout << "Invalid value " << text << " for " << flag << " (expected "
+              << lower << "-" << upper << ")" << std::endl;
+    return false;
+}
+
+
+bool parseSizeOption(const std::string &flag, const std::string &text,
+                     int upper, int &width, int &height) {
+    size_t x = text.find('x');
+    double w, h;
+    if (x == std::string::npos) {
+        std::cout << "Invalid value " << text << " for " << flag
+                  << " (expected WxH)" << std::endl;
+        return false;
+    }
+    if (!parseNumberOption(flag, text.substr(0, x), 1, upper, w)
+            || !parseNumberOption(flag, text.substr(x + 1), 1, upper, h))
+        return false;
+    width = w;
+    height = h;
+    return true;
+}
+
+
+bool parseSpecsOption(const std::string &flag, const std::string &text,
+                      ManipulationSpecs &specs, bool &valid) {
+    double value = 0;  // Left at 0 for auto or an invalid number
+    if (flag == "--threshold") {
+        // auto picks it from each image (AutoThreshold.h)
+        valid = text == "auto" || parseNumberOption(flag, text, 0, 255, value);
+        specs.bwThreshold = text == "auto" ? -1 : value;
+    } else if (flag == "--brightness") {
+        valid = parseNumberOption(flag, text, 0, 1, value);
+        specs.brightnessConstant = value;
+    } else if (flag == "--red") {
+        valid = parseNumberOption(flag, text, 0, 150, value);
+        specs.redMult = (int)value;
+    } else if (flag == "--green") {
+        valid = parseNumberOption(flag, text, 0, 150, value);
+        specs.greenMult = (int)value;
+    } else if (flag == "--blue") {
+        valid = parseNumberOption(flag, text, 0, 150, value);
+        specs.blueMult = (int)value;
+    } else if (flag == "--motion-threshold") {
+        valid = text == "auto" || parseNumberOption(flag, text, 0, 765, value);
+        specs.motion.threshold = text == "auto" ? -1 : value;
+    } else if (flag == "--motion-noise") {
+        valid = parseNumberOption(flag, text, 0, 255, value);
+        specs.motion.noiseFloor = value;
+    } else if (flag == "--motion-adapt") {
+        valid = parseNumberOption(flag, text, 1, 8, value);
+        specs.motion.adaptShift = value;
+    } else if (flag == "--motion-background") {
+        valid = text == "previous" || text == "average";
+        if (!valid)
+            std::cout << "Invalid value " << text << " for " << flag
+                      << " (expected previous or average)" << std::endl;
+        specs.motion.background = text == "average"
+                                  ? MotionBackground::Average
+                                  : MotionBackground::PreviousFrame;
+    } else if (flag == "--iterations") {
+        valid = parseNumberOption(flag, text, 0, 1e9, value);
+        specs.approximation.iterations = value;
+    } else if (flag == "--time-budget") {
+        valid = parseNumberOption(flag, text, 0, 1e6, value);
+        specs.approximation.timeBudget = value;
+    } else if (flag == "--seed") {
+        valid = parseNumberOption(flag, text, 0, 0xffffffffu, value);
+        specs.approximation.seed = value;
+    } else if (flag == "--approximate-tile") {
+        valid = parseNumberOption(flag, text, 16, 1e5, value);
+        specs.approximation.tileSize = value;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+/*
+    Option parsing shared by the headless modes (BatchMode.h, LiveMode.h,
+    MultiStreamMode.h, DaemonMode.h) and the load test client.
+*/
+
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include "Manipulations.h"
+#include <string>
+
+/* Parses text as a number between lower and upper (inclusive), returns
+   false and prints the expected range if it isn't one */
+bool parseNumberOption(const std::string &flag, const std::string &text,
+                       double lower, double upper, double &value);
+
+/* Parses text as a WxH size, each between 1 and upper, returns false and
+   prints what's expected if it isn't one */
+bool parseSizeOption(const std::string &flag, const std::string &text,
+                     int upper, int &width, int &height);
+
+/* Handles the manipulation specification options (--threshold,
+   --brightness, --red, --green and --blue, with the menu's ranges, and
+   --motion-threshold, --motion-noise, --motion-background and
+   --motion-adapt, see MotionEngine.h, and --iterations, --time-budget,
+   --seed and --approximate-tile, see ApproximateEngine.h). The thresholds
+   also take auto (AutoThreshold.h).
+   Returns false if flag isn't one of them, otherwise sets valid to whether
+   its value was */
+bool parseSpecsOption(const std::string &flag, const std::string &text,
+                      ManipulationSpecs &specs, bool &valid);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+    Daemon mode (see DaemonMode.h).
+*/
+
+#include "DaemonMode.h"
+#include "CommandLine.h"
+#include "FrameServer.h"
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#ifdef __linux__
+
+/* The running daemon, for the signal handler */
+static FrameServer *runningServer = nullptr;
+
+static void stopServer(int) {
+    if (runningServer)
+        runningServer->stop();
+}
+
+#endif
+
+
+static void printDaemonUsage() {
+    std::cout << std::endl << "Usage: image_manipulation --daemon <socket> "
+              << "[--threads N] [--max-clients N]" << std::endl
+              << "    [--max-slots N] [--max-frame WxH]" << std::endl;
+}
+
+
+int runDaemonMode(int argc, char **argv) {
+#ifdef __linux__
+    if (argc < 3) {
+        printDaemonUsage();
+        return -1;
+    }
+    FrameServerOptions options;
+    options.socketPath = argv[2];
+    double value;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            printDaemonUsage();
+            return -1;
+        }
+        std::string text = argv[++i];
+
+        bool valid = true;
+        if (flag == "--threads") {
+            valid = parseNumberOption(flag, text, 1, 1024, value);
+            options.threads = value;
+        } else if (flag == "--max-clients") {
+            valid = parseNumberOption(flag, text, 1, 4096, value);
+            options.maxClients = value;
+        } else if (flag == "--max-slots") {
+            valid = parseNumberOption(flag, text, 1, 256, value);
+            options.maxSlots = value;
+        } else if (flag == "--max-frame") {
+            valid = parseSizeOption(flag, text, 32768, options.maxWidth,
+                                    options.maxHeight);
+        } else {
+            std::cout << "Unknown option " << flag << std::endl;
+            valid = false;
+        }
+        if (!valid) {
+            printDaemonUsage();
+            return -1;
+        }
+    }
+
+    FrameServer server(options);
+    std::string error;
+    if (!server.listen(error)) {
+        std::cout << "Error starting the daemon: " << error << std::endl;
+        return -1;
+    }
+    runningServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    server.run();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    runningServer = nullptr;
+    return 0;
+#else
+    (void)argc;
+    (void)argv;
+    std::cout << "Daemon mode needs Linux (memfd and Unix sockets)"
+              << std::endl;
+    printDaemonUsage();
+    return -1;
+#endif
+}
@@ -0,0 +1,26 @@
+/*
+    Daemon mode: serves frame manipulations to other local processes over
+    a Unix socket, the frames going through shared memory (see
+    FrameServer.h, and FrameClient.h for the client side). Usage:
+
+    image_manipulation --daemon <socket> [--threads N] [--max-clients N]
+                       [--max-slots N] [--max-frame WxH]
+
+    e.g. --daemon /tmp/image_manipulation.sock --threads 8
+
+    --threads sets the workers every client shares (defaults to
+    IMAGE_MANIPULATION_THREADS or the number of cores), --max-clients the
+    clients connected at once, --max-slots the frames each can have in
+    flight and --max-frame the largest frame (3840x2160 by default). Runs
+    until interrupted (Ctrl+C or SIGTERM), then prints its totals. Linux
+    only.
+*/
+
+#ifndef DAEMON_MODE_H
+#define DAEMON_MODE_H
+
+/* Runs daemon mode with the program's command line, returns the exit
+   code */
+int runDaemonMode(int argc, char **argv);
+
+#endif
@@ -0,0 +1,208 @@
+/*
+    Incremental (dirty tile) processing (see DirtyTiles.h).
+*/
+
+#include "DirtyTiles.h"
+#include "BackendProfile.h"
+#include "FrameStats.h"
+#include "ParallelExecutor.h"
+#include "SobelEngine.h"
+#include <algorithm>
+#include <cstring>
+
+
+int manipulationHalo(int choice) {
+    return choice == 6 ? 1 : 0;
+}
+
+
+IncrementalManipulator::IncrementalManipulator(int tileSize, int tolerance)
+    : tileSize(std::max(tileSize, 8)), tolerance(std::max(tolerance, 0)) {}
+
+
+void IncrementalManipulator::reset() {
+    lastInput.release();
+    output.release();
+    lastChoice = -1;
+}
+
+
+/* Whether the specifications the manipulation depends on are the same */
+static bool sameSpecs(int choice, const ManipulationSpecs &a,
+                      const ManipulationSpecs &b) {
+    switch (choice) {
+        case 1:
+            return a.bwThreshold == b.bwThreshold;
+        case 3:
+            return a.brightnessConstant == b.brightnessConstant;
+        case 4:
+            return a.redMult == b.redMult && a.greenMult == b.greenMult
+                && a.blueMult == b.blueMult;
+        default:
+            return true;
+    }
+}
+
+
+/* Whether any byte of two rows differs by more than tolerance */
+static bool rowsDiffer(const uint8_t *a, const uint8_t *b, int bytes,
+                       int tolerance) {
+    if (tolerance == 0)
+        return std::memcmp(a, b, bytes) != 0;
+    int over = 0;
+    for (int i = 0; i < bytes; ++i) {
+        int difference = a[i] - b[i];
+        over |= (difference > tolerance) | (difference < -tolerance);
+    }
+    return over != 0;
+}
+
+
+double IncrementalManipulator::process(int choice, const cv::Mat &original,
+                                       cv::Mat &modified,
+                                       const ManipulationSpecs &specs) {
+    int tiles;
+    int reprocessed;
+
+    if (choice == 7 || (choice == 1 && specs.bwThreshold < 0)
+            || original.type() != CV_8UC3) {
+        // Motion detection and the automatic threshold need every frame
+        // whole
+        reset();
+        executeManipulation(choice, 2, original, modified, specs);
+        return 1;
+    }
+
+    if (lastInput.empty() || original.size() != lastInput.size()
+            || choice != lastChoice
+            || !sameSpecs(choice, specs, lastSpecs)) {
+        executeManipulation(choice, 2, original, output, specs);
+        original.copyTo(lastInput);
+        lastChoice = choice;
+        lastSpecs = specs;
+        tileCols = (original.cols + tileSize - 1) / tileSize;
+        tileRows = (original.rows + tileSize - 1) / tileSize;
+        changed.assign((size_t)tileCols * tileRows, 0);
+        dirty.assign((size_t)tileCols * tileRows, 0);
+        tiles = reprocessed = tileCols * tileRows;
+    } else {
+        StageTimer timer(FrameStage::Manipulate);
+        findDirtyTiles(original);
+        // Picked for the whole frame, like executeManipulation() does
+        const ManipulationBackend *backend
+            = selectBackend(choice, original.size(), &specs);
+
+        // Tiles run as horizontal runs of dirty tiles, a row of tiles per
+        // chunk of the pool
+        parallelForRows(tileRows, [&](int rowBegin, int rowEnd) {
+            for (int ty = rowBegin; ty < rowEnd; ++ty) {
+                const uint8_t *row = &dirty[(size_t)ty * tileCols];
+                int tx = 0;
+                while (tx < tileCols) {
+                    if (!row[tx]) {
+                        ++tx;
+                        continue;
+                    }
+                    int end = tx;
+                    while (end < tileCols && row[end])
+                        ++end;
+                    processTileRun(choice, backend, original, specs, ty, tx,
+                                   end);
+                    tx = end;
+                }
+            }
+        });
+
+        tiles = tileCols * tileRows;
+        reprocessed = std::count(dirty.begin(), dirty.end(), 1);
+    }
+
+    output.copyTo(modified);
+    frameStats().countTiles(reprocessed, tiles);
+    return (double)reprocessed / tiles;
+}
+
+
+/* Marks the tiles that changed since the last frame (copying them into
+   lastInput), then the tiles to reprocess: those plus the tiles within the
+   manipulation's halo */
+void IncrementalManipulator::findDirtyTiles(const cv::Mat &original) {
+    parallelForRows(tileRows, [&](int rowBegin, int rowEnd) {
+        for (int ty = rowBegin; ty < rowEnd; ++ty) {
+            int y0 = ty * tileSize;
+            int y1 = std::min(y0 + tileSize, original.rows);
+            for (int tx = 0; tx < tileCols; ++tx) {
+                int x0 = tx * tileSize;
+                int bytes = (std::min(x0 + tileSize, original.cols) - x0) * 3;
+                bool differs = false;
+                for (int y = y0; y < y1 && !differs; ++y) {
+                    differs = rowsDiffer(original.ptr<uint8_t>(y) + x0 * 3,
+                                         lastInput.ptr<uint8_t>(y) + x0 * 3,
+                                         bytes, tolerance);
+                }
+                if (differs) {
+                    for (int y = y0; y < y1; ++y)
+                        std::memcpy(lastInput.ptr<uint8_t>(y) + x0 * 3,
+                                    original.ptr<uint8_t>(y) + x0 * 3, bytes);
+                }
+                changed[(size_t)ty * tileCols + tx] = differs;
+            }
+        }
+    });
+
+    // A halo of up to a tile reaches the neighbouring tiles
+    int reach = manipulationHalo(lastChoice) > 0 ? 1 : 0;
+    for (int ty = 0; ty < tileRows; ++ty) {
+        for (int tx = 0; tx < tileCols; ++tx) {
+            uint8_t mark = changed[(size_t)ty * tileCols + tx];
+            for (int dy = -reach; dy <= reach && !mark; ++dy) {
+                for (int dx = -reach; dx <= reach && !mark; ++dx) {
+                    int y = ty + dy, x = tx + dx;
+                    mark = y >= 0 && y < tileRows && x >= 0 && x < tileCols
+                           && changed[(size_t)y * tileCols + x];
+                }
+            }
+            dirty[(size_t)ty * tileCols + tx] = mark;
+        }
+    }
+}
+
+
+/* Reprocesses tiles [tileBegin, tileEnd) of a row of tiles into output */
+void IncrementalManipulator::processTileRun(int choice,
+                                            const ManipulationBackend *backend,
+                                            const cv::Mat &original,
+                                            const ManipulationSpecs &specs,
+                                            int tileRow, int tileBegin,
+                                            int tileEnd) {
+    int y0 = tileRow * tileSize;
+    int y1 = std::min(y0 + tileSize, original.rows);
+    int x0 = tileBegin * tileSize;
+    int x1 = std::min(tileEnd * tileSize, original.cols);
+
+    if (manipulationHalo(choice) == 0) {
+        cv::Rect run(x0, y0, x1 - x0, y1 - y0);
+        cv::Mat source = original(run);
+        cv::Mat target = output(run);
+        manipulateRows(choice, source, target, specs, 0, run.height,
+                       backend);
+        return;
+    }
+
+    // The outline of the run's columns needs a column either side, so work
+    // on a wider run (up to the image edges) and keep the middle
+    int halo = manipulationHalo(choice);
+    int wideX0 = std::max(x0 - halo, 0);
+    int wideX1 = std::min(x1 + halo, original.cols);
+    int width = wideX1 - wideX0;
+    static thread_local std::vector<uint8_t> scratch;
+    scratch.resize((size_t)(y1 - y0) * width * 3);
+
+    sobelOutlineRows(original.ptr<uint8_t>() + wideX0 * 3, original.step,
+                     scratch.data(), width * 3, width, original.rows, y0, y1);
+    for (int y = y0; y < y1; ++y) {
+        std::memcpy(output.ptr<uint8_t>(y) + x0 * 3,
+                    &scratch[((size_t)(y - y0) * width + x0 - wideX0) * 3],
+                    (x1 - x0) * 3);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+    Incremental (dirty tile) processing for the live loop.
+
+    Frames are split into square tiles. Each tile of an incoming frame is
+    compared against the same tile of the last frame processed, and only
+    tiles that changed (by more than the tolerance in any channel) are
+    manipulated again; the rest of the output is kept from the previous
+    frame. The Sobel outline reads the pixels around each one, so the
+    tiles next to a changed tile are reprocessed too (its halo).
+
+    Comparing a clean tile reads it twice, about what a point manipulation
+    costs anyway, so this pays off on mostly static scenes for the outline
+    rather than for the point manipulations. Motion detection keeps state
+    from every frame and always runs on the whole frame.
+
+    Each frame's fraction of tiles reprocessed is added to the frame stats
+    (FrameStats.h).
+*/
+
+#ifndef DIRTY_TILES_H
+#define DIRTY_TILES_H
+
+#include "opencv2/opencv.hpp"
+#include "Manipulations.h"
+#include <cstdint>
+#include <vector>
+
+class IncrementalManipulator {
+public:
+    /* tileSize in pixels, tolerance is the channel difference still taken
+       as unchanged (0 for exact) */
+    explicit IncrementalManipulator(int tileSize = 64, int tolerance = 0);
+
+    /* Like executeManipulation(), but only reprocesses the tiles that
+       changed since the last call. Returns the fraction of tiles
+       reprocessed */
+    double process(int choice, const cv::Mat &original, cv::Mat &modified,
+                   const ManipulationSpecs &specs);
+
+    /* Forgets the last frame, so the next one is processed whole */
+    void reset();
+
+private:
+    void findDirtyTiles(const cv::Mat &original);
+    void processTileRun(int choice, const ManipulationBackend *backend,
+                        const cv::Mat &original,
+                        const ManipulationSpecs &specs, int tileRow,
+                        int tileBegin, int tileEnd);
+
+    int tileSize;
+    int tolerance;
+    int tileCols = 0, tileRows = 0;
+
+    // What the kept output was made from
+    cv::Mat lastInput;
+    cv::Mat output;
+    int lastChoice = -1;
+    ManipulationSpecs lastSpecs;
+
+    std::vector<uint8_t> changed;  // Tiles whose pixels changed
+    std::vector<uint8_t> dirty;    // Tiles to reprocess (changed plus halo)
+};
+
+/* Rows and columns around a pixel that its manipulated value depends on */
+int manipulationHalo(int choice);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+    Filter chains compiled into fused passes (see FilterChain.h).
+*/
+
+#include "FilterChain.h"
+#include "ParallelExecutor.h"
+#include "PointKernels.h"
+#include "SobelEngine.h"
+#include <algorithm>
+#include <sstream>
+
+
+/* Parses text as a number between lower and upper (inclusive) */
+static bool parseChainNumber(const std::string &text, double lower,
+                             double upper, double &value) {
+    try {
+        size_t used;
+        value = std::stod(text, &used);
+        return used == text.size() && value >= lower && value <= upper;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+
+bool parseChain(const std::string &text, std::vector<ChainStage> &stages,
+                std::string &error) {
+    stages.clear();
+    std::stringstream stream(text);
+    std::string token;
+
+    while (std::getline(stream, token, ',')) {
+        size_t colon = token.find(':');
+        std::string choiceText = token.substr(0, colon);
+        std::string specText = colon == std::string::npos
+                               ? "" : token.substr(colon + 1);
+        double value;
+        if (!parseChainNumber(choiceText, 0, 6, value)
+                || value != (int)value) {
+            error = "\"" + token + "\" is not a manipulation between 0-6";
+            return false;
+        }
+
+        ChainStage stage;
+        stage.choice = value;
+        bool valid = true;
+        switch (stage.choice) {
+            case 1:
+                valid = parseChainNumber(specText, 0, 255, value);
+                stage.specs.bwThreshold = value;
+                break;
+            case 3:
+                valid = parseChainNumber(specText, 0, 1, value);
+                stage.specs.brightnessConstant = value;
+                break;
+            case 4: {
+                // red/green/blue like the menu asks for them
+                std::stringstream mults(specText);
+                std::string mult;
+                double *targets[3] = {&stage.specs.redMult,
+                                      &stage.specs.greenMult,
+                                      &stage.specs.blueMult};
+                for (int k = 0; k < 3 && valid; ++k) {
+                    valid = std::getline(mults, mult, '/')
+                            && parseChainNumber(mult, 0, 150, value);
+                    *targets[k] = (int)value;
+                }
+                valid = valid && !std::getline(mults, mult, '/');
+                break;
+            }
+            default:
+                valid = colon == std::string::npos;
+                break;
+        }
+        if (!valid) {
+            error = "invalid specification in \"" + token + "\" (expected "
+                    "1:threshold, 3:brightness or 4:red/green/blue)";
+            return false;
+        }
+        stages.push_back(stage);
+    }
+
+    if (stages.empty()) {
+        error = "the chain is empty";
+        return false;
+    }
+    return true;
+}
+
+
+FilterChain::FilterChain(const std::vector<ChainStage> &stages) {
+    for (const ChainStage &stage : stages) {
+        if (stage.choice == 0)  // Original changes nothing
+            continue;
+
+        Op op;
+        op.choices.push_back(stage.choice);
+        op.haloAfter = 0;
+
+        if (isLutManipulation(stage.choice)) {
+            PointLut lut = makeManipulationLut(stage.choice, stage.specs);
+            if (!ops.empty() && ops.back().kind == OpKind::Lut) {
+                // Merge into the previous table
+                Op &previous = ops.back();
+                previous.lut = std::make_shared<PointLut>(
+                    composeLuts(*previous.lut, lut));
+                previous.choices.push_back(stage.choice);
+                continue;
+            }
+            op.kind = OpKind::Lut;
+            op.lut = std::make_shared<PointLut>(lut);
+        } else if (stage.choice == 2) {
+            op.kind = OpKind::Grayscale;
+        } else if (stage.choice == 5) {
+            op.kind = OpKind::Purify;
+        } else {
+            op.kind = OpKind::Outline;
+        }
+        ops.push_back(op);
+    }
+
+    int outlines = 0;
+    for (int i = ops.size() - 1; i >= 0; --i) {
+        ops[i].haloAfter = outlines;
+        if (ops[i].kind == OpKind::Outline)
+            ++outlines;
+    }
+}
+
+
+int FilterChain::halo() const {
+    if (ops.empty())
+        return 0;
+    return ops[0].haloAfter + (ops[0].kind == OpKind::Outline ? 1 : 0);
+}
+
+
+int FilterChain::passes() const {
+    int passes = 0;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        // A run of point ops is a single pass
+        if (ops[i].kind == OpKind::Outline || i == 0
+                || ops[i - 1].kind == OpKind::Outline)
+            ++passes;
+    }
+    return passes;
+}
+
+
+std::string FilterChain::describe() const {
+    std::string text;
+    for (const Op &op : ops) {
+        if (!text.empty())
+            text += " > ";
+        switch (op.kind) {
+            case OpKind::Lut:
+                text += "lut(";
+                for (size_t i = 0; i < op.choices.size(); ++i)
+                    text += (i ? "," : "") + std::to_string(op.choices[i]);
+                text += ")";
+                break;
+            case OpKind::Grayscale:
+                text += "grayscale";
+                break;
+            case OpKind::Purify:
+                text += "purify";
+                break;
+            case OpKind::Outline:
+                text += "outline";
+                break;
+        }
+    }
+    return text.empty() ? "original" : text;
+}
+
+
+void FilterChain::applyPointOp(const Op &op, const uint8_t *src, uint8_t *dst,
+                               int pixels) const {
+    switch (op.kind) {
+        case OpKind::Lut:
+            applyLutRow(*op.lut, src, dst, pixels);
+            break;
+        case OpKind::Grayscale:
+            grayscaleRow(src, dst, pixels);
+            break;
+        case OpKind::Purify:
+            purifyRow(src, dst, pixels);
+            break;
+        default:
+            break;
+    }
+}
+
+
+void FilterChain::run(const cv::Mat &original, cv::Mat &modified) const {
+    modified.create(original.size(), original.type());
+    if (ops.empty()) {
+        original.copyTo(modified);
+        return;
+    }
+    parallelForRows(original.rows, [&](int rowBegin, int rowEnd) {
+        runRows(original, modified, rowBegin, rowEnd);
+    });
+}
+
+
+void FilterChain::runRows(const cv::Mat &original, cv::Mat &modified,
+                          int rowBegin, int rowEnd) const {
+    if (ops.empty()) {
+        cv::Mat band = modified.rowRange(rowBegin, rowEnd);
+        original.rowRange(rowBegin, rowEnd).copyTo(band);
+        return;
+    }
+
+    const int width = original.cols;
+    const int height = original.rows;
+    const size_t rowBytes = (size_t)width * 3;
+
+    // Band sized scratch (ping-ponged between passes) and row sized scratch
+    // (ping-ponged between the ops of a pass), reused between calls
+    static thread_local std::vector<uint8_t> scratch[2];
+    static thread_local std::vector<uint8_t> rowScratch[2];
+    size_t scratchRows = rowEnd - rowBegin + 2 * halo();
+    for (int k = 0; k < 2; ++k) {
+        if (scratch[k].size() < scratchRows * rowBytes)
+            scratch[k].resize(scratchRows * rowBytes);
+        if (rowScratch[k].size() < rowBytes)
+            rowScratch[k].resize(rowBytes);
+    }
+
+    // The input of the current pass holds image rows [inBegin, inEnd)
+    const uint8_t *in = original.ptr<uint8_t>();
+    size_t inStep = original.step;
+    int inBegin = 0, inEnd = height;
+    int inScratch = -1;  // Which scratch holds the input (-1 for original)
+
+    size_t i = 0;
+    while (i < ops.size()) {
+        // Ops [i, last) make up this pass
+        size_t last = i + 1;
+        if (ops[i].kind != OpKind::Outline) {
+            while (last < ops.size() && ops[last].kind != OpKind::Outline)
+                ++last;
+        }
+
+        // Rows this pass outputs: the band plus the later outlines' halo
+        int halo = ops[last - 1].haloAfter;
+        int outBegin = std::max(rowBegin - halo, 0);
+        int outEnd = std::min(rowEnd + halo, height);
+
+        uint8_t *out;
+        size_t outStep;
+        int outScratch = -1;
+        if (last == ops.size()) {
+            out = modified.ptr<uint8_t>(rowBegin);
+            outStep = modified.step;
+        } else {
+            outScratch = inScratch == 0 ? 1 : 0;
+            out = scratch[outScratch].data();
+            outStep = rowBytes;
+        }
+
+        if (ops[i].kind == OpKind::Outline) {
+            // The input covers the output rows plus one each side (or up to
+            // the image edge, where the engine repeats the edge row)
+            sobelOutlineRows(in, inStep, out, outStep, width, inEnd - inBegin,
+                             outBegin - inBegin, outEnd - inBegin);
+        } else {
+            for (int r = outBegin; r < outEnd; ++r) {
+                const uint8_t *src = in + (r - inBegin) * inStep;
+                uint8_t *dst = out + (r - outBegin) * outStep;
+                for (size_t k = i; k < last; ++k) {
+                    uint8_t *target = k + 1 == last
+                                      ? dst : rowScratch[(k - i) & 1].data();
+                    applyPointOp(ops[k], src, target, width);
+                    src = target;
+                }
+            }
+        }
+
+        in = out;
+        inStep = outStep;
+        inBegin = outBegin;
+        inEnd = outEnd;
+        inScratch = outScratch;
+        i = last;
+    }
+}
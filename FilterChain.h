@@ -0,0 +1,79 @@
+/*
+    Filter chains: an ordered list of manipulations (each with its own
+    specifications) applied one after the other, for example darken, then
+    grayscale, then black and white.
+
+    A chain is compiled once into as few memory passes as possible:
+    - consecutive darken / RGB values / black and white stages compose into
+      one lookup table (LutEngine.h),
+    - consecutive point stages (those tables, grayscale, purify) run row by
+      row, each row going through every stage while it is in cache,
+    - the strobel outline needs the rows around it, so the point stages
+      before it run over the band plus that halo into a per-band scratch
+      buffer, which the outline then reads.
+    The frame is split into row bands on the thread pool (ParallelExecutor.h),
+    so no full frame intermediate is ever made.
+
+    Chains are written as comma separated menu choices, with the choice's
+    specification after a colon: 1:threshold, 3:brightness and
+    4:red/green/blue, e.g. "3:0.5,2,1:128". Approximate and motion detection
+    (7) can't be chained, nor can black and white's automatic threshold.
+*/
+
+#ifndef FILTER_CHAIN_H
+#define FILTER_CHAIN_H
+
+#include "LutEngine.h"
+#include "Manipulations.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/* One manipulation of a chain */
+struct ChainStage {
+    int choice;
+    ManipulationSpecs specs;
+};
+
+/* Parses a chain description, returns false and sets error if it's invalid */
+bool parseChain(const std::string &text, std::vector<ChainStage> &stages,
+                std::string &error);
+
+class FilterChain {
+public:
+    explicit FilterChain(const std::vector<ChainStage> &stages);
+
+    /* Applies the chain to original, storing the result in modified */
+    void run(const cv::Mat &original, cv::Mat &modified) const;
+
+    /* Applies the chain to rows [rowBegin, rowEnd) of an already allocated
+       modified, reading the rows around them from original as needed */
+    void runRows(const cv::Mat &original, cv::Mat &modified, int rowBegin,
+                 int rowEnd) const;
+
+    /* Rows above and below an output row that it depends on */
+    int halo() const;
+
+    /* Memory passes over each band after fusion */
+    int passes() const;
+
+    /* The fused passes, e.g. "lut(3,1) > outline > grayscale" */
+    std::string describe() const;
+
+private:
+    enum class OpKind { Lut, Grayscale, Purify, Outline };
+
+    struct Op {
+        OpKind kind;
+        std::shared_ptr<const PointLut> lut;
+        std::vector<int> choices;  // Stages the op came from
+        int haloAfter;             // Outline ops after this one
+    };
+
+    void applyPointOp(const Op &op, const uint8_t *src, uint8_t *dst,
+                      int pixels) const;
+
+    std::vector<Op> ops;
+};
+
+#endif
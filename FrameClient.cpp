@@ -0,0 +1,161 @@
+/*
+    Client library of the frame processing daemon (see FrameClient.h).
+*/
+
+#include "FrameClient.h"
+
+#ifdef __linux__
+
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+FrameClient::~FrameClient() {
+    close();
+}
+
+
+bool FrameClient::connect(const std::string &socketPath, int slots,
+                          cv::Size maxFrame, std::string &error) {
+    close();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof address.sun_path) {
+        error = "bad socket path " + socketPath;
+        return false;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket < 0
+            || ::connect(socket, (sockaddr *)&address, sizeof address) != 0) {
+        error = socketPath + ": " + systemError();
+        close();
+        return false;
+    }
+
+    ServiceHello hello = {};
+    hello.magic = serviceMagic;
+    hello.version = serviceVersion;
+    hello.slots = slots;
+    hello.slotBytes = (uint64_t)maxFrame.width * maxFrame.height * 3;
+    ServiceWelcome welcome;
+    int memory;
+    if (!sendAll(socket, &hello, sizeof hello)
+            || !receiveWithDescriptor(socket, &welcome, sizeof welcome,
+                                      memory)) {
+        error = "the daemon hung up";
+        close();
+        return false;
+    }
+    if (welcome.status != (int32_t)ServiceStatus::Ok || memory < 0) {
+        error = std::string("the daemon said ")
+                + serviceStatusName(welcome.status);
+        if (memory >= 0)
+            ::close(memory);
+        close();
+        return false;
+    }
+
+    ringSize = ringBytes(welcome.slots, welcome.slotBytes);
+    void *mapped = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, memory, 0);
+    ::close(memory);
+    if (mapped == MAP_FAILED) {
+        error = "mapping the ring: " + systemError();
+        close();
+        return false;
+    }
+    ring = (uint8_t *)mapped;
+    slotCount = welcome.slots;
+    slotBytes = welcome.slotBytes;
+    return true;
+}
+
+
+void FrameClient::close() {
+    if (ring)
+        munmap(ring, ringSize);
+    if (socket >= 0)
+        ::close(socket);
+    socket = -1;
+    ring = nullptr;
+    ringSize = 0;
+    slotCount = 0;
+    slotBytes = 0;
+}
+
+
+/* Throws unless a frame of size fits in slot */
+static void checkSlot(int slot, cv::Size size, int slots, uint64_t bytes) {
+    if (slot < 0 || slot >= slots || size.width < 0 || size.height < 0
+            || (uint64_t)size.width * size.height * 3 > bytes)
+        throw std::out_of_range("frame doesn't fit in the ring's slot");
+}
+
+
+cv::Mat FrameClient::input(int slot, cv::Size size) {
+    checkSlot(slot, size, slotCount, slotBytes);
+    return cv::Mat(size, CV_8UC3, slotInput(ring, slot, slotBytes));
+}
+
+
+cv::Mat FrameClient::output(int slot, cv::Size size) {
+    checkSlot(slot, size, slotCount, slotBytes);
+    return cv::Mat(size, CV_8UC3, slotOutput(ring, slot, slotBytes));
+}
+
+
+bool FrameClient::submit(uint64_t id, int slot, cv::Size size, int choice,
+                         const ManipulationSpecs &specs, std::string &error) {
+    ServiceRequest request = {};
+    request.id = id;
+    request.slot = slot;
+    request.choice = choice;
+    request.width = size.width;
+    request.height = size.height;
+    request.specs = toServiceSpecs(specs);
+    if (socket < 0 || !sendAll(socket, &request, sizeof request)) {
+        error = "the daemon hung up";
+        return false;
+    }
+    return true;
+}
+
+
+bool FrameClient::receive(ServiceReply &reply, std::string &error) {
+    if (socket < 0 || !receiveAll(socket, &reply, sizeof reply)) {
+        error = "the daemon hung up";
+        return false;
+    }
+    return true;
+}
+
+
+bool FrameClient::process(const cv::Mat &frame, cv::Mat &result, int choice,
+                          const ManipulationSpecs &specs,
+                          std::string &error) {
+    if (frame.type() != CV_8UC3) {
+        error = "the daemon takes 8 bit BGR frames";
+        return false;
+    }
+    cv::Mat slot = input(0, frame.size());
+    frame.copyTo(slot);
+    ServiceReply reply;
+    uint64_t id = nextId++;
+    if (!submit(id, 0, frame.size(), choice, specs, error)
+            || !receive(reply, error))
+        return false;
+    if (reply.id != id || reply.status != (int32_t)ServiceStatus::Ok) {
+        error = std::string("the daemon said ")
+                + serviceStatusName(reply.status);
+        return false;
+    }
+    output(0, frame.size()).copyTo(result);
+    return true;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+    Client library of the frame processing daemon (FrameServer.h, protocol
+    in FrameService.h).
+
+    connect() asks the daemon for a ring of slots big enough for frames of
+    a given size and maps it. A frame is sent by writing it into a slot's
+    input (input() wraps it in a Mat, so a frame can be captured or
+    converted straight into it), then submitting the slot. The reply says
+    when the slot's output() holds the manipulated frame. Submitting a slot
+    per frame and receiving the replies as they come keeps several frames
+    in flight, the daemon working on one while the next is being written;
+    process() is the simple one frame at a time round trip.
+
+    A client is used from one thread. Every request's slot has to be left
+    alone until its reply has been received.
+*/
+
+#ifndef FRAME_CLIENT_H
+#define FRAME_CLIENT_H
+
+#include "opencv2/opencv.hpp"
+#include "FrameService.h"
+#include <cstdint>
+#include <string>
+
+class FrameClient {
+public:
+    FrameClient() = default;
+    ~FrameClient();
+
+    FrameClient(const FrameClient &) = delete;
+    FrameClient &operator=(const FrameClient &) = delete;
+
+    /* Connects to the daemon at socketPath, asking for slots slots of frames
+       up to maxFrame. Returns false and sets error if it can't, or if the
+       daemon refuses */
+    bool connect(const std::string &socketPath, int slots, cv::Size maxFrame,
+                 std::string &error);
+
+    /* Unmaps the ring and disconnects */
+    void close();
+
+    bool connected() const { return socket >= 0; }
+    int slots() const { return slotCount; }
+
+    /* A slot's input and output as 8 bit BGR frames of size (which has to
+       fit in the slot), in the shared ring */
+    cv::Mat input(int slot, cv::Size size);
+    cv::Mat output(int slot, cv::Size size);
+
+    /* Sends a request to manipulate the frame of size in slot's input
+       (webcam menu choice 0-7, 7 being motion detection), id coming back in
+       its reply. False and sets error if the daemon is gone */
+    bool submit(uint64_t id, int slot, cv::Size size, int choice,
+                const ManipulationSpecs &specs, std::string &error);
+
+    /* Waits for the next reply, false and sets error if the daemon is
+       gone. The replies come in the order the requests were submitted */
+    bool receive(ServiceReply &reply, std::string &error);
+
+    /* Manipulates frame through slot 0 and waits for it, copying the
+       output into result. False and sets error if the daemon is gone or
+       the request failed */
+    bool process(const cv::Mat &frame, cv::Mat &result, int choice,
+                 const ManipulationSpecs &specs, std::string &error);
+
+private:
+    int socket = -1;
+    uint8_t *ring = nullptr;
+    size_t ringSize = 0;
+    int slotCount = 0;
+    uint64_t slotBytes = 0;
+    uint64_t nextId = 0;  // For process()
+};
+
+#endif
@@ -0,0 +1,300 @@
+/*
+    Frame buffer pool (see FramePool.h).
+*/
+
+#include "FramePool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static const size_t BUFFER_ALIGNMENT = 64;
+static const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+
+struct FrameLease::Buffer {
+    uint8_t *data;
+    size_t bytes;
+    bool mapped;    // mmap()ed rather than from the heap
+    bool inUse;
+    bool overflow;  // Past the pool's capacity, freed when returned
+};
+
+
+FrameLease::FrameLease(FrameLease &&other) noexcept {
+    *this = std::move(other);
+}
+
+
+FrameLease &FrameLease::operator=(FrameLease &&other) noexcept {
+    if (this != &other) {
+        reset();
+        pool = other.pool;
+        buffer = other.buffer;
+        other.pool = nullptr;
+        other.buffer = nullptr;
+    }
+    return *this;
+}
+
+
+void FrameLease::reset() {
+    if (buffer)
+        pool->release(buffer);
+    pool = nullptr;
+    buffer = nullptr;
+}
+
+
+uint8_t *FrameLease::data() const {
+    return buffer ? buffer->data : nullptr;
+}
+
+
+size_t FrameLease::size() const {
+    return buffer ? buffer->bytes : 0;
+}
+
+
+FramePool::FramePool(int capacity, bool hugePages)
+    : maxBuffers(std::max(capacity, 1)), huge(hugePages) {
+    owned.reserve(maxBuffers);
+}
+
+
+FramePool::~FramePool() {
+    for (FrameLease::Buffer *buffer : owned)
+        destroy(buffer);
+}
+
+
+FrameLease FramePool::acquire(size_t bytes) {
+    FrameLease lease;
+    lease.pool = this;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The smallest free buffer that fits, or the largest one to replace
+    FrameLease::Buffer *fits = nullptr;
+    FrameLease::Buffer *largest = nullptr;
+    for (FrameLease::Buffer *buffer : owned) {
+        if (buffer->inUse)
+            continue;
+        if (buffer->bytes >= bytes && (!fits || buffer->bytes < fits->bytes))
+            fits = buffer;
+        if (!largest || buffer->bytes > largest->bytes)
+            largest = buffer;
+    }
+
+    if (fits) {
+        ++reuseCount;
+        lease.buffer = fits;
+    } else if ((int)owned.size() < maxBuffers) {
+        lease.buffer = allocate(bytes);
+        owned.push_back(lease.buffer);
+    } else if (largest) {  // Too small for the frames now, replaced
+        FrameLease::Buffer *replacement = allocate(bytes);
+        std::replace(owned.begin(), owned.end(), largest, replacement);
+        destroy(largest);
+        lease.buffer = replacement;
+    } else {
+        ++overflowCount;
+        lease.buffer = allocate(bytes);
+        lease.buffer->overflow = true;
+    }
+    lease.buffer->inUse = true;
+    return lease;
+}
+
+
+cv::Mat FramePool::acquireImage(cv::Size size, int type, FrameLease &lease) {
+    size_t step = (size_t)size.width * CV_ELEM_SIZE(type);
+    lease = acquire(step * size.height);
+    return cv::Mat(size, type, lease.data(), step);
+}
+
+
+bool FramePool::holds(const FrameLease &lease, const cv::Mat &image) {
+    if (lease.empty() || image.empty())
+        return false;
+    const uint8_t *begin = image.ptr<uint8_t>(0);
+    const uint8_t *end = image.ptr<uint8_t>(image.rows - 1)
+                         + image.cols * image.elemSize();
+    return begin >= lease.data() && end <= lease.data() + lease.size();
+}
+
+
+void FramePool::countUnpooled() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++unpooledCount;
+}
+
+
+void FramePool::release(FrameLease::Buffer *buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer->inUse = false;
+    if (buffer->overflow)
+        destroy(buffer);
+}
+
+
+/* A new buffer of at least bytes, zeroed so rows' padding is defined.
+   Called with the lock held */
+FrameLease::Buffer *FramePool::allocate(size_t bytes) {
+    ++allocationCount;
+    FrameLease::Buffer *buffer = new FrameLease::Buffer();
+    buffer->bytes = std::max<size_t>(bytes, 1);
+#ifdef __linux__
+    if (huge) {
+        size_t mapped = (buffer->bytes + HUGE_PAGE_BYTES - 1)
+                        / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+        void *data = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data == MAP_FAILED) {
+            // No huge pages set aside, ask for transparent ones
+            data = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data != MAP_FAILED)
+                madvise(data, mapped, MADV_HUGEPAGE);
+        }
+        if (data != MAP_FAILED) {  // Zeroed by the kernel
+            buffer->data = (uint8_t *)data;
+            buffer->bytes = mapped;
+            buffer->mapped = true;
+            return buffer;
+        }
+    }
+#endif
+    size_t rounded = (buffer->bytes + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT
+                     * BUFFER_ALIGNMENT;
+    buffer->data = (uint8_t *)std::aligned_alloc(BUFFER_ALIGNMENT, rounded);
+    if (!buffer->data) {
+        delete buffer;
+        throw std::bad_alloc();
+    }
+    std::memset(buffer->data, 0, rounded);
+    buffer->bytes = rounded;
+    return buffer;
+}
+
+
+/* Called with the lock held (or from the destructor) */
+void FramePool::destroy(FrameLease::Buffer *buffer) {
+#ifdef __linux__
+    if (buffer->mapped) {
+        munmap(buffer->data, buffer->bytes);
+        delete buffer;
+        return;
+    }
+#endif
+    std::free(buffer->data);
+    delete buffer;
+}
+
+
+int FramePool::buffers() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return owned.size();
+}
+
+
+size_t FramePool::bytesReserved() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (const FrameLease::Buffer *buffer : owned)
+        bytes += buffer->bytes;
+    return bytes;
+}
+
+
+uint64_t FramePool::allocations() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocationCount;
+}
+
+
+uint64_t FramePool::reuses() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return reuseCount;
+}
+
+
+uint64_t FramePool::overflows() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return overflowCount;
+}
+
+
+uint64_t FramePool::unpooled() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return unpooledCount;
+}
+
+
+std::string FramePool::describe() {
+    std::ostringstream text;
+    text << buffers() << " buffers (" << std::fixed << std::setprecision(1)
+         << bytesReserved() / 1048576.0 << " MB" << (huge ? ", huge pages" : "")
+         << "), " << allocations() << " allocations, " << reuses()
+         << " reuses, " << overflows() << " overflows, " << unpooled()
+         << " unpooled frames";
+    return text.str();
+}
+
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag MatAccessFlag;
+#else
+typedef int MatAccessFlag;
+#endif
+
+/* Counts the buffers and hands them to the allocator it stands in for,
+   which the buffers then belong to (UMatData::currAllocator), so they can
+   outlive the counter */
+class MatAllocationCounter::Allocator : public cv::MatAllocator {
+public:
+    explicit Allocator(cv::MatAllocator *inner) : inner(inner) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                           size_t *step, MatAccessFlag flags,
+                           cv::UMatUsageFlags usage) const override {
+        if (!data)  // Not wrapping the caller's memory
+            count.fetch_add(1, std::memory_order_relaxed);
+        return inner->allocate(dims, sizes, type, data, step, flags, usage);
+    }
+
+    bool allocate(cv::UMatData *data, MatAccessFlag flags,
+                  cv::UMatUsageFlags usage) const override {
+        return inner->allocate(data, flags, usage);
+    }
+
+    void deallocate(cv::UMatData *data) const override {
+        inner->deallocate(data);
+    }
+
+    cv::MatAllocator *inner;
+    mutable std::atomic<uint64_t> count{0};
+};
+
+
+MatAllocationCounter::MatAllocationCounter()
+    : previous(cv::Mat::getDefaultAllocator()) {
+    allocator.reset(new Allocator(previous));
+    cv::Mat::setDefaultAllocator(allocator.get());
+}
+
+
+MatAllocationCounter::~MatAllocationCounter() {
+    cv::Mat::setDefaultAllocator(previous);
+}
+
+
+uint64_t MatAllocationCounter::allocations() const {
+    return allocator->count.load(std::memory_order_relaxed);
+}
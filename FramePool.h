@@ -0,0 +1,138 @@
+/*
+    Frame buffer pool for the live loop.
+
+    Every frame buffer the pipeline stages use (the captured frame, the
+    manipulated frame, planar frames, the frames scaled by the adaptive
+    resolution) is checked out of a FramePool and goes back to it when the
+    frame is dropped, so once the buffers exist no frame allocates.
+
+    The pool owns at most `capacity` buffers, each aligned to 64 bytes (2 MB
+    pages when huge pages are asked for: MAP_HUGETLB if the system has huge
+    pages set aside, transparent huge pages otherwise). A checkout takes the
+    smallest free buffer that is large enough, replacing a free buffer that
+    is too small (after a resolution change) or adding one while under
+    capacity. Past capacity it falls back to a one-off buffer, counted as an
+    overflow.
+
+    The counts (buffers allocated, checkouts served by reuse, overflows and
+    frames a stage put in a buffer of its own, unpooled) are printed after
+    the run, along with the images OpenCV allocated per frame, counted by a
+    MatAllocationCounter for the length of the run. Those are the cv::Mat
+    buffers made outside the pool: Mat::create() reallocations, cv::resize()
+    temporaries, decoded frames. Other heap allocations aren't counted.
+*/
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include "opencv2/opencv.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FramePool;
+
+/* A checked out buffer, returned to its pool when the lease is dropped */
+class FrameLease {
+public:
+    FrameLease() = default;
+    ~FrameLease() { reset(); }
+
+    FrameLease(FrameLease &&other) noexcept;
+    FrameLease &operator=(FrameLease &&other) noexcept;
+    FrameLease(const FrameLease &) = delete;
+    FrameLease &operator=(const FrameLease &) = delete;
+
+    /* Returns the buffer */
+    void reset();
+
+    bool empty() const { return buffer == nullptr; }
+    uint8_t *data() const;
+    size_t size() const;
+
+private:
+    friend class FramePool;
+    struct Buffer;
+
+    FramePool *pool = nullptr;
+    Buffer *buffer = nullptr;
+};
+
+class FramePool {
+public:
+    FramePool(int capacity, bool hugePages = false);
+
+    /* Every lease has to be returned first */
+    ~FramePool();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    /* Checks out a buffer of at least bytes */
+    FrameLease acquire(size_t bytes);
+
+    /* Checks out a buffer for an image of size and type, returning the
+       image on it (continuous rows) */
+    cv::Mat acquireImage(cv::Size size, int type, FrameLease &lease);
+
+    /* Whether image's pixels are in lease's buffer */
+    static bool holds(const FrameLease &lease, const cv::Mat &image);
+
+    /* Counts a frame a stage didn't keep in its pooled buffer */
+    void countUnpooled();
+
+    int capacity() const { return maxBuffers; }
+    bool hugePages() const { return huge; }
+    int buffers();
+    size_t bytesReserved();
+    uint64_t allocations();
+    uint64_t reuses();
+    uint64_t overflows();
+    uint64_t unpooled();
+
+    /* The counts in a line, e.g. "12 buffers (37.3 MB), 12 allocations,
+       1188 reuses, 0 overflows, 1 unpooled frames" */
+    std::string describe();
+
+private:
+    friend class FrameLease;
+
+    void release(FrameLease::Buffer *buffer);
+    FrameLease::Buffer *allocate(size_t bytes);
+    void destroy(FrameLease::Buffer *buffer);
+
+    std::mutex mutex;
+    int maxBuffers;
+    bool huge;
+    std::vector<FrameLease::Buffer *> owned;  // Reserved for capacity
+    uint64_t allocationCount = 0;
+    uint64_t reuseCount = 0;
+    uint64_t overflowCount = 0;
+    uint64_t unpooledCount = 0;
+};
+
+/* Counts the cv::Mat buffers OpenCV allocates while it exists, by
+   standing in as OpenCV's default allocator on top of the one that was
+   (Mat::setDefaultAllocator()). Make it before the threads whose
+   allocations it counts and drop it after they're done */
+class MatAllocationCounter {
+public:
+    MatAllocationCounter();
+    ~MatAllocationCounter();
+
+    MatAllocationCounter(const MatAllocationCounter &) = delete;
+    MatAllocationCounter &operator=(const MatAllocationCounter &) = delete;
+
+    /* Buffers allocated so far */
+    uint64_t allocations() const;
+
+private:
+    class Allocator;
+    std::unique_ptr<Allocator> allocator;
+    cv::MatAllocator *previous;
+};
+
+#endif
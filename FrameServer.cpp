@@ -0,0 +1,506 @@
+/*
+    The frame processing daemon (see FrameServer.h).
+*/
+
+#include "FrameServer.h"
+
+#ifdef __linux__
+
+#include "Manipulations.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+/* How long a worker waits for a client to take its reply before dropping
+   it, so a client that stopped reading can't hold a worker */
+static const int replyTimeoutMs = 1000;
+
+/* How often the I/O thread looks for dropped clients it can unmap */
+static const int pollIntervalMs = 100;
+
+
+struct FrameServer::Request {
+    ServiceRequest message;
+    StatsClock::time_point received;
+};
+
+
+/* A connected client. The I/O thread owns it and alone reads its socket.
+   Its requests run one at a time (the client is queued once at most), so
+   the state and stats need no lock */
+struct FrameServer::Client {
+    ~Client() {
+        if (ring)
+            munmap(ring, ringSize);
+        close(socket);
+    }
+
+    FrameServer *server = nullptr;
+    int socket = -1;
+    uint64_t number = 0;
+    std::vector<char> inbox;  // Bytes of the next messages, not whole yet
+    bool welcomed = false;
+    uint8_t *ring = nullptr;
+    size_t ringSize = 0;
+    uint32_t slots = 0;
+    uint64_t slotBytes = 0;
+
+    std::mutex mutex;  // Guards pending, queued and closed
+    std::deque<Request> pending;
+    bool queued = false;
+    bool closed = false;
+
+    ManipulationState state;
+    uint64_t requests = 0;
+    LatencyHistogram latency;
+};
+
+
+static bool setNonBlocking(int descriptor) {
+    int flags = fcntl(descriptor, F_GETFL);
+    return flags >= 0 && fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+
+static double milliseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+
+FrameServer::FrameServer(const FrameServerOptions &options)
+    : options(options),
+      workers(options.threads > 0 ? options.threads : executorThreads()) {}
+
+
+FrameServer::~FrameServer() {
+    // Every client has to be off the pool before it's freed
+    for (std::unique_ptr<Client> &client : clients)
+        drop(*client);
+    while (!clients.empty()) {
+        for (size_t i = 0; i < clients.size();) {
+            if (reap(clients[i]))
+                clients.erase(clients.begin() + i);
+            else
+                ++i;
+        }
+        if (!clients.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (listener >= 0) {
+        close(listener);
+        unlink(options.socketPath.c_str());
+    }
+    for (int descriptor : wakePipe) {
+        if (descriptor >= 0)
+            close(descriptor);
+    }
+}
+
+
+bool FrameServer::listen(std::string &error) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.empty()
+            || options.socketPath.size() >= sizeof address.sun_path) {
+        error = "socket path has to be 1 to "
+                + std::to_string(sizeof address.sun_path - 1) + " bytes";
+        return false;
+    }
+    std::strcpy(address.sun_path, options.socketPath.c_str());
+
+    int descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (descriptor < 0) {
+        error = "socket: " + systemError();
+        return false;
+    }
+    if (access(address.sun_path, F_OK) == 0) {
+        // Left by a daemon that died, unless one answers on it
+        if (connect(descriptor, (sockaddr *)&address, sizeof address) == 0) {
+            close(descriptor);
+            error = options.socketPath + " is in use by another daemon";
+            return false;
+        }
+        unlink(address.sun_path);
+    }
+    if (bind(descriptor, (sockaddr *)&address, sizeof address) != 0
+            || ::listen(descriptor, 64) != 0 || !setNonBlocking(descriptor)) {
+        error = options.socketPath + ": " + systemError();
+        close(descriptor);
+        return false;
+    }
+    listener = descriptor;
+
+    if (pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        error = "pipe: " + systemError();
+        return false;
+    }
+    return true;
+}
+
+
+void FrameServer::stop() {
+    stopping = true;
+    if (wakePipe[1] >= 0) {
+        char byte = 0;
+        ssize_t written = write(wakePipe[1], &byte, 1);
+        (void)written;  // Full means a wake up is already on its way
+    }
+}
+
+
+void FrameServer::run() {
+    StatsClock::time_point began = StatsClock::now();
+    std::cout << "Serving on " << options.socketPath << " with "
+              << workers.threadCount() << " workers" << std::endl;
+
+    std::vector<pollfd> polled;
+    std::vector<Client *> polledClients;
+    while (!stopping) {
+        polled.assign({{wakePipe[0], POLLIN, 0}, {listener, POLLIN, 0}});
+        polledClients.clear();
+        for (std::unique_ptr<Client> &client : clients) {
+            std::lock_guard<std::mutex> lock(client->mutex);
+            if (!client->closed) {
+                polled.push_back({client->socket, POLLIN, 0});
+                polledClients.push_back(client.get());
+            }
+        }
+        if (poll(polled.data(), polled.size(), pollIntervalMs) < 0
+                && errno != EINTR) {
+            std::cout << "poll: " << systemError() << std::endl;
+            break;
+        }
+
+        if (polled[0].revents) {
+            char bytes[64];
+            while (read(wakePipe[0], bytes, sizeof bytes) > 0) {}
+        }
+        for (size_t i = 0; i < polledClients.size(); ++i) {
+            if (polled[i + 2].revents && !receive(*polledClients[i]))
+                drop(*polledClients[i]);
+        }
+        for (size_t i = 0; i < clients.size();) {
+            if (reap(clients[i]))
+                clients.erase(clients.begin() + i);
+            else
+                ++i;
+        }
+        if (polled[1].revents)
+            accept();
+    }
+
+    for (std::unique_ptr<Client> &client : clients)
+        drop(*client);
+    printReport(began);
+}
+
+
+void FrameServer::accept() {
+    int descriptor;
+    while ((descriptor = accept4(listener, nullptr, nullptr,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        clients.emplace_back(new Client);
+        clients.back()->server = this;
+        clients.back()->socket = descriptor;
+        clients.back()->number = nextClient++;
+    }
+}
+
+
+/* Takes in what the client sent, returns false if it left or broke the
+   protocol */
+bool FrameServer::receive(Client &client) {
+    char bytes[16384];
+    ssize_t received;
+    while ((received = recv(client.socket, bytes, sizeof bytes, 0)) > 0)
+        client.inbox.insert(client.inbox.end(), bytes, bytes + received);
+    bool open = received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+                                 || errno == EINTR);
+
+    size_t used = 0;
+    while (true) {
+        size_t size = client.welcomed ? sizeof(ServiceRequest)
+                                      : sizeof(ServiceHello);
+        if (client.inbox.size() - used < size)
+            break;
+        if (client.welcomed) {
+            ServiceRequest message;
+            std::memcpy(&message, client.inbox.data() + used, size);
+            size_t waiting;
+            {
+                std::lock_guard<std::mutex> lock(client.mutex);
+                waiting = client.pending.size();
+            }
+            if (waiting >= client.slots) {
+                // More requests than slots, it isn't waiting for replies
+                std::cout << "Client " << client.number
+                          << " sent more requests than it has slots"
+                          << std::endl;
+                return false;
+            }
+            enqueue(client, message);
+        } else {
+            ServiceHello hello;
+            std::memcpy(&hello, client.inbox.data() + used, size);
+            if (!welcome(client, hello))
+                return false;
+        }
+        used += size;
+    }
+    client.inbox.erase(client.inbox.begin(), client.inbox.begin() + used);
+    return open;
+}
+
+
+/* Answers a client's hello, mapping its ring. Returns false if it's
+   refused */
+bool FrameServer::welcome(Client &client, const ServiceHello &hello) {
+    if (hello.magic != serviceMagic || hello.version != serviceVersion) {
+        std::cout << "Client " << client.number
+                  << " doesn't speak this protocol version" << std::endl;
+        return false;
+    }
+
+    ServiceWelcome answer = {};
+    answer.status = (int32_t)ServiceStatus::Refused;
+    size_t welcomed = 0;
+    for (std::unique_ptr<Client> &other : clients)
+        welcomed += other->welcomed;
+    uint64_t maxBytes = (uint64_t)options.maxWidth * options.maxHeight * 3;
+    if (welcomed >= (size_t)options.maxClients || hello.slots < 1
+            || hello.slots > (uint32_t)options.maxSlots
+            || hello.slotBytes < 1 || hello.slotBytes > maxBytes) {
+        std::cout << "Client " << client.number << " refused ("
+                  << hello.slots << " slots of " << hello.slotBytes
+                  << " bytes, " << welcomed << " clients)" << std::endl;
+        sendAll(client.socket, &answer, sizeof answer, replyTimeoutMs);
+        return false;
+    }
+
+    // Page aligned slots, so no two frames share a page
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t slotBytes = (hello.slotBytes + page - 1) / page * page;
+    size_t size = ringBytes(hello.slots, slotBytes);
+    int memory = createSharedMemory(size, "image_manipulation_ring");
+    void *ring = memory < 0 ? MAP_FAILED
+                 : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        memory, 0);
+    if (ring == MAP_FAILED) {
+        std::cout << "Client " << client.number << ": no ring of " << size
+                  << " bytes (" << systemError() << ")" << std::endl;
+        if (memory >= 0)
+            close(memory);
+        sendAll(client.socket, &answer, sizeof answer, replyTimeoutMs);
+        return false;
+    }
+    client.ring = (uint8_t *)ring;
+    client.ringSize = size;
+    client.slots = hello.slots;
+    client.slotBytes = slotBytes;
+
+    answer.status = (int32_t)ServiceStatus::Ok;
+    answer.slots = client.slots;
+    answer.slotBytes = client.slotBytes;
+    bool sent = sendWithDescriptor(client.socket, &answer, sizeof answer,
+                                   memory);
+    close(memory);  // The mappings keep it
+    if (!sent)
+        return false;
+    client.welcomed = true;
+    ++served;
+    std::cout << "Client " << client.number << " connected: " << client.slots
+              << " slots of " << client.slotBytes << " bytes" << std::endl;
+    return true;
+}
+
+
+void FrameServer::enqueue(Client &client, const ServiceRequest &message) {
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(client.mutex);
+        client.pending.push_back({message, StatsClock::now()});
+        schedule = !client.queued;
+        client.queued = true;
+    }
+    if (schedule)
+        this->schedule(client);
+}
+
+
+/* Stops taking the client's requests and forgets those queued */
+void FrameServer::drop(Client &client) {
+    std::lock_guard<std::mutex> lock(client.mutex);
+    client.closed = true;
+    client.pending.clear();
+}
+
+
+/* Frees a dropped client once no worker has it, returns whether it did */
+bool FrameServer::reap(std::unique_ptr<Client> &client) {
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        if (!client->closed || client->queued)
+            return false;
+    }
+    if (client->welcomed) {
+        HistogramSnapshot latency = client->latency.snapshot();
+        std::cout << "Client " << client->number << " left after "
+                  << client->requests << " requests, latency p50/p99/max "
+                  << std::fixed << std::setprecision(2)
+                  << milliseconds(latency.percentile(0.5)) << "/"
+                  << milliseconds(latency.percentile(0.99)) << "/"
+                  << milliseconds(latency.max) << " ms" << std::defaultfloat
+                  << std::endl;
+    }
+    client.reset();
+    return true;
+}
+
+
+void FrameServer::schedule(Client &client) {
+    PoolTask task;
+    task.run = runClient;
+    task.context = &client;
+    workers.submit(task);
+}
+
+
+void FrameServer::runClient(void *context, int, int) {
+    Client &client = *(Client *)context;
+    client.server->process(client);
+}
+
+
+/* The client's turn on a worker: runs its oldest request, replies, then
+   queues it again behind the other clients if it sent more */
+void FrameServer::process(Client &client) {
+    Request request;
+    bool popped;
+    {
+        std::lock_guard<std::mutex> lock(client.mutex);
+        popped = !client.closed && !client.pending.empty();
+        if (popped) {
+            request = client.pending.front();
+            client.pending.pop_front();
+        }
+    }
+
+    if (popped) {
+        ServiceReply reply = serve(client, request);
+        bool sent = sendAll(client.socket, &reply, sizeof reply,
+                            replyTimeoutMs);
+        StatsClock::time_point replied = StatsClock::now();
+        latency.record(request.received, replied);
+        client.latency.record(request.received, replied);
+        ++client.requests;
+        if (!sent) {
+            drop(client);
+            shutdown(client.socket, SHUT_RDWR);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(client.mutex);
+        if (client.closed || client.pending.empty()) {
+            client.queued = false;  // The I/O thread may free it from here
+            return;
+        }
+    }
+    schedule(client);
+}
+
+
+/* Manipulates a request's frame in place in the client's ring */
+ServiceReply FrameServer::serve(Client &client, const Request &request) {
+    const ServiceRequest &message = request.message;
+    ServiceReply reply = {};
+    reply.id = message.id;
+    reply.slot = message.slot;
+
+    uint64_t bytes = (uint64_t)message.width * message.height * 3;
+    if (message.slot >= client.slots || message.width < 1
+            || message.height < 1 || message.width > options.maxWidth
+            || message.height > options.maxHeight || bytes > client.slotBytes
+            || message.choice < 0 || message.choice > 7
+            || !validServiceSpecs(message.specs)) {
+        reply.status = (int32_t)ServiceStatus::BadRequest;
+        ++rejected;
+        return reply;
+    }
+
+    cv::Mat original(message.height, message.width, CV_8UC3,
+                     slotInput(client.ring, message.slot, client.slotBytes));
+    cv::Mat modified(message.height, message.width, CV_8UC3,
+                     slotOutput(client.ring, message.slot, client.slotBytes));
+    ManipulationSpecs specs = fromServiceSpecs(message.specs);
+    StatsClock::time_point start = StatsClock::now();
+    try {
+        executeManipulation(message.choice, 2, original, modified, specs,
+                            client.state);
+        reply.status = (int32_t)ServiceStatus::Ok;
+    } catch (const std::exception &error) {
+        std::cout << "Client " << client.number << ": " << error.what()
+                  << std::endl;
+        reply.status = (int32_t)ServiceStatus::Failed;
+    }
+    StatsClock::time_point end = StatsClock::now();
+
+    reply.queuedNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        start - request.received).count();
+    reply.processNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+    queued.record(reply.queuedNanos);
+    manipulate.record(reply.processNanos);
+    ++requests;
+    pixels += (uint64_t)message.width * message.height;
+    return reply;
+}
+
+
+void FrameServer::printReport(StatsClock::time_point began) {
+    double seconds = std::chrono::duration<double>(StatsClock::now()
+                                                   - began).count();
+    HistogramSnapshot waits = queued.snapshot();
+    HistogramSnapshot runs = manipulate.snapshot();
+    HistogramSnapshot replies = latency.snapshot();
+    std::cout << std::endl << "Served " << served << " clients, "
+              << requests << " requests (" << rejected << " rejected) in "
+              << std::fixed << std::setprecision(2) << seconds << " s"
+              << std::endl
+              << "Requests/sec: " << (seconds > 0 ? requests / seconds : 0)
+              << ", megapixels/sec: "
+              << (seconds > 0 ? pixels / seconds / 1e6 : 0) << std::endl
+              << "Queued p50/p99/max ms: "
+              << milliseconds(waits.percentile(0.5)) << "/"
+              << milliseconds(waits.percentile(0.99)) << "/"
+              << milliseconds(waits.max) << std::endl
+              << "Manipulate p50/p99/max ms: "
+              << milliseconds(runs.percentile(0.5)) << "/"
+              << milliseconds(runs.percentile(0.99)) << "/"
+              << milliseconds(runs.max) << std::endl
+              << "Received to replied p50/p99/max ms: "
+              << milliseconds(replies.percentile(0.5)) << "/"
+              << milliseconds(replies.percentile(0.99)) << "/"
+              << milliseconds(replies.max) << std::endl;
+    uint64_t stolen = workers.stolenChunks();
+    uint64_t chunks = stolen + workers.ownChunks();
+    std::cout << "Row chunks stolen: " << stolen << " of " << chunks;
+    if (chunks > 0)
+        std::cout << " (" << 100.0 * stolen / chunks << "%)";
+    std::cout << std::defaultfloat << std::endl;
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+    The frame processing daemon: a long running process that other local
+    processes send frames to be manipulated, over the protocol in
+    FrameService.h, instead of each loading the manipulations and starting
+    its own thread pool.
+
+    One I/O thread polls the listening Unix socket and the clients, takes
+    their hellos (mapping each a ring of frame slots in shared memory) and
+    requests, and queues each request on its client. Clients are then
+    scheduled on one shared WorkStealingPool like multi-stream mode's
+    streams (StreamScheduler.h): a client is queued at most once, a worker
+    runs one of its requests per turn, its rows split into chunks that idle
+    workers steal, and the client goes to the back of the queue if it has
+    more. A client sending many frames can't starve the others, and each
+    client has its own ManipulationState, so its motion detection follows
+    its own frames. The worker replies on the client's socket itself.
+
+    A client that goes away (or breaks the protocol) is dropped with its
+    requests still queued, its ring unmapped once no worker has it. Each
+    request's time queued and manipulating are sent back in its reply and
+    kept in the daemon's histograms, which it prints per client as they
+    leave and in total when stopped.
+*/
+
+#ifndef FRAME_SERVER_H
+#define FRAME_SERVER_H
+
+#include "FrameService.h"
+#include "FrameStats.h"
+#include "ParallelExecutor.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FrameServerOptions {
+    std::string socketPath;
+    int threads = 0;      // Workers, 0 for the executor's thread count
+    int maxClients = 64;  // Connected at once
+    int maxSlots = 16;    // Per client
+    int maxWidth = 3840, maxHeight = 2160;  // Of a frame
+};
+
+class FrameServer {
+public:
+    explicit FrameServer(const FrameServerOptions &options);
+
+    /* Drops the clients, removes the socket */
+    ~FrameServer();
+
+    FrameServer(const FrameServer &) = delete;
+    FrameServer &operator=(const FrameServer &) = delete;
+
+    /* Creates the socket, removing a stale one left by a daemon that died.
+       Returns false and sets error if it can't, or if a daemon is already
+       listening on it */
+    bool listen(std::string &error);
+
+    /* Serves clients until stop() is called, then prints the totals */
+    void run();
+
+    /* Makes run() return, from any thread or a signal handler */
+    void stop();
+
+private:
+    struct Request;
+    struct Client;
+
+    void accept();
+    bool receive(Client &client);
+    bool welcome(Client &client, const ServiceHello &hello);
+    void enqueue(Client &client, const ServiceRequest &message);
+    void drop(Client &client);
+    bool reap(std::unique_ptr<Client> &client);
+    void schedule(Client &client);
+    static void runClient(void *context, int begin, int end);
+    void process(Client &client);
+    ServiceReply serve(Client &client, const Request &request);
+    void printReport(StatsClock::time_point began);
+
+    FrameServerOptions options;
+    WorkStealingPool workers;
+    int listener = -1;
+    int wakePipe[2] = {-1, -1};  // stop() writes to it to wake the poll
+    std::atomic<bool> stopping{false};
+    std::vector<std::unique_ptr<Client>> clients;  // The I/O thread's
+    uint64_t nextClient = 0;
+    uint64_t served = 0;  // Clients welcomed
+
+    // Totals, recorded by the workers
+    LatencyHistogram queued;      // Request received to manipulation started
+    LatencyHistogram manipulate;
+    LatencyHistogram latency;     // Request received to reply sent
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> pixels{0};
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*
+    Frame processing service protocol (see FrameService.h).
+*/
+
+#include "FrameService.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+const char *serviceStatusName(int32_t status) {
+    switch ((ServiceStatus)status) {
+        case ServiceStatus::Ok:
+            return "ok";
+        case ServiceStatus::BadRequest:
+            return "bad request";
+        case ServiceStatus::Refused:
+            return "refused";
+        case ServiceStatus::Failed:
+            return "failed";
+    }
+    return "unknown status";
+}
+
+
+ServiceSpecs toServiceSpecs(const ManipulationSpecs &specs) {
+    ServiceSpecs wire;
+    std::memset(&wire, 0, sizeof wire);  // No stray bytes in the padding
+    wire.bwThreshold = specs.bwThreshold;
+    wire.brightnessConstant = specs.brightnessConstant;
+    wire.redMult = specs.redMult;
+    wire.greenMult = specs.greenMult;
+    wire.blueMult = specs.blueMult;
+    wire.motionThreshold = specs.motion.threshold;
+    wire.motionNoiseFloor = specs.motion.noiseFloor;
+    wire.motionBackground = (int32_t)specs.motion.background;
+    wire.motionAdaptShift = specs.motion.adaptShift;
+    return wire;
+}
+
+
+ManipulationSpecs fromServiceSpecs(const ServiceSpecs &wire) {
+    ManipulationSpecs specs;
+    specs.bwThreshold = wire.bwThreshold;
+    specs.brightnessConstant = wire.brightnessConstant;
+    specs.redMult = wire.redMult;
+    specs.greenMult = wire.greenMult;
+    specs.blueMult = wire.blueMult;
+    specs.motion.threshold = wire.motionThreshold;
+    specs.motion.noiseFloor = wire.motionNoiseFloor;
+    specs.motion.background = wire.motionBackground == 1
+                              ? MotionBackground::Average
+                              : MotionBackground::PreviousFrame;
+    specs.motion.adaptShift = wire.motionAdaptShift;
+    return specs;
+}
+
+
+bool validServiceSpecs(const ServiceSpecs &specs) {
+    // Written so that NaNs fail
+    return specs.bwThreshold >= -1 && specs.bwThreshold <= 255
+           && specs.brightnessConstant >= 0 && specs.brightnessConstant <= 1
+           && specs.redMult >= 0 && specs.redMult <= 150
+           && specs.greenMult >= 0 && specs.greenMult <= 150
+           && specs.blueMult >= 0 && specs.blueMult <= 150
+           && specs.motionThreshold >= -1 && specs.motionThreshold <= 765
+           && specs.motionNoiseFloor >= 0 && specs.motionNoiseFloor <= 255
+           && (specs.motionBackground == 0 || specs.motionBackground == 1)
+           && specs.motionAdaptShift >= 1 && specs.motionAdaptShift <= 8;
+}
+
+
+size_t ringBytes(uint32_t slots, uint64_t slotBytes) {
+    return (size_t)slots * 2 * slotBytes;
+}
+
+
+uint8_t *slotInput(uint8_t *ring, uint32_t slot, uint64_t slotBytes) {
+    return ring + (size_t)slot * 2 * slotBytes;
+}
+
+
+uint8_t *slotOutput(uint8_t *ring, uint32_t slot, uint64_t slotBytes) {
+    return slotInput(ring, slot, slotBytes) + slotBytes;
+}
+
+
+std::string systemError() {
+    return std::strerror(errno);
+}
+
+
+#ifdef __linux__
+
+/* Waits until socket is ready for events, false on a timeout */
+static bool waitFor(int socket, short events, int timeoutMs) {
+    pollfd entry = {socket, events, 0};
+    int ready;
+    do {
+        ready = poll(&entry, 1, timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0;
+}
+
+
+bool sendAll(int socket, const void *data, size_t size, int timeoutMs) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitFor(socket, POLLOUT, timeoutMs))
+                return false;
+            continue;
+        }
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+
+bool receiveAll(int socket, void *data, size_t size, int timeoutMs) {
+    char *bytes = (char *)data;
+    while (size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitFor(socket, POLLIN, timeoutMs))
+                return false;
+            continue;
+        }
+        if (received <= 0)  // 0 once the peer closed
+            return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+
+bool sendWithDescriptor(int socket, const void *data, size_t size,
+                        int descriptor) {
+    iovec part = {const_cast<void *>(data), size};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && (errno == EINTR
+                          || ((errno == EAGAIN || errno == EWOULDBLOCK)
+                              && waitFor(socket, POLLOUT, 1000))));
+    if (sent <= 0)
+        return false;
+    // The descriptor went with the first byte, the rest is plain data
+    return sendAll(socket, (const char *)data + sent, size - sent, 1000);
+}
+
+
+bool receiveWithDescriptor(int socket, void *data, size_t size,
+                           int &descriptor) {
+    descriptor = -1;
+    iovec part = {data, size};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0)
+        return false;
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET
+                && header->cmsg_type == SCM_RIGHTS)
+            std::memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+    }
+    return receiveAll(socket, (char *)data + received, size - received);
+}
+
+
+int createSharedMemory(size_t size, const char *name) {
+    int descriptor = memfd_create(name, MFD_CLOEXEC);
+    if (descriptor < 0)
+        return -1;
+    if (ftruncate(descriptor, size) != 0) {
+        int error = errno;
+        close(descriptor);
+        errno = error;
+        return -1;
+    }
+    return descriptor;
+}
+
+#endif
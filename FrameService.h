@@ -0,0 +1,112 @@
+/*
+    Wire protocol of the frame processing service, shared by the daemon
+    (FrameServer.h) and its client library (FrameClient.h).
+
+    A client connects to the daemon's Unix socket and says hello, asking for
+    a ring of frame slots. The daemon creates the ring in shared memory and
+    passes its file descriptor back with the welcome, and both map it. Each
+    slot holds an input and an output frame (8 bit BGR, up to the slot's
+    bytes each), so frames never go through the socket: the client writes a
+    frame into a slot's input and sends a request naming the slot, the
+    manipulation reads the input and writes the output where they are, and
+    the reply says the output is ready. A client mustn't touch a slot while
+    its request is out.
+
+    The messages are fixed size structs in the host's byte order, the
+    service being for processes on the same host. Linux only (memfd and
+    descriptor passing).
+*/
+
+#ifndef FRAME_SERVICE_H
+#define FRAME_SERVICE_H
+
+#include "Manipulations.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const uint32_t serviceMagic = 0x494d5356;  // "IMSV"
+const uint32_t serviceVersion = 1;
+
+enum class ServiceStatus : int32_t {
+    Ok,
+    BadRequest,  // Slot, size or choice out of range
+    Refused,     // Too many clients, or a ring too large
+    Failed       // The manipulation threw
+};
+
+const char *serviceStatusName(int32_t status);
+
+struct ServiceHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;      // Wanted
+    uint64_t slotBytes;  // Of each frame, input and output
+};
+
+/* Sent with the ring's descriptor when the status is Ok */
+struct ServiceWelcome {
+    int32_t status;
+    uint32_t slots;
+    uint64_t slotBytes;
+};
+
+/* The manipulation specifications that go over the wire */
+struct ServiceSpecs {
+    int32_t bwThreshold;
+    double brightnessConstant;
+    double redMult, greenMult, blueMult;
+    int32_t motionThreshold;
+    int32_t motionNoiseFloor;
+    int32_t motionBackground;  // MotionBackground
+    int32_t motionAdaptShift;
+};
+
+struct ServiceRequest {
+    uint64_t id;     // The client's, given back in the reply
+    uint32_t slot;
+    int32_t choice;  // Webcam menu choice (0-7, 7 being motion detection)
+    int32_t width;
+    int32_t height;
+    ServiceSpecs specs;
+};
+
+struct ServiceReply {
+    uint64_t id;
+    uint32_t slot;
+    int32_t status;         // ServiceStatus
+    uint64_t queuedNanos;   // Request received to manipulation started
+    uint64_t processNanos;  // Manipulating
+};
+
+ServiceSpecs toServiceSpecs(const ManipulationSpecs &specs);
+ManipulationSpecs fromServiceSpecs(const ServiceSpecs &specs);
+
+/* Whether specs are within the command line's ranges (CommandLine.h) */
+bool validServiceSpecs(const ServiceSpecs &specs);
+
+/* Bytes of a ring, and where a slot's frames are in it */
+size_t ringBytes(uint32_t slots, uint64_t slotBytes);
+uint8_t *slotInput(uint8_t *ring, uint32_t slot, uint64_t slotBytes);
+uint8_t *slotOutput(uint8_t *ring, uint32_t slot, uint64_t slotBytes);
+
+/* Sends or receives all of size bytes, retrying partial and interrupted
+   transfers, and waiting up to timeoutMs (-1 for ever) whenever a non
+   blocking socket isn't ready. False on an error or once the peer closed */
+bool sendAll(int socket, const void *data, size_t size, int timeoutMs = -1);
+bool receiveAll(int socket, void *data, size_t size, int timeoutMs = -1);
+
+/* The same with a file descriptor attached to the message */
+bool sendWithDescriptor(int socket, const void *data, size_t size,
+                        int descriptor);
+bool receiveWithDescriptor(int socket, void *data, size_t size,
+                           int &descriptor);
+
+/* Anonymous shared memory of size bytes, -1 (with errno) if it can't be
+   made */
+int createSharedMemory(size_t size, const char *name);
+
+/* The last system error, for messages */
+std::string systemError();
+
+#endif
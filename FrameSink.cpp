@@ -0,0 +1,258 @@
+/*
+    Output sinks (see FrameSink.h).
+*/
+
+#include "FrameSink.h"
+#include "FrameSource.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+VideoSink::VideoSink(const std::string &path, double fps)
+    : path(path), fps(fps) {}
+
+
+/* The codec for a video file, by its extension */
+static int videoCodec(const std::string &path) {
+    std::string extension = path.substr(std::min(path.rfind('.'),
+                                                 path.size()));
+    for (char &c : extension)
+        c = std::tolower((unsigned char)c);
+    if (extension == ".mp4" || extension == ".m4v")
+        return cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    return cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+}
+
+
+bool VideoSink::write(const cv::Mat &frame) {
+    if (!opened) {
+        size = frame.size();
+        if (!writer.open(path, videoCodec(path), fps, size, true))
+            return false;
+        opened = true;
+    }
+    if (frame.size() == size) {
+        writer.write(frame);
+    } else {
+        cv::resize(frame, resized, size);
+        writer.write(resized);
+    }
+    return true;
+}
+
+
+void VideoSink::close() {
+    writer.release();
+}
+
+
+std::string VideoSink::name() const {
+    std::ostringstream text;
+    text << "video:" << path << " (" << fps << " fps)";
+    return text.str();
+}
+
+
+ImageSequenceSink::ImageSequenceSink(const std::string &pattern)
+    : pattern(pattern) {}
+
+
+bool ImageSequenceSink::write(const cv::Mat &frame) {
+    char path[4096];
+    std::snprintf(path, sizeof(path), pattern.c_str(), next++);
+    return cv::imwrite(path, frame);
+}
+
+
+RawSink::RawSink(const std::string &path)
+    : file(path, std::ios::binary), path(path) {}
+
+
+bool RawSink::write(const cv::Mat &frame) {
+    size = frame.size();
+    size_t rowBytes = frame.cols * frame.elemSize();
+    for (int r = 0; r < frame.rows; ++r)
+        file.write((const char *)frame.ptr(r), rowBytes);
+    return (bool)file;
+}
+
+
+void RawSink::close() {
+    file.close();
+}
+
+
+std::string RawSink::name() const {
+    std::ostringstream text;
+    text << "raw:" << path;
+    if (size.area() > 0)
+        text << " (" << size.width << "x" << size.height << " bgr24)";
+    return text.str();
+}
+
+
+std::unique_ptr<FrameSink> openFrameSink(const std::string &description,
+                                         std::string &error) {
+    size_t colon = description.find(':');
+    std::string kind = description.substr(0, colon);
+    std::string argument = colon == std::string::npos
+                           ? "" : description.substr(colon + 1);
+
+    if (kind == "video") {
+        double fps = 30;
+        size_t comma = argument.rfind(",fps=");
+        if (comma != std::string::npos) {
+            std::string number = argument.substr(comma + 5);
+            try {
+                size_t used;
+                fps = std::stod(number, &used);
+                if (used != number.size() || !(fps > 0 && fps <= 1000))
+                    throw std::invalid_argument(number);
+            } catch (const std::exception &) {
+                error = "invalid video frame rate " + number;
+                return nullptr;
+            }
+            argument.erase(comma);
+        }
+        if (argument.empty()) {
+            error = "video: needs a file";
+            return nullptr;
+        }
+        return std::unique_ptr<FrameSink>(new VideoSink(argument, fps));
+    }
+
+    if (kind == "images") {
+        if (!isSequencePattern(argument)) {
+            error = "images: needs a pattern with one number, e.g. %04d";
+            return nullptr;
+        }
+        return std::unique_ptr<FrameSink>(new ImageSequenceSink(argument));
+    }
+
+    if (kind == "raw") {
+        if (argument.empty()) {
+            error = "raw: needs a file";
+            return nullptr;
+        }
+        std::unique_ptr<RawSink> sink(new RawSink(argument));
+        if (!sink->isOpen()) {
+            error = "can't open " + argument + " for writing";
+            return nullptr;
+        }
+        return sink;
+    }
+
+    error = "unknown output " + description
+            + " (expected video, images or raw)";
+    return nullptr;
+}
+
+
+AsyncSink::AsyncSink(std::unique_ptr<FrameSink> sink, int capacity,
+                     SinkPolicy policy)
+    : sink(std::move(sink)), policy(policy),
+      slots(std::max(capacity, 1)) {
+    frameStats().setSinkQueue(0);
+    writer = std::thread(&AsyncSink::writerLoop, this);
+}
+
+
+AsyncSink::~AsyncSink() {
+    finish();
+}
+
+
+bool AsyncSink::push(const cv::Mat &frame, FrameLease &&lease) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (policy == SinkPolicy::Block) {
+            notFull.wait(lock, [this] {
+                return count < slots.size() || closed;
+            });
+        }
+        if (count == slots.size() || closed) {
+            ++dropCount;
+            frameStats().countSinkDropped();
+            return false;
+        }
+        Entry &entry = slots[(head + count) % slots.size()];
+        entry.image = frame;
+        entry.lease = std::move(lease);
+        ++count;
+        deepest = std::max(deepest, count);
+        frameStats().setSinkQueue(count);
+    }
+    notEmpty.notify_one();
+    return true;
+}
+
+
+void AsyncSink::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+    if (writer.joinable())
+        writer.join();
+}
+
+
+void AsyncSink::writerLoop() {
+    bool failed = false;
+    while (true) {
+        Entry entry;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return count > 0 || closed; });
+            if (count == 0)
+                break;
+            entry = std::move(slots[head]);
+            slots[head].image.release();
+            head = (head + 1) % slots.size();
+            --count;
+            frameStats().setSinkQueue(count);
+        }
+        notFull.notify_one();
+
+        // Once writing fails the remaining frames are dropped, still taken
+        // off the queue so a blocked loop goes on
+        std::string why;
+        if (!failed) {
+            try {
+                failed = !sink->write(entry.image);
+            } catch (const std::exception &e) {
+                failed = true;
+                why = e.what();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failed) {
+            if (error.empty())
+                error = why.empty() ? "writing failed" : why;
+            ++dropCount;
+            frameStats().countSinkDropped();
+        } else {
+            ++writtenCount;
+        }
+    }
+    sink->close();
+}
+
+
+std::string AsyncSink::describe() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream text;
+    text << sink->name() << ", " << writtenCount << " frames written, "
+         << dropCount << " dropped, queue at most " << deepest << " of "
+         << slots.size() << " frames";
+    if (!error.empty())
+        text << " (" << error << ")";
+    return text.str();
+}
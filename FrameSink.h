@@ -0,0 +1,159 @@
+/*
+    Output sinks the live (webcam) loop can write its processed frames to,
+    so the output can be recorded without capturing the screen.
+
+    Sinks are opened from a description, like frame sources (FrameSource.h):
+    - video:<path>[,fps=N]  a video file (cv::VideoWriter), MJPG for .avi
+                            and .mkv, mp4v for .mp4, at N frames/sec
+                            (defaults to 30)
+    - images:<pattern>      numbered images, e.g. images:out/%04d.png (the
+                            extension picks the format, counting from 0)
+    - raw:<path>            the frames' 8 bit BGR pixels back to back, the
+                            frame size being given in the report, e.g. for
+                            ffmpeg -f rawvideo -pix_fmt bgr24 -s WxH
+
+    An AsyncSink runs a sink on an encoder thread of its own behind a
+    bounded queue, so encoding and disk I/O stay off the capture and
+    processing threads. Frames are queued without copying them (a pooled
+    frame's buffer, FramePool.h, goes back to the pool once written). When
+    the queue is full the Drop policy drops the frame, while Block waits
+    for room: every frame is recorded, at the cost of holding back the loop
+    if the disk can't keep up. The queue depth and the dropped frames go to
+    the frame stats (FrameStats.h).
+*/
+
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include "opencv2/opencv.hpp"
+#include "FramePool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameSink {
+public:
+    virtual ~FrameSink() {}
+
+    /* Writes a frame (8 bit BGR), returns false if it couldn't */
+    virtual bool write(const cv::Mat &frame) = 0;
+
+    /* Finishes the output (called once the last frame is written) */
+    virtual void close() {}
+
+    /* What the sink writes to, for reports */
+    virtual std::string name() const = 0;
+};
+
+/* Opens a sink from its description, returns null and sets error if it is
+   invalid */
+std::unique_ptr<FrameSink> openFrameSink(const std::string &description,
+                                         std::string &error);
+
+/* Video file, opened at the first frame's size (later frames of another
+   size are resized to it) */
+class VideoSink : public FrameSink {
+public:
+    VideoSink(const std::string &path, double fps);
+
+    bool write(const cv::Mat &frame) override;
+    void close() override;
+    std::string name() const override;
+
+private:
+    cv::VideoWriter writer;
+    std::string path;
+    double fps;
+    bool opened = false;
+    cv::Size size;
+    cv::Mat resized;
+};
+
+/* Numbered images */
+class ImageSequenceSink : public FrameSink {
+public:
+    explicit ImageSequenceSink(const std::string &pattern);
+
+    bool write(const cv::Mat &frame) override;
+    std::string name() const override { return "images:" + pattern; }
+
+private:
+    std::string pattern;
+    int next = 0;
+};
+
+/* Raw BGR frames */
+class RawSink : public FrameSink {
+public:
+    explicit RawSink(const std::string &path);
+
+    bool isOpen() const { return file.is_open(); }
+    bool write(const cv::Mat &frame) override;
+    void close() override;
+    std::string name() const override;
+
+private:
+    std::ofstream file;
+    std::string path;
+    cv::Size size;  // Of the last frame
+};
+
+enum class SinkPolicy { Block, Drop };
+
+/* Runs a sink on its own thread behind a bounded queue */
+class AsyncSink {
+public:
+    AsyncSink(std::unique_ptr<FrameSink> sink, int capacity,
+              SinkPolicy policy);
+
+    /* Finishes writing (see finish()) */
+    ~AsyncSink();
+
+    AsyncSink(const AsyncSink &) = delete;
+    AsyncSink &operator=(const AsyncSink &) = delete;
+
+    /* Queues frame for the encoder thread, lease holding its pooled buffer
+       (if it is in one) until it is written. Returns false if the frame was
+       dropped. frame mustn't be written to afterwards */
+    bool push(const cv::Mat &frame, FrameLease &&lease = FrameLease());
+
+    /* Writes the frames still queued and closes the sink, waiting for the
+       encoder thread */
+    void finish();
+
+    int capacity() const { return slots.size(); }
+
+    /* The counts in a line, e.g. "video:out.avi, 600 frames written, 0
+       dropped, queue at most 3 of 8 frames". Once finished */
+    std::string describe();
+
+private:
+    struct Entry {
+        cv::Mat image;
+        FrameLease lease;
+    };
+
+    void writerLoop();
+
+    std::unique_ptr<FrameSink> sink;
+    SinkPolicy policy;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<Entry> slots;
+    size_t head = 0;  // Oldest frame
+    size_t count = 0;
+    size_t deepest = 0;
+    bool closed = false;
+    uint64_t writtenCount = 0;
+    uint64_t dropCount = 0;
+    std::string error;  // Why writing stopped, if it did
+    std::thread writer;
+};
+
+#endif
@@ -0,0 +1,284 @@
+/*
+    Frame sources (see FrameSource.h).
+*/
+
+#include "FrameSource.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+
+
+CaptureSource::CaptureSource(int camera)
+    : cap(camera), source("camera:" + std::to_string(camera)) {}
+
+
+CaptureSource::CaptureSource(const std::string &path)
+    : cap(path), source("video:" + path) {}
+
+
+bool CaptureSource::read(cv::Mat &frame) {
+    cap >> frame;
+    return !frame.empty();
+}
+
+
+ImageSequenceSource::ImageSequenceSource(const std::string &pattern)
+    : pattern(pattern), next(0) {
+    // Numbering starts at 0 or 1, probed without decoding the image
+    std::error_code error;
+    if (!std::filesystem::exists(path(0), error))
+        next = 1;
+}
+
+
+std::string ImageSequenceSource::path(int index) const {
+    char buffer[4096];
+    std::snprintf(buffer, sizeof(buffer), pattern.c_str(), index);
+    return buffer;
+}
+
+
+bool ImageSequenceSource::read(cv::Mat &frame) {
+    frame = cv::imread(path(next), cv::IMREAD_COLOR);
+    ++next;
+    return !frame.empty();
+}
+
+
+/* Small deterministic generator, so the frames don't depend on the
+   standard library's distributions */
+static uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+SyntheticSource::SyntheticSource(const SyntheticOptions &options)
+    : options(options),
+      background(options.height, options.width, CV_8UC3),
+      nextFrame(std::chrono::steady_clock::now()) {
+    uint32_t state = options.seed * 2654435761u + 1;
+
+    // Gradients with a little fixed noise, so the outline and motion
+    // detection have texture to work on
+    for (int y = 0; y < options.height; ++y) {
+        uint8_t *row = background.ptr<uint8_t>(y);
+        for (int x = 0; x < options.width; ++x) {
+            int noise = nextRandom(state) & 31;
+            row[3 * x] = x * 223 / options.width + noise;
+            row[3 * x + 1] = y * 223 / options.height + noise;
+            row[3 * x + 2] = 96 + noise;
+        }
+    }
+
+    int smallest = std::min(options.width, options.height);
+    for (int i = 0; i < options.objects; ++i) {
+        Square square;
+        square.size = std::max(1, smallest / 8
+                               + (int)(nextRandom(state) % (smallest / 8 + 1)));
+        square.x = nextRandom(state) % std::max(1, options.width - square.size);
+        square.y = nextRandom(state) % std::max(1, options.height - square.size);
+        square.dx = nextRandom(state) & 1 ? options.speed : -options.speed;
+        square.dy = nextRandom(state) & 1 ? options.speed : -options.speed;
+        for (int k = 0; k < 3; ++k)
+            square.color[k] = nextRandom(state);
+        squares.push_back(square);
+    }
+}
+
+
+/* Moves a coordinate by its speed, bouncing off 0 and limit */
+static void bounce(int &position, int &speed, int limit) {
+    position += speed;
+    if (limit <= 0) {
+        position = 0;
+    } else if (position < 0) {
+        position = std::min(-position, limit);
+        speed = -speed;
+    } else if (position > limit) {
+        position = std::max(2 * limit - position, 0);
+        speed = -speed;
+    }
+}
+
+
+bool SyntheticSource::read(cv::Mat &frame) {
+    if (options.frames > 0 && produced >= options.frames)
+        return false;
+
+    // Pace to the frame rate like a camera would, without catching up on
+    // frames the reader was too slow for
+    if (options.fps > 0) {
+        std::this_thread::sleep_until(nextFrame);
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1 / options.fps));
+        nextFrame = std::max(nextFrame + period,
+                             std::chrono::steady_clock::now());
+    }
+
+    background.copyTo(frame);
+    for (Square &square : squares) {
+        if (produced > 0) {
+            bounce(square.x, square.dx, options.width - square.size);
+            bounce(square.y, square.dy, options.height - square.size);
+        }
+        int right = std::min(square.x + square.size, options.width);
+        int bottom = std::min(square.y + square.size, options.height);
+        for (int y = square.y; y < bottom; ++y) {
+            uint8_t *row = frame.ptr<uint8_t>(y);
+            for (int x = square.x; x < right; ++x)
+                std::memcpy(row + 3 * x, square.color, 3);
+        }
+    }
+    ++produced;
+    return true;
+}
+
+
+std::string SyntheticSource::name() const {
+    std::ostringstream text;
+    text << "synthetic:" << options.width << "x" << options.height
+         << ",fps=" << options.fps << ",frames=" << options.frames
+         << ",objects=" << options.objects << ",speed=" << options.speed
+         << ",seed=" << options.seed;
+    return text.str();
+}
+
+
+/* Parses text as a whole number between lower and upper (inclusive) */
+static bool parseWhole(const std::string &text, long lower, long upper,
+                       long &value) {
+    try {
+        size_t used;
+        value = std::stol(text, &used);
+        return used == text.size() && value >= lower && value <= upper;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+
+/* Fills options from "1080p,fps=30,...", returns false if one is invalid */
+static bool parseSyntheticOptions(const std::string &text,
+                                  SyntheticOptions &options) {
+    std::stringstream stream(text);
+    std::string option;
+    long value;
+    while (std::getline(stream, option, ',')) {
+        size_t equals = option.find('=');
+        std::string key = option.substr(0, equals);
+        std::string number = equals == std::string::npos
+                             ? "" : option.substr(equals + 1);
+
+        if (key == "720p") {
+            options.width = 1280;
+            options.height = 720;
+        } else if (key == "1080p") {
+            options.width = 1920;
+            options.height = 1080;
+        } else if (key == "4k") {
+            options.width = 3840;
+            options.height = 2160;
+        } else if (equals == std::string::npos
+                       && key.find('x') != std::string::npos) {
+            size_t x = key.find('x');
+            long height;
+            if (!parseWhole(key.substr(0, x), 8, 16384, value)
+                    || !parseWhole(key.substr(x + 1), 8, 16384, height))
+                return false;
+            options.width = value;
+            options.height = height;
+        } else if (key == "fps" && parseWhole(number, 0, 1000, value)) {
+            options.fps = value;
+        } else if (key == "frames" && parseWhole(number, 0, 1L << 40, value)) {
+            options.frames = value;
+        } else if (key == "objects" && parseWhole(number, 0, 1000, value)) {
+            options.objects = value;
+        } else if (key == "speed" && parseWhole(number, 0, 1000, value)) {
+            options.speed = value;
+        } else if (key == "seed" && parseWhole(number, 0, 0xffffffffL, value)) {
+            options.seed = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool isSequencePattern(const std::string &pattern) {
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%')
+            continue;
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            ++i;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < pattern.size() && std::isdigit((unsigned char)pattern[end]))
+            ++end;
+        if (end == pattern.size() || pattern[end] != 'd')
+            return false;
+        ++conversions;
+        i = end;
+    }
+    return conversions == 1;
+}
+
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string &description,
+                                             std::string &error) {
+    size_t colon = description.find(':');
+    std::string kind = description.substr(0, colon);
+    std::string argument = colon == std::string::npos
+                           ? "" : description.substr(colon + 1);
+
+    if (kind == "camera" || kind == "video") {
+        long camera = 0;
+        if (kind == "camera" && !argument.empty()
+                && !parseWhole(argument, 0, 1000, camera)) {
+            error = "invalid camera number " + argument;
+            return nullptr;
+        }
+        if (kind == "video" && argument.empty()) {
+            error = "video: needs a file";
+            return nullptr;
+        }
+        std::unique_ptr<CaptureSource> source(
+            kind == "camera" ? new CaptureSource((int)camera)
+                             : new CaptureSource(argument));
+        if (!source->isOpened()) {
+            error = "can't open " + source->name();
+            return nullptr;
+        }
+        return source;
+    }
+
+    if (kind == "images") {
+        if (!isSequencePattern(argument)) {
+            error = "images: needs a pattern with one number, e.g. %04d";
+            return nullptr;
+        }
+        return std::unique_ptr<FrameSource>(new ImageSequenceSource(argument));
+    }
+
+    if (kind == "synthetic") {
+        SyntheticOptions options;
+        if (!argument.empty() && !parseSyntheticOptions(argument, options)) {
+            error = "invalid synthetic options " + argument;
+            return nullptr;
+        }
+        return std::unique_ptr<FrameSource>(new SyntheticSource(options));
+    }
+
+    error = "unknown source " + description
+            + " (expected camera, video, images or synthetic)";
+    return nullptr;
+}
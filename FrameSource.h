@@ -0,0 +1,114 @@
+/*
+    Frame sources the live (webcam) loop reads from: the webcam, a video
+    file, a numbered image sequence, or a synthetic generator, so the live
+    manipulations can run and be measured without a camera.
+
+    Sources are opened from a description:
+    - camera[:N]           webcam number N (defaults to 0)
+    - video:<path>         a video file
+    - images:<pattern>     numbered images, e.g. images:frames/%04d.png
+                           (counting from 0, or from 1 if there is no 0)
+    - synthetic[:options]  generated frames, options being a comma separated
+                           list of a size (WxH, 720p, 1080p or 4k, defaults
+                           to 720p) and fps=N (0 for as fast as possible,
+                           defaults to 30), frames=N (0 for no end, the
+                           default), objects=N and speed=N (moving squares
+                           and their pixels per frame, defaults to 4 and 4)
+                           and seed=N
+                           e.g. synthetic:1080p,fps=0,frames=600,objects=8
+*/
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "opencv2/opencv.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+
+    /* Reads the next frame (8 bit BGR), returns false once there are none */
+    virtual bool read(cv::Mat &frame) = 0;
+
+    /* What the source reads from, for reports */
+    virtual std::string name() const = 0;
+};
+
+/* Opens a source from its description, returns null and sets error if it
+   is invalid or can't be opened */
+std::unique_ptr<FrameSource> openFrameSource(const std::string &description,
+                                             std::string &error);
+
+/* Whether pattern holds exactly one integer conversion (%d, %04d...), as
+   images: sources and sinks (FrameSink.h) need */
+bool isSequencePattern(const std::string &pattern);
+
+/* Webcam or video file through cv::VideoCapture */
+class CaptureSource : public FrameSource {
+public:
+    explicit CaptureSource(int camera);
+    explicit CaptureSource(const std::string &path);
+
+    bool isOpened() const { return cap.isOpened(); }
+    bool read(cv::Mat &frame) override;
+    std::string name() const override { return source; }
+
+private:
+    cv::VideoCapture cap;
+    std::string source;
+};
+
+/* Numbered images, read until the next number is missing */
+class ImageSequenceSource : public FrameSource {
+public:
+    explicit ImageSequenceSource(const std::string &pattern);
+
+    bool read(cv::Mat &frame) override;
+    std::string name() const override { return "images:" + pattern; }
+
+private:
+    std::string path(int index) const;
+
+    std::string pattern;
+    int next;
+};
+
+struct SyntheticOptions {
+    int width = 1280;
+    int height = 720;
+    double fps = 30;
+    uint64_t frames = 0;  // 0 for no end
+    int objects = 4;
+    int speed = 4;
+    uint32_t seed = 1;
+};
+
+/* Deterministic frames: a fixed textured background with squares moving
+   over it, bouncing off the edges. The same options always give the same
+   frames */
+class SyntheticSource : public FrameSource {
+public:
+    explicit SyntheticSource(const SyntheticOptions &options);
+
+    bool read(cv::Mat &frame) override;
+    std::string name() const override;
+
+private:
+    struct Square {
+        int x, y, dx, dy, size;
+        uint8_t color[3];
+    };
+
+    SyntheticOptions options;
+    cv::Mat background;
+    std::vector<Square> squares;
+    uint64_t produced = 0;
+    std::chrono::steady_clock::time_point nextFrame;
+};
+
+#endif
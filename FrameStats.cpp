@@ -0,0 +1,334 @@
+/*
+    Frame time instrumentation (see FrameStats.h).
+*/
+
+#include "FrameStats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+LatencyHistogram::LatencyHistogram() : total(0), max(0) {
+    for (std::atomic<uint64_t> &count : counts)
+        count.store(0, std::memory_order_relaxed);
+}
+
+
+/* Values below SUB_BUCKETS have a bucket each, above that every power of two
+   is split into SUB_BUCKETS buckets */
+int LatencyHistogram::bucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < (uint64_t)SUB_BUCKETS)
+        return nanoseconds;
+    int exponent = 63 - __builtin_clzll(nanoseconds) - 5;
+    return SUB_BUCKETS * exponent + (int)(nanoseconds >> exponent);
+}
+
+
+uint64_t LatencyHistogram::bucketTop(int bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    int exponent = bucket / SUB_BUCKETS - 1;
+    uint64_t mantissa = bucket - SUB_BUCKETS * exponent;
+    return ((mantissa + 1) << exponent) - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    counts[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    uint64_t highest = max.load(std::memory_order_relaxed);
+    while (nanoseconds > highest
+               && !max.compare_exchange_weak(highest, nanoseconds,
+                                             std::memory_order_relaxed)) {
+    }
+}
+
+
+void LatencyHistogram::record(StatsClock::time_point start,
+                              StatsClock::time_point end) {
+    record(std::max<int64_t>(0, std::chrono::duration_cast<
+        std::chrono::nanoseconds>(end - start).count()));
+}
+
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.counts.resize(BUCKETS);
+    for (int b = 0; b < BUCKETS; ++b) {
+        snapshot.counts[b] = counts[b].load(std::memory_order_relaxed);
+        snapshot.total += snapshot.counts[b];
+    }
+    snapshot.max = max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+
+uint64_t HistogramSnapshot::percentile(double fraction) const {
+    if (total == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * total));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts.size(); ++b) {
+        seen += counts[b];
+        if (seen >= rank)
+            return std::min(LatencyHistogram::bucketTop(b), max);
+    }
+    return max;
+}
+
+
+HistogramSnapshot HistogramSnapshot::since(
+        const HistogramSnapshot &earlier) const {
+    HistogramSnapshot delta;
+    delta.counts.resize(counts.size());
+    for (size_t b = 0; b < counts.size(); ++b) {
+        delta.counts[b] = counts[b] - (b < earlier.counts.size()
+                                       ? earlier.counts[b] : 0);
+        delta.total += delta.counts[b];
+        // The exact max isn't known for an interval, so use its bucket's
+        if (delta.counts[b] > 0)
+            delta.max = std::min(LatencyHistogram::bucketTop(b), max);
+    }
+    return delta;
+}
+
+
+const char *frameStageName(FrameStage stage) {
+    switch (stage) {
+        case FrameStage::Capture: return "capture";
+        case FrameStage::Manipulate: return "manipulate";
+        case FrameStage::Display: return "display";
+        case FrameStage::Latency: return "latency";
+        default: return "";
+    }
+}
+
+
+FrameStats::FrameStats()
+    : on(true), deadline(0.033), dropped(0), missed(0), tilesReprocessed(0),
+      tilesTotal(0), resolution(1), sinkQueue(-1), sinkDropped(0) {
+    const char *stats = std::getenv("IMAGE_MANIPULATION_STATS");
+    if (stats && std::strcmp(stats, "off") == 0)
+        on = false;
+    if (const char *deadlineMs = std::getenv("IMAGE_MANIPULATION_DEADLINE_MS"))
+        deadline = std::max(0.0, std::atof(deadlineMs)) / 1000;
+}
+
+
+void FrameStats::frameShown(StatsClock::time_point captured,
+                            StatsClock::time_point shown) {
+    if (!on)
+        return;
+    stage(FrameStage::Latency).record(captured, shown);
+    if (deadline > 0
+            && std::chrono::duration<double>(shown - captured).count()
+                   > deadline)
+        missed.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+FrameStats &frameStats() {
+    static FrameStats stats;
+    return stats;
+}
+
+
+StatsSnapshot StatsSnapshot::take() {
+    FrameStats &stats = frameStats();
+    StatsSnapshot snapshot;
+    snapshot.taken = StatsClock::now();
+    for (int s = 0; s < (int)FrameStage::Count; ++s)
+        snapshot.stages[s] = stats.stage((FrameStage)s).snapshot();
+    snapshot.dropped = stats.droppedFrames();
+    snapshot.missed = stats.missedDeadlines();
+    snapshot.tilesReprocessed = stats.reprocessedTiles();
+    snapshot.tilesTotal = stats.totalTiles();
+    snapshot.resolutionScale = stats.resolutionScale();
+    snapshot.sinkQueue = stats.sinkQueueDepth();
+    snapshot.sinkDropped = stats.sinkDroppedFrames();
+    return snapshot;
+}
+
+
+static bool endsWith(const std::string &text, const std::string &suffix) {
+    return text.size() >= suffix.size()
+        && text.compare(text.size() - suffix.size(), suffix.size(),
+                        suffix) == 0;
+}
+
+
+StatsExporter::StatsExporter(const std::string &target, double interval)
+    : target(target), interval(interval) {
+    first = previous = StatsSnapshot::take();
+    if (target.empty() || target == "status")
+        return;
+
+    file.open(target);
+    if (!file.is_open()) {
+        std::cout << "Error opening stats file " << target << std::endl;
+        this->target.clear();
+        return;
+    }
+    if (endsWith(target, ".csv")) {
+        file << "time_s,frames,fps,dropped,missed_deadlines,tiles_reprocessed,"
+             << "scale,output_queue,output_dropped";
+        for (int s = 0; s < (int)FrameStage::Count; ++s) {
+            const char *name = frameStageName((FrameStage)s);
+            file << "," << name << "_count," << name << "_p50_ms," << name
+                 << "_p95_ms," << name << "_p99_ms," << name << "_max_ms";
+        }
+        file << std::endl;
+    }
+}
+
+
+StatsExporter::~StatsExporter() {
+    finish();
+}
+
+
+void StatsExporter::tick() {
+    if (target.empty())
+        return;
+    StatsClock::time_point now = StatsClock::now();
+    if (std::chrono::duration<double>(now - previous.taken).count() < interval)
+        return;
+    exportSince(StatsSnapshot::take());
+}
+
+
+void StatsExporter::finish() {
+    if (finished)
+        return;
+    finished = true;
+    if (target.empty())
+        return;
+    exportSince(StatsSnapshot::take());
+    if (target == "status")
+        std::cout << std::endl;
+}
+
+
+static double milliseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+
+/* Fraction of the tiles reprocessed between two snapshots (1 when no tiles
+   were counted, as every pixel was processed) */
+static double tileFraction(const StatsSnapshot &start,
+                           const StatsSnapshot &end) {
+    uint64_t total = end.tilesTotal - start.tilesTotal;
+    if (total == 0)
+        return 1;
+    return (double)(end.tilesReprocessed - start.tilesReprocessed) / total;
+}
+
+
+void StatsExporter::exportSince(const StatsSnapshot &now) {
+    double seconds = std::chrono::duration<double>(now.taken
+                                                   - previous.taken).count();
+    double elapsed = std::chrono::duration<double>(now.taken
+                                                   - first.taken).count();
+    HistogramSnapshot stages[(int)FrameStage::Count];
+    for (int s = 0; s < (int)FrameStage::Count; ++s)
+        stages[s] = now.stages[s].since(previous.stages[s]);
+    uint64_t frames = stages[(int)FrameStage::Latency].total;
+    double fps = seconds > 0 ? frames / seconds : 0;
+    uint64_t dropped = now.dropped - previous.dropped;
+    uint64_t missed = now.missed - previous.missed;
+    bool tiled = now.tilesTotal > previous.tilesTotal;
+    double tiles = tileFraction(previous, now);
+    uint64_t sinkDropped = now.sinkDropped - previous.sinkDropped;
+    previous = now;
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2);
+    if (target == "status") {
+        line << "\r" << fps << " fps";
+        for (int s = 0; s < (int)FrameStage::Count; ++s) {
+            line << " | " << frameStageName((FrameStage)s) << " "
+                 << milliseconds(stages[s].percentile(0.5)) << "/"
+                 << milliseconds(stages[s].percentile(0.99)) << " ms";
+        }
+        line << " | dropped " << dropped << ", missed " << missed;
+        if (tiled)
+            line << " | tiles " << tiles * 100 << "%";
+        if (now.resolutionScale < 1)
+            line << " | scale " << now.resolutionScale * 100 << "%";
+        if (now.sinkQueue >= 0) {
+            line << " | output queue " << now.sinkQueue << ", dropped "
+                 << sinkDropped;
+        }
+        line << "   ";
+        std::cout << line.str() << std::flush;
+    } else if (endsWith(target, ".csv")) {
+        line << elapsed << "," << frames << "," << fps << "," << dropped
+             << "," << missed << "," << tiles << ","
+             << now.resolutionScale << "," << now.sinkQueue << ","
+             << sinkDropped;
+        for (const HistogramSnapshot &stage : stages) {
+            line << "," << stage.total
+                 << "," << milliseconds(stage.percentile(0.5))
+                 << "," << milliseconds(stage.percentile(0.95))
+                 << "," << milliseconds(stage.percentile(0.99))
+                 << "," << milliseconds(stage.max);
+        }
+        file << line.str() << std::endl;
+    } else {
+        line << "{\"time_s\": " << elapsed << ", \"frames\": " << frames
+             << ", \"fps\": " << fps << ", \"dropped\": " << dropped
+             << ", \"missed_deadlines\": " << missed
+             << ", \"tiles_reprocessed\": " << tiles
+             << ", \"scale\": " << now.resolutionScale
+             << ", \"output_queue\": " << now.sinkQueue
+             << ", \"output_dropped\": " << sinkDropped << ", \"stages\": {";
+        for (int s = 0; s < (int)FrameStage::Count; ++s) {
+            const HistogramSnapshot &stage = stages[s];
+            line << (s ? ", " : "") << "\"" << frameStageName((FrameStage)s)
+                 << "\": {\"count\": " << stage.total
+                 << ", \"p50_ms\": " << milliseconds(stage.percentile(0.5))
+                 << ", \"p95_ms\": " << milliseconds(stage.percentile(0.95))
+                 << ", \"p99_ms\": " << milliseconds(stage.percentile(0.99))
+                 << ", \"max_ms\": " << milliseconds(stage.max) << "}";
+        }
+        file << line.str() << "}}" << std::endl;
+    }
+}
+
+
+void printStatsReport(const StatsSnapshot &start, const StatsSnapshot &end) {
+    if (!frameStats().enabled()) {
+        std::cout << "Frame stats are off (IMAGE_MANIPULATION_STATS)"
+                  << std::endl;
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(end.taken
+                                                   - start.taken).count();
+    std::cout << std::fixed << std::setprecision(2)
+              << "Stage         Frames  Frames/sec    p50 ms    p95 ms"
+              << "    p99 ms    max ms" << std::endl;
+    for (int s = 0; s < (int)FrameStage::Count; ++s) {
+        HistogramSnapshot stage = end.stages[s].since(start.stages[s]);
+        std::cout << std::left << std::setw(12)
+                  << frameStageName((FrameStage)s) << std::right
+                  << std::setw(8) << stage.total
+                  << std::setw(12) << (seconds > 0 ? stage.total / seconds : 0)
+                  << std::setw(10) << milliseconds(stage.percentile(0.5))
+                  << std::setw(10) << milliseconds(stage.percentile(0.95))
+                  << std::setw(10) << milliseconds(stage.percentile(0.99))
+                  << std::setw(10) << milliseconds(stage.max) << std::endl;
+    }
+    std::cout << "Dropped frames: " << end.dropped - start.dropped
+              << ", missed deadlines (" << frameStats().deadlineSeconds() * 1000
+              << " ms): " << end.missed - start.missed << std::endl;
+    if (end.tilesTotal > start.tilesTotal)
+        std::cout << "Tiles reprocessed: " << tileFraction(start, end) * 100
+                  << "%" << std::endl;
+    std::cout << std::defaultfloat;
+}
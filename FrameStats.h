@@ -0,0 +1,201 @@
+/*
+    Frame time instrumentation for the live loop and executeManipulation().
+
+    Each stage (capture, manipulate, display, and the latency from capture
+    until the frame is on screen) records its times in a LatencyHistogram,
+    an HDR style histogram with 32 buckets per power of two (values are kept
+    to within about 3%), from which p50/p95/p99/max are read. Dropped frames
+    and frames shown later than the deadline (missed deadlines) are counted
+    too, as is the scale the live loop manipulates frames at
+    (ResolutionController.h) and the depth of its output queue and the
+    frames the output dropped (FrameSink.h).
+
+    Recording is a couple of clock reads and relaxed atomic adds, so it is
+    on by default and safe from any thread (batch mode manipulates several
+    images at once). A StatsExporter periodically writes the stats since its
+    last export as a status line, CSV or JSON lines.
+
+    Environment variables:
+    - IMAGE_MANIPULATION_STATS: off disables recording
+    - IMAGE_MANIPULATION_DEADLINE_MS: capture to display deadline (default 33)
+    The live loop's exports are set with IMAGE_MANIPULATION_STATS_OUT and
+    IMAGE_MANIPULATION_STATS_INTERVAL (see WebcamPipeline.h).
+*/
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock StatsClock;
+
+/* Counts copied out of a LatencyHistogram at one point in time */
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max = 0;  // Nanoseconds
+
+    /* Nanoseconds at or below which fraction (0-1) of the values are */
+    uint64_t percentile(double fraction) const;
+
+    /* Values recorded after earlier was taken */
+    HistogramSnapshot since(const HistogramSnapshot &earlier) const;
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t nanoseconds);
+    void record(StatsClock::time_point start, StatsClock::time_point end);
+
+    HistogramSnapshot snapshot() const;
+
+    static const int SUB_BUCKETS = 32;
+    static const int BUCKETS = SUB_BUCKETS * 60;
+
+    /* Bucket of a value, and the highest value of a bucket */
+    static int bucketOf(uint64_t nanoseconds);
+    static uint64_t bucketTop(int bucket);
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+};
+
+enum class FrameStage { Capture, Manipulate, Display, Latency, Count };
+
+/* Stage name for reports */
+const char *frameStageName(FrameStage stage);
+
+/* Program wide frame stats */
+class FrameStats {
+public:
+    FrameStats();
+
+    bool enabled() const { return on; }
+    void setEnabled(bool enabled) { on = enabled; }
+
+    LatencyHistogram &stage(FrameStage stage) { return stages[(int)stage]; }
+
+    /* Records a frame's latency, counting it if it missed the deadline */
+    void frameShown(StatsClock::time_point captured,
+                    StatsClock::time_point shown);
+
+    void countDropped(uint64_t frames = 1) {
+        dropped.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+    /* Counts a frame's tiles and how many of them were reprocessed */
+    void countTiles(uint64_t reprocessed, uint64_t total) {
+        tilesReprocessed.fetch_add(reprocessed, std::memory_order_relaxed);
+        tilesTotal.fetch_add(total, std::memory_order_relaxed);
+    }
+
+    uint64_t droppedFrames() const { return dropped; }
+    uint64_t missedDeadlines() const { return missed; }
+    uint64_t reprocessedTiles() const { return tilesReprocessed; }
+    uint64_t totalTiles() const { return tilesTotal; }
+
+    /* Share of the width and height frames are manipulated at */
+    void setResolutionScale(double scale) { resolution = scale; }
+    double resolutionScale() const { return resolution; }
+
+    /* Frames waiting in the output queue (FrameSink.h), -1 without one */
+    void setSinkQueue(int frames) { sinkQueue = frames; }
+    int sinkQueueDepth() const { return sinkQueue; }
+
+    /* Counts a frame the output dropped */
+    void countSinkDropped() {
+        sinkDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t sinkDroppedFrames() const { return sinkDropped; }
+
+    double deadlineSeconds() const { return deadline; }
+    void setDeadline(double seconds) { deadline = seconds; }
+
+private:
+    std::atomic<bool> on;
+    double deadline;
+    LatencyHistogram stages[(int)FrameStage::Count];
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> missed;
+    std::atomic<uint64_t> tilesReprocessed;
+    std::atomic<uint64_t> tilesTotal;
+    std::atomic<double> resolution;
+    std::atomic<int> sinkQueue;
+    std::atomic<uint64_t> sinkDropped;
+};
+
+FrameStats &frameStats();
+
+/* Times the enclosing scope as one of a stage's samples */
+class StageTimer {
+public:
+    explicit StageTimer(FrameStage stage)
+        : stage(stage), running(frameStats().enabled()) {
+        if (running)
+            start = StatsClock::now();
+    }
+
+    ~StageTimer() {
+        if (running)
+            frameStats().stage(stage).record(start, StatsClock::now());
+    }
+
+private:
+    FrameStage stage;
+    bool running;
+    StatsClock::time_point start;
+};
+
+/* All the stats at one point in time */
+struct StatsSnapshot {
+    StatsClock::time_point taken;
+    HistogramSnapshot stages[(int)FrameStage::Count];
+    uint64_t dropped = 0;
+    uint64_t missed = 0;
+    uint64_t tilesReprocessed = 0;
+    uint64_t tilesTotal = 0;
+    double resolutionScale = 1;
+    int sinkQueue = -1;
+    uint64_t sinkDropped = 0;
+
+    static StatsSnapshot take();
+};
+
+/* Writes the stats since the previous export every interval seconds */
+class StatsExporter {
+public:
+    /* target is "status" (a status line on the console), a .csv or a .json
+       file (JSON lines), or empty for no exports */
+    StatsExporter(const std::string &target, double interval);
+    ~StatsExporter();
+
+    /* Exports if the interval has passed, cheap enough to call every frame */
+    void tick();
+
+    /* Exports whatever is left */
+    void finish();
+
+private:
+    void exportSince(const StatsSnapshot &now);
+
+    std::string target;
+    std::ofstream file;
+    double interval;
+    StatsSnapshot first;
+    StatsSnapshot previous;
+    bool finished = false;
+};
+
+/* Prints each stage's frames, throughput and p50/p95/p99/max since start */
+void printStatsReport(const StatsSnapshot &start, const StatsSnapshot &end);
+
+#endif
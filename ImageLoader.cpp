@@ -0,0 +1,173 @@
+/*
+    Image loading (see ImageLoader.h).
+*/
+
+#include "ImageLoader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+
+bool readJpegSize(const std::string &path, cv::Size &size) {
+    std::ifstream file(path, std::ios::binary);
+    if (file.get() != 0xFF || file.get() != 0xD8)
+        return false;
+
+    // Walk the segments up to the frame header (SOF)
+    while (file) {
+        if (file.get() != 0xFF)
+            return false;
+        int marker = file.get();
+        while (marker == 0xFF)  // Fill bytes
+            marker = file.get();
+        if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+            return false;
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            continue;  // No length
+
+        int length = file.get() << 8;
+        length |= file.get();
+        if (!file || length < 2)
+            return false;
+        bool frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4
+                     && marker != 0xC8 && marker != 0xCC;
+        if (frame) {
+            unsigned char header[5];  // Precision, height, width
+            if (!file.read((char *)header, sizeof(header)))
+                return false;
+            size.height = header[1] << 8 | header[2];
+            size.width = header[3] << 8 | header[4];
+            return size.width > 0 && size.height > 0;
+        }
+        file.seekg(length - 2, std::ios::cur);
+    }
+    return false;
+}
+
+
+/* imread flags decoding a JPEG of the given size for target, the smallest
+   reduction that still leaves it at least as large as target (whichever
+   way its orientation turns it) */
+static int jpegReadFlags(cv::Size native, cv::Size target) {
+    static const int REDUCTIONS[][2] = {{8, cv::IMREAD_REDUCED_COLOR_8},
+                                        {4, cv::IMREAD_REDUCED_COLOR_4},
+                                        {2, cv::IMREAD_REDUCED_COLOR_2}};
+    int needed = std::max(target.width, target.height);
+    for (const int *reduction : REDUCTIONS) {
+        int shortSide = std::min(native.width, native.height) / reduction[0];
+        if (shortSide >= needed)
+            return reduction[1];
+    }
+    return cv::IMREAD_COLOR;
+}
+
+
+cv::Mat loadImage(const std::string &path, cv::Size target) {
+    int flags = cv::IMREAD_COLOR;
+    cv::Size native;
+    if (!target.empty() && readJpegSize(path, native))
+        flags = jpegReadFlags(native, target);
+
+    cv::Mat image = cv::imread(path, flags);
+    if (!image.empty() && !target.empty() && image.size() != target)
+        cv::resize(image, image, target);
+    return image;
+}
+
+
+ImageCache::ImageCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+
+cv::Mat ImageCache::load(const std::string &path, cv::Size target) {
+    std::string key = path + "\n" + std::to_string(target.width) + "x"
+                      + std::to_string(target.height);
+    std::error_code error;
+    int64_t modified = fs::last_write_time(path, error)
+                           .time_since_epoch().count();
+    uintmax_t fileSize = fs::file_size(path, error);
+    bool stamped = !error;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = byKey.find(key);
+        if (found != byKey.end()) {
+            std::list<Entry>::iterator entry = found->second;
+            if (stamped && entry->modified == modified
+                    && entry->fileSize == fileSize) {
+                entries.splice(entries.begin(), entries, entry);
+                ++hitCount;
+                return entry->image;
+            }
+            // The file changed
+            used -= entry->image.total() * entry->image.elemSize();
+            entries.erase(entry);
+            byKey.erase(found);
+        }
+        ++missCount;
+    }
+
+    // Decode without holding the lock, other images can still be served
+    cv::Mat image = loadImage(path, target);
+    size_t bytes = image.total() * image.elemSize();
+    if (image.empty() || !stamped)
+        return image;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bytes > budget || byKey.count(key))
+        return image;
+    entries.push_front(Entry{key, image, modified, fileSize});
+    byKey[key] = entries.begin();
+    used += bytes;
+    evict();
+    return image;
+}
+
+
+void ImageCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    evict();
+}
+
+
+/* Drops the least recently used images until the cache fits its budget,
+   called with the lock held */
+void ImageCache::evict() {
+    while (used > budget && !entries.empty()) {
+        Entry &oldest = entries.back();
+        used -= oldest.image.total() * oldest.image.elemSize();
+        byKey.erase(oldest.key);
+        entries.pop_back();
+    }
+}
+
+
+size_t ImageCache::bytesUsed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+
+uint64_t ImageCache::hits() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+
+uint64_t ImageCache::misses() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
+
+
+ImageCache &imageCache() {
+    static ImageCache cache([] {
+        const char *megabytes = std::getenv("IMAGE_MANIPULATION_CACHE_MB");
+        return (size_t)std::max(0, megabytes ? std::atoi(megabytes) : 256)
+               << 20;
+    }());
+    return cache;
+}
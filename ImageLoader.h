@@ -0,0 +1,71 @@
+/*
+    Image loading for the image menu and batch mode.
+
+    Images are decoded once and resized to the size they're shown or
+    processed at. When a JPEG is at least twice as large as that size (read
+    from its header, without decoding it), it's decoded at 1/2, 1/4 or 1/8
+    of its resolution instead (libjpeg scales while decoding, for a fraction
+    of the work), then resized the rest of the way.
+
+    ImageCache keeps decoded and resized images, least recently used first
+    out, within a memory budget, so going back to an image costs no I/O or
+    decoding. Images are looked up by path and size, and reloaded if their
+    file changed. The program's cache holds IMAGE_MANIPULATION_CACHE_MB
+    megabytes (defaults to 256, 0 turns it off).
+*/
+
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include "opencv2/opencv.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/* Width and height of a JPEG from its header, false if path isn't one */
+bool readJpegSize(const std::string &path, cv::Size &size);
+
+/* Decodes path as BGR, resized to target (an empty target keeps the
+   native size). Returns an empty image if it can't be read */
+cv::Mat loadImage(const std::string &path, cv::Size target = cv::Size());
+
+class ImageCache {
+public:
+    explicit ImageCache(size_t budgetBytes);
+
+    /* Like loadImage(), from the cache if it's there. The image shares its
+       pixels with the cache, so clone it before writing into it */
+    cv::Mat load(const std::string &path, cv::Size target = cv::Size());
+
+    /* Sets the budget, dropping images until the cache fits */
+    void setBudget(size_t bytes);
+
+    size_t bytesUsed();
+    uint64_t hits();
+    uint64_t misses();
+
+private:
+    struct Entry {
+        std::string key;
+        cv::Mat image;
+        int64_t modified;   // File time and size when loaded
+        uintmax_t fileSize;
+    };
+
+    void evict();
+
+    std::mutex mutex;
+    size_t budget;
+    size_t used = 0;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> byKey;
+};
+
+/* The program's image cache */
+ImageCache &imageCache();
+
+#endif
@@ -10,11 +10,24 @@
 */
 
 #include "opencv2/opencv.hpp"
+#include "Manipulations.h"
+#include "BatchMode.h"
+#include "DaemonMode.h"
+#include "DirtyTiles.h"
+#include "FrameSink.h"
+#include "FrameSource.h"
+#include "ImageLoader.h"
+#include "LiveMode.h"
+#include "MultiStreamMode.h"
+#include "WebcamPipeline.h"
 #include <iostream>
 #include <limits>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <utility>
 
 /* Function declarations -- get inputs from user */
 int getModeInput();
@@ -22,28 +35,6 @@ std::string getImageChoice();
 int displayMenu(int mode);
 void getManipulationSpecifications(int choice);
 
-/* Function declaration -- execute a chosen manipulation */
-void executeManipulation(int choice, int mode);
-
-/* Function declarations -- manipulation functions */
-void originalMedia();
-void blackWhite();
-void grayscale();
-void darken();
-void rgbPercentages();
-void purify();
-void strobelOutline();
-void approximate();
-void motionDetection();
-
-/* Function declarations -- helper functions for manipulations */
-double getLuminosity(double b, double g, double r);
-int isClose(float originalB, float originalG, float originalR,
-            float b, float g, float r, int strength);
-double getDistance(float originalBlue, float originalGreen, float originalRed,
-                   float blue, float green, float red);
-int smallest(double up, double right, double down, double left);
-
 /* Function declarations -- Sanitized input to avoid breaking the program */
 int getSanitizedInt(const std::string prompt, int lower, int upper);
 double getSanitizedDouble(const std::string prompt, int lower, int upper);
@@ -54,15 +45,12 @@ int HEIGHT = 350;
 
 /* Mat objects to store data (pixels) on the images (png only) */
 cv::Mat original;
-cv::Mat prevFrame;
 cv::Mat modified;
 
 /* Given manipulation specifications for some of the features */
-int bwThreshold = 0;
-double brightnessConstant;
-double redMult, blueMult, greenMult;
+ManipulationSpecs specs;
 
-int main() {
+int main(int argc, char **argv) {
     int mode;
     std::string imageName;
     int manipulationChoice = 0;
@@ -73,6 +61,16 @@ int main() {
     int APPROXIMATE = 7;
     int MOTION_DETECTION = 7;
 
+    // Headless modes are selected on the command line, the menu otherwise
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+        return runBatchMode(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--live")
+        return runLiveMode(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--stream")
+        return runMultiStreamMode(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--daemon")
+        return runDaemonMode(argc, argv);
+
     cv::namedWindow("Modified", cv::WINDOW_FREERATIO);  // Display window
 
     std::cout << "Image/Webcam Manipulation Program" << std::endl;
@@ -89,17 +87,24 @@ int main() {
             return -1;
         }
 
-        original = cv::imread("images/" + imageName, cv::IMREAD_COLOR); 
-        modified = cv::imread("images/" + imageName, cv::IMREAD_COLOR); 
-        cv::resize(original, original, cv::Size(WIDTH, HEIGHT));    
-        cv::resize(modified, modified, cv::Size(WIDTH, HEIGHT));   
+        // Decoded once (and kept in the image cache), original is only
+        // read from so it can share the cached pixels
+        original = imageCache().load("images/" + imageName,
+                                     cv::Size(WIDTH, HEIGHT));
+        if (original.empty()) {
+            std::cout << "Error loading image" << std::endl;
+            return -1;
+        }
+        modified = original.clone();
     } 
     
     /* Set up display windows */
     cv::resizeWindow("Modified", WIDTH, HEIGHT);
     cv::moveWindow("Modified", 210 + WIDTH, 0);
     
-    cv::VideoCapture cap;  // To capture webcam media
+    // To capture webcam media (or another source, see FrameSource.h)
+    const char *sourceSetting = std::getenv("IMAGE_MANIPULATION_SOURCE");
+    std::string sourceDescription = sourceSetting ? sourceSetting : "camera:0";
 
     /* Main menu control loop */
     while (manipulationChoice != QUIT) {
@@ -110,6 +115,7 @@ int main() {
         if (manipulationChoice == APPROXIMATE && mode == 1) {
             std::cout << "Press ESC while focused on display to exit "
                 << "approximation early" << std::endl;
+            specs.approximation.refreshInterval = 0.05;  // Show it as it goes
         }
         
         getManipulationSpecifications(manipulationChoice);
@@ -117,24 +123,76 @@ int main() {
                   <<  "to the main menu" << std::endl << std::endl;
 
         if (mode == IMAGE_MODE) {
-            executeManipulation(manipulationChoice, mode);
+            executeManipulation(manipulationChoice, mode, original,
+                                modified, specs);
             cv::imshow("Modified", modified);
             cv::waitKey(0);
         } else {
-            if (!cap.open(0))  // Can't open webcam, exit
+            std::string error;
+            std::unique_ptr<FrameSource> source = openFrameSource(
+                sourceDescription, error);
+            if (!source) {  // Can't open webcam, exit
+                std::cout << "Error opening webcam: " << error << std::endl;
                 return -1;
-            while (true) {
-                cap >> original;
-                if (original.empty()) // No more feed
-                    break;
-                if (modified.empty()) // first frame, fill modifed as well
-                    cap >> modified;
-
-                executeManipulation(manipulationChoice, mode);
-                cv::imshow("Modified", modified);
-                if (cv::waitKey(10) == 27) {
-                    cap.release();
-                    break;
+            }
+
+            // Capture, manipulation and display on their own threads
+            PipelineOptions pipeline = pipelineOptionsFromEnvironment();
+            std::unique_ptr<FrameSink> output;
+            if (!pipeline.output.empty()) {
+                output = openFrameSink(pipeline.output, error);
+                if (!output) {
+                    std::cout << "Error opening output: " << error
+                              << std::endl;
+                    return -1;
+                }
+            }
+            if (pipeline.enabled) {
+                runLivePipeline(*source, "Modified", manipulationChoice, specs,
+                                pipeline, std::move(output));
+            } else {
+                StatsExporter exporter(pipeline.statsTarget,
+                                       pipeline.statsInterval);
+                std::unique_ptr<AsyncSink> sink;
+                if (output) {
+                    sink.reset(new AsyncSink(std::move(output),
+                                             pipeline.outputQueue,
+                                             pipeline.outputPolicy));
+                }
+                IncrementalManipulator incremental(pipeline.tileSize,
+                                                   pipeline.tileTolerance);
+                while (true) {
+                    StatsClock::time_point captured;
+                    {
+                        StageTimer timer(FrameStage::Capture);
+                        if (!source->read(original)) // No more feed
+                            break;
+                        captured = StatsClock::now();
+                    }
+
+                    if (pipeline.tileSize > 0) {
+                        incremental.process(manipulationChoice, original,
+                                            modified, specs);
+                    } else {
+                        executeManipulation(manipulationChoice, mode,
+                                            original, modified, specs);
+                    }
+                    int key;
+                    {
+                        StageTimer timer(FrameStage::Display);
+                        cv::imshow("Modified", modified);
+                        key = cv::waitKey(10);
+                    }
+                    if (sink)  // A copy, modified is written again
+                        sink->push(modified.clone());
+                    frameStats().frameShown(captured, StatsClock::now());
+                    exporter.tick();
+                    if (key == 27)
+                        break;
+                }
+                if (sink) {
+                    sink->finish();
+                    std::cout << "Output: " << sink->describe() << std::endl;
                 }
             }
         }
@@ -288,612 +346,23 @@ int displayMenu(int mode) {
 void getManipulationSpecifications(int menuChoice) {
     switch (menuChoice) {
         case 1: // black and white
-            bwThreshold = getSanitizedInt(
-                    "Please enter a threshold (0-255): ", 0, 255);
+            specs.bwThreshold = getSanitizedInt(
+                    "Please enter a threshold (0-255, -1 for automatic): ",
+                    -1, 255);
             break;
         case 3: // Brightness
-            brightnessConstant = getSanitizedDouble(
+            specs.brightnessConstant = getSanitizedDouble(
                 "Please enter a brightness constant between 0-1: ", 0, 1);
             break;
         case 4:  // RGB values
-            redMult = getSanitizedInt(
+            specs.redMult = getSanitizedInt(
                     "Please enter a red multiplier (%): ", 0, 150);
-            greenMult = getSanitizedInt(
+            specs.greenMult = getSanitizedInt(
                     "Please enter a green multiplier (%): ", 0, 150);
-            blueMult = getSanitizedInt(
+            specs.blueMult = getSanitizedInt(
                     "Please enter a blue multiplier (%): ", 0, 150);
             break;
         default:
             break;
     }
 }
-
-
-void executeManipulation(int menuChoice, int mode) {
-    switch (menuChoice) {
-        case 0:
-            originalMedia();
-            break;
-        case 1:
-            blackWhite();
-            break;
-        case 2:
-            grayscale();
-            break;
-        case 3:
-            darken();
-            break;
-        case 4:
-            rgbPercentages();
-            break;
-        case 5:
-            purify();
-            break;
-        case 6:
-            strobelOutline();
-            break;
-        case 7:
-            if (mode == 1)
-                approximate();
-            else
-                motionDetection();
-            break;
-        default:
-            break;
-    }
-}
-
-
-void originalMedia() {
-    for (int r = 0; r < original.rows; r++) {
-        for (int c = 0; c < original.cols; c++) {
-            modified.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0];
-            modified.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1];
-            modified.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2];
-        } 
-    }
-}
-
-
-/* Looks at each pixel of the original image, determines if the RGB components 
- * surpass a given threshold, and makes the modified equivalent image either
- * black or white */ 
-void blackWhite() {
-    for (int r = 0; r < modified.rows; ++r) {
-		for (int c = 0; c < modified.cols; ++c) {
-			float blue = original.at<cv::Vec3b>(r, c)[0];
-			float green = original.at<cv::Vec3b>(r, c)[1];
-			float red = original.at<cv::Vec3b>(r, c)[2];
-			if (((double)blue + (double)green + (double)red) / 3.0 > bwThreshold) {
-				modified.at<cv::Vec3b>(r, c)[0] = 255;
-				modified.at<cv::Vec3b>(r, c)[1] = 255;
-				modified.at<cv::Vec3b>(r, c)[2] = 255;
-			}
-			else {
-				modified.at<cv::Vec3b>(r, c)[0] = 0;
-				modified.at<cv::Vec3b>(r, c)[1] = 0;
-				modified.at<cv::Vec3b>(r, c)[2] = 0;
-			}
-		}
-	}
-}
-
-
-/* Looks at each pixel of the original image and converts the pixel to grayscale
- * using grayscale formula found online */
-void grayscale() {
-    for (int r = 0; r < original.rows; ++r) {                           
-        for (int c = 0; c < original.cols; ++c) {                       
-            float blue = original.at<cv::Vec3b>(r, c)[0];               
-            float green = original.at<cv::Vec3b>(r, c)[1];              
-            float red = original.at<cv::Vec3b>(r, c)[2];                
-
-            double gray = .299 * red + .587 * green + .114 * blue;      
-            modified.at<cv::Vec3b>(r, c)[0] = gray;                     
-            modified.at<cv::Vec3b>(r, c)[1] = gray;                     
-            modified.at<cv::Vec3b>(r, c)[2] = gray;                     
-        }                                                               
-    }       
-}
-
-
-/* Multiplies the pixels by a given constant (between 0-1) to affect brightness */
-void darken() {
-    for (int r = 0; r < original.rows; ++r) {                           
-        for (int c = 0; c < original.cols; ++c) {                       
-            modified.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0] * brightnessConstant;
-            modified.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1] * brightnessConstant;
-            modified.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2] * brightnessConstant;
-        }                                                               
-    }    
-}
-
-
-/* Multiplies the pixels by a given constant (0-100) to affect percentage */
-void rgbPercentages() {
-    for (int r = 0; r < original.rows; ++r) {                           
-        for (int c = 0; c < original.cols; ++c) {                       
-            modified.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0] * (blueMult / 100.0);
-            modified.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1] * (greenMult / 100.0);
-            modified.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2] * (redMult / 100.0);
-        }                                                               
-    }    
-}
-
-
-/* Finds the highest RGB component and maxes it for the given pixel */
-void purify() {
-    for (int r = 0; r < original.rows; ++r) {
-		for (int c = 0; c < original.cols; ++c) {
-			float blue = original.at<cv::Vec3b>(r, c)[0];
-			float green = original.at<cv::Vec3b>(r, c)[1];
-			float red = original.at<cv::Vec3b>(r, c)[2];
-
-			if (blue > green && blue > red) {
-				modified.at<cv::Vec3b>(r, c)[0] = 255;
-				modified.at<cv::Vec3b>(r, c)[1] = 0;
-				modified.at<cv::Vec3b>(r, c)[2] = 0;
-			}
-			else if (green > blue && green > red) {
-				modified.at<cv::Vec3b>(r, c)[0] = 0;
-				modified.at<cv::Vec3b>(r, c)[1] = 255;
-				modified.at<cv::Vec3b>(r, c)[2] = 0;
-			}
-			else {
-				modified.at<cv::Vec3b>(r, c)[0] = 0;
-				modified.at<cv::Vec3b>(r, c)[1] = 0;
-				modified.at<cv::Vec3b>(r, c)[2] = 255;
-			}
-		}
-	}
-}
-
-
-/* Using given strobel outline algorithm online, detects images using gradients */
-void strobelOutline() {
-    for (int r = 0; r < original.rows; ++r) {
-        for (int c = 0; c < original.cols; ++c) {
-            if (r > 1 && r < original.rows - 1 && c > 1 && c < original.cols - 1) {
-
-                // Vertical
-                double vertY;
-                vertY = getLuminosity(original.at<cv::Vec3b>(r + 1, c + 1)[0], original.at<cv::Vec3b>(r + 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c + 1)[2])
-                    + getLuminosity(original.at<cv::Vec3b>(r, c + 1)[0], original.at<cv::Vec3b>(r, c + 1)[1], original.at<cv::Vec3b>(r, c + 1)[2]) * 2
-                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c + 1)[0], original.at<cv::Vec3b>(r - 1, c + 1)[1], original.at<cv::Vec3b>(r - 1, c + 1)[2])
-                    + getLuminosity(original.at<cv::Vec3b>(r, c - 1)[0], original.at<cv::Vec3b>(r, c - 1)[1], original.at<cv::Vec3b>(r, c - 1)[2]) * -2
-                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c - 1)[0], original.at<cv::Vec3b>(r + 1, c - 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]) * -1
-                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c - 1)[0], original.at<cv::Vec3b>(r - 1, c - 1)[1], original.at<cv::Vec3b>(r - 1, c - 1)[2]) * -1;
-
-
-                // Horizontal
-                double horzX;
-                horzX = getLuminosity(original.at<cv::Vec3b>(r + 1, c - 1)[0], original.at<cv::Vec3b>(r + 1, c - 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]) * -1
-                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c)[0], original.at<cv::Vec3b>(r + 1, c)[1], original.at<cv::Vec3b>(r + 1, c)[2]) * -2
-                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c + 1)[0], original.at<cv::Vec3b>(r + 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c + 1)[2]) * -1
-                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c)[0], original.at<cv::Vec3b>(r - 1, c)[1], original.at<cv::Vec3b>(r - 1, c)[2]) * 2
-                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c - 1)[0], original.at<cv::Vec3b>(r - 1, c - 1)[1], original.at<cv::Vec3b>(r - 1, c - 1)[2])
-                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c + 1)[0], original.at<cv::Vec3b>(r - 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]);
-
-
-                // Magnitude
-                double mag = sqrt(pow(vertY, 2.0) + pow(horzX, 2.0));
-
-                // Assign values to each pixel according to magnitude
-                if (mag > 100) {
-                    modified.at<cv::Vec3b>(r, c)[0] = 255;
-                    modified.at<cv::Vec3b>(r, c)[1] = 255;
-                    modified.at<cv::Vec3b>(r, c)[2] = 255;
-                }
-
-                else if (mag > 30) {
-                    modified.at<cv::Vec3b>(r, c)[0] = mag;
-                    modified.at<cv::Vec3b>(r, c)[1] = mag;
-                    modified.at<cv::Vec3b>(r, c)[2] = mag;
-                }
-                else {
-                    modified.at<cv::Vec3b>(r, c)[0] = 0;
-                    modified.at<cv::Vec3b>(r, c)[1] = 0;
-                    modified.at<cv::Vec3b>(r, c)[2] = 0;
-                }
-            }
-        }
-    }
-}
-
-
-/* Helper function for strobel outline (gets brightness of a pixel */
-double getLuminosity(double b, double g, double r) {
-	return 0.2126 * r + 0.7152 * g + 0.0722 * b;
-}
-
-
-void approximate() {
-    int randomR, randomC;
-    double upperGrad, lowerGrad, leftGrad, rightGrad;
-    float originalBlue, originalGreen, originalRed;
-    double smallest, secondSmallest;
-    int pt1Row, pt1Col, pt2Row, pt2Col;
-    int count = 0;
-    int strength;
-
-    // Blank white canvas
-    for (int r = 0; r < original.rows; ++r) {
-        for (int c = 0; c < original.cols; ++c) {
-            modified.at<cv::Vec3b >(r, c)[0] = 255;
-            modified.at<cv::Vec3b >(r, c)[1] = 255;
-            modified.at<cv::Vec3b >(r, c)[2] = 255;
-        }
-    }
-    
-    do {
-        pt1Row = 0; // Initialize all points
-        pt1Col = 0;
-        pt2Row = 0;
-        pt2Col = 0;
-
-        if (count < 2500)
-            strength = 90;
-        else if (count < 5000)
-            strength = 60;
-        else if (count < 6000)
-            strength = 45;
-        else if (count < 8000)
-            strength = 30;
-        else
-            strength = 20;
-
-        // Pick random pixel, this will act as one vertice of the triangle
-        randomR = rand() % original.rows;
-        randomC = rand() % original.cols;
-        originalBlue = original.at<cv::Vec3b>(randomR, randomC)[0];
-        originalGreen = original.at<cv::Vec3b>(randomR, randomC)[1];
-        originalRed = original.at<cv::Vec3b>(randomR, randomC)[2];
-
-
-        // Find gradient of pixel directly above randomly chosen pixel.
-        if (randomR - 2 < 0) {
-            upperGrad = 442; // Highest gradient possible (Does not choose the upper direction)
-        }
-        else {
-            upperGrad = getDistance(originalBlue, originalGreen, originalRed,
-                original.at<cv::Vec3b>(randomR - 1, randomC)[0],
-                original.at<cv::Vec3b>(randomR - 1, randomC)[1],
-                original.at<cv::Vec3b>(randomR - 1, randomC)[2]);
-        }
-
-        // Find gradient of pixel directly below randomly chosen pixel.
-        if (randomR + 2 > original.rows) {
-            lowerGrad = 442;
-        }
-        else {
-            lowerGrad = getDistance(originalBlue, originalGreen, originalRed,
-                original.at<cv::Vec3b>(randomR + 1, randomC)[0],
-                original.at<cv::Vec3b>(randomR + 1, randomC)[1],
-                original.at<cv::Vec3b>(randomR + 1, randomC)[2]);
-        }
-
-        // Find gradient of pixel directly right of the randomly chosen pixel.
-        if (randomC + 2 > original.cols) {
-            rightGrad = 442;
-        }
-        else {
-            rightGrad = getDistance(originalBlue, originalGreen, originalRed,
-                original.at<cv::Vec3b>(randomR, randomC + 1)[0],
-                original.at<cv::Vec3b>(randomR, randomC + 1)[1],
-                original.at<cv::Vec3b>(randomR, randomC + 1)[2]);
-        }
-
-        // Find gradient of pixel directly left of the randomly chosen pixel
-        if (randomC - 2 < 0) {
-            leftGrad = 442;
-        }
-        else {
-            leftGrad = getDistance(originalBlue, originalGreen, originalRed,
-                original.at<cv::Vec3b>(randomR, randomC - 1)[0],
-                original.at<cv::Vec3b>(randomR, randomC - 1)[1],
-                original.at<cv::Vec3b>(randomR, randomC - 1)[2]);
-        }
-
-        
-
-        // Now we will compare and get the two smallest gradients
-        smallest = std::min(std::min(upperGrad, lowerGrad), std::min(rightGrad, leftGrad));
-        // 1 = Up, 2 = Right, 3 = Down, 4 = Left
-        if (smallest == upperGrad) {
-            smallest = 1;
-            secondSmallest = std::min(lowerGrad, std::min(rightGrad, leftGrad));
-            if (secondSmallest == lowerGrad)
-                secondSmallest = 3;
-            else if (secondSmallest == rightGrad)
-                secondSmallest = 2;
-            else
-                secondSmallest = 4;
-        }
-        else if (smallest == rightGrad) {
-            smallest = 2;
-            secondSmallest = std::min(std::min(upperGrad, lowerGrad), leftGrad);
-            if (secondSmallest == upperGrad)
-                secondSmallest = 1;
-            else if (secondSmallest == lowerGrad)
-                secondSmallest = 3;
-            else
-                secondSmallest = 4;
-        }
-        else if (smallest == lowerGrad) {
-            smallest = 3;
-            secondSmallest = std::min(upperGrad, std::min(rightGrad, leftGrad));
-            if (secondSmallest == upperGrad)
-                secondSmallest = 1;
-            else if (secondSmallest == rightGrad)
-                secondSmallest = 2;
-            else if (secondSmallest == leftGrad)
-                secondSmallest = 4;
-        }
-        else {
-            smallest = 4;
-            secondSmallest = std::min(std::min(upperGrad, lowerGrad), rightGrad);
-            if (secondSmallest == upperGrad)
-                secondSmallest = 1;
-            else if (secondSmallest == rightGrad)
-                secondSmallest = 2;
-            else if (secondSmallest == lowerGrad)
-                secondSmallest = 3;
-        }
-        
-        // Now, we will go in each direction of the smallest and secondSmallest gradients,
-        // and will stop at a point when the difference in average color is too large.
-        // Resulting in two points.
-        if (smallest == 1 || secondSmallest == 1) { // Go up.
-            int r = randomR - 1;
-            int close = 1;
-            while (close && r > 1) {
-                close = isClose(originalBlue, originalGreen, originalRed,
-                    original.at<cv::Vec3b>(r, randomC)[0],
-                    original.at<cv::Vec3b>(r, randomC)[1],
-                    original.at<cv::Vec3b>(r, randomC)[2], strength);
-                --r;
-            }
-            ++r; // Need to reset r either back to zero, or to the coordinate which isClose failed.
-            if (smallest == 1) {
-                pt1Row = r;
-                pt1Col = randomC;
-            }
-            else {
-                pt2Row = r;
-                pt2Col = randomC;
-            }
-        }
-        if (smallest == 2 || secondSmallest == 2) { // Go right
-            int c = randomC + 1;
-            int close = 1;
-            while (close && c + 1 < original.cols) {
-                close = isClose(originalBlue, originalGreen, originalRed,
-                    original.at<cv::Vec3b>(randomR, c)[0],
-                    original.at<cv::Vec3b>(randomR, c)[1],
-                    original.at<cv::Vec3b>(randomR, c)[2], strength);
-                ++c;
-            }
-            --c;
-            if (smallest == 2) {
-                pt1Row = randomR;
-                pt1Col = c;
-            }
-            else {
-                pt2Row = randomR;
-                pt2Col = c;
-            }
-        }
-        if (smallest == 3 || secondSmallest == 3) { // Go down
-            int r = randomR + 1;
-            int close = 1;
-            while (close && r + 1 < original.rows) {
-                close = isClose(originalBlue, originalGreen, originalRed,
-                    original.at<cv::Vec3b>(r, randomC)[0],
-                    original.at<cv::Vec3b>(r, randomC)[1],
-                    original.at<cv::Vec3b>(r, randomC)[2], strength);
-                ++r;
-            }
-            --r;
-            if (smallest == 3) {
-                pt1Row = r;
-                pt1Col = randomC;
-            }
-            else {
-                pt2Row = r;
-                pt2Col = randomC;
-            }
-        }
-        if (smallest == 4 || secondSmallest == 4) {
-            int c = randomC - 1;
-            int close = 1;
-            while (close && c > 1) { // Go left
-                close = isClose(originalBlue, originalGreen, originalRed,
-                    original.at<cv::Vec3b>(randomR, c)[0],
-                    original.at<cv::Vec3b>(randomR, c)[1],
-                    original.at<cv::Vec3b>(randomR, c)[2], strength);
-                --c;
-            }
-            ++c;
-            if (smallest == 4) {
-                pt1Row = randomR;
-                pt1Col = c;
-            }
-            else {
-                pt2Row = randomR;
-                pt2Col = c;
-            }
-        }
-        
-        // Fill the triangle with the given points (randomR, randomC), (pt1Row, pt1Col), (pt2Row, pt2Col)
-        // 1st, check for base cases (straight lines)
-        if ((smallest == 1 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 1)) { // straight line up and down
-            // start from top
-            
-            int r = std::min(pt1Row, pt2Row);
-            int stop = std::max(pt1Row, pt2Row);
-            while (r <= stop) {
-                modified.at<cv::Vec3b>(r, randomC)[0] = originalBlue;
-                modified.at<cv::Vec3b>(r, randomC)[1] = originalGreen;
-                modified.at<cv::Vec3b>(r, randomC)[2] = originalRed;
-                ++r;
-            }
-        }
-        else if ((smallest == 2 && secondSmallest == 4) || (smallest == 4 && secondSmallest == 2)) { // straight line left and right
-            // Start from left
-            
-            int c = std::min(pt1Col, pt2Col);
-            int stop = std::max(pt1Col, pt2Col);
-            while (c <= stop) {
-                modified.at<cv::Vec3b>(randomR, c)[0] = originalBlue;
-                modified.at<cv::Vec3b>(randomR, c)[1] = originalGreen;
-                modified.at<cv::Vec3b>(randomR, c)[2] = originalRed;
-                ++c;
-            }		
-        }
-        else {
-            // It's a right triangle.
-            int horzDistance, vertDistance;
-            int subPerLine;
-            int eachLine;
-
-            horzDistance = abs(pt2Col - randomC);
-            if (horzDistance == 0)
-                horzDistance = abs(pt1Col - randomC);
-            vertDistance = abs(pt2Row - randomR);
-            if (vertDistance == 0)
-                vertDistance = abs(pt1Row - randomR);
-
-            if (horzDistance == 0)
-                horzDistance = 1;
-
-            subPerLine = vertDistance / horzDistance;
-            eachLine = horzDistance;
-
-            if ((smallest == 2 && secondSmallest == 1) || (smallest == 1 && secondSmallest == 2)) {
-                // Draw triangle in 1st quadrant
-                for (int r = randomR; r >= randomR - vertDistance; --r) {
-                    for (int c = randomC; c <= (randomC + eachLine); ++c) {
-                        if (isClose(originalBlue, originalGreen, originalRed,
-                            original.at<cv::Vec3b>(r, c)[0],
-                            original.at<cv::Vec3b>(r, c)[1],
-                            original.at<cv::Vec3b>(r, c)[2], strength)) {
-                                modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
-                                modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
-                                modified.at<cv::Vec3b>(r, c)[2] = originalRed;
-                        }
-                    }
-                    eachLine -= subPerLine;
-                }	
-                
-            }
-            else if ((smallest == 2 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 2)) {
-                // Draw triangle in 4th quadrant
-                for (int r = randomR; r <= randomR + vertDistance; ++r) {
-                    for (int c = randomC; c <= (randomC + eachLine); ++c) {
-                        if (isClose(originalBlue, originalGreen, originalRed,
-                            original.at<cv::Vec3b>(r, c)[0],
-                            original.at<cv::Vec3b>(r, c)[1],
-                            original.at<cv::Vec3b>(r, c)[2], strength)) {
-                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
-                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
-                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
-                        }
-                    }
-                    eachLine -= subPerLine;
-                }
-            }
-            else if ((smallest == 4 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 4)) {
-                // Draw triangle in 3rd quadrant
-                for (int r = randomR; r <= randomR + vertDistance; ++r) {
-                    for (int c = randomC; c >= (randomC - eachLine); --c) {
-                        if (isClose(originalBlue, originalGreen, originalRed,
-                            original.at<cv::Vec3b>(r, c)[0],
-                            original.at<cv::Vec3b>(r, c)[1],
-                            original.at<cv::Vec3b>(r, c)[2], strength)) {
-                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
-                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
-                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
-                        }
-                    }
-                    eachLine -= subPerLine;
-                }
-            }
-            else {
-                // Draw triangle in 2nd quadrant
-                for (int r = randomR; r >= randomR - vertDistance; --r) {
-                    for (int c = randomC; c >= (randomC - eachLine); --c) {
-                        if (isClose(originalBlue, originalGreen, originalRed,
-                            original.at<cv::Vec3b>(r, c)[0],
-                            original.at<cv::Vec3b>(	r, c)[1],
-                            original.at<cv::Vec3b>(r, c)[2], strength)) {
-                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
-                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
-                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
-                        }
-                    }
-                    eachLine -= subPerLine;
-                }
-            }
-        }
-        // Show the modified image
-        cv::imshow("Modified", modified);
-        //cv::waitKey(2);
-        ++count;
-    } while (count < 10000 && cv::waitKey(2) != 27);
-}
-
-
-void motionDetection() {
-    if (prevFrame.empty()) {
-       original.copyTo(prevFrame); 
-    }
-
-    // Compare each pixel of original frame to prevFrame
-    for (int r = 0; r < original.rows; r++) {
-        for (int c = 0; c < original.cols; c++) {
-            float bDiff = std::abs(original.at<cv::Vec3b>(r, c)[0] - prevFrame.at<cv::Vec3b>(r, c)[0]);
-            float gDiff = std::abs(original.at<cv::Vec3b>(r, c)[1] - prevFrame.at<cv::Vec3b>(r, c)[1]);
-            float rDiff = std::abs(original.at<cv::Vec3b>(r, c)[2] - prevFrame.at<cv::Vec3b>(r, c)[2]);            
-            double total = (double)bDiff + (double)gDiff + (double)rDiff;
-            if (total > 110) {
-                modified.at<cv::Vec3b>(r, c)[0] = 255; 
-                modified.at<cv::Vec3b>(r, c)[1] = 255; 
-                modified.at<cv::Vec3b>(r, c)[2] = 255; 
-            } else {
-                modified.at<cv::Vec3b>(r, c)[0] = 0; 
-                modified.at<cv::Vec3b>(r, c)[1] = 0; 
-                modified.at<cv::Vec3b>(r, c)[2] = 0; 
-            }
-        }
-    }
-
-    // copy original to prevFrame
-    for (int r = 0; r < original.rows; r++) {
-        for(int c = 0; c < original.cols; c++) {
-            prevFrame.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0];
-            prevFrame.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1];
-            prevFrame.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2];
-        }
-    }
-}
-
-
-int isClose(float originalB, float originalG, float originalR, float b, float g, float r, int strength) {
-	double distance = sqrt(pow(originalB - b, 2) + pow(originalG - g, 2) + pow(originalR - r, 2));
-	if (distance < strength) return 1;
-	else return 0;
-}
-
-
-double getDistance(float originalBlue, float originalGreen, float originalRed, float blue, float green, float red) {
-	return sqrt(pow(originalBlue - blue, 2) + pow(originalGreen - green, 2) + pow(originalRed - red, 2));
-}
-
-
-int smallest(double up, double right, double down, double left) {
-	double min = std::min(std::min(down, up), std::min(left, right));
-	if (min == up) return 1;
-	else if (min = right) return 2;
-	else if (min == down) return 3;
-	else return 4;
-}
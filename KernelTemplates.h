@@ -0,0 +1,102 @@
+/*
+    Compile-time building blocks for the row kernels (PointKernels.cpp,
+    SobelEngine.cpp, MotionEngine.cpp).
+
+    A kernel is written once as a template over what varies between its
+    variants: the coefficients (ChannelWeights), the pixel layout and type
+    (Interleaved or Planar rows of a pixel type, with the channel count in
+    the type) and, for stencils, the border policy. Each variant the kernel
+    tables hand out is an instantiation, so the coefficients are immediates,
+    the loops over channels are unrolled and the compiler vectorizes a loop
+    specialized for that layout, once per instruction set (SimdDispatch.h).
+
+    The manipulations' floating point constants are turned into fixed point
+    here at compile time, e.g. the grayscale() weights into GrayscaleWeights.
+*/
+
+#ifndef KERNEL_TEMPLATES_H
+#define KERNEL_TEMPLATES_H
+
+#include "SimdDispatch.h"
+#include <algorithm>
+#include <cstdint>
+
+/* value in fixed point with bits fractional bits, rounded to nearest */
+constexpr int32_t fixedPoint(double value, int bits = 16) {
+    return (int32_t)(value * (1 << bits) + 0.5);
+}
+
+/* Weights of the B, G and R channels in 16.16 fixed point */
+template <int32_t Blue, int32_t Green, int32_t Red>
+struct ChannelWeights {
+    static constexpr int32_t blue = Blue;
+    static constexpr int32_t green = Green;
+    static constexpr int32_t red = Red;
+    static constexpr int32_t sum = Blue + Green + Red;
+};
+
+/* .299 R + .587 G + .114 B, as in grayscale() */
+using GrayscaleWeights = ChannelWeights<fixedPoint(.114), fixedPoint(.587),
+                                        fixedPoint(.299)>;
+
+/* .2126 R + .7152 G + .0722 B, as in getLuminosity() */
+using LuminanceWeights = ChannelWeights<fixedPoint(.0722), fixedPoint(.7152),
+                                        fixedPoint(.2126)>;
+
+static_assert(GrayscaleWeights::sum == 1 << 16
+              && LuminanceWeights::sum == 1 << 16,
+              "white has to stay white");
+
+/* A row of Channels interleaved values per pixel: (i, k) is channel k of
+   pixel i */
+template <typename Pixel, int Channels>
+struct Interleaved {
+    static constexpr int channels = Channels;
+    Pixel *row;
+
+    Pixel &operator()(int i, int k) const { return row[Channels * i + k]; }
+};
+
+/* The rows of Channels planes, one per channel (PlanarFrame.h) */
+template <typename Pixel, int Channels>
+struct Planar {
+    static constexpr int channels = Channels;
+    Pixel *planes[Channels];
+
+    Pixel &operator()(int i, int k) const { return planes[k][i]; }
+};
+
+/* Writes value to every channel of pixel i: a gray pixel when interleaved,
+   the one value of a single plane */
+template <typename Dst, typename Value>
+KERNEL_INLINE void writeGray(const Dst &dst, int i, Value value) {
+    for (int k = 0; k < Dst::channels; ++k)
+        dst(i, k) = value;
+}
+
+/* Weighted sum of pixel i's B, G and R, keeping Bits fractional bits
+   (rounded to nearest when Round is set, truncated otherwise) */
+template <typename Weights, int Bits, bool Round, typename Src>
+KERNEL_INLINE int32_t weightedSum(const Src &src, int i) {
+    const int32_t round = Round ? 1 << (15 - Bits) : 0;
+    return (src(i, 0) * Weights::blue + src(i, 1) * Weights::green
+            + src(i, 2) * Weights::red + round) >> (16 - Bits);
+}
+
+/* Border policy for stencils: rows and columns past the edges repeat the
+   edge pixels */
+struct ReplicateBorder {
+    /* The row read for row r of an image of rows rows */
+    static int row(int r, int rows) {
+        return std::min(std::max(r, 0), rows - 1);
+    }
+
+    /* Fills the padding columns -1 and width of a row */
+    template <typename Pixel>
+    static void pad(Pixel *row, int width) {
+        row[-1] = row[0];
+        row[width] = row[width - 1];
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+    Headless live mode (see LiveMode.h).
+*/
+
+#include "LiveMode.h"
+#include "CommandLine.h"
+#include "FrameSink.h"
+#include "FrameSource.h"
+#include "FrameStats.h"
+#include "Manipulations.h"
+#include "ParallelExecutor.h"
+#include "WebcamPipeline.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+
+static void printLiveUsage() {
+    std::cout << std::endl << "Usage: image_manipulation --live <source> "
+              << "--filter <0-7> [--frames N]" << std::endl
+              << "    [--threshold 0-255|auto] [--brightness 0-1] [--red 0-150]"
+              << " [--green 0-150] [--blue 0-150]" << std::endl
+              << "    [--motion-threshold 0-765|auto] [--motion-noise 0-255]"
+              << " [--motion-background previous|average]" << std::endl
+              << "    [--motion-adapt 1-8]" << std::endl
+              << "    [--policy block|latest] [--threads N] [--display]"
+              << std::endl
+              << "    [--stats status|file.csv|file.json] [--deadline ms]"
+              << std::endl
+              << "    [--tiles N] [--tile-tolerance 0-255] [--target-fps N]"
+              << " [--planar]" << std::endl
+              << "    [--huge-pages] [--output <sink>] [--output-queue N]"
+              << " [--output-policy block|drop]" << std::endl
+              << "Sources: camera[:N], video:<path>, images:<pattern>, "
+              << "synthetic[:options] (see FrameSource.h)" << std::endl
+              << "Sinks: video:<path>[,fps=N], images:<pattern>, raw:<path>"
+              << " (see FrameSink.h)" << std::endl;
+}
+
+
+int runLiveMode(int argc, char **argv) {
+    std::string sourceDescription;
+    int choice = -1;
+    ManipulationSpecs specs;
+    PipelineOptions pipeline = pipelineOptionsFromEnvironment();
+    pipeline.policy = QueuePolicy::Block;  // Every frame, for repeatable runs
+    bool display = false;
+    double value;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--display") {
+            display = true;
+            continue;
+        }
+        if (flag == "--planar") {
+            pipeline.planar = true;
+            continue;
+        }
+        if (flag == "--huge-pages") {
+            pipeline.hugePages = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            printLiveUsage();
+            return -1;
+        }
+        std::string text = argv[++i];
+
+        bool valid = true;
+        if (flag == "--live") {
+            sourceDescription = text;
+        } else if (flag == "--filter") {
+            valid = parseNumberOption(flag, text, 0, 7, value);
+            choice = value;
+        } else if (flag == "--policy") {
+            valid = text == "block" || text == "latest";
+            pipeline.policy = text == "latest" ? QueuePolicy::LatestOnly
+                                               : QueuePolicy::Block;
+        } else if (flag == "--stats") {
+            pipeline.statsTarget = text;
+        } else if (flag == "--deadline") {
+            valid = parseNumberOption(flag, text, 0, 1e6, value);
+            frameStats().setDeadline(value / 1000);
+        } else if (flag == "--frames") {
+            valid = parseNumberOption(flag, text, 1, 1e12, value);
+            pipeline.maxFrames = value;
+        } else if (flag == "--tiles") {
+            valid = parseNumberOption(flag, text, 0, 4096, value);
+            pipeline.tileSize = value;
+        } else if (flag == "--tile-tolerance") {
+            valid = parseNumberOption(flag, text, 0, 255, value);
+            pipeline.tileTolerance = value;
+        } else if (flag == "--target-fps") {
+            valid = parseNumberOption(flag, text, 0, 1000, value);
+            pipeline.targetFps = value;
+        } else if (flag == "--output") {
+            pipeline.output = text;
+        } else if (flag == "--output-queue") {
+            valid = parseNumberOption(flag, text, 1, 1024, value);
+            pipeline.outputQueue = value;
+        } else if (flag == "--output-policy") {
+            valid = text == "block" || text == "drop";
+            pipeline.outputPolicy = text == "block" ? SinkPolicy::Block
+                                                    : SinkPolicy::Drop;
+        } else if (flag == "--threads") {
+            valid = parseNumberOption(flag, text, 1, 1024, value);
+            configureExecutor(value, 0);
+        } else if (!parseSpecsOption(flag, text, specs, valid)) {
+            std::cout << "Unknown option " << flag << std::endl;
+            valid = false;
+        }
+        if (!valid) {
+            printLiveUsage();
+            return -1;
+        }
+    }
+
+    if (sourceDescription.empty() || choice < 0) {
+        std::cout << "--live and --filter are required" << std::endl;
+        printLiveUsage();
+        return -1;
+    }
+
+    std::string error;
+    std::unique_ptr<FrameSource> source = openFrameSource(sourceDescription,
+                                                          error);
+    if (!source) {
+        std::cout << "Error opening frame source: " << error << std::endl;
+        return -1;
+    }
+    std::unique_ptr<FrameSink> output;
+    if (!pipeline.output.empty()) {
+        output = openFrameSink(pipeline.output, error);
+        if (!output) {
+            std::cout << "Error opening output: " << error << std::endl;
+            return -1;
+        }
+    }
+
+    std::string window;
+    if (display) {
+        window = "Modified";
+        cv::namedWindow(window, cv::WINDOW_FREERATIO);
+    }
+    runLivePipeline(*source, window, choice, specs, pipeline,
+                    std::move(output));
+    if (display)
+        cv::destroyAllWindows();
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+    Headless live mode: runs a live manipulation (the webcam menu's choices,
+    7 being motion detection) through the capture/process/display pipeline
+    (WebcamPipeline.h) on any frame source (FrameSource.h), so the live
+    manipulations can be measured reproducibly without a camera or display.
+    Usage:
+
+    image_manipulation --live <source> --filter <0-7> [--frames N]
+                       [--threshold 0-255|auto] [--brightness 0-1]
+                       [--red 0-150] [--green 0-150] [--blue 0-150]
+                       [--motion-threshold 0-765|auto]
+                       [--motion-noise 0-255]
+                       [--motion-background previous|average]
+                       [--motion-adapt 1-8]
+                       [--policy block|latest] [--threads N] [--display]
+                       [--stats status|file.csv|file.json] [--deadline ms]
+                       [--tiles N] [--tile-tolerance 0-255]
+                       [--target-fps N] [--planar] [--huge-pages]
+                       [--output <sink>] [--output-queue N]
+                       [--output-policy block|drop]
+
+    e.g. --live synthetic:1080p,fps=0,frames=600 --filter 7
+    The stage report is printed once the source ends (or after N frames).
+    Every frame is processed unless --policy latest drops stale ones like
+    webcam mode does. The ring depth comes from IMAGE_MANIPULATION_QUEUE.
+    --stats exports the frame stats every second while running (see
+    FrameStats.h) and --deadline sets the capture to display deadline.
+    --tiles N reprocesses only the changed N x N tiles of each frame (see
+    DirtyTiles.h). --target-fps N lowers the processing resolution while
+    the manipulation can't keep up with N frames/sec (see
+    ResolutionController.h). --planar manipulates planar frames
+    (PlanarFrame.h), converting them at capture and display. --huge-pages
+    backs the frame pool with 2 MB pages (FramePool.h). --output writes the
+    frames to a video, numbered images or a raw file (FrameSink.h) from an
+    encoder thread, through a queue of --output-queue frames which drops
+    frames when full unless --output-policy is block.
+*/
+
+#ifndef LIVE_MODE_H
+#define LIVE_MODE_H
+
+/* Runs live mode with the program's command line, returns the exit code */
+int runLiveMode(int argc, char **argv);
+
+#endif
@@ -0,0 +1,292 @@
+/*
+    Load test client of the frame processing daemon (the
+    image_manipulation_loadtest target, see FrameServer.h).
+
+    Connects several clients to a running daemon at once, each on its own
+    thread with its own synthetic frames (FrameSource.h), keeping --depth
+    requests in flight: a frame is written straight into a free slot of the
+    client's ring and submitted, and as each reply comes in its slot gets
+    the next frame. Reports the requests/sec and MPix/s over every client,
+    the round trip of the requests as each client saw it (frame submitted
+    to reply received) and how long the daemon says they were queued and
+    manipulated.
+
+    Usage:
+    image_manipulation_loadtest --socket <path> [--clients N]
+                                [--requests N] [--depth N] [--size WxH]
+                                [--filter 0-7] [specs] [--verify]
+
+    --requests is per client. The specs are live mode's (--threshold,
+    --motion-threshold... see LiveMode.h). --verify also runs every frame
+    locally, in the same order with its own state, and counts the replies
+    whose output differs.
+*/
+
+#include "opencv2/opencv.hpp"
+#include "CommandLine.h"
+#include "FrameClient.h"
+#include "FrameSource.h"
+#include "FrameStats.h"
+#include "Manipulations.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+
+struct LoadTestOptions {
+    std::string socketPath;
+    int clients = 4;
+    int requests = 500;  // Per client
+    int depth = 2;       // Requests in flight per client
+    cv::Size size = cv::Size(1280, 720);
+    int choice = 2;
+    ManipulationSpecs specs;
+    bool verify = false;
+};
+
+/* What every client adds to */
+struct LoadTestTotals {
+    LatencyHistogram roundTrip;
+    LatencyHistogram queued;  // In the daemon, as its replies say
+    LatencyHistogram manipulate;
+    std::atomic<uint64_t> replies{0};
+    std::atomic<uint64_t> failed{0};      // Not Ok
+    std::atomic<uint64_t> mismatched{0};  // Differing from --verify's
+    std::mutex mutex;  // Guards errors and the start gate
+    std::vector<std::string> errors;
+    std::condition_variable startGate;
+    int connected = 0;
+    bool started = false;
+};
+
+
+static bool sameFrame(const cv::Mat &a, const cv::Mat &b) {
+    if (a.size() != b.size() || a.type() != b.type())
+        return false;
+    size_t rowBytes = a.cols * a.elemSize();
+    for (int r = 0; r < a.rows; ++r) {
+        if (std::memcmp(a.ptr(r), b.ptr(r), rowBytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+
+/* One client's run, on its own thread */
+static void runClient(int index, const LoadTestOptions &options,
+                      LoadTestTotals &totals) {
+    FrameClient client;
+    std::string error;
+    bool connected = client.connect(options.socketPath, options.depth,
+                                    options.size, error);
+    {
+        // Everyone starts together once connected (or failed to)
+        std::unique_lock<std::mutex> lock(totals.mutex);
+        if (!connected)
+            totals.errors.push_back("client " + std::to_string(index)
+                                    + ": " + error);
+        ++totals.connected;
+        totals.startGate.notify_all();
+        totals.startGate.wait(lock, [&] { return totals.started; });
+    }
+    if (!connected)
+        return;
+
+    SyntheticOptions synthetic;
+    synthetic.width = options.size.width;
+    synthetic.height = options.size.height;
+    synthetic.fps = 0;
+    synthetic.seed = index + 1;
+    SyntheticSource source(synthetic);
+    ManipulationState state;  // --verify's
+    cv::Mat expected;
+    std::vector<StatsClock::time_point> submitted(client.slots());
+
+    int sent = 0, received = 0;
+    auto submit = [&](int slot) {
+        cv::Mat frame = client.input(slot, options.size);
+        source.read(frame);  // Straight into the shared ring
+        submitted[slot] = StatsClock::now();
+        return client.submit(sent++, slot, options.size, options.choice,
+                             options.specs, error);
+    };
+
+    bool ok = true;
+    for (int slot = 0; ok && slot < client.slots() && sent < options.requests;
+         ++slot)
+        ok = submit(slot);
+    while (ok && received < sent) {
+        ServiceReply reply;
+        if (!client.receive(reply, error)) {
+            ok = false;
+            break;
+        }
+        if (reply.slot >= (uint32_t)client.slots()) {
+            error = "reply for slot " + std::to_string(reply.slot);
+            ok = false;
+            break;
+        }
+        totals.roundTrip.record(submitted[reply.slot], StatsClock::now());
+        totals.queued.record(reply.queuedNanos);
+        totals.manipulate.record(reply.processNanos);
+        ++totals.replies;
+        ++received;
+        if (reply.status != (int32_t)ServiceStatus::Ok) {
+            ++totals.failed;
+        } else if (options.verify) {
+            executeManipulation(options.choice, 2,
+                                client.input(reply.slot, options.size),
+                                expected, options.specs, state);
+            if (!sameFrame(expected, client.output(reply.slot, options.size)))
+                ++totals.mismatched;
+        }
+        if (sent < options.requests)
+            ok = submit(reply.slot);
+    }
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(totals.mutex);
+        totals.errors.push_back("client " + std::to_string(index) + ": "
+                                + error);
+    }
+}
+
+
+static bool parseLoadTestOptions(int argc, char **argv,
+                                 LoadTestOptions &options) {
+    double value;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--verify") {
+            options.verify = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            return false;
+        }
+        std::string text = argv[++i];
+
+        bool valid = true;
+        if (flag == "--socket") {
+            options.socketPath = text;
+        } else if (flag == "--clients") {
+            valid = parseNumberOption(flag, text, 1, 4096, value);
+            options.clients = value;
+        } else if (flag == "--requests") {
+            valid = parseNumberOption(flag, text, 1, 1e9, value);
+            options.requests = value;
+        } else if (flag == "--depth") {
+            valid = parseNumberOption(flag, text, 1, 256, value);
+            options.depth = value;
+        } else if (flag == "--size") {
+            valid = parseSizeOption(flag, text, 32768, options.size.width,
+                                    options.size.height);
+        } else if (flag == "--filter") {
+            valid = parseNumberOption(flag, text, 0, 7, value);
+            options.choice = value;
+        } else if (!parseSpecsOption(flag, text, options.specs, valid)) {
+            std::cout << "Unknown option " << flag << std::endl;
+            valid = false;
+        }
+        if (!valid)
+            return false;
+    }
+    if (options.socketPath.empty()) {
+        std::cout << "--socket is required" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+static double milliseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+
+static void printHistogram(const char *name, const LatencyHistogram &values) {
+    HistogramSnapshot snapshot = values.snapshot();
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::setw(10) << milliseconds(snapshot.percentile(0.5))
+              << std::setw(10) << milliseconds(snapshot.percentile(0.9))
+              << std::setw(10) << milliseconds(snapshot.percentile(0.99))
+              << std::setw(10) << milliseconds(snapshot.max) << std::endl;
+}
+
+
+int main(int argc, char **argv) {
+    LoadTestOptions options;
+    if (!parseLoadTestOptions(argc, argv, options)) {
+        std::cout << std::endl << "Usage: image_manipulation_loadtest "
+                  << "--socket <path> [--clients N]" << std::endl
+                  << "    [--requests N] [--depth N] [--size WxH] "
+                  << "[--filter 0-7] [specs] [--verify]" << std::endl;
+        return -1;
+    }
+
+    LoadTestTotals totals;
+    std::vector<std::thread> clients;
+    for (int i = 0; i < options.clients; ++i)
+        clients.emplace_back(runClient, i, std::cref(options),
+                             std::ref(totals));
+    StatsClock::time_point began;
+    {
+        std::unique_lock<std::mutex> lock(totals.mutex);
+        totals.startGate.wait(lock, [&] {
+            return totals.connected == options.clients;
+        });
+        totals.started = true;
+        began = StatsClock::now();
+        totals.startGate.notify_all();
+    }
+    for (std::thread &client : clients)
+        client.join();
+    double seconds = std::chrono::duration<double>(StatsClock::now()
+                                                   - began).count();
+
+    for (const std::string &error : totals.errors)
+        std::cout << "Error: " << error << std::endl;
+    uint64_t replies = totals.replies;
+    std::cout << options.clients << " clients, " << options.depth
+              << " in flight each, " << options.size.width << "x"
+              << options.size.height << " filter " << options.choice
+              << std::endl << replies << " replies (" << totals.failed
+              << " failed) in " << std::fixed << std::setprecision(2)
+              << seconds << " s: "
+              << (seconds > 0 ? replies / seconds : 0) << " requests/sec, "
+              << (seconds > 0 ? replies * options.size.area() / seconds / 1e6
+                              : 0)
+              << " MPix/s" << std::endl << std::endl
+              << "ms                 p50       p90       p99       max"
+              << std::endl;
+    printHistogram("round trip", totals.roundTrip);
+    printHistogram("queued", totals.queued);
+    printHistogram("manipulate", totals.manipulate);
+    std::cout << std::defaultfloat;
+    if (options.verify) {
+        std::cout << std::endl << "Verified: " << totals.mismatched
+                  << " of " << replies - totals.failed
+                  << " outputs differ from the local manipulation"
+                  << std::endl;
+    }
+    bool passed = totals.errors.empty() && totals.failed == 0
+                  && totals.mismatched == 0;
+    return passed ? 0 : -1;
+}
+
+#else
+
+int main() {
+    std::cout << "The load test needs Linux, like daemon mode" << std::endl;
+    return -1;
+}
+
+#endif
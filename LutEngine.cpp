@@ -0,0 +1,198 @@
+/*
+    Lookup table engine for the per-channel point manipulations (see
+    LutEngine.h).
+*/
+
+#include "LutEngine.h"
+#include "Manipulations.h"
+#include <algorithm>
+
+
+PointLut identityLut() {
+    PointLut lut;
+    for (int k = 0; k < 3; ++k) {
+        for (int v = 0; v < 256; ++v) {
+            lut.pre[k][v] = v;
+            lut.post[k][v] = v;
+        }
+    }
+    for (int s = 0; s < 766; ++s)
+        lut.sum[s] = s / 3;
+    return lut;
+}
+
+
+bool isLutManipulation(int choice) {
+    return choice == 1 || choice == 3 || choice == 4;
+}
+
+
+PointLut makeManipulationLut(int choice, const ManipulationSpecs &specs) {
+    PointLut lut = identityLut();
+    double factor[3] = {1, 1, 1};
+
+    switch (choice) {
+        case 1:  // Black and white, on the average of the channels
+            lut.reduces = true;
+            for (int s = 0; s < 766; ++s)
+                lut.sum[s] = s / 3.0 > specs.bwThreshold ? 255 : 0;
+            return lut;
+        case 3:  // Darken
+            factor[0] = factor[1] = factor[2] = specs.brightnessConstant;
+            break;
+        case 4:  // RGB values (BGR order)
+            factor[0] = specs.blueMult / 100.0;
+            factor[1] = specs.greenMult / 100.0;
+            factor[2] = specs.redMult / 100.0;
+            break;
+        default:
+            return lut;
+    }
+
+    // Same conversion (through int) as the at<> loops
+    for (int k = 0; k < 3; ++k) {
+        for (int v = 0; v < 256; ++v)
+            lut.pre[k][v] = (int)(v * factor[k]);
+    }
+    return lut;
+}
+
+
+PointLut composeLuts(const PointLut &first, const PointLut &second) {
+    PointLut lut = first;
+
+    if (!first.reduces) {
+        // Channels go through both sets of pre tables, then second's sum
+        for (int k = 0; k < 3; ++k) {
+            for (int v = 0; v < 256; ++v)
+                lut.pre[k][v] = second.pre[k][first.pre[k][v]];
+        }
+        lut.reduces = second.reduces;
+        std::copy(second.sum, second.sum + 766, lut.sum);
+        std::copy(&second.post[0][0], &second.post[0][0] + 3 * 256,
+                  &lut.post[0][0]);
+        return lut;
+    }
+
+    // first reduces every pixel to one value x, whose channels then go
+    // through all of second
+    for (int x = 0; x < 256; ++x) {
+        uint8_t channel[3];
+        int sum = 0;
+        for (int k = 0; k < 3; ++k) {
+            channel[k] = second.pre[k][first.post[k][x]];
+            sum += channel[k];
+        }
+        for (int k = 0; k < 3; ++k) {
+            lut.post[k][x] = second.reduces ? second.post[k][second.sum[sum]]
+                                            : channel[k];
+        }
+    }
+    return lut;
+}
+
+
+void applyLutRow(const PointLut &lut, const uint8_t *src, uint8_t *dst,
+                 int pixels) {
+    const uint8_t *blue = lut.pre[0], *green = lut.pre[1], *red = lut.pre[2];
+
+    if (!lut.reduces) {
+        for (int i = 0; i < pixels * 3; i += 3) {
+            dst[i] = blue[src[i]];
+            dst[i + 1] = green[src[i + 1]];
+            dst[i + 2] = red[src[i + 2]];
+        }
+        return;
+    }
+
+    for (int i = 0; i < pixels * 3; i += 3) {
+        uint8_t value = lut.sum[blue[src[i]] + green[src[i + 1]]
+                                + red[src[i + 2]]];
+        dst[i] = lut.post[0][value];
+        dst[i + 1] = lut.post[1][value];
+        dst[i + 2] = lut.post[2][value];
+    }
+}
+
+
+/* The choices followed by the specifications the tables depend on, into
+   key (reusing its memory) */
+static void lutKey(const std::vector<int> &choices,
+                   const ManipulationSpecs &specs, std::vector<double> &key) {
+    key.assign(choices.begin(), choices.end());
+    for (int choice : choices) {
+        if (choice == 1) {
+            key.push_back(specs.bwThreshold);
+        } else if (choice == 3) {
+            key.push_back(specs.brightnessConstant);
+        } else if (choice == 4) {
+            key.push_back(specs.blueMult);
+            key.push_back(specs.greenMult);
+            key.push_back(specs.redMult);
+        }
+    }
+}
+
+
+/* The tables a thread got last. They only depend on their key, so they
+   stay right even once the cache has dropped them */
+struct LastLut {
+    const LutCache *cache = nullptr;
+    std::vector<double> key;
+    std::shared_ptr<const PointLut> lut;
+};
+
+
+std::shared_ptr<const PointLut> LutCache::get(const std::vector<int> &choices,
+                                              const ManipulationSpecs &specs) {
+    // Reused between calls on the same thread, a frame's bands look the
+    // tables up without allocating or locking
+    static thread_local std::vector<double> key;
+    static thread_local LastLut last;
+    lutKey(choices, specs, key);
+    if (last.cache == this && last.lut && key == last.key)
+        return last.lut;
+
+    std::shared_ptr<const PointLut> found;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++uses;
+        for (Entry &entry : entries) {
+            if (entry.key == key) {
+                entry.lastUse = uses;
+                found = entry.lut;
+                break;
+            }
+        }
+        if (!found) {
+            std::shared_ptr<PointLut> lut
+                = std::make_shared<PointLut>(identityLut());
+            for (int choice : choices)
+                *lut = composeLuts(*lut, makeManipulationLut(choice, specs));
+            found = lut;
+            ++buildCount;
+
+            if (entries.size() < CAPACITY) {
+                entries.push_back(Entry{key, found, uses});
+            } else {
+                Entry &oldest = *std::min_element(
+                    entries.begin(), entries.end(),
+                    [](const Entry &a, const Entry &b) {
+                        return a.lastUse < b.lastUse;
+                    });
+                oldest = Entry{key, found, uses};
+            }
+        }
+    }
+
+    last.cache = this;
+    last.key = key;
+    last.lut = found;
+    return found;
+}
+
+
+LutCache &manipulationLutCache() {
+    static LutCache cache;
+    return cache;
+}
@@ -0,0 +1,84 @@
+/*
+    Lookup table engine for the per-channel point manipulations (darken,
+    RGB values and black and white).
+
+    A PointLut maps every channel through its own 256 entry table. Black and
+    white also reduces each pixel to one value (white or black) from the sum
+    of its mapped channels, after which that value goes through a second set
+    of per-channel tables. Any sequence of these manipulations composes into
+    a single PointLut, so applying several of them costs one gather pass.
+
+    Tables are made from the manipulation specifications and kept in a
+    LutCache, which keeps the tables of the last few specifications, so
+    streams and clients with specifications of their own don't rebuild them
+    in turn. Darken and RGB values run through them on their own too (their
+    tables are exact for every multiplier, where the fixed point kernels are
+    not), while black and white alone keeps its arithmetic kernel, which
+    needs no gathers.
+*/
+
+#ifndef LUT_ENGINE_H
+#define LUT_ENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct ManipulationSpecs;
+
+struct PointLut {
+    uint8_t pre[3][256];     // Per channel (BGR), applied first
+    bool reduces = false;    // Pixel reduced to one value from its sum
+    uint8_t sum[766];        // Sum of the pre mapped channels -> value
+    uint8_t post[3][256];    // Per channel, applied to the reduced value
+};
+
+/* Identity table (no change) */
+PointLut identityLut();
+
+/* Whether a menu choice can be expressed as a PointLut (1, 3 and 4) */
+bool isLutManipulation(int choice);
+
+/* Table for a menu choice, matching its at<> loop exactly */
+PointLut makeManipulationLut(int choice, const ManipulationSpecs &specs);
+
+/* Table applying first, then second */
+PointLut composeLuts(const PointLut &first, const PointLut &second);
+
+/* Applies a table to `pixels` BGR pixels (src and dst may be the same) */
+void applyLutRow(const PointLut &lut, const uint8_t *src, uint8_t *dst,
+                 int pixels);
+
+/* Composed tables for sequences of menu choices, built once per choices
+   and specifications they depend on. The last CAPACITY are kept, and each
+   thread remembers the last tables it got, so a frame's bands find them
+   without locking */
+class LutCache {
+public:
+    static const size_t CAPACITY = 8;
+
+    std::shared_ptr<const PointLut> get(const std::vector<int> &choices,
+                                        const ManipulationSpecs &specs);
+
+    /* Number of times tables were (re)built, for checking the cache works */
+    int builds() const { return buildCount; }
+
+private:
+    struct Entry {
+        std::vector<double> key;
+        std::shared_ptr<const PointLut> lut;
+        uint64_t lastUse;
+    };
+
+    std::mutex mutex;
+    std::vector<Entry> entries;  // Up to CAPACITY, least recently used out
+    uint64_t uses = 0;
+    std::atomic<int> buildCount{0};
+};
+
+/* The program wide cache used by executeManipulation() */
+LutCache &manipulationLutCache();
+
+#endif
@@ -0,0 +1,915 @@
+/*
+    Manipulation functions shared by the interactive menu and batch mode.
+
+    Every manipulation reads from the given original image and writes to the
+    given modified image, so several images can be processed at once on
+    different threads (see BatchMode.cpp), and executeManipulation() splits
+    each frame into row bands run on the thread pool (ParallelExecutor.h).
+*/
+
+#include "Manipulations.h"
+#include "BackendProfile.h"
+#include "FrameStats.h"
+#include "LutEngine.h"
+#include "MotionEngine.h"
+#include "ParallelExecutor.h"
+#include "PointKernels.h"
+#include "SobelEngine.h"
+#include <algorithm>
+#include <cmath>
+
+/* State of the menu's and the live loop's frames (the webcam's motion
+   detection background) */
+static ManipulationState sharedState;
+
+static void manipulateRows(int menuChoice, const cv::Mat &original,
+                           cv::Mat &modified, const ManipulationSpecs &specs,
+                           MotionDetector &motion, int rowBegin, int rowEnd);
+static void manipulatePlanarRows(int menuChoice, const PlanarFrame &original,
+                                 PlanarFrame &modified,
+                                 const ManipulationSpecs &specs,
+                                 MotionDetector &motion, int rowBegin,
+                                 int rowEnd);
+
+
+void executeManipulation(int menuChoice, int mode, const cv::Mat &original,
+                         cv::Mat &modified, const ManipulationSpecs &specs) {
+    executeManipulation(menuChoice, mode, original, modified, specs,
+                        sharedState);
+}
+
+
+void executeManipulation(int menuChoice, int mode, const cv::Mat &original,
+                         cv::Mat &modified, const ManipulationSpecs &specs,
+                         ManipulationState &state) {
+    StageTimer timer(FrameStage::Manipulate);
+    modified.create(original.size(), original.type());
+
+    // Approximation paints strokes within tiles instead of row bands
+    if (menuChoice == 7 && mode == 1) {
+        approximateTiled(original, modified, specs.approximation,
+                         [](const cv::Mat &canvas) {
+            cv::imshow("Modified", canvas);
+            return cv::waitKey(1) != 27;
+        });
+        return;
+    }
+
+    // The automatic threshold needs the whole frame's histogram, the
+    // webcam's frames following on from the ones before
+    if (menuChoice == 1 && specs.bwThreshold < 0) {
+        autoBlackWhite(original, modified,
+                       mode == 2 ? &state.blackWhite : nullptr);
+        return;
+    }
+
+    if (menuChoice == 7) {
+        state.motion.beginFrame(original, specs.motion);
+        parallelForRows(original.rows, [&](int rowBegin, int rowEnd) {
+            manipulateRows(menuChoice, original, modified, specs,
+                           state.motion, rowBegin, rowEnd);
+        });
+        state.motion.endFrame();
+        return;
+    }
+
+    // The others run on the backend picked for this host (BackendProfile.h)
+    runManipulationBackend(menuChoice,
+                           selectBackend(menuChoice, original.size(), &specs),
+                           original, modified, specs);
+}
+
+
+void runManipulationBackend(int menuChoice,
+                            const ManipulationBackend *backend,
+                            const cv::Mat &original, cv::Mat &modified,
+                            const ManipulationSpecs &specs) {
+    modified.create(original.size(), original.type());
+    if (backend && backend->run && !backend->rowBands) {
+        backend->run(original, modified, specs);
+        return;
+    }
+    parallelForRows(original.rows, [&](int rowBegin, int rowEnd) {
+        if (backend && backend->run) {
+            cv::Mat source = original.rowRange(rowBegin, rowEnd);
+            cv::Mat band = modified.rowRange(rowBegin, rowEnd);
+            backend->run(source, band, specs);
+        } else {
+            manipulateRows(menuChoice, original, modified, specs,
+                           sharedState.motion, rowBegin, rowEnd);
+        }
+    });
+}
+
+
+void executePlanarManipulation(int menuChoice, int mode,
+                               const PlanarFrame &original,
+                               PlanarFrame &modified,
+                               const ManipulationSpecs &specs) {
+    executePlanarManipulation(menuChoice, mode, original, modified, specs,
+                              sharedState);
+}
+
+
+void executePlanarManipulation(int menuChoice, int mode,
+                               const PlanarFrame &original,
+                               PlanarFrame &modified,
+                               const ManipulationSpecs &specs,
+                               ManipulationState &state) {
+    if (menuChoice == 7 && mode == 1) {
+        cv::Mat image, painted;
+        fromPlanar(original, image);
+        executeManipulation(menuChoice, mode, image, painted, specs, state);
+        toPlanar(painted, modified);
+        return;
+    }
+
+    StageTimer timer(FrameStage::Manipulate);
+    modified.create(original.size(), planarOutputChannels(menuChoice, mode));
+    if (menuChoice == 1 && specs.bwThreshold < 0) {
+        autoBlackWhite(original, modified,
+                       mode == 2 ? &state.blackWhite : nullptr);
+        return;
+    }
+    if (menuChoice == 7)
+        state.motion.beginFrame(original, specs.motion);
+
+    parallelForRows(original.rows(), [&](int rowBegin, int rowEnd) {
+        manipulatePlanarRows(menuChoice, original, modified, specs,
+                             state.motion, rowBegin, rowEnd);
+    });
+
+    if (menuChoice == 7)
+        state.motion.endFrame();
+}
+
+
+int planarOutputChannels(int menuChoice, int mode) {
+    if (const PointFilter *filter = findPointFilter(menuChoice))
+        return filter->planarChannels;
+    switch (menuChoice) {
+        case 6:
+            return 1;
+        case 7:
+            return mode == 2 ? 1 : 3;
+        default:
+            return 3;
+    }
+}
+
+
+/* The point kernels' parameters for a menu choice */
+static PointParams pointParams(int menuChoice,
+                               const ManipulationSpecs &specs) {
+    PointParams params;
+    params.threshold = specs.bwThreshold;
+    if (menuChoice == 3) {
+        double k = specs.brightnessConstant;
+        params.scale = makeChannelScale(k, k, k);
+    } else if (menuChoice == 4) {
+        params.scale = makeChannelScale(specs.blueMult / 100.0,
+                                        specs.greenMult / 100.0,
+                                        specs.redMult / 100.0);
+    }
+    return params;
+}
+
+
+void manipulatePlanarRows(int menuChoice, const PlanarFrame &original,
+                          PlanarFrame &modified,
+                          const ManipulationSpecs &specs, int rowBegin,
+                          int rowEnd) {
+    manipulatePlanarRows(menuChoice, original, modified, specs,
+                         sharedState.motion, rowBegin, rowEnd);
+}
+
+
+/* Planar version of manipulateRows(). Point kernels (the registry in
+ * PointKernels.h) run over whole padded rows (PlanarFrame.h) */
+static void manipulatePlanarRows(int menuChoice, const PlanarFrame &original,
+                                 PlanarFrame &modified,
+                                 const ManipulationSpecs &specs,
+                                 MotionDetector &motion, int rowBegin,
+                                 int rowEnd) {
+    if (menuChoice == 6) {
+        sobelOutlinePlanarRows(original, modified.ptr(0, rowBegin),
+                               modified.step(), rowBegin, rowEnd);
+        return;
+    }
+    if (menuChoice == 7) {
+        motion.detectRows(original, modified, rowBegin, rowEnd);
+        return;
+    }
+
+    const PointFilter *filter = findPointFilter(menuChoice);
+    if (!filter)
+        return;
+    PointParams params = pointParams(menuChoice, specs);
+    for (int r = rowBegin; r < rowEnd; ++r) {
+        const uint8_t *src[3] = {original.ptr(0, r), original.ptr(1, r),
+                                 original.ptr(2, r)};
+        uint8_t *dst[3] = {};
+        for (int k = 0; k < modified.channels(); ++k)
+            dst[k] = modified.ptr(k, r);
+        filter->planarRow(src, dst, original.step(), params);
+    }
+}
+
+
+void manipulateRows(int menuChoice, const cv::Mat &original,
+                    cv::Mat &modified, const ManipulationSpecs &specs,
+                    int rowBegin, int rowEnd,
+                    const ManipulationBackend *backend) {
+    if (backend && backend->run && backend->rowBands) {
+        cv::Mat source = original.rowRange(rowBegin, rowEnd);
+        cv::Mat band = modified.rowRange(rowBegin, rowEnd);
+        backend->run(source, band, specs);
+        return;
+    }
+    manipulateRows(menuChoice, original, modified, specs, sharedState.motion,
+                   rowBegin, rowEnd);
+}
+
+
+/* Runs a manipulation (other than approximate) on the band of rows
+ * [rowBegin, rowEnd) of modified. Stencils read the rows around the band
+ * from original, motion detection compares them against motion's
+ * background */
+static void manipulateRows(int menuChoice, const cv::Mat &original,
+                           cv::Mat &modified, const ManipulationSpecs &specs,
+                           MotionDetector &motion, int rowBegin, int rowEnd) {
+    cv::Mat source = original.rowRange(rowBegin, rowEnd);
+    cv::Mat band = modified.rowRange(rowBegin, rowEnd);
+
+    switch (menuChoice) {
+        case 3:
+        case 4:
+            manipulationLut(menuChoice, source, band, specs);
+            break;
+        case 6:
+            sobelOutlineRows(original.ptr<uint8_t>(), original.step,
+                             band.ptr<uint8_t>(), band.step, original.cols,
+                             original.rows, rowBegin, rowEnd);
+            break;
+        case 7:
+            motion.detectRows(original, modified, rowBegin, rowEnd);
+            break;
+        default:
+            // The other point manipulations, through the registry
+            if (const PointFilter *filter = findPointFilter(menuChoice)) {
+                PointParams params = pointParams(menuChoice, specs);
+                for (int r = 0; r < band.rows; ++r) {
+                    filter->row(source.ptr<uint8_t>(r), band.ptr<uint8_t>(r),
+                                band.cols, params);
+                }
+            }
+            break;
+    }
+}
+
+
+void originalMedia(const cv::Mat &original, cv::Mat &modified) {
+    for (int r = 0; r < original.rows; r++) {
+        for (int c = 0; c < original.cols; c++) {
+            modified.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0];
+            modified.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1];
+            modified.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2];
+        } 
+    }
+}
+
+
+/* Looks at each pixel of the original image, determines if the RGB components 
+ * surpass a given threshold, and makes the modified equivalent image either
+ * black or white */ 
+void blackWhite(const cv::Mat &original, cv::Mat &modified,
+                const ManipulationSpecs &specs) {
+    for (int r = 0; r < modified.rows; ++r) {
+		for (int c = 0; c < modified.cols; ++c) {
+			float blue = original.at<cv::Vec3b>(r, c)[0];
+			float green = original.at<cv::Vec3b>(r, c)[1];
+			float red = original.at<cv::Vec3b>(r, c)[2];
+			if (((double)blue + (double)green + (double)red) / 3.0 > specs.bwThreshold) {
+				modified.at<cv::Vec3b>(r, c)[0] = 255;
+				modified.at<cv::Vec3b>(r, c)[1] = 255;
+				modified.at<cv::Vec3b>(r, c)[2] = 255;
+			}
+			else {
+				modified.at<cv::Vec3b>(r, c)[0] = 0;
+				modified.at<cv::Vec3b>(r, c)[1] = 0;
+				modified.at<cv::Vec3b>(r, c)[2] = 0;
+			}
+		}
+	}
+}
+
+
+/* Looks at each pixel of the original image and converts the pixel to grayscale
+ * using grayscale formula found online */
+void grayscale(const cv::Mat &original, cv::Mat &modified) {
+    for (int r = 0; r < original.rows; ++r) {                           
+        for (int c = 0; c < original.cols; ++c) {                       
+            float blue = original.at<cv::Vec3b>(r, c)[0];               
+            float green = original.at<cv::Vec3b>(r, c)[1];              
+            float red = original.at<cv::Vec3b>(r, c)[2];                
+
+            double gray = .299 * red + .587 * green + .114 * blue;      
+            modified.at<cv::Vec3b>(r, c)[0] = gray;                     
+            modified.at<cv::Vec3b>(r, c)[1] = gray;                     
+            modified.at<cv::Vec3b>(r, c)[2] = gray;                     
+        }                                                               
+    }       
+}
+
+
+/* Multiplies the pixels by a given constant (between 0-1) to affect brightness */
+void darken(const cv::Mat &original, cv::Mat &modified,
+            const ManipulationSpecs &specs) {
+    for (int r = 0; r < original.rows; ++r) {                           
+        for (int c = 0; c < original.cols; ++c) {                       
+            modified.at<cv::Vec3b>(r, c)[0] = (int)(original.at<cv::Vec3b>(r, c)[0] * specs.brightnessConstant);
+            modified.at<cv::Vec3b>(r, c)[1] = (int)(original.at<cv::Vec3b>(r, c)[1] * specs.brightnessConstant);
+            modified.at<cv::Vec3b>(r, c)[2] = (int)(original.at<cv::Vec3b>(r, c)[2] * specs.brightnessConstant);
+        }                                                               
+    }    
+}
+
+
+/* Multiplies the pixels by a given constant (0-150) to affect percentage.
+ * Values past 255 wrap around (converted through int) */
+void rgbPercentages(const cv::Mat &original, cv::Mat &modified,
+                    const ManipulationSpecs &specs) {
+    for (int r = 0; r < original.rows; ++r) {                           
+        for (int c = 0; c < original.cols; ++c) {                       
+            modified.at<cv::Vec3b>(r, c)[0] = (int)(original.at<cv::Vec3b>(r, c)[0] * (specs.blueMult / 100.0));
+            modified.at<cv::Vec3b>(r, c)[1] = (int)(original.at<cv::Vec3b>(r, c)[1] * (specs.greenMult / 100.0));
+            modified.at<cv::Vec3b>(r, c)[2] = (int)(original.at<cv::Vec3b>(r, c)[2] * (specs.redMult / 100.0));
+        }                                                               
+    }    
+}
+
+
+/* Finds the highest RGB component and maxes it for the given pixel */
+void purify(const cv::Mat &original, cv::Mat &modified) {
+    for (int r = 0; r < original.rows; ++r) {
+		for (int c = 0; c < original.cols; ++c) {
+			float blue = original.at<cv::Vec3b>(r, c)[0];
+			float green = original.at<cv::Vec3b>(r, c)[1];
+			float red = original.at<cv::Vec3b>(r, c)[2];
+
+			if (blue > green && blue > red) {
+				modified.at<cv::Vec3b>(r, c)[0] = 255;
+				modified.at<cv::Vec3b>(r, c)[1] = 0;
+				modified.at<cv::Vec3b>(r, c)[2] = 0;
+			}
+			else if (green > blue && green > red) {
+				modified.at<cv::Vec3b>(r, c)[0] = 0;
+				modified.at<cv::Vec3b>(r, c)[1] = 255;
+				modified.at<cv::Vec3b>(r, c)[2] = 0;
+			}
+			else {
+				modified.at<cv::Vec3b>(r, c)[0] = 0;
+				modified.at<cv::Vec3b>(r, c)[1] = 0;
+				modified.at<cv::Vec3b>(r, c)[2] = 255;
+			}
+		}
+	}
+}
+
+
+/* Vectorized versions of the point manipulations above (see PointKernels.h
+ * for how their results compare). The at<> versions are kept as the
+ * reference the kernels are checked against */
+template <typename RowKernel>
+static void forEachRow(const cv::Mat &original, cv::Mat &modified,
+                       RowKernel kernel) {
+    int rows = original.rows;
+    int pixels = original.cols;
+    if (original.isContinuous() && modified.isContinuous()) {
+        pixels *= rows;  // One long row
+        rows = 1;
+    }
+    for (int r = 0; r < rows; ++r)
+        kernel(original.ptr<uint8_t>(r), modified.ptr<uint8_t>(r), pixels);
+}
+
+
+void blackWhiteSimd(const cv::Mat &original, cv::Mat &modified,
+                    const ManipulationSpecs &specs) {
+    forEachRow(original, modified,
+               [&](const uint8_t *src, uint8_t *dst, int pixels) {
+        blackWhiteRow(src, dst, pixels, specs.bwThreshold);
+    });
+}
+
+
+void grayscaleSimd(const cv::Mat &original, cv::Mat &modified) {
+    forEachRow(original, modified, grayscaleRow);
+}
+
+
+void darkenSimd(const cv::Mat &original, cv::Mat &modified,
+                const ManipulationSpecs &specs) {
+    double k = specs.brightnessConstant;
+    ChannelScale scale = makeChannelScale(k, k, k);
+    forEachRow(original, modified,
+               [&](const uint8_t *src, uint8_t *dst, int pixels) {
+        scaleRow(src, dst, pixels, scale);
+    });
+}
+
+
+void rgbPercentagesSimd(const cv::Mat &original, cv::Mat &modified,
+                        const ManipulationSpecs &specs) {
+    ChannelScale scale = makeChannelScale(specs.blueMult / 100.0,
+                                          specs.greenMult / 100.0,
+                                          specs.redMult / 100.0);
+    forEachRow(original, modified,
+               [&](const uint8_t *src, uint8_t *dst, int pixels) {
+        scaleRow(src, dst, pixels, scale);
+    });
+}
+
+
+void purifySimd(const cv::Mat &original, cv::Mat &modified) {
+    forEachRow(original, modified, purifyRow);
+}
+
+
+/* Using given strobel outline algorithm online, detects images using gradients */
+void strobelOutline(const cv::Mat &original, cv::Mat &modified) {
+    for (int r = 0; r < original.rows; ++r) {
+        for (int c = 0; c < original.cols; ++c) {
+            if (r > 1 && r < original.rows - 1 && c > 1 && c < original.cols - 1) {
+
+                // Vertical
+                double vertY;
+                vertY = getLuminosity(original.at<cv::Vec3b>(r + 1, c + 1)[0], original.at<cv::Vec3b>(r + 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c + 1)[2])
+                    + getLuminosity(original.at<cv::Vec3b>(r, c + 1)[0], original.at<cv::Vec3b>(r, c + 1)[1], original.at<cv::Vec3b>(r, c + 1)[2]) * 2
+                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c + 1)[0], original.at<cv::Vec3b>(r - 1, c + 1)[1], original.at<cv::Vec3b>(r - 1, c + 1)[2])
+                    + getLuminosity(original.at<cv::Vec3b>(r, c - 1)[0], original.at<cv::Vec3b>(r, c - 1)[1], original.at<cv::Vec3b>(r, c - 1)[2]) * -2
+                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c - 1)[0], original.at<cv::Vec3b>(r + 1, c - 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]) * -1
+                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c - 1)[0], original.at<cv::Vec3b>(r - 1, c - 1)[1], original.at<cv::Vec3b>(r - 1, c - 1)[2]) * -1;
+
+
+                // Horizontal
+                double horzX;
+                horzX = getLuminosity(original.at<cv::Vec3b>(r + 1, c - 1)[0], original.at<cv::Vec3b>(r + 1, c - 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]) * -1
+                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c)[0], original.at<cv::Vec3b>(r + 1, c)[1], original.at<cv::Vec3b>(r + 1, c)[2]) * -2
+                    + getLuminosity(original.at<cv::Vec3b>(r + 1, c + 1)[0], original.at<cv::Vec3b>(r + 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c + 1)[2]) * -1
+                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c)[0], original.at<cv::Vec3b>(r - 1, c)[1], original.at<cv::Vec3b>(r - 1, c)[2]) * 2
+                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c - 1)[0], original.at<cv::Vec3b>(r - 1, c - 1)[1], original.at<cv::Vec3b>(r - 1, c - 1)[2])
+                    + getLuminosity(original.at<cv::Vec3b>(r - 1, c + 1)[0], original.at<cv::Vec3b>(r - 1, c + 1)[1], original.at<cv::Vec3b>(r + 1, c - 1)[2]);
+
+
+                // Magnitude
+                double mag = sqrt(pow(vertY, 2.0) + pow(horzX, 2.0));
+
+                // Assign values to each pixel according to magnitude
+                if (mag > 100) {
+                    modified.at<cv::Vec3b>(r, c)[0] = 255;
+                    modified.at<cv::Vec3b>(r, c)[1] = 255;
+                    modified.at<cv::Vec3b>(r, c)[2] = 255;
+                }
+
+                else if (mag > 30) {
+                    modified.at<cv::Vec3b>(r, c)[0] = mag;
+                    modified.at<cv::Vec3b>(r, c)[1] = mag;
+                    modified.at<cv::Vec3b>(r, c)[2] = mag;
+                }
+                else {
+                    modified.at<cv::Vec3b>(r, c)[0] = 0;
+                    modified.at<cv::Vec3b>(r, c)[1] = 0;
+                    modified.at<cv::Vec3b>(r, c)[2] = 0;
+                }
+            }
+        }
+    }
+}
+
+
+/* Darken, RGB values or black and white through the lookup tables in
+ * manipulationLutCache(), which are only rebuilt when specs change */
+void manipulationLut(int menuChoice, const cv::Mat &original,
+                     cv::Mat &modified, const ManipulationSpecs &specs) {
+    static thread_local std::vector<int> choices(1);
+    choices[0] = menuChoice;
+    std::shared_ptr<const PointLut> lut =
+        manipulationLutCache().get(choices, specs);
+    forEachRow(original, modified,
+               [&](const uint8_t *src, uint8_t *dst, int pixels) {
+        applyLutRow(*lut, src, dst, pixels);
+    });
+}
+
+
+/* Single pass version of strobelOutline() that also outlines the edge rows
+ * and columns (see SobelEngine.h) */
+void strobelOutlineSimd(const cv::Mat &original, cv::Mat &modified) {
+    sobelOutlineRows(original.ptr<uint8_t>(), original.step,
+                     modified.ptr<uint8_t>(), modified.step,
+                     original.cols, original.rows, 0, original.rows);
+}
+
+
+/* Helper function for strobel outline (gets brightness of a pixel */
+double getLuminosity(double b, double g, double r) {
+	return 0.2126 * r + 0.7152 * g + 0.0722 * b;
+}
+
+
+/* Draws iterations triangles, showing each one in the display window (and
+   stopping early on ESC) if display is set */
+void approximate(const cv::Mat &original, cv::Mat &modified, int iterations,
+                 bool display) {
+    int randomR, randomC;
+    double upperGrad, lowerGrad, leftGrad, rightGrad;
+    float originalBlue, originalGreen, originalRed;
+    double smallest, secondSmallest;
+    int pt1Row, pt1Col, pt2Row, pt2Col;
+    int count = 0;
+    int strength;
+
+    // Blank white canvas
+    for (int r = 0; r < original.rows; ++r) {
+        for (int c = 0; c < original.cols; ++c) {
+            modified.at<cv::Vec3b >(r, c)[0] = 255;
+            modified.at<cv::Vec3b >(r, c)[1] = 255;
+            modified.at<cv::Vec3b >(r, c)[2] = 255;
+        }
+    }
+    
+    do {
+        pt1Row = 0; // Initialize all points
+        pt1Col = 0;
+        pt2Row = 0;
+        pt2Col = 0;
+
+        if (count < 2500)
+            strength = 90;
+        else if (count < 5000)
+            strength = 60;
+        else if (count < 6000)
+            strength = 45;
+        else if (count < 8000)
+            strength = 30;
+        else
+            strength = 20;
+
+        // Pick random pixel, this will act as one vertice of the triangle
+        randomR = rand() % original.rows;
+        randomC = rand() % original.cols;
+        originalBlue = original.at<cv::Vec3b>(randomR, randomC)[0];
+        originalGreen = original.at<cv::Vec3b>(randomR, randomC)[1];
+        originalRed = original.at<cv::Vec3b>(randomR, randomC)[2];
+
+
+        // Find gradient of pixel directly above randomly chosen pixel.
+        if (randomR - 2 < 0) {
+            upperGrad = 442; // Highest gradient possible (Does not choose the upper direction)
+        }
+        else {
+            upperGrad = getDistance(originalBlue, originalGreen, originalRed,
+                original.at<cv::Vec3b>(randomR - 1, randomC)[0],
+                original.at<cv::Vec3b>(randomR - 1, randomC)[1],
+                original.at<cv::Vec3b>(randomR - 1, randomC)[2]);
+        }
+
+        // Find gradient of pixel directly below randomly chosen pixel.
+        if (randomR + 2 > original.rows) {
+            lowerGrad = 442;
+        }
+        else {
+            lowerGrad = getDistance(originalBlue, originalGreen, originalRed,
+                original.at<cv::Vec3b>(randomR + 1, randomC)[0],
+                original.at<cv::Vec3b>(randomR + 1, randomC)[1],
+                original.at<cv::Vec3b>(randomR + 1, randomC)[2]);
+        }
+
+        // Find gradient of pixel directly right of the randomly chosen pixel.
+        if (randomC + 2 > original.cols) {
+            rightGrad = 442;
+        }
+        else {
+            rightGrad = getDistance(originalBlue, originalGreen, originalRed,
+                original.at<cv::Vec3b>(randomR, randomC + 1)[0],
+                original.at<cv::Vec3b>(randomR, randomC + 1)[1],
+                original.at<cv::Vec3b>(randomR, randomC + 1)[2]);
+        }
+
+        // Find gradient of pixel directly left of the randomly chosen pixel
+        if (randomC - 2 < 0) {
+            leftGrad = 442;
+        }
+        else {
+            leftGrad = getDistance(originalBlue, originalGreen, originalRed,
+                original.at<cv::Vec3b>(randomR, randomC - 1)[0],
+                original.at<cv::Vec3b>(randomR, randomC - 1)[1],
+                original.at<cv::Vec3b>(randomR, randomC - 1)[2]);
+        }
+
+        
+
+        // Now we will compare and get the two smallest gradients
+        smallest = std::min(std::min(upperGrad, lowerGrad), std::min(rightGrad, leftGrad));
+        // 1 = Up, 2 = Right, 3 = Down, 4 = Left
+        if (smallest == upperGrad) {
+            smallest = 1;
+            secondSmallest = std::min(lowerGrad, std::min(rightGrad, leftGrad));
+            if (secondSmallest == lowerGrad)
+                secondSmallest = 3;
+            else if (secondSmallest == rightGrad)
+                secondSmallest = 2;
+            else
+                secondSmallest = 4;
+        }
+        else if (smallest == rightGrad) {
+            smallest = 2;
+            secondSmallest = std::min(std::min(upperGrad, lowerGrad), leftGrad);
+            if (secondSmallest == upperGrad)
+                secondSmallest = 1;
+            else if (secondSmallest == lowerGrad)
+                secondSmallest = 3;
+            else
+                secondSmallest = 4;
+        }
+        else if (smallest == lowerGrad) {
+            smallest = 3;
+            secondSmallest = std::min(upperGrad, std::min(rightGrad, leftGrad));
+            if (secondSmallest == upperGrad)
+                secondSmallest = 1;
+            else if (secondSmallest == rightGrad)
+                secondSmallest = 2;
+            else if (secondSmallest == leftGrad)
+                secondSmallest = 4;
+        }
+        else {
+            smallest = 4;
+            secondSmallest = std::min(std::min(upperGrad, lowerGrad), rightGrad);
+            if (secondSmallest == upperGrad)
+                secondSmallest = 1;
+            else if (secondSmallest == rightGrad)
+                secondSmallest = 2;
+            else if (secondSmallest == lowerGrad)
+                secondSmallest = 3;
+        }
+        
+        // Now, we will go in each direction of the smallest and secondSmallest gradients,
+        // and will stop at a point when the difference in average color is too large.
+        // Resulting in two points.
+        if (smallest == 1 || secondSmallest == 1) { // Go up.
+            int r = randomR - 1;
+            int close = 1;
+            while (close && r > 1) {
+                close = isClose(originalBlue, originalGreen, originalRed,
+                    original.at<cv::Vec3b>(r, randomC)[0],
+                    original.at<cv::Vec3b>(r, randomC)[1],
+                    original.at<cv::Vec3b>(r, randomC)[2], strength);
+                --r;
+            }
+            ++r; // Need to reset r either back to zero, or to the coordinate which isClose failed.
+            if (smallest == 1) {
+                pt1Row = r;
+                pt1Col = randomC;
+            }
+            else {
+                pt2Row = r;
+                pt2Col = randomC;
+            }
+        }
+        if (smallest == 2 || secondSmallest == 2) { // Go right
+            int c = randomC + 1;
+            int close = 1;
+            while (close && c + 1 < original.cols) {
+                close = isClose(originalBlue, originalGreen, originalRed,
+                    original.at<cv::Vec3b>(randomR, c)[0],
+                    original.at<cv::Vec3b>(randomR, c)[1],
+                    original.at<cv::Vec3b>(randomR, c)[2], strength);
+                ++c;
+            }
+            --c;
+            if (smallest == 2) {
+                pt1Row = randomR;
+                pt1Col = c;
+            }
+            else {
+                pt2Row = randomR;
+                pt2Col = c;
+            }
+        }
+        if (smallest == 3 || secondSmallest == 3) { // Go down
+            int r = randomR + 1;
+            int close = 1;
+            while (close && r + 1 < original.rows) {
+                close = isClose(originalBlue, originalGreen, originalRed,
+                    original.at<cv::Vec3b>(r, randomC)[0],
+                    original.at<cv::Vec3b>(r, randomC)[1],
+                    original.at<cv::Vec3b>(r, randomC)[2], strength);
+                ++r;
+            }
+            --r;
+            if (smallest == 3) {
+                pt1Row = r;
+                pt1Col = randomC;
+            }
+            else {
+                pt2Row = r;
+                pt2Col = randomC;
+            }
+        }
+        if (smallest == 4 || secondSmallest == 4) {
+            int c = randomC - 1;
+            int close = 1;
+            while (close && c > 1) { // Go left
+                close = isClose(originalBlue, originalGreen, originalRed,
+                    original.at<cv::Vec3b>(randomR, c)[0],
+                    original.at<cv::Vec3b>(randomR, c)[1],
+                    original.at<cv::Vec3b>(randomR, c)[2], strength);
+                --c;
+            }
+            ++c;
+            if (smallest == 4) {
+                pt1Row = randomR;
+                pt1Col = c;
+            }
+            else {
+                pt2Row = randomR;
+                pt2Col = c;
+            }
+        }
+        
+        // Fill the triangle with the given points (randomR, randomC), (pt1Row, pt1Col), (pt2Row, pt2Col)
+        // 1st, check for base cases (straight lines)
+        if ((smallest == 1 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 1)) { // straight line up and down
+            // start from top
+            
+            int r = std::min(pt1Row, pt2Row);
+            int stop = std::max(pt1Row, pt2Row);
+            while (r <= stop) {
+                modified.at<cv::Vec3b>(r, randomC)[0] = originalBlue;
+                modified.at<cv::Vec3b>(r, randomC)[1] = originalGreen;
+                modified.at<cv::Vec3b>(r, randomC)[2] = originalRed;
+                ++r;
+            }
+        }
+        else if ((smallest == 2 && secondSmallest == 4) || (smallest == 4 && secondSmallest == 2)) { // straight line left and right
+            // Start from left
+            
+            int c = std::min(pt1Col, pt2Col);
+            int stop = std::max(pt1Col, pt2Col);
+            while (c <= stop) {
+                modified.at<cv::Vec3b>(randomR, c)[0] = originalBlue;
+                modified.at<cv::Vec3b>(randomR, c)[1] = originalGreen;
+                modified.at<cv::Vec3b>(randomR, c)[2] = originalRed;
+                ++c;
+            }		
+        }
+        else {
+            // It's a right triangle.
+            int horzDistance, vertDistance;
+            int subPerLine;
+            int eachLine;
+
+            horzDistance = abs(pt2Col - randomC);
+            if (horzDistance == 0)
+                horzDistance = abs(pt1Col - randomC);
+            vertDistance = abs(pt2Row - randomR);
+            if (vertDistance == 0)
+                vertDistance = abs(pt1Row - randomR);
+
+            if (horzDistance == 0)
+                horzDistance = 1;
+
+            subPerLine = vertDistance / horzDistance;
+            eachLine = horzDistance;
+
+            if ((smallest == 2 && secondSmallest == 1) || (smallest == 1 && secondSmallest == 2)) {
+                // Draw triangle in 1st quadrant
+                for (int r = randomR; r >= randomR - vertDistance; --r) {
+                    for (int c = randomC; c <= (randomC + eachLine); ++c) {
+                        if (isClose(originalBlue, originalGreen, originalRed,
+                            original.at<cv::Vec3b>(r, c)[0],
+                            original.at<cv::Vec3b>(r, c)[1],
+                            original.at<cv::Vec3b>(r, c)[2], strength)) {
+                                modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
+                                modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
+                                modified.at<cv::Vec3b>(r, c)[2] = originalRed;
+                        }
+                    }
+                    eachLine -= subPerLine;
+                }	
+                
+            }
+            else if ((smallest == 2 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 2)) {
+                // Draw triangle in 4th quadrant
+                for (int r = randomR; r <= randomR + vertDistance; ++r) {
+                    for (int c = randomC; c <= (randomC + eachLine); ++c) {
+                        if (isClose(originalBlue, originalGreen, originalRed,
+                            original.at<cv::Vec3b>(r, c)[0],
+                            original.at<cv::Vec3b>(r, c)[1],
+                            original.at<cv::Vec3b>(r, c)[2], strength)) {
+                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
+                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
+                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
+                        }
+                    }
+                    eachLine -= subPerLine;
+                }
+            }
+            else if ((smallest == 4 && secondSmallest == 3) || (smallest == 3 && secondSmallest == 4)) {
+                // Draw triangle in 3rd quadrant
+                for (int r = randomR; r <= randomR + vertDistance; ++r) {
+                    for (int c = randomC; c >= (randomC - eachLine); --c) {
+                        if (isClose(originalBlue, originalGreen, originalRed,
+                            original.at<cv::Vec3b>(r, c)[0],
+                            original.at<cv::Vec3b>(r, c)[1],
+                            original.at<cv::Vec3b>(r, c)[2], strength)) {
+                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
+                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
+                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
+                        }
+                    }
+                    eachLine -= subPerLine;
+                }
+            }
+            else {
+                // Draw triangle in 2nd quadrant
+                for (int r = randomR; r >= randomR - vertDistance; --r) {
+                    for (int c = randomC; c >= (randomC - eachLine); --c) {
+                        if (isClose(originalBlue, originalGreen, originalRed,
+                            original.at<cv::Vec3b>(r, c)[0],
+                            original.at<cv::Vec3b>(	r, c)[1],
+                            original.at<cv::Vec3b>(r, c)[2], strength)) {
+                            modified.at<cv::Vec3b>(r, c)[0] = originalBlue;
+                            modified.at<cv::Vec3b>(r, c)[1] = originalGreen;
+                            modified.at<cv::Vec3b>(r, c)[2] = originalRed;
+                        }
+                    }
+                    eachLine -= subPerLine;
+                }
+            }
+        }
+        // Show the modified image
+        if (display)
+            cv::imshow("Modified", modified);
+        //cv::waitKey(2);
+        ++count;
+    } while (count < iterations && (!display || cv::waitKey(2) != 27));
+}
+
+
+void motionDetection(const cv::Mat &original, cv::Mat &modified,
+                     cv::Mat &prevFrame) {
+    if (prevFrame.empty()) {
+       original.copyTo(prevFrame); 
+    }
+
+    // Compare each pixel of original frame to prevFrame
+    for (int r = 0; r < original.rows; r++) {
+        for (int c = 0; c < original.cols; c++) {
+            float bDiff = std::abs(original.at<cv::Vec3b>(r, c)[0] - prevFrame.at<cv::Vec3b>(r, c)[0]);
+            float gDiff = std::abs(original.at<cv::Vec3b>(r, c)[1] - prevFrame.at<cv::Vec3b>(r, c)[1]);
+            float rDiff = std::abs(original.at<cv::Vec3b>(r, c)[2] - prevFrame.at<cv::Vec3b>(r, c)[2]);            
+            double total = (double)bDiff + (double)gDiff + (double)rDiff;
+            if (total > 110) {
+                modified.at<cv::Vec3b>(r, c)[0] = 255; 
+                modified.at<cv::Vec3b>(r, c)[1] = 255; 
+                modified.at<cv::Vec3b>(r, c)[2] = 255; 
+            } else {
+                modified.at<cv::Vec3b>(r, c)[0] = 0; 
+                modified.at<cv::Vec3b>(r, c)[1] = 0; 
+                modified.at<cv::Vec3b>(r, c)[2] = 0; 
+            }
+        }
+    }
+
+    // copy original to prevFrame
+    for (int r = 0; r < original.rows; r++) {
+        for(int c = 0; c < original.cols; c++) {
+            prevFrame.at<cv::Vec3b>(r, c)[0] = original.at<cv::Vec3b>(r, c)[0];
+            prevFrame.at<cv::Vec3b>(r, c)[1] = original.at<cv::Vec3b>(r, c)[1];
+            prevFrame.at<cv::Vec3b>(r, c)[2] = original.at<cv::Vec3b>(r, c)[2];
+        }
+    }
+}
+
+
+int isClose(float originalB, float originalG, float originalR, float b, float g, float r, int strength) {
+	double distance = sqrt(pow(originalB - b, 2) + pow(originalG - g, 2) + pow(originalR - r, 2));
+	if (distance < strength) return 1;
+	else return 0;
+}
+
+
+double getDistance(float originalBlue, float originalGreen, float originalRed, float blue, float green, float red) {
+	return sqrt(pow(originalBlue - blue, 2) + pow(originalGreen - green, 2) + pow(originalRed - red, 2));
+}
+
+
+int smallest(double up, double right, double down, double left) {
+	double min = std::min(std::min(down, up), std::min(left, right));
+	if (min == up) return 1;
+	else if (min = right) return 2;
+	else if (min == down) return 3;
+	else return 4;
+}
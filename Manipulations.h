@@ -0,0 +1,125 @@
+/*
+    Manipulation functions and the specifications (user given parameters)
+    that some of them need. Shared by the interactive menu and batch mode.
+*/
+
+#ifndef MANIPULATIONS_H
+#define MANIPULATIONS_H
+
+#include "opencv2/opencv.hpp"
+#include "ApproximateEngine.h"
+#include "AutoThreshold.h"
+#include "BackendRegistry.h"
+#include "MotionEngine.h"
+#include "PlanarFrame.h"
+
+/* Given manipulation specifications for some of the features */
+struct ManipulationSpecs {
+    int bwThreshold = 0;  // -1 picks it per image (AutoThreshold.h)
+    double brightnessConstant = 1.0;
+    double redMult = 100, greenMult = 100, blueMult = 100;
+    MotionSettings motion;
+    ApproximateSettings approximation;
+};
+
+/* State the manipulations keep from one frame to the next (the motion
+   detection background, black and white's automatic threshold), one per
+   stream of frames. The functions taking none share the menu's and the
+   live loop's state */
+struct ManipulationState {
+    MotionDetector motion;
+    AutoThreshold blackWhite;
+};
+
+/* Function declaration -- execute a chosen manipulation (menu choice) on
+   original, storing the result in modified, on the thread pool. Image mode's
+   approximate (7) runs on the approximation engine (ApproximateEngine.h),
+   showing the canvas in the Modified window if its refresh interval is set */
+void executeManipulation(int choice, int mode, const cv::Mat &original,
+                         cv::Mat &modified, const ManipulationSpecs &specs);
+void executeManipulation(int choice, int mode, const cv::Mat &original,
+                         cv::Mat &modified, const ManipulationSpecs &specs,
+                         ManipulationState &state);
+
+/* Function declaration -- execute a manipulation (other than approximate)
+   on rows [rowBegin, rowEnd) of an already allocated modified, on backend
+   if it runs on row bands, the built-in one otherwise. Callers pick the
+   backend once per frame (selectBackend(), BackendProfile.h). Motion
+   detection's frames and black and white's automatic threshold have to go
+   through executeManipulation() */
+void manipulateRows(int choice, const cv::Mat &original, cv::Mat &modified,
+                    const ManipulationSpecs &specs, int rowBegin, int rowEnd,
+                    const ManipulationBackend *backend = nullptr);
+
+/* Function declaration -- execute a point manipulation or the outline
+   (menu choice 0-6) on one of its backends (BackendRegistry.h), the
+   built-in one if backend is null or has none of its own.
+   executeManipulation() runs them on the backend selectBackend() picks */
+void runManipulationBackend(int choice, const ManipulationBackend *backend,
+                            const cv::Mat &original, cv::Mat &modified,
+                            const ManipulationSpecs &specs);
+
+/* Function declarations -- the same on planar frames (PlanarFrame.h), giving
+   the same pixels once converted back. Black and white, grayscale, the
+   outline and motion detection write a single plane. Approximate converts
+   to BGR and back, its strokes not being a per-pixel kernel */
+void executePlanarManipulation(int choice, int mode,
+                               const PlanarFrame &original,
+                               PlanarFrame &modified,
+                               const ManipulationSpecs &specs);
+void executePlanarManipulation(int choice, int mode,
+                               const PlanarFrame &original,
+                               PlanarFrame &modified,
+                               const ManipulationSpecs &specs,
+                               ManipulationState &state);
+void manipulatePlanarRows(int choice, const PlanarFrame &original,
+                          PlanarFrame &modified,
+                          const ManipulationSpecs &specs, int rowBegin,
+                          int rowEnd);
+
+/* Function declaration -- planes a menu choice's planar output has */
+int planarOutputChannels(int choice, int mode);
+
+/* Function declarations -- manipulation functions */
+void originalMedia(const cv::Mat &original, cv::Mat &modified);
+void blackWhite(const cv::Mat &original, cv::Mat &modified,
+                const ManipulationSpecs &specs);
+void grayscale(const cv::Mat &original, cv::Mat &modified);
+void darken(const cv::Mat &original, cv::Mat &modified,
+            const ManipulationSpecs &specs);
+void rgbPercentages(const cv::Mat &original, cv::Mat &modified,
+                    const ManipulationSpecs &specs);
+void purify(const cv::Mat &original, cv::Mat &modified);
+void strobelOutline(const cv::Mat &original, cv::Mat &modified);
+void approximate(const cv::Mat &original, cv::Mat &modified,
+                 int iterations = 10000, bool display = true);
+void motionDetection(const cv::Mat &original, cv::Mat &modified,
+                     cv::Mat &prevFrame);
+
+/* Function declarations -- vectorized point manipulations (PointKernels.h) */
+void blackWhiteSimd(const cv::Mat &original, cv::Mat &modified,
+                    const ManipulationSpecs &specs);
+void grayscaleSimd(const cv::Mat &original, cv::Mat &modified);
+void darkenSimd(const cv::Mat &original, cv::Mat &modified,
+                const ManipulationSpecs &specs);
+void rgbPercentagesSimd(const cv::Mat &original, cv::Mat &modified,
+                        const ManipulationSpecs &specs);
+void purifySimd(const cv::Mat &original, cv::Mat &modified);
+
+/* Function declaration -- darken, RGB values or black and white through
+   cached lookup tables (LutEngine.h) */
+void manipulationLut(int choice, const cv::Mat &original, cv::Mat &modified,
+                     const ManipulationSpecs &specs);
+
+/* Function declaration -- single pass strobel outline (SobelEngine.h) */
+void strobelOutlineSimd(const cv::Mat &original, cv::Mat &modified);
+
+/* Function declarations -- helper functions for manipulations */
+double getLuminosity(double b, double g, double r);
+int isClose(float originalB, float originalG, float originalR,
+            float b, float g, float r, int strength);
+double getDistance(float originalBlue, float originalGreen, float originalRed,
+                   float blue, float green, float red);
+int smallest(double up, double right, double down, double left);
+
+#endif
@@ -0,0 +1,419 @@
+/*
+    Motion detection engine (see MotionEngine.h).
+
+    Like PointKernels.cpp the kernels are plain branch free loops compiled
+    once per instruction set, each in two variants: with a noise floor and
+    without one, where the per channel subtraction drops out. With the
+    automatic threshold the interleaved kernels write each pixel's sum to a
+    row that stays in L1, which is then thresholded and counted.
+*/
+
+#include "MotionEngine.h"
+#include "AutoThreshold.h"
+#include "KernelTemplates.h"
+#include "SimdDispatch.h"
+#include <algorithm>
+
+
+/* Difference of two channels minus the noise floor (0 if below it), kept
+   in bytes so the vectors hold as many channels as they can. Without
+   NoiseFloor (a noise floor of 0, the default) it's the plain difference */
+template <bool NoiseFloor>
+KERNEL_INLINE uint8_t channelDifference(uint8_t a, uint8_t b,
+                                        uint8_t noiseFloor) {
+    uint8_t difference = (a > b ? a : b) - (a > b ? b : a);
+    if (!NoiseFloor)
+        return difference;
+    return difference > noiseFloor ? difference - noiseFloor : 0;
+}
+
+
+/* The automatic threshold never goes below this: Otsu's method splits the
+   sensor noise of a frame with nothing moving */
+static const int automaticFloor = 48;
+
+
+/* A row of sums of differences, kept rather than thresholded */
+struct SumRow {
+    uint16_t *row;
+};
+
+
+/* Writes pixel i's mask (a row of bytes) or sum (a SumRow) */
+template <typename Dst>
+KERNEL_INLINE void writeMask(const Dst &dst, int i, int sum, int threshold) {
+    writeGray(dst, i, (uint8_t)(sum > threshold ? 255 : 0));
+}
+
+
+KERNEL_INLINE void writeMask(const SumRow &dst, int i, int sum, int) {
+    dst.row[i] = sum;
+}
+
+
+/* Compares src against prev, writing the mask to dst and src to next */
+template <bool NoiseFloor, typename Src, typename Next, typename Dst>
+KERNEL_INLINE void previousFrameBody(Src src, Src prev, Next next, Dst dst,
+                                     int pixels, int threshold,
+                                     int noiseFloor) {
+    for (int i = 0; i < pixels; ++i) {
+        uint16_t sum = 0;
+        for (int k = 0; k < Src::channels; ++k) {
+            sum += channelDifference<NoiseFloor>(src(i, k), prev(i, k),
+                                                 noiseFloor);
+            next(i, k) = src(i, k);
+        }
+        writeMask(dst, i, sum, threshold);
+    }
+}
+
+
+/* Compares src against the average (8.8 fixed point, rounded to a byte),
+   writing the mask to dst, then moves the average towards src */
+template <bool NoiseFloor, typename Src, typename Average, typename Dst>
+KERNEL_INLINE void averageBody(Src src, Average average, Dst dst, int pixels,
+                               int threshold, int noiseFloor, int shift) {
+    for (int i = 0; i < pixels; ++i) {
+        int sum = 0;
+        for (int k = 0; k < Src::channels; ++k) {
+            int value = src(i, k);
+            int background = average(i, k);
+            sum += channelDifference<NoiseFloor>(value, (background + 128) >> 8,
+                                                 noiseFloor);
+            average(i, k) = background
+                            + (((value << 8) - background) >> shift);
+        }
+        writeMask(dst, i, sum, threshold);
+    }
+}
+
+
+/* Planar kernels: each plane adds its channel's differences to sum, which
+   is then thresholded into the mask plane */
+template <bool NoiseFloor>
+KERNEL_INLINE void differencePlaneBody(const uint8_t *src, const uint8_t *prev,
+                                       uint16_t *sum, int pixels,
+                                       int noiseFloor) {
+    for (int i = 0; i < pixels; ++i)
+        sum[i] += channelDifference<NoiseFloor>(src[i], prev[i], noiseFloor);
+}
+
+
+template <bool NoiseFloor>
+KERNEL_INLINE void averagePlaneBody(const uint8_t *src, uint16_t *average,
+                                    uint16_t *sum, int pixels, int noiseFloor,
+                                    int shift) {
+    for (int i = 0; i < pixels; ++i) {
+        int value = src[i];
+        int background = average[i];
+        sum[i] += channelDifference<NoiseFloor>(value, (background + 128) >> 8,
+                                                noiseFloor);
+        average[i] = background + (((value << 8) - background) >> shift);
+    }
+}
+
+
+template <typename Dst>
+KERNEL_INLINE void thresholdBody(const uint16_t *sum, Dst dst, int pixels,
+                                 int threshold) {
+    for (int i = 0; i < pixels; ++i)
+        writeGray(dst, i, (uint8_t)(sum[i] > threshold ? 255 : 0));
+}
+
+
+/* The layouts the kernels are instantiated for (KernelTemplates.h) */
+using BgrRow = Interleaved<const uint8_t, 3>;
+using BgrOutRow = Interleaved<uint8_t, 3>;
+using BgrAverageRow = Interleaved<uint16_t, 3>;
+using PlaneOutRow = Interleaved<uint8_t, 1>;
+
+
+/* One set of kernels per instruction set, each indexed by whether there is
+   a noise floor */
+struct MotionKernelTable {
+    void (*previousFrame[2])(const uint8_t *, const uint8_t *, uint8_t *,
+                             uint8_t *, int, int, int);
+    void (*average[2])(const uint8_t *, uint16_t *, uint8_t *, int, int, int,
+                       int);
+    void (*differencePlane[2])(const uint8_t *, const uint8_t *, uint16_t *,
+                               int, int);
+    void (*averagePlane[2])(const uint8_t *, uint16_t *, uint16_t *, int, int,
+                            int);
+    void (*thresholdPlane)(const uint16_t *, uint8_t *, int, int);
+    void (*previousFrameSums[2])(const uint8_t *, const uint8_t *, uint8_t *,
+                                 uint16_t *, int, int);
+    void (*averageSums[2])(const uint8_t *, uint16_t *, uint16_t *, int, int,
+                           int);
+    void (*thresholdBgr)(const uint16_t *, uint8_t *, int, int);
+};
+
+#define DEFINE_MOTION_TABLE(name, attributes)                                  \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##PreviousFrame(                                \
+            const uint8_t *src, const uint8_t *prev, uint8_t *next,            \
+            uint8_t *dst, int pixels, int threshold, int noiseFloor) {         \
+        previousFrameBody<NoiseFloor>(BgrRow{src}, BgrRow{prev},               \
+                                      BgrOutRow{next}, BgrOutRow{dst},         \
+                                      pixels, threshold, noiseFloor);          \
+    }                                                                          \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##Average(                                      \
+            const uint8_t *src, uint16_t *average, uint8_t *dst, int pixels,   \
+            int threshold, int noiseFloor, int shift) {                        \
+        averageBody<NoiseFloor>(BgrRow{src}, BgrAverageRow{average},           \
+                                BgrOutRow{dst}, pixels, threshold,             \
+                                noiseFloor, shift);                            \
+    }                                                                          \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##DifferencePlane(                              \
+            const uint8_t *src, const uint8_t *prev, uint16_t *sum,            \
+            int pixels, int noiseFloor) {                                      \
+        differencePlaneBody<NoiseFloor>(src, prev, sum, pixels, noiseFloor);   \
+    }                                                                          \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##AveragePlane(                                 \
+            const uint8_t *src, uint16_t *average, uint16_t *sum, int pixels,  \
+            int noiseFloor, int shift) {                                       \
+        averagePlaneBody<NoiseFloor>(src, average, sum, pixels, noiseFloor,    \
+                                     shift);                                   \
+    }                                                                          \
+    attributes static void name##ThresholdPlane(                               \
+            const uint16_t *sum, uint8_t *dst, int pixels, int threshold) {    \
+        thresholdBody(sum, PlaneOutRow{dst}, pixels, threshold);               \
+    }                                                                          \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##PreviousFrameSums(                            \
+            const uint8_t *src, const uint8_t *prev, uint8_t *next,            \
+            uint16_t *sums, int pixels, int noiseFloor) {                      \
+        previousFrameBody<NoiseFloor>(BgrRow{src}, BgrRow{prev},               \
+                                      BgrOutRow{next}, SumRow{sums}, pixels,   \
+                                      0, noiseFloor);                          \
+    }                                                                          \
+    template <bool NoiseFloor>                                                 \
+    attributes static void name##AverageSums(                                  \
+            const uint8_t *src, uint16_t *average, uint16_t *sums, int pixels, \
+            int noiseFloor, int shift) {                                       \
+        averageBody<NoiseFloor>(BgrRow{src}, BgrAverageRow{average},           \
+                                SumRow{sums}, pixels, 0, noiseFloor, shift);   \
+    }                                                                          \
+    attributes static void name##ThresholdBgr(                                 \
+            const uint16_t *sum, uint8_t *dst, int pixels, int threshold) {    \
+        thresholdBody(sum, BgrOutRow{dst}, pixels, threshold);                 \
+    }                                                                          \
+    static const MotionKernelTable name##MotionKernels = {                     \
+        {name##PreviousFrame<false>, name##PreviousFrame<true>},               \
+        {name##Average<false>, name##Average<true>},                           \
+        {name##DifferencePlane<false>, name##DifferencePlane<true>},           \
+        {name##AveragePlane<false>, name##AveragePlane<true>},                 \
+        name##ThresholdPlane,                                                  \
+        {name##PreviousFrameSums<false>, name##PreviousFrameSums<true>},       \
+        {name##AverageSums<false>, name##AverageSums<true>},                   \
+        name##ThresholdBgr};
+
+DEFINE_MOTION_TABLE(baseline, )
+#ifdef SIMD_DISPATCH_X86
+DEFINE_MOTION_TABLE(sse41, KERNEL_TARGET("sse4.1"))
+DEFINE_MOTION_TABLE(avx2, KERNEL_TARGET("avx2"))
+DEFINE_MOTION_TABLE(avx512, KERNEL_TARGET("avx512f,avx512bw"))
+#endif
+
+
+static const MotionKernelTable &motionKernels() {
+#ifdef SIMD_DISPATCH_X86
+    switch (activeSimdLevel()) {
+        case SimdLevel::AVX512:
+            return avx512MotionKernels;
+        case SimdLevel::AVX2:
+            return avx2MotionKernels;
+        case SimdLevel::SSE41:
+            return sse41MotionKernels;
+        default:
+            break;
+    }
+#endif
+    return baselineMotionKernels;
+}
+
+
+/* Takes the frame's settings, returns whether the background has to start
+   over from the frame */
+bool MotionDetector::restarts(cv::Size frameSize, bool planarFrame,
+                              const MotionSettings &settings) {
+    bool restart = frameSize != size || planarFrame != planar
+                   || settings.background != this->settings.background;
+    bool started = !frames[previous].empty() || !planarPrevious.empty()
+                   || !average.empty();
+    this->settings = settings;
+    this->settings.adaptShift = std::min(std::max(settings.adaptShift, 1), 8);
+    // Automatic: where the frames before settled, the default until then
+    threshold = settings.threshold >= 0
+                ? settings.threshold
+                : automatic.current(MotionSettings().threshold);
+    return restart || !started;
+}
+
+
+void MotionDetector::beginFrame(const cv::Mat &frame,
+                                const MotionSettings &settings) {
+    if (!restarts(frame.size(), false, settings))
+        return;
+
+    // First frame (or a new resolution), nothing has moved yet
+    reset();
+    size = frame.size();
+    if (settings.background == MotionBackground::PreviousFrame) {
+        frame.copyTo(frames[0]);
+        frames[1].create(frame.size(), frame.type());
+    } else {
+        average.resize((size_t)frame.rows * frame.cols * 3);
+        for (int r = 0; r < frame.rows; ++r) {
+            const uint8_t *row = frame.ptr<uint8_t>(r);
+            uint16_t *background = &average[(size_t)r * frame.cols * 3];
+            for (int i = 0; i < frame.cols * 3; ++i)
+                background[i] = row[i] << 8;
+        }
+    }
+}
+
+
+void MotionDetector::detectRows(const cv::Mat &frame, cv::Mat &mask,
+                                int rowBegin, int rowEnd) {
+    const MotionKernelTable &kernels = motionKernels();
+    bool noise = settings.noiseFloor > 0;
+    if (settings.threshold < 0) {
+        detectCountingRows(frame, mask, rowBegin, rowEnd);
+        return;
+    }
+    for (int r = rowBegin; r < rowEnd; ++r) {
+        if (settings.background == MotionBackground::PreviousFrame) {
+            kernels.previousFrame[noise](frame.ptr<uint8_t>(r),
+                                         frames[previous].ptr<uint8_t>(r),
+                                         frames[previous ^ 1].ptr<uint8_t>(r),
+                                         mask.ptr<uint8_t>(r), frame.cols,
+                                         threshold, settings.noiseFloor);
+        } else {
+            kernels.average[noise](frame.ptr<uint8_t>(r),
+                                   &average[(size_t)r * frame.cols * 3],
+                                   mask.ptr<uint8_t>(r), frame.cols,
+                                   threshold, settings.noiseFloor,
+                                   settings.adaptShift);
+        }
+    }
+}
+
+
+/* detectRows() with the automatic threshold: the sums of each row are
+   thresholded, then counted into the band's histogram */
+void MotionDetector::detectCountingRows(const cv::Mat &frame, cv::Mat &mask,
+                                        int rowBegin, int rowEnd) {
+    const MotionKernelTable &kernels = motionKernels();
+    bool noise = settings.noiseFloor > 0;
+
+    // Reused between calls on the same thread
+    static thread_local std::vector<uint16_t> sums;
+    sums.resize(frame.cols);
+    uint32_t histogram[autoThresholdBins] = {};
+    for (int r = rowBegin; r < rowEnd; ++r) {
+        if (settings.background == MotionBackground::PreviousFrame) {
+            kernels.previousFrameSums[noise](
+                frame.ptr<uint8_t>(r), frames[previous].ptr<uint8_t>(r),
+                frames[previous ^ 1].ptr<uint8_t>(r), sums.data(), frame.cols,
+                settings.noiseFloor);
+        } else {
+            kernels.averageSums[noise](frame.ptr<uint8_t>(r),
+                                       &average[(size_t)r * frame.cols * 3],
+                                       sums.data(), frame.cols,
+                                       settings.noiseFloor,
+                                       settings.adaptShift);
+        }
+        kernels.thresholdBgr(sums.data(), mask.ptr<uint8_t>(r), frame.cols,
+                             threshold);
+        countValues(sums.data(), frame.cols, histogram);
+    }
+    automatic.merge(histogram);
+}
+
+
+void MotionDetector::beginFrame(const PlanarFrame &frame,
+                                const MotionSettings &settings) {
+    if (!restarts(frame.size(), true, settings))
+        return;
+
+    reset();
+    size = frame.size();
+    planar = true;
+    if (settings.background == MotionBackground::PreviousFrame) {
+        frame.copyTo(planarPrevious);
+    } else {
+        // Same layout as the frame's planes, padding included
+        size_t planeSize = frame.step() * frame.rows();
+        average.resize(planeSize * 3);
+        for (int k = 0; k < 3; ++k) {
+            const uint8_t *plane = frame.ptr(k, 0);
+            uint16_t *background = &average[k * planeSize];
+            for (size_t i = 0; i < planeSize; ++i)
+                background[i] = plane[i] << 8;
+        }
+    }
+}
+
+
+void MotionDetector::detectRows(const PlanarFrame &frame, PlanarFrame &mask,
+                                int rowBegin, int rowEnd) {
+    const MotionKernelTable &kernels = motionKernels();
+    int pixels = frame.step();  // Whole vectors, into the padding
+    bool noise = settings.noiseFloor > 0;
+    size_t planeSize = frame.step() * frame.rows();
+
+    // Reused between calls on the same thread
+    static thread_local std::vector<uint16_t> sums;
+    sums.resize(pixels);
+    bool counting = settings.threshold < 0;
+    uint32_t histogram[autoThresholdBins] = {};
+    for (int r = rowBegin; r < rowEnd; ++r) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int k = 0; k < 3; ++k) {
+            if (settings.background == MotionBackground::PreviousFrame) {
+                kernels.differencePlane[noise](frame.ptr(k, r),
+                                               planarPrevious.ptr(k, r),
+                                               sums.data(), pixels,
+                                               settings.noiseFloor);
+                std::copy(frame.ptr(k, r), frame.ptr(k, r) + pixels,
+                          planarPrevious.ptr(k, r));
+            } else {
+                kernels.averagePlane[noise](frame.ptr(k, r),
+                                            &average[k * planeSize
+                                                     + (size_t)r
+                                                       * frame.step()],
+                                            sums.data(), pixels,
+                                            settings.noiseFloor,
+                                            settings.adaptShift);
+            }
+        }
+        kernels.thresholdPlane(sums.data(), mask.ptr(0, r), pixels,
+                               threshold);
+        if (counting)
+            countValues(sums.data(), frame.cols(), histogram);
+    }
+    if (counting)
+        automatic.merge(histogram);
+}
+
+
+void MotionDetector::endFrame() {
+    if (settings.background == MotionBackground::PreviousFrame && !planar)
+        previous ^= 1;
+    if (settings.threshold < 0)
+        automatic.endFrame(automaticFloor);
+}
+
+
+void MotionDetector::reset() {
+    frames[0].release();
+    frames[1].release();
+    previous = 0;
+    planarPrevious.release();
+    average.clear();
+    size = cv::Size();
+    planar = false;
+}
@@ -0,0 +1,91 @@
+/*
+    Motion detection engine for the webcam mode.
+
+    Each pixel's channels are compared against a background, and the pixel
+    turns white when the sum of the absolute differences is above the
+    threshold (black otherwise), in one vectorized pass (SimdDispatch.h)
+    that also updates the background:
+    - PreviousFrame: the background is the previous frame, as in
+      motionDetection(). The pass writes the frame into a second buffer and
+      the two are swapped afterwards, so the frame is never copied.
+    - Average: an exponentially weighted average of the frames (each frame
+      moving it by 1/2^adaptShift), kept in 8.8 fixed point. Sensor noise
+      and slow lighting changes fade into it instead of showing as motion.
+    The noise floor is subtracted from each channel's difference before
+    summing, so flickering pixels don't add up to motion.
+
+    With the PreviousFrame background and a noise floor of 0 the output is
+    the same as motionDetection().
+
+    A threshold of -1 picks it from the differences (AutoThreshold.h), each
+    frame being thresholded at the value the frames before it settled on
+    (the default of 110 at first) and counted into the histogram that moves
+    it, in the same pass.
+
+    Planar frames (PlanarFrame.h) are compared a plane at a time, each
+    channel's differences adding up in a row of sums that is then
+    thresholded into a single plane mask. The previous frame is copied
+    row by row once each row is compared, so it needs no second buffer.
+*/
+
+#ifndef MOTION_ENGINE_H
+#define MOTION_ENGINE_H
+
+#include "opencv2/opencv.hpp"
+#include "AutoThreshold.h"
+#include "PlanarFrame.h"
+#include <cstdint>
+#include <vector>
+
+enum class MotionBackground { PreviousFrame, Average };
+
+struct MotionSettings {
+    int threshold = 110;   // Sum of the channel differences (0-765), -1 auto
+    int noiseFloor = 0;    // Ignored per channel difference (0-255)
+    MotionBackground background = MotionBackground::PreviousFrame;
+    int adaptShift = 3;    // Average moves 1/2^adaptShift per frame (1-8)
+};
+
+class MotionDetector {
+public:
+    /* Gets ready for a frame, (re)starting the background from it on the
+       first frame or when the resolution changes */
+    void beginFrame(const cv::Mat &frame, const MotionSettings &settings);
+
+    /* Writes the motion mask of rows [rowBegin, rowEnd) of frame into the
+       same rows of mask (allocated like frame). Bands of rows can run on
+       different threads */
+    void detectRows(const cv::Mat &frame, cv::Mat &mask, int rowBegin,
+                    int rowEnd);
+
+    /* The same for planar frames, mask being a single plane (allocated
+       like frame). A detector follows either planar or interleaved frames,
+       switching starts the background over */
+    void beginFrame(const PlanarFrame &frame, const MotionSettings &settings);
+    void detectRows(const PlanarFrame &frame, PlanarFrame &mask,
+                    int rowBegin, int rowEnd);
+
+    /* Finishes the frame (swaps the previous frame buffers) */
+    void endFrame();
+
+    /* Forgets the background (the automatic threshold stays) */
+    void reset();
+
+private:
+    bool restarts(cv::Size frameSize, bool planarFrame,
+                  const MotionSettings &settings);
+    void detectCountingRows(const cv::Mat &frame, cv::Mat &mask,
+                            int rowBegin, int rowEnd);
+
+    MotionSettings settings;
+    int threshold = 110;            // The frame's
+    AutoThreshold automatic;
+    cv::Size size;
+    bool planar = false;
+    cv::Mat frames[2];              // PreviousFrame: previous and next
+    int previous = 0;
+    PlanarFrame planarPrevious;     // PreviousFrame, planar
+    std::vector<uint16_t> average;  // Average: 8.8 fixed point, per channel
+};
+
+#endif
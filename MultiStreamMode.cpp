@@ -0,0 +1,103 @@
+/*
+    Multi-stream mode (see MultiStreamMode.h).
+*/
+
+#include "MultiStreamMode.h"
+#include "CommandLine.h"
+#include "FrameStats.h"
+#include "StreamScheduler.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+static void printMultiStreamUsage() {
+    std::cout << std::endl << "Usage: image_manipulation --stream <source> "
+              << "--filter <0-7> [specs]" << std::endl
+              << "    [--stream <source> --filter <0-7> [specs]]..."
+              << std::endl
+              << "    [--frames N] [--threads N] [--policy block|latest]"
+              << " [--queue N]" << std::endl
+              << "    [--stats status|file.csv|file.json] [--deadline ms]"
+              << std::endl
+              << "Specs are live mode's (--threshold, --motion-threshold...)"
+              << " and apply to the --stream before them" << std::endl;
+}
+
+
+int runMultiStreamMode(int argc, char **argv) {
+    std::vector<StreamConfig> streams;
+    std::vector<bool> filtered;  // Whether each stream has its --filter
+    MultiStreamOptions options;
+    double value;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << flag << std::endl;
+            printMultiStreamUsage();
+            return -1;
+        }
+        std::string text = argv[++i];
+
+        bool valid = true;
+        if (flag == "--stream") {
+            streams.emplace_back();
+            streams.back().source = text;
+            filtered.push_back(false);
+        } else if (flag == "--frames") {
+            valid = parseNumberOption(flag, text, 1, 1e12, value);
+            options.maxFrames = value;
+        } else if (flag == "--threads") {
+            valid = parseNumberOption(flag, text, 1, 1024, value);
+            options.threads = value;
+        } else if (flag == "--policy") {
+            valid = text == "block" || text == "latest";
+            options.policy = text == "latest" ? QueuePolicy::LatestOnly
+                                              : QueuePolicy::Block;
+        } else if (flag == "--queue") {
+            valid = parseNumberOption(flag, text, 1, 64, value);
+            options.depth = value;
+        } else if (flag == "--stats") {
+            options.statsTarget = text;
+        } else if (flag == "--deadline") {
+            valid = parseNumberOption(flag, text, 0, 1e6, value);
+            frameStats().setDeadline(value / 1000);
+        } else if (streams.empty()) {
+            std::cout << flag << " has to follow a --stream" << std::endl;
+            valid = false;
+        } else if (flag == "--filter") {
+            valid = parseNumberOption(flag, text, 0, 7, value);
+            streams.back().choice = value;
+            filtered.back() = true;
+        } else if (!parseSpecsOption(flag, text, streams.back().specs,
+                                     valid)) {
+            std::cout << "Unknown option " << flag << std::endl;
+            valid = false;
+        }
+        if (!valid) {
+            printMultiStreamUsage();
+            return -1;
+        }
+    }
+
+    for (size_t s = 0; s < streams.size(); ++s) {
+        if (!filtered[s]) {
+            std::cout << "--filter is required for stream " << s << " ("
+                      << streams[s].source << ")" << std::endl;
+            printMultiStreamUsage();
+            return -1;
+        }
+    }
+
+    StreamScheduler scheduler(options);
+    for (const StreamConfig &stream : streams) {
+        std::string error;
+        if (!scheduler.add(stream, error)) {
+            std::cout << "Error opening frame source: " << error << std::endl;
+            return -1;
+        }
+    }
+    scheduler.run();
+    return 0;
+}
@@ -0,0 +1,32 @@
+/*
+    Multi-stream mode: runs several live manipulations at once, each on its
+    own frame source (FrameSource.h) with its own filter, specifications and
+    motion detection background, on one shared work stealing pool (see
+    StreamScheduler.h). Usage:
+
+    image_manipulation --stream <source> --filter <0-7> [specs]
+                       [--stream <source> --filter <0-7> [specs]]...
+                       [--frames N] [--threads N] [--policy block|latest]
+                       [--queue N] [--stats status|file.csv|file.json]
+                       [--deadline ms]
+
+    e.g. --stream camera:0 --filter 7 --stream camera:1 --filter 2
+         --policy latest
+
+    The specifications (--threshold, --motion-threshold... like live mode,
+    see LiveMode.h) apply to the --stream before them, the other options to
+    every stream. --frames N stops each stream after N frames, --threads
+    sets the workers (defaults to IMAGE_MANIPULATION_THREADS or the number
+    of cores) and --queue the frames held per stream. Every frame is
+    processed unless --policy latest drops stale ones, as cameras want.
+    The report of each stream is printed once every source has ended.
+*/
+
+#ifndef MULTI_STREAM_MODE_H
+#define MULTI_STREAM_MODE_H
+
+/* Runs multi-stream mode with the program's command line, returns the exit
+   code */
+int runMultiStreamMode(int argc, char **argv);
+
+#endif
@@ -0,0 +1,401 @@
+/*
+    Persistent thread pool and row band executor (see ParallelExecutor.h).
+
+    The workers sleep until a job is posted, then claim chunks of it through
+    an atomic counter alongside the posting thread. The posting thread waits
+    for every worker to leave the job before returning, so the job's body
+    never outlives the call.
+
+    The work stealing pool's deques are rings under a mutex each, which the
+    owner and the thieves hold for a push or pop only. A worker that forked
+    chunks keeps running chunks (its own, then stolen ones) until every
+    chunk of its call is done, so it never sleeps with a frame half done.
+*/
+
+#include "ParallelExecutor.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
+/* Set while a thread runs chunks of a job, so nested calls run inline */
+static thread_local bool insideJob = false;
+
+/* The work stealing pool a thread works for, and its worker index there */
+static thread_local WorkStealingPool *currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+
+ThreadPool::ThreadPool(int threads) {
+    for (int t = 1; t < threads; ++t)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::parallelFor(int count, int grain, RangeBody body) {
+    if (count <= 0)
+        return;
+    grain = std::max(grain, 1);
+
+    std::unique_lock<std::mutex> submit(submitMutex, std::defer_lock);
+    if (workers.empty() || count <= grain || insideJob || !submit.try_lock()) {
+        for (int begin = 0; begin < count; begin += grain)
+            body(begin, std::min(begin + grain, count));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->body = &body;
+        this->count = count;
+        this->grain = grain;
+        nextChunk = 0;
+        busyWorkers = workers.size();
+        error = nullptr;
+        ++generation;
+    }
+    wake.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return busyWorkers == 0; });
+    this->body = nullptr;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+void ThreadPool::workerLoop() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0)
+            finished.notify_one();
+    }
+}
+
+
+/* Claims and runs chunks of the current job until there are none left */
+void ThreadPool::runChunks() {
+    insideJob = true;
+    int chunk;
+    while ((chunk = nextChunk++) * (long)grain < count) {
+        int begin = chunk * grain;
+        try {
+            (*body)(begin, std::min(begin + grain, count));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    insideJob = false;
+}
+
+
+void WorkStealingPool::TaskQueue::pushBack(const PoolTask &task) {
+    if (count == slots.size()) {
+        std::vector<PoolTask> grown(slots.size() * 2);
+        for (size_t i = 0; i < count; ++i)
+            grown[i] = slots[(head + i) % slots.size()];
+        slots.swap(grown);
+        head = 0;
+    }
+    slots[(head + count) % slots.size()] = task;
+    ++count;
+}
+
+
+bool WorkStealingPool::TaskQueue::popBack(PoolTask &task) {
+    if (count == 0)
+        return false;
+    --count;
+    task = slots[(head + count) % slots.size()];
+    return true;
+}
+
+
+bool WorkStealingPool::TaskQueue::popFront(PoolTask &task) {
+    if (count == 0)
+        return false;
+    task = slots[head];
+    head = (head + 1) % slots.size();
+    --count;
+    return true;
+}
+
+
+WorkStealingPool::WorkStealingPool(int threads) {
+    for (int t = 0; t < std::max(threads, 1); ++t)
+        workers.emplace_back(new Worker());
+    for (int t = 0; t < (int)workers.size(); ++t) {
+        workers[t]->thread = std::thread(&WorkStealingPool::workerLoop, this,
+                                         t);
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::unique_ptr<Worker> &worker : workers)
+        worker->thread.join();
+}
+
+
+WorkStealingPool *WorkStealingPool::current() {
+    return currentPool;
+}
+
+
+void WorkStealingPool::submit(const PoolTask &task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shared.pushBack(task);
+        ++pending;
+    }
+    wake.notify_one();
+}
+
+
+/* Wakes sleeping workers for tasks just queued (pending was raised first,
+   taking the mutex orders it before their wait) */
+void WorkStealingPool::wakeWorkers(int tasks) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    if (tasks > 1)
+        wake.notify_all();
+    else if (tasks == 1)
+        wake.notify_one();
+}
+
+
+/* Takes a chunk: the newest of the worker's own, else the oldest of
+   another worker's */
+bool WorkStealingPool::takeChunk(int index, PoolTask &task) {
+    if (queuedChunks.load(std::memory_order_relaxed) <= 0)
+        return false;
+    int workerCount = workers.size();
+    for (int i = 0; i < workerCount; ++i) {
+        int victim = (index + i) % workerCount;
+        Worker &worker = *workers[victim];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        bool taken = i == 0 ? worker.chunks.popBack(task)
+                            : worker.chunks.popFront(task);
+        if (taken) {
+            --queuedChunks;
+            --pending;
+            ++(i == 0 ? ownCount : stolenCount);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void WorkStealingPool::workerLoop(int index) {
+    currentPool = this;
+    currentWorker = index;
+    while (true) {
+        // Chunks of frames already started come before new tasks
+        PoolTask task;
+        if (!takeChunk(index, task)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping)
+                return;
+            if (!shared.popFront(task))
+                continue;  // What's pending is a chunk
+            --pending;
+        }
+        task.run(task.context, task.begin, task.end);
+    }
+}
+
+
+/* A WorkStealingPool::parallelFor() call's chunks */
+struct ChunkJob {
+    const RangeBody *body;
+    std::atomic<int> remaining;
+    std::mutex mutex;  // Guards error and done
+    std::condition_variable finished;
+    std::exception_ptr error;
+    bool done = false;  // Set by the last chunk, the job can go after
+};
+
+
+static void runChunk(void *context, int begin, int end) {
+    ChunkJob &job = *(ChunkJob *)context;
+    bool nested = insideJob;
+    insideJob = true;
+    try {
+        (*job.body)(begin, end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if (!job.error)
+            job.error = std::current_exception();
+    }
+    insideJob = nested;
+    // Last, the call returns (and job goes) once done is set under the lock
+    if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.done = true;
+        job.finished.notify_one();
+    }
+}
+
+
+void WorkStealingPool::parallelFor(int count, int grain, RangeBody body) {
+    if (count <= 0)
+        return;
+    grain = std::max(grain, 1);
+    int chunks = (count + grain - 1) / grain;
+    if (currentPool != this || insideJob || chunks == 1) {
+        for (int begin = 0; begin < count; begin += grain)
+            body(begin, std::min(begin + grain, count));
+        return;
+    }
+
+    ChunkJob job;
+    job.body = &body;
+    job.remaining = chunks;
+    Worker &own = *workers[currentWorker];
+    {
+        // Last chunk first, so the worker pops them in order while thieves
+        // take them from the end
+        std::lock_guard<std::mutex> lock(own.mutex);
+        for (int chunk = chunks - 1; chunk >= 1; --chunk) {
+            PoolTask task;
+            task.run = runChunk;
+            task.context = &job;
+            task.begin = chunk * grain;
+            task.end = std::min(task.begin + grain, count);
+            own.chunks.pushBack(task);
+        }
+        queuedChunks += chunks - 1;
+        pending += chunks - 1;
+    }
+    wakeWorkers(chunks - 1);
+
+    runChunk(&job, 0, std::min(grain, count));
+    ++ownCount;
+    // Helps with whatever is queued, then sleeps until the chunks other
+    // workers took are done
+    PoolTask task;
+    while (job.remaining.load(std::memory_order_acquire) > 0
+               && takeChunk(currentWorker, task))
+        task.run(task.context, task.begin, task.end);
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.finished.wait(lock, [&] { return job.done; });
+    if (job.error)
+        std::rethrow_exception(job.error);
+}
+
+
+/* Executor settings and its pool */
+static std::mutex executorMutex;
+static std::shared_ptr<ThreadPool> pool;
+static int configuredThreads = 0;
+static int configuredGrain = 0;
+static bool environmentRead = false;
+
+
+static int defaultThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+/* Reads the environment variables once, called with executorMutex held */
+static void readEnvironment() {
+    if (environmentRead)
+        return;
+    environmentRead = true;
+    if (const char *threads = std::getenv("IMAGE_MANIPULATION_THREADS"))
+        configuredThreads = std::max(0, std::atoi(threads));
+    if (const char *grain = std::getenv("IMAGE_MANIPULATION_GRAIN"))
+        configuredGrain = std::max(0, std::atoi(grain));
+}
+
+
+void configureExecutor(int threads, int grainRows) {
+    std::shared_ptr<ThreadPool> replaced;  // Let go of after unlocking
+    std::lock_guard<std::mutex> lock(executorMutex);
+    environmentRead = true;
+    configuredThreads = std::max(0, threads);
+    configuredGrain = std::max(0, grainRows);
+    int wanted = configuredThreads > 0 ? configuredThreads : defaultThreads();
+    if (pool && pool->threadCount() != wanted)
+        replaced.swap(pool);
+}
+
+
+std::shared_ptr<ThreadPool> executorPool() {
+    std::lock_guard<std::mutex> lock(executorMutex);
+    readEnvironment();
+    if (!pool) {
+        int threads = configuredThreads > 0 ? configuredThreads
+                                            : defaultThreads();
+        pool = std::make_shared<ThreadPool>(threads);
+    }
+    return pool;
+}
+
+
+int executorThreads() {
+    std::lock_guard<std::mutex> lock(executorMutex);
+    readEnvironment();
+    return configuredThreads > 0 ? configuredThreads : defaultThreads();
+}
+
+
+/* Rows per band of a frame of rows rows on threads threads */
+static int grainRows(int rows, int threads) {
+    std::lock_guard<std::mutex> lock(executorMutex);
+    readEnvironment();
+    if (configuredGrain > 0)
+        return configuredGrain;
+    int bands = threads * 4;
+    return std::max(1, (rows + bands - 1) / bands);
+}
+
+
+int executorGrainRows(int rows) {
+    return grainRows(rows, executorPool()->threadCount());
+}
+
+
+void parallelForRows(int rows, RangeBody body) {
+    if (WorkStealingPool *stealing = WorkStealingPool::current()) {
+        stealing->parallelFor(rows, grainRows(rows, stealing->threadCount()),
+                              body);
+        return;
+    }
+    std::shared_ptr<ThreadPool> executor = executorPool();
+    executor->parallelFor(rows, grainRows(rows, executor->threadCount()),
+                          body);
+}
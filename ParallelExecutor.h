@@ -0,0 +1,190 @@
+/*
+    Persistent thread pool and the row band executor the manipulations run
+    on.
+
+    parallelForRows() splits a frame's rows into bands of grain rows and runs
+    them on the pool, the calling thread included. Stencil manipulations read
+    the rows around their band (the halo) straight from the source image, so
+    the bands only ever write their own rows.
+
+    The thread count defaults to the number of cores and the grain to about
+    four bands per thread. Both can be set with configureExecutor() or the
+    environment variables IMAGE_MANIPULATION_THREADS and
+    IMAGE_MANIPULATION_GRAIN (rows per band).
+
+    Jobs take their body as a RangeBody, a reference to the caller's lambda
+    rather than a copy of it like std::function, so posting a job never
+    allocates (see FramePool.h).
+
+    Multi-stream mode (StreamScheduler.h) runs many streams' frames at once
+    on a WorkStealingPool instead. Its workers take whole frames (tasks)
+    from a shared queue in the order they were submitted, and
+    parallelForRows() called on one of them splits the frame's rows into
+    chunks on that worker's own deque: the worker runs them newest first
+    while idle workers steal them oldest first, so a frame spreads over the
+    cores only when there are cores to spare.
+*/
+
+#ifndef PARALLEL_EXECUTOR_H
+#define PARALLEL_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/* Reference to a callable taking (begin, end), which has to outlive the
+   call it's passed to (a lambda written in the call does) */
+class RangeBody {
+public:
+    template <typename Body,
+              typename = typename std::enable_if<!std::is_same<
+                  typename std::decay<Body>::type, RangeBody>::value>::type>
+    RangeBody(Body &&body)
+        : object(&body),
+          call(&invoke<typename std::remove_reference<Body>::type>) {}
+
+    void operator()(int begin, int end) const { call(object, begin, end); }
+
+private:
+    template <typename Body>
+    static void invoke(const void *object, int begin, int end) {
+        (*(Body *)object)(begin, end);
+    }
+
+    const void *object;
+    void (*call)(const void *, int, int);
+};
+
+class ThreadPool {
+public:
+    /* threads counts the thread calling parallelFor(), so threads - 1
+       workers are started */
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const { return workers.size() + 1; }
+
+    /* Runs body(begin, end) over [0, count) in chunks of grain, returns once
+       every chunk is done. Calls made from inside a chunk, or while another
+       thread's call is running, run on the calling thread alone */
+    void parallelFor(int count, int grain, RangeBody body);
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;  // One job at a time
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // Current job, guarded by mutex (nextChunk is claimed without it)
+    const RangeBody *body = nullptr;
+    int count = 0;
+    int grain = 1;
+    std::atomic<int> nextChunk{0};
+    uint64_t generation = 0;
+    int busyWorkers = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+};
+
+/* A task for the WorkStealingPool, run(context, begin, end) */
+struct PoolTask {
+    void (*run)(void *context, int begin, int end) = nullptr;
+    void *context = nullptr;
+    int begin = 0;
+    int end = 0;
+};
+
+class WorkStealingPool {
+public:
+    /* Starts threads workers (the submitting threads don't take part) */
+    explicit WorkStealingPool(int threads);
+
+    /* Stops the workers, tasks still queued are not run */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    int threadCount() const { return workers.size(); }
+
+    /* Queues a task on the shared queue, from any thread */
+    void submit(const PoolTask &task);
+
+    /* Runs body(begin, end) over [0, count) in chunks of grain from one of
+       the pool's workers, idle workers stealing chunks, and returns once
+       every chunk is done. Calls from inside a chunk run inline */
+    void parallelFor(int count, int grain, RangeBody body);
+
+    /* The pool the calling thread works for, null if none */
+    static WorkStealingPool *current();
+
+    /* Chunks run by the worker that made them, and by other workers */
+    uint64_t ownChunks() const { return ownCount; }
+    uint64_t stolenChunks() const { return stolenCount; }
+
+private:
+    /* Ring of tasks, growing when full */
+    struct TaskQueue {
+        std::vector<PoolTask> slots = std::vector<PoolTask>(16);
+        size_t head = 0;
+        size_t count = 0;
+
+        void pushBack(const PoolTask &task);
+        bool popBack(PoolTask &task);
+        bool popFront(PoolTask &task);
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        TaskQueue chunks;  // Chunks of the frame the worker is running
+        std::thread thread;
+    };
+
+    void workerLoop(int index);
+    bool takeChunk(int index, PoolTask &task);
+    void wakeWorkers(int tasks);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;  // Guards the shared queue and sleeping
+    std::condition_variable wake;
+    TaskQueue shared;
+    std::atomic<int> pending{0};  // Tasks queued anywhere
+    std::atomic<int> queuedChunks{0};
+    bool stopping = false;
+    std::atomic<uint64_t> ownCount{0};
+    std::atomic<uint64_t> stolenCount{0};
+};
+
+/* Sets the executor's thread count and rows per band (0 for the defaults).
+   A new thread count replaces the pool; the old one stays alive until
+   whoever is still running on it lets it go */
+void configureExecutor(int threads, int grainRows);
+
+/* The executor's thread count (configured, or one per core) */
+int executorThreads();
+
+/* The executor's pool, created on first use. Hold on to the pointer for
+   as long as the pool is used */
+std::shared_ptr<ThreadPool> executorPool();
+
+/* Rows per band used for a frame of the given height */
+int executorGrainRows(int rows);
+
+/* Runs body(rowBegin, rowEnd) over the bands of [0, rows) on the pool, or
+   on the WorkStealingPool when called from one of its workers */
+void parallelForRows(int rows, RangeBody body);
+
+#endif
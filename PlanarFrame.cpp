@@ -0,0 +1,191 @@
+/*
+    Planar frames (see PlanarFrame.h).
+
+    The conversions are plain loops compiled once per instruction set like
+    PointKernels.cpp, which the compiler turns into byte shuffles.
+*/
+
+#include "PlanarFrame.h"
+#include "ParallelExecutor.h"
+#include "SimdDispatch.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+
+KERNEL_INLINE void deinterleaveBody(const uint8_t *src, uint8_t *blue,
+                                    uint8_t *green, uint8_t *red,
+                                    int pixels) {
+    for (int i = 0; i < pixels; ++i) {
+        blue[i] = src[3 * i];
+        green[i] = src[3 * i + 1];
+        red[i] = src[3 * i + 2];
+    }
+}
+
+
+KERNEL_INLINE void interleaveBody(const uint8_t *blue, const uint8_t *green,
+                                  const uint8_t *red, uint8_t *dst,
+                                  int pixels) {
+    for (int i = 0; i < pixels; ++i) {
+        dst[3 * i] = blue[i];
+        dst[3 * i + 1] = green[i];
+        dst[3 * i + 2] = red[i];
+    }
+}
+
+
+struct PlanarKernelTable {
+    void (*deinterleave)(const uint8_t *, uint8_t *, uint8_t *, uint8_t *,
+                         int);
+    void (*interleave)(const uint8_t *, const uint8_t *, const uint8_t *,
+                       uint8_t *, int);
+};
+
+#define DEFINE_PLANAR_TABLE(name, attributes)                                  \
+    attributes static void name##Deinterleave(const uint8_t *src,             \
+                                              uint8_t *blue, uint8_t *green,  \
+                                              uint8_t *red, int pixels) {     \
+        deinterleaveBody(src, blue, green, red, pixels);                       \
+    }                                                                          \
+    attributes static void name##Interleave(const uint8_t *blue,              \
+                                            const uint8_t *green,             \
+                                            const uint8_t *red, uint8_t *dst, \
+                                            int pixels) {                      \
+        interleaveBody(blue, green, red, dst, pixels);                         \
+    }                                                                          \
+    static const PlanarKernelTable name##PlanarKernels = {                     \
+        name##Deinterleave, name##Interleave};
+
+DEFINE_PLANAR_TABLE(baseline, )
+#ifdef SIMD_DISPATCH_X86
+DEFINE_PLANAR_TABLE(sse41, KERNEL_TARGET("sse4.1"))
+DEFINE_PLANAR_TABLE(avx2, KERNEL_TARGET("avx2"))
+DEFINE_PLANAR_TABLE(avx512, KERNEL_TARGET("avx512f,avx512bw"))
+#endif
+
+
+static const PlanarKernelTable &planarKernels() {
+#ifdef SIMD_DISPATCH_X86
+    switch (activeSimdLevel()) {
+        case SimdLevel::AVX512:
+            return avx512PlanarKernels;
+        case SimdLevel::AVX2:
+            return avx2PlanarKernels;
+        case SimdLevel::SSE41:
+            return sse41PlanarKernels;
+        default:
+            break;
+    }
+#endif
+    return baselinePlanarKernels;
+}
+
+
+PlanarFrame::PlanarFrame(PlanarFrame &&other) noexcept {
+    *this = std::move(other);
+}
+
+
+PlanarFrame &PlanarFrame::operator=(PlanarFrame &&other) noexcept {
+    if (this != &other) {
+        storage = std::move(other.storage);
+        lease = std::move(other.lease);
+        data = std::exchange(other.data, nullptr);
+        width = std::exchange(other.width, 0);
+        height = std::exchange(other.height, 0);
+        planes = std::exchange(other.planes, 0);
+        rowStep = std::exchange(other.rowStep, 0);
+    }
+    return *this;
+}
+
+
+void PlanarFrame::create(cv::Size size, int channels, FramePool *pool) {
+    size_t step = ((size_t)std::max(size.width, 1) + PLANAR_ALIGNMENT - 1)
+                  / PLANAR_ALIGNMENT * PLANAR_ALIGNMENT;
+    size_t bytes = step * std::max(size.height, 0) * channels;
+    if (bytes == 0) {
+        release();
+        return;
+    }
+    // Room to align the first row, the buffer is zeroed when it's made
+    // (padding included) so kernels running into the padding read defined
+    // bytes
+    size_t needed = bytes + PLANAR_ALIGNMENT;
+    if (std::max(storage.size(), lease.size()) < needed) {
+        if (pool) {
+            storage = std::vector<uint8_t>();
+            lease = pool->acquire(needed);
+        } else {
+            lease.reset();
+            storage.assign(needed, 0);
+        }
+    }
+    uint8_t *buffer = lease.empty() ? storage.data() : lease.data();
+    uintptr_t address = (uintptr_t)buffer;
+    data = buffer + (PLANAR_ALIGNMENT - address % PLANAR_ALIGNMENT)
+                    % PLANAR_ALIGNMENT;
+    width = size.width;
+    height = size.height;
+    planes = channels;
+    rowStep = step;
+}
+
+
+void PlanarFrame::release() {
+    storage = std::vector<uint8_t>();
+    lease.reset();
+    data = nullptr;
+    width = height = planes = 0;
+    rowStep = 0;
+}
+
+
+cv::Mat PlanarFrame::plane(int k) const {
+    return cv::Mat(height, width, CV_8UC1, (void *)ptr(k, 0), rowStep);
+}
+
+
+void PlanarFrame::copyTo(PlanarFrame &other) const {
+    other.create(size(), planes);
+    std::memcpy(other.data, data, rowStep * height * planes);
+}
+
+
+void toPlanar(const cv::Mat &image, PlanarFrame &frame) {
+    frame.create(image.size(), 3);
+    const PlanarKernelTable &kernels = planarKernels();
+    parallelForRows(image.rows, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            kernels.deinterleave(image.ptr<uint8_t>(r), frame.ptr(0, r),
+                                 frame.ptr(1, r), frame.ptr(2, r),
+                                 image.cols);
+        }
+    });
+}
+
+
+void fromPlanar(const PlanarFrame &frame, cv::Mat &image) {
+    image.create(frame.size(), CV_8UC3);
+    const PlanarKernelTable &kernels = planarKernels();
+    bool gray = frame.channels() == 1;
+    parallelForRows(frame.rows(), [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; ++r) {
+            const uint8_t *blue = frame.ptr(0, r);
+            kernels.interleave(blue, gray ? blue : frame.ptr(1, r),
+                               gray ? blue : frame.ptr(2, r),
+                               image.ptr<uint8_t>(r), frame.cols());
+        }
+    });
+}
+
+
+void resizePlanar(const PlanarFrame &frame, PlanarFrame &resized,
+                  cv::Size size, int interpolation) {
+    resized.create(size, frame.channels());
+    for (int k = 0; k < frame.channels(); ++k) {
+        cv::Mat plane = resized.plane(k);  // Written in place
+        cv::resize(frame.plane(k), plane, size, 0, 0, interpolation);
+    }
+}
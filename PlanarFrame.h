@@ -0,0 +1,98 @@
+/*
+    Planar (structure of arrays) frames for the manipulation kernels.
+
+    OpenCV keeps BGR pixels interleaved, so a kernel that only needs one
+    value per pixel (luminance, a threshold, a channel's multiplier) still
+    steps over the other two channels, and the compiler has to shuffle the
+    bytes apart before it can vectorize. A PlanarFrame keeps each channel in
+    its own plane instead, with every row starting on a 64 byte boundary and
+    padded to a multiple of 64 bytes, so the kernels run whole vectors from
+    the start of a row to its padding without a scalar tail.
+
+    Black and white, grayscale, the outline and motion detection give one
+    value per pixel, so their output is a single plane (channels() is 1),
+    a third of the bytes to write. It becomes gray BGR again when converted
+    back.
+
+    Frames are converted once where they come in (capture) and once where
+    they go out (display), see toPlanar() and fromPlanar(), both vectorized
+    (SimdDispatch.h) and run on the thread pool. The manipulations on planar
+    frames are executePlanarManipulation() in Manipulations.h.
+*/
+
+#ifndef PLANAR_FRAME_H
+#define PLANAR_FRAME_H
+
+#include "opencv2/opencv.hpp"
+#include "FramePool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Alignment of every row, and the multiple its length is padded to */
+static const int PLANAR_ALIGNMENT = 64;
+
+class PlanarFrame {
+public:
+    PlanarFrame() = default;
+    PlanarFrame(cv::Size size, int channels) { create(size, channels); }
+
+    /* Rows point into the frame's own buffer, which moves with it (the
+       frame moved from is left empty) */
+    PlanarFrame(PlanarFrame &&other) noexcept;
+    PlanarFrame &operator=(PlanarFrame &&other) noexcept;
+    PlanarFrame(const PlanarFrame &) = delete;
+    PlanarFrame &operator=(const PlanarFrame &) = delete;
+
+    /* Allocates size with 1 or 3 planes (B, G, R), keeping the buffer if it
+       is already large enough. The pixels are left as they were. A new
+       buffer comes from pool if there is one (FramePool.h) */
+    void create(cv::Size size, int channels, FramePool *pool = nullptr);
+
+    void release();
+
+    bool empty() const { return data == nullptr; }
+    int rows() const { return height; }
+    int cols() const { return width; }
+    cv::Size size() const { return cv::Size(width, height); }
+    int channels() const { return planes; }
+
+    /* Bytes from one row to the next, a multiple of PLANAR_ALIGNMENT */
+    size_t step() const { return rowStep; }
+
+    /* Row r of plane k */
+    uint8_t *ptr(int k, int r) {
+        return data + ((size_t)k * height + r) * rowStep;
+    }
+    const uint8_t *ptr(int k, int r) const {
+        return data + ((size_t)k * height + r) * rowStep;
+    }
+
+    /* Plane k as a single channel image sharing the frame's pixels, e.g. to
+       resize it with OpenCV */
+    cv::Mat plane(int k) const;
+
+    /* Copies the pixels into other (allocated like this frame) */
+    void copyTo(PlanarFrame &other) const;
+
+private:
+    std::vector<uint8_t> storage;
+    FrameLease lease;         // Used instead of storage when pooled
+    uint8_t *data = nullptr;  // First row, aligned within the buffer
+    int width = 0;
+    int height = 0;
+    int planes = 0;
+    size_t rowStep = 0;
+};
+
+/* Converts a BGR image (CV_8UC3) into a 3 plane frame */
+void toPlanar(const cv::Mat &image, PlanarFrame &frame);
+
+/* Converts a frame back into a BGR image, a single plane becoming gray */
+void fromPlanar(const PlanarFrame &frame, cv::Mat &image);
+
+/* Resizes every plane of frame to size into resized (like cv::resize) */
+void resizePlanar(const PlanarFrame &frame, PlanarFrame &resized,
+                  cv::Size size, int interpolation = cv::INTER_LINEAR);
+
+#endif
@@ -0,0 +1,476 @@
+/*
+    Vectorized row kernels for the point manipulations (see PointKernels.h).
+
+    Each kernel is written once as a plain loop over the row in integer
+    arithmetic with no branches, which the compiler vectorizes. The loops are
+    then instantiated once per instruction set, and the table of function
+    pointers for the active set (SimdDispatch.h) is used.
+*/
+
+#include "PointKernels.h"
+#include "AutoThreshold.h"
+#include "KernelTemplates.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+/* Kernel bodies, one template for both layouts (KernelTemplates.h),
+   instantiated into one function per layout and instruction set */
+template <typename Src, typename Dst>
+KERNEL_INLINE void blackWhiteBody(Src src, Dst dst, int pixels,
+                                  int threshold) {
+    // (b + g + r) / 3.0 > threshold, without the division
+    const int limit = threshold * 3;
+    for (int i = 0; i < pixels; ++i) {
+        int sum = src(i, 0) + src(i, 1) + src(i, 2);
+        writeGray(dst, i, (uint8_t)(sum > limit ? 255 : 0));
+    }
+}
+
+
+/* Black and white at limit (a sum of the channels), also writing each
+   pixel's sum for the automatic threshold's histogram (AutoThreshold.h) */
+template <typename Src, typename Dst>
+KERNEL_INLINE void blackWhiteSumsBody(Src src, Dst dst, int pixels, int limit,
+                                      uint16_t *sums) {
+    for (int i = 0; i < pixels; ++i) {
+        int sum = src(i, 0) + src(i, 1) + src(i, 2);
+        sums[i] = sum;
+        writeGray(dst, i, (uint8_t)(sum > limit ? 255 : 0));
+    }
+}
+
+
+template <typename Src>
+KERNEL_INLINE void channelSumsBody(Src src, int pixels, uint16_t *sums) {
+    for (int i = 0; i < pixels; ++i)
+        sums[i] = src(i, 0) + src(i, 1) + src(i, 2);
+}
+
+
+template <typename Src, typename Dst>
+KERNEL_INLINE void grayscaleBody(Src src, Dst dst, int pixels) {
+    for (int i = 0; i < pixels; ++i) {
+        writeGray(dst, i,
+                  (uint8_t)weightedSum<GrayscaleWeights, 0, false>(src, i));
+    }
+}
+
+
+/* Multipliers above 1 wrap around past 255 like the floating point version
+   (which converts through int). mult holds one multiplier per channel */
+template <typename Src, typename Dst>
+KERNEL_INLINE void scaleBody(Src src, Dst dst, int pixels,
+                             const uint32_t *mult) {
+    uint32_t channelMult[Src::channels];
+    for (int k = 0; k < Src::channels; ++k)
+        channelMult[k] = mult[k];
+    for (int i = 0; i < pixels; ++i) {
+        for (int k = 0; k < Src::channels; ++k)
+            dst(i, k) = (src(i, k) * channelMult[k]) >> 16;
+    }
+}
+
+
+template <typename Src, typename Dst>
+KERNEL_INLINE void purifyBody(Src src, Dst dst, int pixels) {
+    for (int i = 0; i < pixels; ++i) {
+        uint8_t blue = src(i, 0), green = src(i, 1), red = src(i, 2);
+        bool blueMax = blue > green && blue > red;
+        bool greenMax = !blueMax && green > blue && green > red;
+        dst(i, 0) = blueMax ? 255 : 0;
+        dst(i, 1) = greenMax ? 255 : 0;
+        dst(i, 2) = blueMax || greenMax ? 0 : 255;
+    }
+}
+
+
+/* Planar output gets one loop per plane: a single loop writing all three
+   needs more pointer overlap checks than the compiler will vectorize with.
+   The comparisons are combined without branches for the same reason */
+template <typename Src>
+KERNEL_INLINE void purifyBody(Src src, Planar<uint8_t, 3> dst, int pixels) {
+    for (int i = 0; i < pixels; ++i) {
+        bool blueMax = (src(i, 0) > src(i, 1)) & (src(i, 0) > src(i, 2));
+        dst(i, 0) = blueMax ? 255 : 0;
+    }
+    for (int i = 0; i < pixels; ++i) {
+        bool blueMax = (src(i, 0) > src(i, 1)) & (src(i, 0) > src(i, 2));
+        bool greenMax = (src(i, 1) > src(i, 0)) & (src(i, 1) > src(i, 2));
+        dst(i, 1) = !blueMax & greenMax ? 255 : 0;
+    }
+    for (int i = 0; i < pixels; ++i) {
+        bool blueMax = (src(i, 0) > src(i, 1)) & (src(i, 0) > src(i, 2));
+        bool greenMax = (src(i, 1) > src(i, 0)) & (src(i, 1) > src(i, 2));
+        dst(i, 2) = blueMax | greenMax ? 0 : 255;
+    }
+}
+
+
+/* The layouts the kernels are instantiated for */
+using BgrRow = Interleaved<const uint8_t, 3>;
+using BgrOutRow = Interleaved<uint8_t, 3>;
+using PlaneRow = Interleaved<const uint8_t, 1>;
+using PlaneOutRow = Interleaved<uint8_t, 1>;
+using BgrPlanes = Planar<const uint8_t, 3>;
+using BgrOutPlanes = Planar<uint8_t, 3>;
+
+
+/* One set of kernels per instruction set */
+struct PointKernelTable {
+    void (*blackWhite)(const uint8_t *, uint8_t *, int, int);
+    void (*grayscale)(const uint8_t *, uint8_t *, int);
+    void (*scale)(const uint8_t *, uint8_t *, int, const uint32_t *);
+    void (*purify)(const uint8_t *, uint8_t *, int);
+    void (*blackWhitePlanar)(const uint8_t *, const uint8_t *,
+                             const uint8_t *, uint8_t *, int, int);
+    void (*grayscalePlanar)(const uint8_t *, const uint8_t *,
+                            const uint8_t *, uint8_t *, int);
+    void (*scalePlane)(const uint8_t *, uint8_t *, int, uint32_t);
+    void (*purifyPlanar)(const uint8_t *, const uint8_t *, const uint8_t *,
+                         uint8_t *, uint8_t *, uint8_t *, int);
+    void (*blackWhiteSums)(const uint8_t *, uint8_t *, int, int, uint16_t *);
+    void (*channelSums)(const uint8_t *, int, uint16_t *);
+    void (*blackWhiteSumsPlanar)(const uint8_t *, const uint8_t *,
+                                 const uint8_t *, uint8_t *, int, int,
+                                 uint16_t *);
+    void (*channelSumsPlanar)(const uint8_t *, const uint8_t *,
+                              const uint8_t *, int, uint16_t *);
+};
+
+#define DEFINE_KERNEL_TABLE(name, attributes)                                  \
+    attributes static void name##BlackWhite(const uint8_t *src, uint8_t *dst, \
+                                            int pixels, int threshold) {      \
+        blackWhiteBody(BgrRow{src}, BgrOutRow{dst}, pixels, threshold);        \
+    }                                                                          \
+    attributes static void name##Grayscale(const uint8_t *src, uint8_t *dst,  \
+                                           int pixels) {                       \
+        grayscaleBody(BgrRow{src}, BgrOutRow{dst}, pixels);                    \
+    }                                                                          \
+    attributes static void name##Scale(const uint8_t *src, uint8_t *dst,      \
+                                       int pixels, const uint32_t *mult) {     \
+        scaleBody(BgrRow{src}, BgrOutRow{dst}, pixels, mult);                  \
+    }                                                                          \
+    attributes static void name##Purify(const uint8_t *src, uint8_t *dst,     \
+                                        int pixels) {                          \
+        purifyBody(BgrRow{src}, BgrOutRow{dst}, pixels);                       \
+    }                                                                          \
+    attributes static void name##BlackWhitePlanar(                             \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            uint8_t *dst, int pixels, int threshold) {                         \
+        blackWhiteBody(BgrPlanes{{blue, green, red}}, PlaneOutRow{dst},        \
+                       pixels, threshold);                                     \
+    }                                                                          \
+    attributes static void name##GrayscalePlanar(                              \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            uint8_t *dst, int pixels) {                                        \
+        grayscaleBody(BgrPlanes{{blue, green, red}}, PlaneOutRow{dst},         \
+                      pixels);                                                 \
+    }                                                                          \
+    attributes static void name##ScalePlane(const uint8_t *src, uint8_t *dst, \
+                                            int pixels, uint32_t mult) {      \
+        scaleBody(PlaneRow{src}, PlaneOutRow{dst}, pixels, &mult);             \
+    }                                                                          \
+    attributes static void name##PurifyPlanar(                                 \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            uint8_t *dstBlue, uint8_t *dstGreen, uint8_t *dstRed,              \
+            int pixels) {                                                      \
+        purifyBody(BgrPlanes{{blue, green, red}},                              \
+                   BgrOutPlanes{{dstBlue, dstGreen, dstRed}}, pixels);         \
+    }                                                                          \
+    attributes static void name##BlackWhiteSums(                               \
+            const uint8_t *src, uint8_t *dst, int pixels, int limit,           \
+            uint16_t *sums) {                                                  \
+        blackWhiteSumsBody(BgrRow{src}, BgrOutRow{dst}, pixels, limit, sums);  \
+    }                                                                          \
+    attributes static void name##ChannelSums(const uint8_t *src, int pixels,  \
+                                             uint16_t *sums) {                 \
+        channelSumsBody(BgrRow{src}, pixels, sums);                            \
+    }                                                                          \
+    attributes static void name##BlackWhiteSumsPlanar(                         \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            uint8_t *dst, int pixels, int limit, uint16_t *sums) {             \
+        blackWhiteSumsBody(BgrPlanes{{blue, green, red}}, PlaneOutRow{dst},    \
+                           pixels, limit, sums);                               \
+    }                                                                          \
+    attributes static void name##ChannelSumsPlanar(                            \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            int pixels, uint16_t *sums) {                                      \
+        channelSumsBody(BgrPlanes{{blue, green, red}}, pixels, sums);          \
+    }                                                                          \
+    static const PointKernelTable name##Kernels = {                            \
+        name##BlackWhite, name##Grayscale, name##Scale, name##Purify,          \
+        name##BlackWhitePlanar, name##GrayscalePlanar, name##ScalePlane,       \
+        name##PurifyPlanar, name##BlackWhiteSums, name##ChannelSums,           \
+        name##BlackWhiteSumsPlanar, name##ChannelSumsPlanar};
+
+DEFINE_KERNEL_TABLE(baseline, )
+#ifdef SIMD_DISPATCH_X86
+DEFINE_KERNEL_TABLE(sse41, KERNEL_TARGET("sse4.1"))
+DEFINE_KERNEL_TABLE(avx2, KERNEL_TARGET("avx2"))
+DEFINE_KERNEL_TABLE(avx512, KERNEL_TARGET("avx512f,avx512bw"))
+#endif
+
+
+static const PointKernelTable &kernels() {
+    SimdLevel level = activeSimdLevel();
+#ifdef SIMD_DISPATCH_X86
+    switch (level) {
+        case SimdLevel::AVX512:
+            return avx512Kernels;
+        case SimdLevel::AVX2:
+            return avx2Kernels;
+        case SimdLevel::SSE41:
+            return sse41Kernels;
+        default:
+            break;
+    }
+#endif
+    return baselineKernels;
+}
+
+
+/* The floating point formula of darken() and rgbPercentages() */
+static uint8_t scaleReference(int value, double factor) {
+    return (int)(value * factor);
+}
+
+
+/* Finds a 16.16 multiplier that reproduces the floating point formula for
+   every input value. The nearest one almost always does, but factors such as
+   0.29 (where 100 * 0.29 is just below 29 in floating point) can need a
+   neighbouring one, and a few can't be matched at all */
+static bool exactMultiplier(double factor, uint32_t &mult) {
+    long nearest = std::lround(factor * 65536);
+    for (long candidate : {nearest, nearest - 1, nearest + 1}) {
+        if (candidate < 0)
+            continue;
+        bool matches = true;
+        for (int value = 0; value < 256 && matches; ++value) {
+            matches = (uint8_t)((value * candidate) >> 16)
+                      == scaleReference(value, factor);
+        }
+        if (matches) {
+            mult = candidate;
+            return true;
+        }
+    }
+    mult = nearest;
+    return false;
+}
+
+
+ChannelScale makeChannelScale(double blue, double green, double red) {
+    ChannelScale scale;
+    scale.factor[0] = blue;
+    scale.factor[1] = green;
+    scale.factor[2] = red;
+    scale.exact = true;
+    for (int k = 0; k < 3; ++k)
+        scale.exact &= exactMultiplier(scale.factor[k], scale.mult[k]);
+    return scale;
+}
+
+
+void blackWhiteRow(const uint8_t *src, uint8_t *dst, int pixels, int threshold) {
+    kernels().blackWhite(src, dst, pixels, threshold);
+}
+
+
+void grayscaleRow(const uint8_t *src, uint8_t *dst, int pixels) {
+    kernels().grayscale(src, dst, pixels);
+}
+
+
+void scaleRow(const uint8_t *src, uint8_t *dst, int pixels,
+              const ChannelScale &scale) {
+    if (scale.exact) {
+        kernels().scale(src, dst, pixels, scale.mult);
+        return;
+    }
+    for (int i = 0; i < pixels * 3; i += 3) {
+        dst[i] = scaleReference(src[i], scale.factor[0]);
+        dst[i + 1] = scaleReference(src[i + 1], scale.factor[1]);
+        dst[i + 2] = scaleReference(src[i + 2], scale.factor[2]);
+    }
+}
+
+
+void purifyRow(const uint8_t *src, uint8_t *dst, int pixels) {
+    kernels().purify(src, dst, pixels);
+}
+
+
+void blackWhitePlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                         int pixels, int threshold) {
+    kernels().blackWhitePlanar(src[0], src[1], src[2], dst, pixels,
+                               threshold);
+}
+
+
+void grayscalePlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                        int pixels) {
+    kernels().grayscalePlanar(src[0], src[1], src[2], dst, pixels);
+}
+
+
+void scalePlaneRow(const uint8_t *src, uint8_t *dst, int pixels,
+                   const ChannelScale &scale, int channel) {
+    if (scale.exact) {
+        kernels().scalePlane(src, dst, pixels, scale.mult[channel]);
+        return;
+    }
+    for (int i = 0; i < pixels; ++i)
+        dst[i] = scaleReference(src[i], scale.factor[channel]);
+}
+
+
+void purifyPlanarRow(const uint8_t *const src[3], uint8_t *const dst[3],
+                     int pixels) {
+    kernels().purifyPlanar(src[0], src[1], src[2], dst[0], dst[1], dst[2],
+                           pixels);
+}
+
+
+/* Pixels per block of the histogram kernels, whose sums stay in L1 between
+   the vectorized pass and the counting */
+const int sumBlock = 256;
+
+
+void blackWhiteHistogramRow(const uint8_t *src, uint8_t *dst, int pixels,
+                            int limit, uint32_t *histogram) {
+    uint16_t sums[sumBlock];
+    for (int start = 0; start < pixels; start += sumBlock) {
+        int count = std::min(pixels - start, sumBlock);
+        kernels().blackWhiteSums(src + 3 * start, dst + 3 * start, count,
+                                 limit, sums);
+        if (histogram)
+            countValues(sums, count, histogram);
+    }
+}
+
+
+void channelSumHistogramRow(const uint8_t *src, int pixels,
+                            uint32_t *histogram) {
+    uint16_t sums[sumBlock];
+    for (int start = 0; start < pixels; start += sumBlock) {
+        int count = std::min(pixels - start, sumBlock);
+        kernels().channelSums(src + 3 * start, count, sums);
+        countValues(sums, count, histogram);
+    }
+}
+
+
+void blackWhiteHistogramPlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                                  int pixels, int limit,
+                                  uint32_t *histogram) {
+    uint16_t sums[sumBlock];
+    for (int start = 0; start < pixels; start += sumBlock) {
+        int count = std::min(pixels - start, sumBlock);
+        kernels().blackWhiteSumsPlanar(src[0] + start, src[1] + start,
+                                       src[2] + start, dst + start, count,
+                                       limit, sums);
+        if (histogram)
+            countValues(sums, count, histogram);
+    }
+}
+
+
+void channelSumHistogramPlanarRow(const uint8_t *const src[3], int pixels,
+                                  uint32_t *histogram) {
+    uint16_t sums[sumBlock];
+    for (int start = 0; start < pixels; start += sumBlock) {
+        int count = std::min(pixels - start, sumBlock);
+        kernels().channelSumsPlanar(src[0] + start, src[1] + start,
+                                    src[2] + start, count, sums);
+        countValues(sums, count, histogram);
+    }
+}
+
+
+/* Registry entries, adapting the row kernels to one signature */
+static void copyFilterRow(const uint8_t *src, uint8_t *dst, int pixels,
+                          const PointParams &) {
+    std::memcpy(dst, src, (size_t)pixels * 3);
+}
+
+
+static void copyFilterPlanes(const uint8_t *const src[3],
+                             uint8_t *const dst[3], int pixels,
+                             const PointParams &) {
+    for (int k = 0; k < 3; ++k)
+        std::memcpy(dst[k], src[k], pixels);
+}
+
+
+static void blackWhiteFilterRow(const uint8_t *src, uint8_t *dst, int pixels,
+                                const PointParams &params) {
+    blackWhiteRow(src, dst, pixels, params.threshold);
+}
+
+
+static void blackWhiteFilterPlanes(const uint8_t *const src[3],
+                                   uint8_t *const dst[3], int pixels,
+                                   const PointParams &params) {
+    blackWhitePlanarRow(src, dst[0], pixels, params.threshold);
+}
+
+
+static void grayscaleFilterRow(const uint8_t *src, uint8_t *dst, int pixels,
+                               const PointParams &) {
+    grayscaleRow(src, dst, pixels);
+}
+
+
+static void grayscaleFilterPlanes(const uint8_t *const src[3],
+                                  uint8_t *const dst[3], int pixels,
+                                  const PointParams &) {
+    grayscalePlanarRow(src, dst[0], pixels);
+}
+
+
+static void scaleFilterRow(const uint8_t *src, uint8_t *dst, int pixels,
+                           const PointParams &params) {
+    scaleRow(src, dst, pixels, params.scale);
+}
+
+
+static void scaleFilterPlanes(const uint8_t *const src[3],
+                              uint8_t *const dst[3], int pixels,
+                              const PointParams &params) {
+    for (int k = 0; k < 3; ++k)
+        scalePlaneRow(src[k], dst[k], pixels, params.scale, k);
+}
+
+
+static void purifyFilterRow(const uint8_t *src, uint8_t *dst, int pixels,
+                            const PointParams &) {
+    purifyRow(src, dst, pixels);
+}
+
+
+static void purifyFilterPlanes(const uint8_t *const src[3],
+                               uint8_t *const dst[3], int pixels,
+                               const PointParams &) {
+    purifyPlanarRow(src, dst, pixels);
+}
+
+
+static const PointFilter POINT_FILTERS[] = {
+    {0, "original", 3, copyFilterRow, copyFilterPlanes},
+    {1, "black and white", 1, blackWhiteFilterRow, blackWhiteFilterPlanes},
+    {2, "grayscale", 1, grayscaleFilterRow, grayscaleFilterPlanes},
+    {3, "darken", 3, scaleFilterRow, scaleFilterPlanes},
+    {4, "RGB values", 3, scaleFilterRow, scaleFilterPlanes},
+    {5, "purify", 3, purifyFilterRow, purifyFilterPlanes},
+};
+
+
+const PointFilter *findPointFilter(int choice) {
+    for (const PointFilter &filter : POINT_FILTERS) {
+        if (filter.choice == choice)
+            return &filter;
+    }
+    return nullptr;
+}
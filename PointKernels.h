@@ -0,0 +1,97 @@
+/*
+    Vectorized row kernels for the point manipulations (black and white,
+    grayscale, darken, RGB values and purify).
+
+    The kernels work on rows of interleaved BGR bytes, or on the rows of a
+    planar frame's B, G and R planes (PlanarFrame.h), in fixed point
+    arithmetic, and run with the widest instruction set the CPU supports
+    (see SimdDispatch.h). The planar kernels give the same values.
+
+    Accuracy compared to the at<> loops in Manipulations.cpp:
+    - blackWhite, purify: identical.
+    - darken, rgbPercentages: identical. The fixed point multipliers are
+      checked against the floating point formula for all 256 inputs when they
+      are made, and the rare constants that no multiplier reproduces exactly
+      use the floating point formula instead.
+    - grayscale: may be 1 lower or higher than the floating point version
+      where the exact gray value lands on (or within 1/65536 of) a whole
+      number.
+
+    The kernels are instantiated from templates whose weights and layouts
+    are compile-time parameters (KernelTemplates.h). findPointFilter() maps
+    the menu choices 0-5 to them.
+*/
+
+#ifndef POINT_KERNELS_H
+#define POINT_KERNELS_H
+
+#include "SimdDispatch.h"
+#include <cstdint>
+
+/* Per-channel (BGR) multipliers for darken and rgbPercentages, in 16.16
+   fixed point. exact is false when the multipliers can't reproduce the
+   floating point formula for every input value */
+struct ChannelScale {
+    double factor[3];
+    uint32_t mult[3];
+    bool exact;
+};
+
+ChannelScale makeChannelScale(double blue, double green, double red);
+
+/* Row kernels: src and dst point to `pixels` BGR pixels (3 bytes each) */
+void blackWhiteRow(const uint8_t *src, uint8_t *dst, int pixels, int threshold);
+void grayscaleRow(const uint8_t *src, uint8_t *dst, int pixels);
+void scaleRow(const uint8_t *src, uint8_t *dst, int pixels,
+              const ChannelScale &scale);
+void purifyRow(const uint8_t *src, uint8_t *dst, int pixels);
+
+/* Planar row kernels: src points to the rows of the B, G and R planes.
+   Black and white and grayscale write their one value per pixel to a
+   single plane, scalePlaneRow() scales one plane by the given channel's
+   multiplier. The output planes can't be the input planes */
+void blackWhitePlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                         int pixels, int threshold);
+void grayscalePlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                        int pixels);
+void scalePlaneRow(const uint8_t *src, uint8_t *dst, int pixels,
+                   const ChannelScale &scale, int channel);
+void purifyPlanarRow(const uint8_t *const src[3], uint8_t *const dst[3],
+                     int pixels);
+
+/* Black and white at limit, a sum of the three channels rather than their
+   mean, adding each pixel's sum to histogram (autoThresholdBins counts,
+   AutoThreshold.h) in the same pass unless it's null. The channel sum
+   histogram kernels only count. Planar rows write a single plane */
+void blackWhiteHistogramRow(const uint8_t *src, uint8_t *dst, int pixels,
+                            int limit, uint32_t *histogram);
+void channelSumHistogramRow(const uint8_t *src, int pixels,
+                            uint32_t *histogram);
+void blackWhiteHistogramPlanarRow(const uint8_t *const src[3], uint8_t *dst,
+                                  int pixels, int limit,
+                                  uint32_t *histogram);
+void channelSumHistogramPlanarRow(const uint8_t *const src[3], int pixels,
+                                  uint32_t *histogram);
+
+/* Parameters the point kernels take from the manipulation specifications */
+struct PointParams {
+    int threshold = 0;      // Black and white
+    ChannelScale scale{};   // Darken and RGB values
+};
+
+/* A point manipulation's row kernels, for both layouts. planarRow writes
+   planarChannels planes of dst (1 for black and white and grayscale) */
+struct PointFilter {
+    int choice;  // Menu choice
+    const char *name;
+    int planarChannels;
+    void (*row)(const uint8_t *src, uint8_t *dst, int pixels,
+                const PointParams &params);
+    void (*planarRow)(const uint8_t *const src[3], uint8_t *const dst[3],
+                      int pixels, const PointParams &params);
+};
+
+/* The point manipulation of a menu choice (0-5), nullptr for the others */
+const PointFilter *findPointFilter(int choice);
+
+#endif
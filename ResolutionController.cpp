@@ -0,0 +1,91 @@
+/*
+    Adaptive processing resolution (see ResolutionController.h).
+*/
+
+#include "ResolutionController.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+static const double LADDER[] = {1, 0.75, 0.5, 0.375, 0.25};
+static const int LEVELS = sizeof(LADDER) / sizeof(LADDER[0]);
+
+static const double SMOOTHING = 0.2;    // Weight of each new frame
+static const int SETTLE_FRAMES = 5;     // Frames before judging a scale
+static const double DOWN_SHARE = 0.9;   // Of the frame time
+static const int DOWN_FRAMES = 3;
+static const double UP_SHARE = 0.7;
+static const int MIN_UP_FRAMES = 10;
+
+
+ResolutionController::ResolutionController(double targetFps)
+    : targetFps(std::max(targetFps, 0.0)) {
+    if (enabled())
+        frameStats().setResolutionScale(1);
+}
+
+
+double ResolutionController::scale() const {
+    return LADDER[current];
+}
+
+
+int ResolutionController::levels() const {
+    return LEVELS;
+}
+
+
+cv::Size ResolutionController::processingSize(cv::Size frame) const {
+    if (current == 0)
+        return frame;
+    return cv::Size(std::max(16, (int)std::lround(frame.width * scale())),
+                    std::max(16, (int)std::lround(frame.height * scale())));
+}
+
+
+void ResolutionController::record(double seconds) {
+    if (!enabled())
+        return;
+    ++samples;
+    average = samples == 1 ? seconds : average + (seconds - average)
+                                                 * SMOOTHING;
+    if (samples < SETTLE_FRAMES)
+        return;
+
+    double budget = budgetSeconds();
+    overBudget = average > DOWN_SHARE * budget ? overBudget + 1 : 0;
+    if (current > 0) {
+        // The time scales with the pixel count
+        double larger = LADDER[current - 1] / LADDER[current];
+        bool fits = average * larger * larger < UP_SHARE * budget;
+        underBudget = fits ? underBudget + 1 : 0;
+    }
+
+    int upFrames = std::max(MIN_UP_FRAMES, (int)std::ceil(targetFps));
+    if (overBudget >= DOWN_FRAMES && current < LEVELS - 1)
+        step(1);
+    else if (underBudget >= upFrames)
+        step(-1);
+}
+
+
+void ResolutionController::step(int direction) {
+    current += direction;
+    average = 0;
+    samples = 0;
+    overBudget = 0;
+    underBudget = 0;
+    ++changeCount;
+    frameStats().setResolutionScale(scale());
+}
+
+
+std::string ResolutionController::describe() const {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << scale() * 100 << "% ("
+         << current << "/" << LEVELS - 1 << "), " << average * 1000
+         << " ms of " << budgetSeconds() * 1000 << " ms";
+    return text.str();
+}
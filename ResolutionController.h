@@ -0,0 +1,63 @@
+/*
+    Adaptive processing resolution for the live loop.
+
+    The controller times each frame's manipulation and moves along a ladder
+    of scales (100%, 75%, 50%, 37.5% and 25% of the width and height) so the
+    manipulation fits the frame time of a target frame rate. Frames are
+    scaled down before they're manipulated and shown scaled back up.
+
+    The time is smoothed (an exponentially weighted average), and the two
+    directions have different thresholds so the resolution doesn't flip
+    back and forth:
+    - Down a step once the average is over 90% of the frame time for
+      several frames in a row.
+    - Up a step once the time predicted at the larger scale (by the pixel
+      count) is under 70% of the frame time for a second's worth of frames.
+    After a change the average starts over and the controller waits for it
+    to settle before judging the new scale.
+*/
+
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include "opencv2/opencv.hpp"
+#include <string>
+
+class ResolutionController {
+public:
+    /* targetFps of 0 keeps the full resolution */
+    explicit ResolutionController(double targetFps);
+
+    bool enabled() const { return targetFps > 0; }
+
+    /* Size to manipulate a frame of the given size at */
+    cv::Size processingSize(cv::Size frame) const;
+
+    /* Records the seconds a frame's manipulation took, stepping the scale
+       if needed */
+    void record(double seconds);
+
+    /* Current state */
+    double scale() const;
+    int level() const { return current; }
+    int levels() const;
+    double averageSeconds() const { return average; }
+    double budgetSeconds() const { return targetFps > 0 ? 1 / targetFps : 0; }
+    int changes() const { return changeCount; }
+
+    /* The state in a line, e.g. "75% (1/4), 21.4 ms of 33.3 ms" */
+    std::string describe() const;
+
+private:
+    void step(int direction);
+
+    double targetFps;
+    int current = 0;      // Ladder level, 0 being full resolution
+    double average = 0;   // Smoothed seconds per frame at this level
+    int samples = 0;      // Frames since the last change
+    int overBudget = 0;   // Consecutive frames over the down threshold
+    int underBudget = 0;  // Consecutive frames under the up threshold
+    int changeCount = 0;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+    Runtime choice of the instruction set for the vectorized kernels
+    (see SimdDispatch.h).
+*/
+
+#include "SimdDispatch.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+
+SimdLevel supportedSimdLevel() {
+#ifdef SIMD_DISPATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Baseline;
+}
+
+
+/* Picks the level at startup: the supported one, capped by the environment
+   variable IMAGE_MANIPULATION_SIMD if given */
+static SimdLevel startupSimdLevel() {
+    SimdLevel level = supportedSimdLevel();
+    const char *cap = std::getenv("IMAGE_MANIPULATION_SIMD");
+    if (cap == nullptr)
+        return level;
+
+    SimdLevel requested = level;
+    if (std::strcmp(cap, "baseline") == 0)
+        requested = SimdLevel::Baseline;
+    else if (std::strcmp(cap, "sse4.1") == 0)
+        requested = SimdLevel::SSE41;
+    else if (std::strcmp(cap, "avx2") == 0)
+        requested = SimdLevel::AVX2;
+    else if (std::strcmp(cap, "avx512") == 0)
+        requested = SimdLevel::AVX512;
+    return requested < level ? requested : level;
+}
+
+
+static std::atomic<SimdLevel> &currentLevel() {
+    static std::atomic<SimdLevel> level(startupSimdLevel());
+    return level;
+}
+
+
+SimdLevel activeSimdLevel() {
+    return currentLevel().load(std::memory_order_relaxed);
+}
+
+
+SimdLevel setSimdLevel(SimdLevel level) {
+    SimdLevel supported = supportedSimdLevel();
+    if (level > supported)
+        level = supported;
+    currentLevel().store(level);
+    return level;
+}
+
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512:
+            return "AVX-512";
+        case SimdLevel::AVX2:
+            return "AVX2";
+        case SimdLevel::SSE41:
+            return "SSE4.1";
+        default:
+            return "baseline";
+    }
+}
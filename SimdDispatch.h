@@ -0,0 +1,40 @@
+/*
+    Runtime choice of the instruction set for the vectorized kernels
+    (PointKernels.cpp, SobelEngine.cpp, MotionEngine.cpp, built from the
+    templates in KernelTemplates.h).
+
+    Kernels are written once as plain loops that the compiler vectorizes, and
+    compiled for SSE4.1, AVX2 and AVX-512 as well as the compiler's baseline
+    instruction set (SSE2 on x86-64) with the macros below. The widest set
+    the CPU supports is used, unless the environment variable
+    IMAGE_MANIPULATION_SIMD (baseline, sse4.1, avx2 or avx512) caps it.
+*/
+
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_DISPATCH_X86 1
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+/* Instruction sets the kernels are compiled for, narrowest first */
+enum class SimdLevel { Baseline, SSE41, AVX2, AVX512 };
+
+/* The instruction set the kernels currently run with */
+SimdLevel activeSimdLevel();
+
+/* Widest instruction set supported by this CPU (and this build) */
+SimdLevel supportedSimdLevel();
+
+/* Caps the kernels to the given instruction set (or the supported one if it
+   is narrower), returns the level now active */
+SimdLevel setSimdLevel(SimdLevel level);
+
+const char *simdLevelName(SimdLevel level);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+    Strobel (Sobel) outline engine (see SobelEngine.h).
+
+    Each call walks its rows in strips. For a strip the luminance of the
+    strip's rows plus one row above and below is computed into a padded
+    plane, then every output row takes its gradients from three rows of the
+    plane. Strips are sized so the plane stays in the L2 cache.
+*/
+
+#include "SobelEngine.h"
+#include "KernelTemplates.h"
+#include "SimdDispatch.h"
+#include <algorithm>
+#include <vector>
+
+/* Fractional bits kept in the luminance plane. 5 is the most that keeps the
+   squared gradient magnitude within an int */
+static const int LUM_BITS = 5;
+
+/* Squared magnitude thresholds (100 and 30), scaled like the plane */
+static const int WHITE_MAG2 = (100 << LUM_BITS) * (100 << LUM_BITS);
+static const int EDGE_MAG2 = (30 << LUM_BITS) * (30 << LUM_BITS);
+
+/* The white threshold squared in whole units, without the fractional bits */
+static const int WHITE_WHOLE2 = 100 * 100;
+
+/* Bytes of luminance plane per strip (fits comfortably in L2) */
+static const size_t STRIP_BYTES = 128 * 1024;
+
+
+/* Luminance (getLuminosity()) of a row of B, G and R values, either layout
+   (KernelTemplates.h), keeping LUM_BITS fractional bits */
+template <typename Src>
+KERNEL_INLINE void luminanceBody(Src src, int16_t *lum, int width) {
+    for (int x = 0; x < width; ++x)
+        lum[x] = weightedSum<LuminanceWeights, LUM_BITS, true>(src, x);
+}
+
+
+/* One step of a bit by bit integer square root: adds bit to root if the
+   result squared still fits within value */
+KERNEL_INLINE int addRootBit(int root, int bit, int value) {
+    int candidate = root + bit;
+    return candidate * candidate <= value ? candidate : root;
+}
+
+
+/* above, row and below point to column 0 of padded luminance rows, so
+   index -1 and width are valid. The value is written to every channel of
+   the output layout (a gray BGR pixel or a single plane) */
+template <typename Dst>
+KERNEL_INLINE void gradientBody(const int16_t *above, const int16_t *row,
+                                const int16_t *below, Dst dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        int left = above[x - 1] + 2 * row[x - 1] + below[x - 1];
+        int right = above[x + 1] + 2 * row[x + 1] + below[x + 1];
+        int top = above[x - 1] + 2 * above[x] + above[x + 1];
+        int bottom = below[x - 1] + 2 * below[x] + below[x + 1];
+        int gx = right - left;
+        int gy = top - bottom;
+        int mag2 = gx * gx + gy * gy;
+
+        // Whole magnitude for the in-between band: the integer square root of
+        // mag2 without the fractional bits (at most 100 there), spelled out so
+        // the loop stays vectorizable. Clamped in whole units so the root
+        // fits the 7 bits below
+        int whole2 = std::min(mag2 >> (2 * LUM_BITS), WHITE_WHOLE2);
+        int mag = addRootBit(0, 64, whole2);
+        mag = addRootBit(mag, 32, whole2);
+        mag = addRootBit(mag, 16, whole2);
+        mag = addRootBit(mag, 8, whole2);
+        mag = addRootBit(mag, 4, whole2);
+        mag = addRootBit(mag, 2, whole2);
+        mag = addRootBit(mag, 1, whole2);
+        uint8_t value = mag2 > WHITE_MAG2 ? 255 : (mag2 > EDGE_MAG2 ? mag : 0);
+        writeGray(dst, x, value);
+    }
+}
+
+
+struct SobelKernelTable {
+    void (*luminance)(const uint8_t *, int16_t *, int);
+    void (*gradient)(const int16_t *, const int16_t *, const int16_t *,
+                     uint8_t *, int);
+    void (*luminancePlanar)(const uint8_t *, const uint8_t *, const uint8_t *,
+                            int16_t *, int);
+    void (*gradientPlane)(const int16_t *, const int16_t *, const int16_t *,
+                          uint8_t *, int);
+};
+
+#define DEFINE_SOBEL_TABLE(name, attributes)                                   \
+    attributes static void name##Luminance(const uint8_t *src, int16_t *lum,  \
+                                           int width) {                        \
+        luminanceBody(Interleaved<const uint8_t, 3>{src}, lum, width);         \
+    }                                                                          \
+    attributes static void name##Gradient(const int16_t *above,               \
+                                          const int16_t *row,                 \
+                                          const int16_t *below, uint8_t *dst, \
+                                          int width) {                         \
+        gradientBody(above, row, below, Interleaved<uint8_t, 3>{dst}, width); \
+    }                                                                          \
+    attributes static void name##LuminancePlanar(                              \
+            const uint8_t *blue, const uint8_t *green, const uint8_t *red,     \
+            int16_t *lum, int width) {                                         \
+        luminanceBody(Planar<const uint8_t, 3>{{blue, green, red}}, lum,       \
+                      width);                                                  \
+    }                                                                          \
+    attributes static void name##GradientPlane(                                \
+            const int16_t *above, const int16_t *row, const int16_t *below,    \
+            uint8_t *dst, int width) {                                         \
+        gradientBody(above, row, below, Interleaved<uint8_t, 1>{dst}, width); \
+    }                                                                          \
+    static const SobelKernelTable name##SobelKernels = {                       \
+        name##Luminance, name##Gradient, name##LuminancePlanar,                \
+        name##GradientPlane};
+
+DEFINE_SOBEL_TABLE(baseline, )
+#ifdef SIMD_DISPATCH_X86
+DEFINE_SOBEL_TABLE(sse41, KERNEL_TARGET("sse4.1"))
+DEFINE_SOBEL_TABLE(avx2, KERNEL_TARGET("avx2"))
+DEFINE_SOBEL_TABLE(avx512, KERNEL_TARGET("avx512f,avx512bw"))
+#endif
+
+
+static const SobelKernelTable &sobelKernels() {
+    SimdLevel level = activeSimdLevel();
+#ifdef SIMD_DISPATCH_X86
+    switch (level) {
+        case SimdLevel::AVX512:
+            return avx512SobelKernels;
+        case SimdLevel::AVX2:
+            return avx2SobelKernels;
+        case SimdLevel::SSE41:
+            return sse41SobelKernels;
+        default:
+            break;
+    }
+#endif
+    return baselineSobelKernels;
+}
+
+
+/* Outlines rows [rowBegin, rowEnd), luminance(r, lum) filling lum with
+   row r's luminance and gradient writing an output row. Border gives the
+   rows and columns past the edges (KernelTemplates.h) */
+template <typename Border, typename Luminance, typename Gradient>
+static void outlineRows(Luminance luminance, Gradient gradient, uint8_t *dst,
+                        size_t dstStep, int width, int height, int rowBegin,
+                        int rowEnd) {
+    if (width <= 0 || rowBegin >= rowEnd)
+        return;
+
+    const int planeStep = width + 2;  // One column of padding on each side
+    int stripRows = STRIP_BYTES / (planeStep * sizeof(int16_t)) - 2;
+    stripRows = std::max(stripRows, 8);
+
+    // Reused between calls on the same thread
+    static thread_local std::vector<int16_t> plane;
+    plane.resize((size_t)(std::min(stripRows, rowEnd - rowBegin) + 2)
+                 * planeStep);
+
+    for (int stripBegin = rowBegin; stripBegin < rowEnd;
+         stripBegin += stripRows) {
+        int stripEnd = std::min(stripBegin + stripRows, rowEnd);
+
+        // Plane row i holds image row stripBegin - 1 + i
+        int planeRows = stripEnd - stripBegin + 2;
+        for (int i = 0; i < planeRows; ++i) {
+            int16_t *lum = &plane[(size_t)i * planeStep + 1];
+            luminance(Border::row(stripBegin - 1 + i, height), lum);
+            Border::pad(lum, width);
+        }
+
+        for (int r = stripBegin; r < stripEnd; ++r) {
+            const int16_t *row = &plane[(size_t)(r - stripBegin + 1) * planeStep
+                                        + 1];
+            gradient(row - planeStep, row, row + planeStep,
+                     dst + (r - rowBegin) * dstStep, width);
+        }
+    }
+}
+
+
+void sobelOutlineRows(const uint8_t *src, size_t srcStep, uint8_t *dst,
+                      size_t dstStep, int width, int height, int rowBegin,
+                      int rowEnd) {
+    const SobelKernelTable &kernels = sobelKernels();
+    outlineRows<ReplicateBorder>([&](int r, int16_t *lum) {
+        kernels.luminance(src + r * srcStep, lum, width);
+    }, kernels.gradient, dst, dstStep, width, height, rowBegin, rowEnd);
+}
+
+
+void sobelOutlinePlanarRows(const PlanarFrame &src, uint8_t *dst,
+                            size_t dstStep, int rowBegin, int rowEnd) {
+    const SobelKernelTable &kernels = sobelKernels();
+    outlineRows<ReplicateBorder>([&](int r, int16_t *lum) {
+        kernels.luminancePlanar(src.ptr(0, r), src.ptr(1, r), src.ptr(2, r),
+                                lum, src.cols());
+    }, kernels.gradientPlane, dst, dstStep, src.cols(), src.rows(), rowBegin,
+       rowEnd);
+}
@@ -0,0 +1,39 @@
+/*
+    Strobel (Sobel) outline engine.
+
+    The luminance of every pixel is computed once into a plane of 16 bit
+    fixed point values (5 fractional bits), a strip of rows at a time so the
+    plane stays in cache, and the 3x3 gradients run over that plane in integer
+    arithmetic with the widest instruction set available (SimdDispatch.h).
+    Rows and columns past the edges repeat the edge pixels, so every pixel of
+    the image gets an outline value.
+
+    Compared to strobelOutline() in Manipulations.cpp the thresholds (above
+    100 white, above 30 the magnitude, black otherwise) and the luminance
+    weights are the same, but the gradient magnitude can differ by 1 because
+    of the fixed point luminance (so a pixel right at a threshold can land on
+    the other side of it). The top right neighbour's red channel is also read
+    from the right pixel here, where strobelOutline() reads the bottom left.
+*/
+
+#ifndef SOBEL_ENGINE_H
+#define SOBEL_ENGINE_H
+
+#include "PlanarFrame.h"
+#include <cstddef>
+#include <cstdint>
+
+/* Outlines rows [rowBegin, rowEnd) of a width x height BGR image. src points
+   to row 0 of the image and is read from rowBegin - 1 to rowEnd (the rows
+   the gradient needs), so the rows can be split between threads. dst points
+   to the output for row rowBegin. Steps are in bytes */
+void sobelOutlineRows(const uint8_t *src, size_t srcStep, uint8_t *dst,
+                      size_t dstStep, int width, int height, int rowBegin,
+                      int rowEnd);
+
+/* The same on a planar frame's B, G and R planes (PlanarFrame.h), writing
+   one value per pixel to a single plane: dst points to its row rowBegin */
+void sobelOutlinePlanarRows(const PlanarFrame &src, uint8_t *dst,
+                            size_t dstStep, int rowBegin, int rowEnd);
+
+#endif
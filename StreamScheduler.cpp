@@ -0,0 +1,251 @@
+/*
+    Multi-stream processing (see StreamScheduler.h).
+*/
+
+#include "StreamScheduler.h"
+#include "FramePool.h"
+#include "FrameSource.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+
+/* A stream and its stats. Its frames are manipulated one at a time (the
+   stream is queued once at most), so the state and counts need no lock */
+struct StreamScheduler::Stream {
+    Stream(StreamScheduler &scheduler, const StreamConfig &config,
+           std::unique_ptr<FrameSource> source)
+        : scheduler(scheduler), config(config), source(std::move(source)),
+          pool(scheduler.options.depth + 2),
+          ring(scheduler.options.depth, scheduler.options.policy) {}
+
+    StreamScheduler &scheduler;
+    StreamConfig config;
+    std::unique_ptr<FrameSource> source;
+    FramePool pool;  // Before the ring, so it outlives the frames in it
+    FrameRing ring;
+    ManipulationState state;
+    cv::Mat modified;
+    std::atomic<bool> queued{false};
+    std::thread captureThread;
+    std::exception_ptr error;  // Set by the workers
+    std::exception_ptr captureError;  // Set by captureThread
+
+    LatencyHistogram manipulate;
+    LatencyHistogram latency;  // Capture to manipulated
+    uint64_t frames = 0;
+    uint64_t missed = 0;
+    StatsClock::time_point ended;
+};
+
+
+StreamScheduler::StreamScheduler(const MultiStreamOptions &options)
+    : options(options),
+      workers(options.threads > 0 ? options.threads : executorThreads()) {}
+
+
+StreamScheduler::~StreamScheduler() {
+    for (std::unique_ptr<Stream> &stream : streams) {
+        stream->ring.close();
+        if (stream->captureThread.joinable())
+            stream->captureThread.join();
+    }
+}
+
+
+bool StreamScheduler::add(const StreamConfig &config, std::string &error) {
+    std::unique_ptr<FrameSource> source = openFrameSource(config.source,
+                                                          error);
+    if (!source)
+        return false;
+    streams.emplace_back(new Stream(*this, config, std::move(source)));
+    return true;
+}
+
+
+void StreamScheduler::run() {
+    StatsExporter exporter(options.statsTarget, options.statsInterval);
+    StatsSnapshot begin = StatsSnapshot::take();
+    running = streams.size();
+    for (std::unique_ptr<Stream> &stream : streams) {
+        Stream *captured = stream.get();
+        stream->captureThread = std::thread([this, captured] {
+            capture(*captured);
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running > 0) {
+            streamEnded.wait_for(lock, std::chrono::milliseconds(10));
+            lock.unlock();
+            exporter.tick();
+            lock.lock();
+        }
+    }
+    for (std::unique_ptr<Stream> &stream : streams)
+        stream->captureThread.join();
+    exporter.finish();
+
+    printReport(begin);
+    for (std::unique_ptr<Stream> &stream : streams) {
+        if (stream->error)
+            std::rethrow_exception(stream->error);
+        if (stream->captureError)
+            std::rethrow_exception(stream->captureError);
+    }
+}
+
+
+/* Reads the stream's frames into its ring (on the stream's own thread),
+   queuing the stream whenever one comes in. A throw ends the stream like
+   the end of its feed, the other streams run on */
+void StreamScheduler::capture(Stream &stream) {
+    try {
+        cv::Size size;  // Of the last frame, the next is likely alike
+        int type = CV_8UC3;
+        for (uint64_t index = 0;
+             options.maxFrames == 0 || index < options.maxFrames; ++index) {
+            Frame frame;
+            if (!size.empty()) {
+                frame.image = stream.pool.acquireImage(size, type,
+                                                       frame.lease);
+            }
+            bool read;
+            {
+                StageTimer timer(FrameStage::Capture);
+                read = stream.source->read(frame.image);
+            }
+            frame.captured = StatsClock::now();
+            if (!read)  // No more feed
+                break;
+            if (!FramePool::holds(frame.lease, frame.image)) {
+                stream.pool.countUnpooled();
+                frame.lease.reset();
+            }
+            frame.index = index;
+            size = frame.image.size();
+            type = frame.image.type();
+            if (!stream.ring.push(std::move(frame)))
+                break;
+            schedule(stream);
+        }
+    } catch (...) {
+        stream.captureError = std::current_exception();
+    }
+    stream.ring.close();
+    schedule(stream);  // To see it end
+}
+
+
+/* Queues the stream on the pool unless it already is */
+void StreamScheduler::schedule(Stream &stream) {
+    if (stream.queued.exchange(true))
+        return;
+    PoolTask task;
+    task.run = runStream;
+    task.context = &stream;
+    workers.submit(task);
+}
+
+
+void StreamScheduler::runStream(void *context, int, int) {
+    Stream &stream = *(Stream *)context;
+    stream.scheduler.process(stream);
+}
+
+
+/* The stream's turn on a worker: manipulates its next frame (the newest
+   with LatestOnly), then queues it again behind the other streams if
+   there's more to do */
+void StreamScheduler::process(Stream &stream) {
+    bool popped;
+    {
+        Frame frame;
+        popped = stream.ring.pop(frame, std::chrono::milliseconds(0));
+        if (popped && !stream.error) {
+            StatsClock::time_point start = StatsClock::now();
+            try {
+                executeManipulation(stream.config.choice, 2, frame.image,
+                                    stream.modified, stream.config.specs,
+                                    stream.state);
+            } catch (...) {
+                stream.error = std::current_exception();
+                stream.ring.close();  // Stops the capture, the rest drains
+            }
+            StatsClock::time_point end = StatsClock::now();
+            stream.manipulate.record(start, end);
+            stream.latency.record(frame.captured, end);
+            double deadline = frameStats().deadlineSeconds();
+            if (deadline > 0
+                    && std::chrono::duration<double>(end - frame.captured)
+                           .count() > deadline)
+                ++stream.missed;
+            frameStats().frameShown(frame.captured, end);
+            ++stream.frames;
+        }
+    }  // The frame's buffer goes back to the pool before the next turn
+
+    if (!popped && stream.ring.finished()) {
+        // Stays queued, so it's never run again
+        stream.ended = StatsClock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        streamEnded.notify_all();
+        return;
+    }
+    stream.queued = false;
+    if (stream.ring.ready())  // A frame came in (or the ring closed) since
+        schedule(stream);
+}
+
+
+static double milliseconds(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+
+void StreamScheduler::printReport(const StatsSnapshot &begin) {
+    std::cout << std::endl << streams.size() << " streams on "
+              << workers.threadCount() << " workers" << std::endl
+              << std::fixed << std::setprecision(2)
+              << "Stream  Frames  Frames/sec  Dropped  Missed  "
+              << "manipulate p50/p99 ms  latency p50/p99/max ms" << std::endl;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        Stream &stream = *streams[i];
+        double seconds = std::chrono::duration<double>(stream.ended
+                                                       - begin.taken).count();
+        HistogramSnapshot manipulate = stream.manipulate.snapshot();
+        HistogramSnapshot latency = stream.latency.snapshot();
+        std::cout << std::setw(6) << i << std::setw(8) << stream.frames
+                  << std::setw(12)
+                  << (seconds > 0 ? stream.frames / seconds : 0)
+                  << std::setw(9) << stream.ring.dropped()
+                  << std::setw(8) << stream.missed
+                  << std::setw(13) << milliseconds(manipulate.percentile(0.5))
+                  << "/" << std::left << std::setw(9)
+                  << milliseconds(manipulate.percentile(0.99)) << std::right
+                  << std::setw(8) << milliseconds(latency.percentile(0.5))
+                  << "/" << milliseconds(latency.percentile(0.99)) << "/"
+                  << milliseconds(latency.max) << std::endl;
+    }
+    std::cout << std::defaultfloat;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        std::cout << "Stream " << i << ": " << streams[i]->source->name()
+                  << ", filter " << streams[i]->config.choice << std::endl;
+    }
+
+    std::cout << std::endl << "All streams" << std::endl;
+    printStatsReport(begin, StatsSnapshot::take());
+    uint64_t stolen = workers.stolenChunks();
+    uint64_t chunks = stolen + workers.ownChunks();
+    std::cout << "Row chunks stolen: " << stolen << " of " << chunks;
+    if (chunks > 0)
+        std::cout << " (" << 100.0 * stolen / chunks << "%)";
+    std::cout << std::endl << std::endl;
+}
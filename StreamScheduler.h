@@ -0,0 +1,84 @@
+/*
+    Multi-stream processing: many frame sources (FrameSource.h), each with
+    its own manipulation, specifications and state (ManipulationState, so
+    each has its own motion detection background), processed by one shared
+    WorkStealingPool (ParallelExecutor.h) rather than a process and a
+    thread pool per feed fighting over the cores.
+
+    Each stream has a capture thread reading its source into a frame ring
+    (WebcamPipeline.h), which mostly waits on the camera. Once a frame is
+    waiting, the stream is queued on the pool. The worker that takes it
+    manipulates one frame, its rows split into chunks that idle workers
+    steal, then queues the stream again behind the others if another frame
+    came in. A stream is never queued twice, so every stream gets one frame
+    per turn: a busy stream can't starve the rest, and with the LatestOnly
+    policy an overloaded host drops the stale frames of every stream alike.
+
+    Each stream's frames/sec, manipulation times and capture to processed
+    latency are kept apart and printed per stream at the end, with the
+    totals (FrameStats.h) and how many row chunks were stolen.
+*/
+
+#ifndef STREAM_SCHEDULER_H
+#define STREAM_SCHEDULER_H
+
+#include "Manipulations.h"
+#include "ParallelExecutor.h"
+#include "WebcamPipeline.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* A stream's source and manipulation */
+struct StreamConfig {
+    std::string source;  // Frame source description (FrameSource.h)
+    int choice = 0;      // Webcam menu choice (0-7)
+    ManipulationSpecs specs;
+};
+
+struct MultiStreamOptions {
+    int threads = 0;  // Workers, 0 for the executor's thread count
+    QueuePolicy policy = QueuePolicy::Block;
+    int depth = 2;           // Frames per stream's ring
+    uint64_t maxFrames = 0;  // Frames per stream, 0 for all of them
+    std::string statsTarget;  // StatsExporter target, empty for none
+    double statsInterval = 1;
+};
+
+class StreamScheduler {
+public:
+    explicit StreamScheduler(const MultiStreamOptions &options);
+    ~StreamScheduler();
+
+    StreamScheduler(const StreamScheduler &) = delete;
+    StreamScheduler &operator=(const StreamScheduler &) = delete;
+
+    /* Adds a stream, returns false and sets error if its source can't be
+       opened */
+    bool add(const StreamConfig &config, std::string &error);
+
+    /* Runs every stream until its source ends (or after maxFrames frames),
+       then prints the stats of each stream */
+    void run();
+
+private:
+    struct Stream;
+
+    static void runStream(void *context, int begin, int end);
+    void capture(Stream &stream);
+    void schedule(Stream &stream);
+    void process(Stream &stream);
+    void printReport(const StatsSnapshot &begin);
+
+    MultiStreamOptions options;
+    std::vector<std::unique_ptr<Stream>> streams;
+    WorkStealingPool workers;
+    std::mutex mutex;
+    std::condition_variable streamEnded;
+    size_t running = 0;  // Streams not ended yet
+};
+
+#endif
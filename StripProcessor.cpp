@@ -0,0 +1,621 @@
+/*
+    Strip processing (see StripProcessor.h).
+
+    libjpeg reports errors through a callback that mustn't return, so its
+    calls are made under setjmp() and the callback longjmp()s back with
+    the message. The functions doing so hold no objects with destructors.
+*/
+
+#include "StripProcessor.h"
+#include "FramePool.h"
+#include "ParallelExecutor.h"
+#include "WebcamPipeline.h"
+#include <algorithm>
+#include <cctype>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+
+static std::string lowercaseExtension(const std::string &path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+        return "";
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return extension;
+}
+
+
+static bool isJpegPath(const std::string &path) {
+    std::string extension = lowercaseExtension(path);
+    return extension == ".jpg" || extension == ".jpeg";
+}
+
+
+bool isStripOutput(const std::string &path) {
+    return isJpegPath(path) || lowercaseExtension(path) == ".ppm";
+}
+
+
+/* Binary PPM (P6) or PGM (P5) with 8 bit samples */
+class PnmReader : public StripReader {
+public:
+    bool open(const std::string &path, std::string &error);
+    cv::Size size() const override { return imageSize; }
+    bool read(cv::Mat &rows, std::string &error) override;
+
+private:
+    bool readNumber(int &value);
+
+    std::ifstream file;
+    cv::Size imageSize;
+    int channels = 3;
+    std::vector<uint8_t> row;
+};
+
+
+/* Reads a header number, skipping the whitespace and comments before it */
+bool PnmReader::readNumber(int &value) {
+    int c = file.get();
+    while (c == '#' || std::isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF)
+                c = file.get();
+        }
+        c = file.get();
+    }
+    if (!std::isdigit(c))
+        return false;
+    value = 0;
+    while (std::isdigit(c)) {
+        if (value > 100000000)
+            return false;
+        value = value * 10 + (c - '0');
+        c = file.get();
+    }
+    // A single whitespace character ends the last number before the pixels
+    return c != EOF && std::isspace(c);
+}
+
+
+bool PnmReader::open(const std::string &path, std::string &error) {
+    file.open(path, std::ios::binary);
+    char magic[2] = {0, 0};
+    file.read(magic, 2);
+    if (!file || magic[0] != 'P' || (magic[1] != '6' && magic[1] != '5')) {
+        error = path + " is not a binary PPM or PGM file";
+        return false;
+    }
+    channels = magic[1] == '6' ? 3 : 1;
+    int width, height, maxValue;
+    if (!readNumber(width) || !readNumber(height) || !readNumber(maxValue)
+            || width <= 0 || height <= 0) {
+        error = path + " has a malformed header";
+        return false;
+    }
+    if (maxValue != 255) {
+        error = path + " doesn't have 8 bit samples";
+        return false;
+    }
+    imageSize = cv::Size(width, height);
+    row.resize((size_t)width * channels);
+    return true;
+}
+
+
+bool PnmReader::read(cv::Mat &rows, std::string &error) {
+    for (int y = 0; y < rows.rows; ++y) {
+        if (!file.read((char *)row.data(), row.size())) {
+            error = "the image ends early";
+            return false;
+        }
+        uint8_t *out = rows.ptr<uint8_t>(y);
+        const uint8_t *in = row.data();
+        for (int x = 0; x < imageSize.width; ++x, out += 3) {
+            if (channels == 3) {
+                out[0] = in[3 * x + 2];
+                out[1] = in[3 * x + 1];
+                out[2] = in[3 * x];
+            } else {
+                out[0] = out[1] = out[2] = in[x];
+            }
+        }
+    }
+    return true;
+}
+
+
+/* Binary PPM (P6) */
+class PpmWriter : public StripWriter {
+public:
+    bool open(const std::string &path, cv::Size size, std::string &error);
+    bool write(const cv::Mat &rows, std::string &error) override;
+    bool finish(std::string &error) override;
+
+private:
+    std::ofstream file;
+    std::vector<uint8_t> row;
+};
+
+
+bool PpmWriter::open(const std::string &path, cv::Size size,
+                     std::string &error) {
+    file.open(path, std::ios::binary);
+    file << "P6\n" << size.width << " " << size.height << "\n255\n";
+    if (!file) {
+        error = "can't create " + path;
+        return false;
+    }
+    row.resize((size_t)size.width * 3);
+    return true;
+}
+
+
+bool PpmWriter::write(const cv::Mat &rows, std::string &error) {
+    for (int y = 0; y < rows.rows; ++y) {
+        const uint8_t *in = rows.ptr<uint8_t>(y);
+        for (size_t x = 0; x < row.size(); x += 3) {
+            row[x] = in[x + 2];
+            row[x + 1] = in[x + 1];
+            row[x + 2] = in[x];
+        }
+        file.write((const char *)row.data(), row.size());
+    }
+    if (!file) {
+        error = "writing failed";
+        return false;
+    }
+    return true;
+}
+
+
+bool PpmWriter::finish(std::string &error) {
+    file.close();
+    if (file.fail()) {
+        error = "writing failed";
+        return false;
+    }
+    return true;
+}
+
+
+#ifdef HAVE_LIBJPEG
+
+/* libjpeg-turbo converts to and from BGR itself, plain libjpeg only RGB */
+#ifdef JCS_EXTENSIONS
+static const J_COLOR_SPACE bgrSpace = JCS_EXT_BGR;
+#else
+static const J_COLOR_SPACE bgrSpace = JCS_RGB;
+#endif
+
+static void swapRedBlue(uint8_t *pixels, int width) {
+#ifndef JCS_EXTENSIONS
+    for (int x = 0; x < width; ++x, pixels += 3)
+        std::swap(pixels[0], pixels[2]);
+#else
+    (void)pixels;  // libjpeg-turbo reads and writes BGR itself
+    (void)width;
+#endif
+}
+
+
+/* Error manager longjmp()ing back to the call that failed */
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+
+static void jpegErrorExit(j_common_ptr info) {
+    JpegError *error = (JpegError *)info->err;
+    info->err->format_message(info, error->message);
+    longjmp(error->jump, 1);
+}
+
+
+static void jpegWarning(j_common_ptr, int) {}  // Corrupt data, decoded on
+
+
+class JpegReader : public StripReader {
+public:
+    JpegReader() {
+        info.err = jpeg_std_error(&error.manager);
+        error.manager.error_exit = jpegErrorExit;
+        error.manager.emit_message = jpegWarning;
+        jpeg_create_decompress(&info);
+    }
+    ~JpegReader() override {
+        jpeg_destroy_decompress(&info);
+        if (file)
+            std::fclose(file);
+    }
+
+    bool open(const char *path);
+    cv::Size size() const override {
+        return cv::Size(info.output_width, info.output_height);
+    }
+    bool read(cv::Mat &rows, std::string &message) override;
+
+    const char *errorMessage() const { return error.message; }
+
+private:
+    bool readRows(uint8_t *pixels, size_t step, int count);
+
+    jpeg_decompress_struct info;
+    JpegError error;
+    FILE *file = nullptr;
+    bool gray = false;
+    std::vector<uint8_t> grayRow;
+};
+
+
+bool JpegReader::open(const char *path) {
+    file = std::fopen(path, "rb");
+    if (!file) {
+        std::snprintf(error.message, sizeof error.message, "can't open it");
+        return false;
+    }
+    if (setjmp(error.jump))
+        return false;
+    jpeg_stdio_src(&info, file);
+    jpeg_read_header(&info, TRUE);
+    gray = info.jpeg_color_space == JCS_GRAYSCALE;
+    info.out_color_space = gray ? JCS_GRAYSCALE : bgrSpace;
+    jpeg_start_decompress(&info);
+    if (gray)
+        grayRow.resize(info.output_width);
+    return true;
+}
+
+
+bool JpegReader::readRows(uint8_t *pixels, size_t step, int count) {
+    if (setjmp(error.jump))
+        return false;
+    for (int y = 0; y < count; ++y) {
+        uint8_t *out = pixels + y * step;
+        JSAMPROW scanline = gray ? grayRow.data() : out;
+        if (jpeg_read_scanlines(&info, &scanline, 1) != 1) {
+            std::snprintf(error.message, sizeof error.message,
+                          "the image ends early");
+            return false;
+        }
+        if (!gray) {
+            swapRedBlue(out, info.output_width);
+            continue;
+        }
+        for (JDIMENSION x = 0; x < info.output_width; ++x, out += 3)
+            out[0] = out[1] = out[2] = grayRow[x];
+    }
+    return true;
+}
+
+
+bool JpegReader::read(cv::Mat &rows, std::string &message) {
+    if (!readRows(rows.ptr<uint8_t>(0), rows.step, rows.rows)) {
+        message = error.message;
+        return false;
+    }
+    return true;
+}
+
+
+/* Baseline JPEG at quality 95 */
+class JpegWriter : public StripWriter {
+public:
+    JpegWriter() {
+        info.err = jpeg_std_error(&error.manager);
+        error.manager.error_exit = jpegErrorExit;
+        jpeg_create_compress(&info);
+    }
+    ~JpegWriter() override {
+        jpeg_destroy_compress(&info);
+        if (file)
+            std::fclose(file);
+    }
+
+    bool open(const char *path, cv::Size size);
+    bool write(const cv::Mat &rows, std::string &message) override;
+    bool finish(std::string &message) override;
+
+    const char *errorMessage() const { return error.message; }
+
+private:
+    bool writeRows(const uint8_t *pixels, size_t step, int count);
+    bool complete();
+
+    jpeg_compress_struct info;
+    JpegError error;
+    FILE *file = nullptr;
+    std::vector<uint8_t> row;
+};
+
+
+bool JpegWriter::open(const char *path, cv::Size size) {
+    file = std::fopen(path, "wb");
+    if (!file) {
+        std::snprintf(error.message, sizeof error.message, "can't create it");
+        return false;
+    }
+    if (setjmp(error.jump))
+        return false;
+    jpeg_stdio_dest(&info, file);
+    info.image_width = size.width;
+    info.image_height = size.height;
+    info.input_components = 3;
+    info.in_color_space = bgrSpace;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 95, TRUE);
+    jpeg_start_compress(&info, TRUE);
+    row.resize((size_t)size.width * 3);
+    return true;
+}
+
+
+bool JpegWriter::writeRows(const uint8_t *pixels, size_t step, int count) {
+    if (setjmp(error.jump))
+        return false;
+    for (int y = 0; y < count; ++y) {
+        // libjpeg takes rows it may not change as writable
+        std::memcpy(row.data(), pixels + y * step, row.size());
+        swapRedBlue(row.data(), info.image_width);
+        JSAMPROW scanline = row.data();
+        jpeg_write_scanlines(&info, &scanline, 1);
+    }
+    return true;
+}
+
+
+bool JpegWriter::write(const cv::Mat &rows, std::string &message) {
+    if (!writeRows(rows.ptr<uint8_t>(0), rows.step, rows.rows)) {
+        message = error.message;
+        return false;
+    }
+    return true;
+}
+
+
+bool JpegWriter::complete() {
+    if (setjmp(error.jump))
+        return false;
+    jpeg_finish_compress(&info);
+    return true;
+}
+
+
+bool JpegWriter::finish(std::string &message) {
+    bool completed = complete();
+    bool closed = std::fclose(file) == 0;
+    file = nullptr;
+    if (!completed) {
+        message = error.message;
+        return false;
+    }
+    if (!closed) {
+        message = "writing failed";
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+
+std::unique_ptr<StripReader> openStripReader(const std::string &path,
+                                             std::string &error) {
+    unsigned char magic[2] = {0, 0};
+    std::ifstream probe(path, std::ios::binary);
+    if (!probe.read((char *)magic, 2)) {
+        error = "can't read " + path;
+        return nullptr;
+    }
+    probe.close();
+
+    if (magic[0] == 0xff && magic[1] == 0xd8) {
+#ifdef HAVE_LIBJPEG
+        std::unique_ptr<JpegReader> reader(new JpegReader());
+        if (!reader->open(path.c_str())) {
+            error = path + ": " + reader->errorMessage();
+            return nullptr;
+        }
+        return reader;
+#else
+        error = "this build has no libjpeg to decode " + path + " in strips";
+        return nullptr;
+#endif
+    }
+    if (magic[0] == 'P') {
+        std::unique_ptr<PnmReader> reader(new PnmReader());
+        if (!reader->open(path, error))
+            return nullptr;
+        return reader;
+    }
+    error = path + " can't be decoded in strips, it's not a JPEG, PPM or PGM"
+            " file";
+    return nullptr;
+}
+
+
+std::unique_ptr<StripWriter> openStripWriter(const std::string &path,
+                                             cv::Size size,
+                                             std::string &error) {
+    if (isJpegPath(path)) {
+#ifdef HAVE_LIBJPEG
+        std::unique_ptr<JpegWriter> writer(new JpegWriter());
+        if (!writer->open(path.c_str(), size)) {
+            error = path + ": " + writer->errorMessage();
+            return nullptr;
+        }
+        return writer;
+#else
+        error = "this build has no libjpeg to encode " + path + " in strips";
+        return nullptr;
+#endif
+    }
+    if (lowercaseExtension(path) == ".ppm") {
+        std::unique_ptr<PpmWriter> writer(new PpmWriter());
+        if (!writer->open(path, size, error))
+            return nullptr;
+        return writer;
+    }
+    error = path + " can't be encoded in strips, it's not a .jpg or .ppm file";
+    return nullptr;
+}
+
+
+/* The message of the exception being handled, from inside a catch */
+static std::string currentErrorMessage() {
+    try {
+        throw;
+    } catch (const std::exception &e) {
+        return e.what();
+    } catch (...) {
+        return "unknown error";
+    }
+}
+
+
+bool processStrips(const std::string &input, const std::string &output,
+                   const FilterChain &chain, int stripRows, StripStats &stats,
+                   std::string &error) {
+    std::unique_ptr<StripReader> reader = openStripReader(input, error);
+    if (!reader)
+        return false;
+    cv::Size size = reader->size();
+    std::unique_ptr<StripWriter> writer = openStripWriter(output, size, error);
+    if (!writer)
+        return false;
+
+    int rows = std::max(stripRows, 1);
+    int halo = chain.halo();
+    int strips = (size.height + rows - 1) / rows;
+    // Strip k's window holds image rows [windowBegin(k), windowEnd(k)), the
+    // strip's rows and its halo
+    auto windowBegin = [&](int k) { return std::max(k * rows - halo, 0); };
+    auto windowEnd = [&](int k) {
+        return std::min((k + 1) * rows + halo, size.height);
+    };
+
+    // Windows being decoded, queued and manipulated, and as many results
+    FramePool pool(8);
+    FrameRing decoded(1, QueuePolicy::Block);
+    FrameRing manipulated(1, QueuePolicy::Block);
+    // Set by the decoder, the calling thread and the encoder, each its own
+    std::string readError, processError, writeError;
+    int written = 0;
+
+    // A throw on any of the three (an allocation failing on a huge image,
+    // a decoder or encoder error) closes both rings, so the others stop
+    // and are joined, and the image fails with its message
+    auto decodeWindows = [&] {
+        // The end of the last window, the start of the next one's
+        cv::Mat overlap(std::max(2 * halo, 1), size.width, CV_8UC3);
+        int overlapRows = 0;
+        for (int k = 0; k < strips; ++k) {
+            Frame window;
+            int begin = windowBegin(k);
+            window.image = pool.acquireImage(
+                cv::Size(size.width, windowEnd(k) - begin), CV_8UC3,
+                window.lease);
+            if (overlapRows > 0) {
+                cv::Mat top = window.image.rowRange(0, overlapRows);
+                overlap.rowRange(0, overlapRows).copyTo(top);
+            }
+            cv::Mat fresh = window.image.rowRange(overlapRows,
+                                                  window.image.rows);
+            if (!reader->read(fresh, readError))
+                break;
+            if (k + 1 < strips) {
+                overlapRows = windowEnd(k) - windowBegin(k + 1);
+                cv::Mat kept = overlap.rowRange(0, overlapRows);
+                window.image.rowRange(window.image.rows - overlapRows,
+                                      window.image.rows).copyTo(kept);
+            }
+            window.index = k;
+            if (!decoded.push(std::move(window)))
+                break;
+        }
+    };
+
+    std::thread decoder([&] {
+        try {
+            decodeWindows();
+        } catch (...) {
+            readError = currentErrorMessage();
+            manipulated.close();
+        }
+        decoded.close();
+    });
+
+    std::thread encoder([&] {
+        try {
+            Frame strip;
+            while (manipulated.pop(strip)) {
+                if (!writer->write(strip.image, writeError))
+                    break;
+                ++written;
+            }
+        } catch (...) {
+            writeError = currentErrorMessage();
+        }
+        if (!writeError.empty()) {
+            manipulated.close();  // Stops the others
+            decoded.close();
+        }
+    });
+
+    try {
+        Frame window;
+        while (decoded.pop(window)) {
+            int k = window.index;
+            int offset = k * rows - windowBegin(k);  // Of the strip in it
+            int count = std::min(rows, size.height - k * rows);
+            Frame strip;
+            cv::Mat modified = pool.acquireImage(window.image.size(),
+                                                 CV_8UC3, strip.lease);
+            parallelForRows(count, [&](int begin, int end) {
+                chain.runRows(window.image, modified, offset + begin,
+                              offset + end);
+            });
+            strip.image = modified.rowRange(offset, offset + count);
+            strip.index = k;
+            window = Frame();  // Back to the pool before the next is decoded
+            if (!manipulated.push(std::move(strip)))
+                break;
+        }
+    } catch (...) {
+        processError = currentErrorMessage();
+    }
+    manipulated.close();
+    decoded.close();
+    decoder.join();
+    encoder.join();
+
+    stats.size = size;
+    stats.strips = written;
+    stats.bufferBytes = pool.bytesReserved();
+    if (!readError.empty()) {
+        error = input + ": " + readError;
+        return false;
+    }
+    if (!processError.empty()) {
+        error = input + ": " + processError;
+        return false;
+    }
+    if (!writeError.empty() || !writer->finish(writeError)) {
+        error = output + ": " + writeError;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+    Out-of-core strip processing for images too large to hold whole: the
+    image is decoded, manipulated and encoded a strip of rows at a time at
+    its native resolution, so memory grows with the strip height and the
+    image's width rather than with its size.
+
+    Three threads overlap the work: one decodes strips, the calling thread
+    manipulates them (on the thread pool, ParallelExecutor.h) and one
+    encodes the results straight to disk. They're connected by frame rings
+    of one strip (WebcamPipeline.h), the strips' buffers coming from a
+    FramePool, so about six strips are in memory at once.
+
+    Stencils need the rows around each strip (the halo, a row per strobel
+    outline in the chain, see FilterChain.h), so each strip is decoded with
+    the halo rows above and below it, those above copied from the previous
+    strip rather than decoded again. The output is the same as manipulating
+    the whole image.
+
+    Strips are read from JPEG files (libjpeg decoding scanlines as they're
+    needed) and binary PPM / PGM files, and written as JPEG (quality 95,
+    like cv::imwrite) or PPM by the output's extension. Other formats can't
+    be decoded in part, so they aren't supported. JPEG needs libjpeg
+    (HAVE_LIBJPEG, defined by CMake when it finds it).
+*/
+
+#ifndef STRIP_PROCESSOR_H
+#define STRIP_PROCESSOR_H
+
+#include "opencv2/opencv.hpp"
+#include "FilterChain.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/* Decodes an image from the top, a few rows at a time */
+class StripReader {
+public:
+    virtual ~StripReader() {}
+
+    virtual cv::Size size() const = 0;
+
+    /* Decodes the next rows.rows rows into rows (8 bit BGR, allocated at
+       the image's width), returns false and sets error if it can't */
+    virtual bool read(cv::Mat &rows, std::string &error) = 0;
+};
+
+/* Encodes an image from the top, a few rows at a time */
+class StripWriter {
+public:
+    virtual ~StripWriter() {}
+
+    /* Encodes the next rows (8 bit BGR), returns false and sets error if it
+       can't */
+    virtual bool write(const cv::Mat &rows, std::string &error) = 0;
+
+    /* Completes the file once every row is written */
+    virtual bool finish(std::string &error) = 0;
+};
+
+/* Opens a JPEG, PPM or PGM file (by its contents) for reading, returns
+   null and sets error if it can't */
+std::unique_ptr<StripReader> openStripReader(const std::string &path,
+                                             std::string &error);
+
+/* Creates a JPEG or PPM file (by its extension) of size for writing,
+   returns null and sets error if it can't */
+std::unique_ptr<StripWriter> openStripWriter(const std::string &path,
+                                             cv::Size size,
+                                             std::string &error);
+
+/* Whether strips can be written to path (.jpg, .jpeg or .ppm) */
+bool isStripOutput(const std::string &path);
+
+struct StripStats {
+    cv::Size size;           // Of the image
+    int strips = 0;
+    size_t bufferBytes = 0;  // Strip buffers made, the peak memory
+};
+
+/* Applies chain to the image at input, writing the result to output at
+   its native resolution, stripRows rows at a time. Returns false and sets
+   error if reading or writing fails */
+bool processStrips(const std::string &input, const std::string &output,
+                   const FilterChain &chain, int stripRows, StripStats &stats,
+                   std::string &error);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+    Pipelined webcam loop (see WebcamPipeline.h).
+*/
+
+#include "WebcamPipeline.h"
+#include "DirtyTiles.h"
+#include "ResolutionController.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+
+FrameRing::FrameRing(int capacity, QueuePolicy policy)
+    : slots(std::max(capacity, 1)), policy(policy) {}
+
+
+bool FrameRing::push(Frame &&frame) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (policy == QueuePolicy::Block)
+        notFull.wait(lock, [this] { return closed || count < slots.size(); });
+    if (closed)
+        return false;
+
+    if (count == slots.size()) {  // LatestOnly, drop the oldest frame
+        slots[head] = Frame();
+        head = (head + 1) % slots.size();
+        --count;
+        ++dropCount;
+        frameStats().countDropped();
+    }
+    slots[(head + count) % slots.size()] = std::move(frame);
+    ++count;
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+
+bool FrameRing::pop(Frame &frame, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto ready = [this] { return closed || count > 0; };
+    if (timeout == std::chrono::milliseconds::max())
+        notEmpty.wait(lock, ready);
+    else if (!notEmpty.wait_for(lock, timeout, ready))
+        return false;
+    if (count == 0)  // Closed
+        return false;
+
+    if (policy == QueuePolicy::LatestOnly) {
+        // Skip to the newest frame, the ones before it are stale
+        while (count > 1) {
+            slots[head] = Frame();
+            head = (head + 1) % slots.size();
+            --count;
+            ++dropCount;
+            frameStats().countDropped();
+        }
+    }
+    frame = std::move(slots[head]);
+    slots[head] = Frame();
+    head = (head + 1) % slots.size();
+    --count;
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+
+void FrameRing::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+}
+
+
+bool FrameRing::ready() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return closed || count > 0;
+}
+
+
+bool FrameRing::finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return closed && count == 0;
+}
+
+
+uint64_t FrameRing::dropped() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropCount;
+}
+
+
+PipelineOptions pipelineOptionsFromEnvironment() {
+    PipelineOptions options;
+    if (const char *pipeline = std::getenv("IMAGE_MANIPULATION_PIPELINE")) {
+        if (std::strcmp(pipeline, "off") == 0)
+            options.enabled = false;
+        else if (std::strcmp(pipeline, "block") == 0)
+            options.policy = QueuePolicy::Block;
+    }
+    if (const char *depth = std::getenv("IMAGE_MANIPULATION_QUEUE"))
+        options.depth = std::max(1, std::atoi(depth));
+    if (const char *target = std::getenv("IMAGE_MANIPULATION_STATS_OUT"))
+        options.statsTarget = target;
+    if (const char *interval = std::getenv("IMAGE_MANIPULATION_STATS_INTERVAL"))
+        options.statsInterval = std::max(0.0, std::atof(interval));
+    if (const char *tiles = std::getenv("IMAGE_MANIPULATION_TILES"))
+        options.tileSize = std::max(0, std::atoi(tiles));
+    if (const char *tolerance
+            = std::getenv("IMAGE_MANIPULATION_TILE_TOLERANCE"))
+        options.tileTolerance = std::max(0, std::atoi(tolerance));
+    if (const char *fps = std::getenv("IMAGE_MANIPULATION_TARGET_FPS"))
+        options.targetFps = std::max(0.0, std::atof(fps));
+    if (const char *planar = std::getenv("IMAGE_MANIPULATION_PLANAR"))
+        options.planar = std::strcmp(planar, "on") == 0;
+    if (const char *huge = std::getenv("IMAGE_MANIPULATION_HUGE_PAGES"))
+        options.hugePages = std::strcmp(huge, "on") == 0;
+    if (const char *output = std::getenv("IMAGE_MANIPULATION_OUTPUT"))
+        options.output = output;
+    if (const char *queue = std::getenv("IMAGE_MANIPULATION_OUTPUT_QUEUE"))
+        options.outputQueue = std::max(1, std::atoi(queue));
+    if (const char *policy = std::getenv("IMAGE_MANIPULATION_OUTPUT_POLICY"))
+        options.outputPolicy = std::strcmp(policy, "block") == 0
+                               ? SinkPolicy::Block : SinkPolicy::Drop;
+    return options;
+}
+
+
+/* Frames shown before the image allocations per frame are counted, while
+   the pool's buffers and the kernels' scratch rows are made */
+static const uint64_t WARMUP_FRAMES = 30;
+
+
+/* Points image at a pooled buffer of size and type (the frame's lease),
+   which the stages then write into in place */
+static void poolImage(FramePool &pool, Frame &frame, cv::Size size,
+                      int type) {
+    frame.image = pool.acquireImage(size, type, frame.lease);
+}
+
+
+/* Counts a frame whose image a stage put somewhere other than its pooled
+   buffer (e.g. a frame source that allocates its own images) */
+static void checkPooled(FramePool &pool, Frame &frame) {
+    if (!frame.image.empty() && !FramePool::holds(frame.lease, frame.image)) {
+        pool.countUnpooled();
+        frame.lease.reset();
+    }
+}
+
+
+void runLivePipeline(FrameSource &source, const std::string &window,
+                     int choice, const ManipulationSpecs &specs,
+                     const PipelineOptions &options,
+                     std::unique_ptr<FrameSink> output) {
+    // Counts the images allocated outside the pool while the threads run
+    MatAllocationCounter matAllocations;
+    // Before the rings and the output, so it outlives the frames in them
+    FramePool pool(2 * options.depth + 8
+                       + (output ? options.outputQueue : 0),
+                   options.hugePages);
+    std::unique_ptr<AsyncSink> sink;
+    if (output) {
+        sink.reset(new AsyncSink(std::move(output), options.outputQueue,
+                                 options.outputPolicy));
+    }
+    FrameRing captured(options.depth, options.policy);
+    FrameRing processed(options.depth, options.policy);
+    FrameStats &stats = frameStats();
+    StatsExporter exporter(options.statsTarget, options.statsInterval);
+    StatsSnapshot begin = StatsSnapshot::take();
+    std::atomic<bool> stopping(false);
+    std::mutex errorMutex;  // Guards error, set by either thread
+    std::exception_ptr error;  // The first thrown, rethrown after the run
+    auto keepError = [&](std::exception_ptr thrown) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+            error = thrown;
+    };
+    ResolutionController controller(options.targetFps);
+    bool planar = options.planar && options.tileSize == 0;
+
+    // A throw (a failing capture device or a corrupt image, the pool out
+    // of memory) ends the run like the end of the feed, and is rethrown
+    std::thread captureThread([&] {
+        try {
+            cv::Size sourceSize;  // Of the last frame, likely the next's
+            int sourceType = CV_8UC3;
+            for (uint64_t index = 0; !stopping; ++index) {
+                if (options.maxFrames > 0 && index >= options.maxFrames)
+                    break;
+                Frame frame;
+                if (!sourceSize.empty())
+                    poolImage(pool, frame, sourceSize, sourceType);
+                PipelineClock::time_point start = PipelineClock::now();
+                bool read = source.read(frame.image);
+                frame.captured = PipelineClock::now();
+                if (!read)  // No more feed
+                    break;
+                frame.index = index;
+                checkPooled(pool, frame);
+                sourceSize = frame.image.size();
+                sourceType = frame.image.type();
+                if (planar) {  // Converted once, where the frame comes in
+                    frame.planar.create(sourceSize, 3, &pool);
+                    toPlanar(frame.image, frame.planar);
+                    frame.image.release();
+                    frame.lease.reset();
+                }
+                if (stats.enabled()) {
+                    stats.stage(FrameStage::Capture).record(
+                        start, PipelineClock::now());
+                }
+                if (!captured.push(std::move(frame)))
+                    break;
+            }
+        } catch (...) {
+            keepError(std::current_exception());
+        }
+        captured.close();
+    });
+
+    // executeManipulation() records the manipulate stage itself
+    std::thread processThread([&] {
+        try {
+            IncrementalManipulator incremental(options.tileSize,
+                                               options.tileTolerance);
+            Frame frame;
+            while (captured.pop(frame)) {
+                Frame result;
+                PipelineClock::time_point start = PipelineClock::now();
+                cv::Size frameSize = planar ? frame.planar.size()
+                                            : frame.image.size();
+                cv::Size size = controller.processingSize(frameSize);
+                if (size != frameSize) {
+                    result.sourceSize = frameSize;
+                    if (planar) {
+                        PlanarFrame scaled;
+                        scaled.create(size, 3, &pool);
+                        resizePlanar(frame.planar, scaled, size,
+                                     cv::INTER_AREA);
+                        frame.planar = std::move(scaled);
+                    } else {
+                        Frame scaled;
+                        poolImage(pool, scaled, size, frame.image.type());
+                        cv::resize(frame.image, scaled.image, size, 0, 0,
+                                   cv::INTER_AREA);
+                        frame.image = scaled.image;
+                        frame.lease = std::move(scaled.lease);
+                    }
+                }
+
+                // The output buffer too, the manipulation's create() keeps it
+                if (planar) {
+                    result.planar.create(size, planarOutputChannels(choice, 2),
+                                         &pool);
+                } else if (!frame.image.empty()) {
+                    poolImage(pool, result, size, frame.image.type());
+                }
+                if (planar) {
+                    executePlanarManipulation(choice, 2, frame.planar,
+                                              result.planar, specs);
+                } else if (options.tileSize > 0) {
+                    incremental.process(choice, frame.image, result.image,
+                                        specs);
+                } else {
+                    executeManipulation(choice, 2, frame.image, result.image,
+                                        specs);
+                }
+                controller.record(std::chrono::duration<double>(
+                    PipelineClock::now() - start).count());
+                checkPooled(pool, result);
+                result.index = frame.index;
+                result.captured = frame.captured;
+                if (!processed.push(std::move(result)))
+                    break;
+            }
+        } catch (...) {
+            keepError(std::current_exception());
+        }
+        captured.close();
+        processed.close();
+    });
+
+    bool headless = window.empty();
+    uint64_t shown = 0;
+    uint64_t warmAllocations = 0;
+    while (true) {
+        Frame frame;
+        if (processed.pop(frame, std::chrono::milliseconds(10))) {
+            int key = -1;
+            if (!headless || planar || sink) {
+                StageTimer timer(FrameStage::Display);
+                if (planar) {  // Back to BGR where the frame goes out
+                    poolImage(pool, frame, frame.planar.size(), CV_8UC3);
+                    fromPlanar(frame.planar, frame.image);
+                }
+                if ((!headless || sink) && !frame.sourceSize.empty()) {
+                    Frame shownFrame;
+                    poolImage(pool, shownFrame, frame.sourceSize,
+                              frame.image.type());
+                    cv::resize(frame.image, shownFrame.image,
+                               frame.sourceSize);
+                    frame.image = shownFrame.image;
+                    frame.lease = std::move(shownFrame.lease);
+                }
+                if (!headless) {
+                    cv::imshow(window, frame.image);
+                    key = cv::waitKey(1);
+                }
+                // Handed over with its buffer, the encoder thread writes it
+                if (sink)
+                    sink->push(frame.image, std::move(frame.lease));
+            }
+            stats.frameShown(frame.captured, PipelineClock::now());
+            exporter.tick();
+            if (++shown == WARMUP_FRAMES)
+                warmAllocations = matAllocations.allocations();
+            if (key == 27)
+                break;
+        } else if (processed.finished()
+                       || (!headless && cv::waitKey(1) == 27)) {
+            break;
+        }
+    }
+
+    uint64_t allocated = matAllocations.allocations() - warmAllocations;
+    stopping = true;
+    captured.close();
+    processed.close();
+    captureThread.join();
+    processThread.join();
+    if (sink)
+        sink->finish();
+    exporter.finish();
+
+    std::cout << std::endl << source.name() << std::endl;
+    printStatsReport(begin, StatsSnapshot::take());
+    if (controller.enabled()) {
+        std::cout << "Processing scale: " << controller.describe() << ", "
+                  << controller.changes() << " changes" << std::endl;
+    }
+    if (sink)
+        std::cout << "Output: " << sink->describe() << std::endl;
+    std::cout << "Frame pool: " << pool.describe() << std::endl;
+    if (shown > WARMUP_FRAMES) {
+        std::cout << "Image allocations per frame: " << std::fixed
+                  << std::setprecision(2)
+                  << (double)allocated / (shown - WARMUP_FRAMES)
+                  << " (after the " << WARMUP_FRAMES << " first frames)"
+                  << std::defaultfloat
+                  << std::endl;
+    }
+    std::cout << std::endl;
+
+    if (error)
+        std::rethrow_exception(error);
+}
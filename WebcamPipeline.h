@@ -0,0 +1,157 @@
+/*
+    Pipelined webcam loop: capture, processing and display run on their own
+    threads, connected by bounded frame rings, so a frame's cost is the
+    slowest stage rather than the sum of all of them.
+
+    - The capture thread reads frames from the webcam (or another frame
+      source, see FrameSource.h) into the capture ring.
+    - The processing thread runs the manipulation (on the thread pool, see
+      ParallelExecutor.h) and puts the result in the display ring.
+    - The calling (main) thread shows the frames, since the display windows
+      have to stay on it, and watches for ESC. Headless runs (no window)
+      just drop the processed frames there.
+
+    With the Block policy a full ring holds its producer back, so every frame
+    is shown. With LatestOnly a full ring drops its oldest frame, and taking
+    a frame skips to the newest one, dropping the stale frames before it, so
+    the frame on screen is as recent as possible.
+
+    The policy and ring depth default to LatestOnly and 2, and can be set with
+    the environment variables IMAGE_MANIPULATION_PIPELINE (latest, block or
+    off for the serial loop) and IMAGE_MANIPULATION_QUEUE (frames per ring).
+
+    Each stage's times, the dropped frames and missed deadlines go to the
+    frame stats (FrameStats.h), exported while running to
+    IMAGE_MANIPULATION_STATS_OUT (status, or a .csv / .json file) every
+    IMAGE_MANIPULATION_STATS_INTERVAL seconds (defaults to 1).
+
+    IMAGE_MANIPULATION_TILES (a tile size in pixels) only reprocesses the
+    tiles of each frame that changed (see DirtyTiles.h), with
+    IMAGE_MANIPULATION_TILE_TOLERANCE the channel difference still taken as
+    unchanged (defaults to 0).
+
+    IMAGE_MANIPULATION_TARGET_FPS lowers the resolution frames are
+    manipulated at whenever the manipulation can't keep up with that frame
+    rate, and raises it again once there's room (see ResolutionController.h).
+    The frames are shown scaled back up to the source's size.
+
+    IMAGE_MANIPULATION_PLANAR=on runs the manipulations on planar frames
+    (PlanarFrame.h): the capture thread converts each frame to planes and
+    the display thread converts the result back, so the processing thread
+    only runs the planar kernels. Incremental tiles keep BGR frames.
+
+    Frame buffers come from a FramePool (FramePool.h) of 2 x the ring depth
+    + 8 buffers, enough for every frame in flight, so frames stop
+    allocating after the first few. IMAGE_MANIPULATION_HUGE_PAGES=on backs
+    them with huge pages. The pool's counts and the images OpenCV allocated
+    per frame (MatAllocationCounter) are printed with the frame stats.
+
+    IMAGE_MANIPULATION_OUTPUT records the processed frames to an output sink
+    (video:, images: or raw:, see FrameSink.h) at the source's size. The
+    display thread hands each frame, pooled buffer and all, to the sink's
+    encoder thread through a queue of IMAGE_MANIPULATION_OUTPUT_QUEUE frames
+    (defaults to 8). IMAGE_MANIPULATION_OUTPUT_POLICY is drop (the default,
+    a full queue drops the frame, so a slow disk never holds back the loop)
+    or block (every frame is recorded, waiting for room in the queue).
+*/
+
+#ifndef WEBCAM_PIPELINE_H
+#define WEBCAM_PIPELINE_H
+
+#include "opencv2/opencv.hpp"
+#include "FramePool.h"
+#include "FrameSink.h"
+#include "FrameSource.h"
+#include "FrameStats.h"
+#include "Manipulations.h"
+#include "PlanarFrame.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef StatsClock PipelineClock;
+
+/* A frame and when it was captured */
+struct Frame {
+    cv::Mat image;
+    uint64_t index = 0;
+    PipelineClock::time_point captured;
+    cv::Size sourceSize;  // Size it was captured at, if it was scaled
+    PlanarFrame planar;   // The frame, when the pipeline runs planar
+    FrameLease lease;     // Pooled buffer holding image
+};
+
+enum class QueuePolicy { Block, LatestOnly };
+
+/* Bounded ring of frames between two threads */
+class FrameRing {
+public:
+    FrameRing(int capacity, QueuePolicy policy);
+
+    /* Adds a frame, returns false (dropping it) once the ring is closed */
+    bool push(Frame &&frame);
+
+    /* Takes the next frame (the newest with LatestOnly), waiting up to
+       timeout. Returns false on timeout or once closed and empty */
+    bool pop(Frame &frame, std::chrono::milliseconds timeout
+                               = std::chrono::milliseconds::max());
+
+    /* Wakes every waiting thread, later pushes are dropped */
+    void close();
+
+    /* Whether pop() would return without waiting (a frame is waiting or
+       the ring is closed) */
+    bool ready();
+
+    /* Whether the ring is closed and has no frames left */
+    bool finished();
+
+    /* Frames dropped by the LatestOnly policy */
+    uint64_t dropped();
+
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<Frame> slots;
+    QueuePolicy policy;
+    size_t head = 0;   // Oldest frame
+    size_t count = 0;
+    bool closed = false;
+    uint64_t dropCount = 0;
+};
+
+struct PipelineOptions {
+    bool enabled = true;
+    QueuePolicy policy = QueuePolicy::LatestOnly;
+    int depth = 2;
+    uint64_t maxFrames = 0;  // Frames to capture, 0 for all of them
+    std::string statsTarget;  // StatsExporter target, empty for none
+    double statsInterval = 1;
+    int tileSize = 0;       // Incremental tile size, 0 to process whole frames
+    int tileTolerance = 0;
+    double targetFps = 0;   // Adaptive resolution's frame rate, 0 for off
+    bool planar = false;    // Manipulate planar frames
+    bool hugePages = false; // Frame pool on huge pages
+    std::string output;     // Output sink description, empty for none
+    int outputQueue = 8;
+    SinkPolicy outputPolicy = SinkPolicy::Drop;
+};
+
+/* Options from the environment variables */
+PipelineOptions pipelineOptionsFromEnvironment();
+
+/* Runs the manipulation on source's frames and shows them in window (none
+   if it's empty), writing them to output if there is one (opened from
+   options.output), until ESC is pressed or the source ends, then prints the
+   frame stats of the run */
+void runLivePipeline(FrameSource &source, const std::string &window,
+                     int choice, const ManipulationSpecs &specs,
+                     const PipelineOptions &options,
+                     std::unique_ptr<FrameSink> output = nullptr);
+
+#endif